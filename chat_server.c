@@ -5,23 +5,62 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <pthread.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 #include <sys/statvfs.h>
 #include <dirent.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <time.h>
+#include <sys/random.h>
+#include <poll.h>
+#include <signal.h>
 
 #include "auth.h"
+#include "checksum.h"
+#include "upload_manager.h"
+#include "tree_stream.h"
+#include "compress.h"
+#include "worker_pool.h"
+#include "delta.h"
+#include "sync_manifest.h"
+#include "file_ops.h"
+#include "jobs.h"
+#include "dir_events.h"
+#include "file_tail.h"
+#include "journal.h"
+#include "tree_watch.h"
+#include "file_index.h"
+#include "text_search.h"
+#include "content_index.h"
+#include "name_cache.h"
+#include "file_hash.h"
+#include "dupes.h"
+#include "fair_share.h"
+#include "local_socket.h"
+#include "traffic_class.h"
 
 #define MAX_CLIENTS 20
 #define BUFFER_SIZE 1024
 #define FILE_BUFFER_SIZE 4096
 #define DEFAULT_PORT 5050
 
+// 병렬 전송: 한 전송에 붙일 수 있는 추가 연결 수와 토큰 유효 시간
+#define MAX_TRANSFER_STREAMS 8
+#define MAX_STREAM_TOKENS 32
+#define STREAM_TOKEN_TTL 60
+
+// 명령을 처리하는 동안 슬롯마다 미뤄 두는 채팅 최대 바이트
+#define HELD_CHAT_MAX (256 * 1024)
+
 typedef struct
 {
     int sock;
@@ -29,11 +68,38 @@ typedef struct
     char username[64];
     int permission_level;
     char pending_upload_file[256];
+    char pending_upload_dir[PATH_MAX]; // UPLOAD PLAN 에 적은 대상 디렉토리 (비면 작업 디렉토리)
+    bool compress;                // COMPRESS 로 압축을 협상한 세션
+    int delta_base_fd;            // UPLOAD DELTA SIGS 로 서명을 보낸 기존 파일 (없으면 -1)
+    unsigned delta_block;
+    long long delta_blocks;
+    char rbuf[BUFFER_SIZE * 4];   // 수신 버퍼 (명령 줄 + 뒤따르는 바이너리 데이터)
+    size_t rlen;
+    DirEvents *events;            // WATCH 로 보고 있는 디렉토리의 변경 알림 (없으면 NULL)
+    FileTails *tails;             // TAIL 로 따라 읽고 있는 파일 (없으면 NULL)
+    bool local;                   // Unix 소켓으로 붙은 같은 호스트의 클라이언트 (UPLOAD FD 가능)
+    bool data;                    // ATTACH 로 붙은 데이터 연결 (채팅 알림을 보내지 않는다)
+    char upload_key[UPLOAD_ID_LEN];   // 이 연결에서 INIT 한 뒤 아직 끝나지 않은 청크 업로드 (잠금 안에서 바꾼다)
+    bool busy;                    // 명령을 처리하는 중 (응답 사이에 채팅을 끼우지 않는다, 잠금 안에서 바꾼다)
+    char *held;                   // busy 동안 미뤄 둔 채팅 줄 (다음 명령을 기다릴 때 보낸다)
+    size_t held_len, held_cap;
 } ClientSlot;
 
+// 추가 데이터 연결이 로그인 없이 같은 사용자로 붙기 위한 일회성 토큰
+typedef struct
+{
+    char token[33];
+    char username[64];
+    int permission_level;
+    int remaining;      // 남은 ATTACH 횟수
+    time_t expires;
+} StreamToken;
+
 static ClientSlot clients[MAX_CLIENTS];
+static StreamToken stream_tokens[MAX_STREAM_TOKENS];
 static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 static char server_root[PATH_MAX] = "/home";
+static WorkerPool *workers;   // 압축/해시 등 CPU 작업용 공유 풀
 static bool is_path_under_root(const char *path);
 
 // ------------------------------------------------------------
@@ -92,9 +158,14 @@ static int dls_cmp_desc(const void *a, const void *b)
     return (ea->size < eb->size) ? 1 : -1;
 }
 
-static unsigned long long dls_dir_size(const char *path)
+static unsigned long long dls_dir_size(const char *path, Job *job)
 {
     struct stat st;
+    if (job_cancelled(job))
+        return 0;
+    job_add_done(job, 1);
+    fair_share_ops(1);
+
     if (lstat(path, &st) != 0)
         return 0;
 
@@ -113,7 +184,8 @@ static unsigned long long dls_dir_size(const char *path)
 
             char child[PATH_MAX];
             snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
-            total += dls_dir_size(child);
+            job_add_total(job, 1);
+            total += dls_dir_size(child, job);
         }
 
         closedir(dir);
@@ -171,6 +243,87 @@ static int dls_resolve_path(const char *raw, char *resolved)
     return 0;
 }
 
+static int slot_send_all(void *ctx, const void *buf, size_t len)
+{
+    ClientSlot *slot = ctx;
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send(slot->sock, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// 다운로드 본문: 사용자의 전송 몫을 쓰고 보낸다 (짧은 응답 줄은 slot_send_all 로 바로 보낸다)
+static int slot_send_bulk(void *ctx, const void *buf, size_t len)
+{
+    fair_share_bytes(len);
+    return slot_send_all(ctx, buf, len);
+}
+
+// --- 텍스트 응답 (ls, dls 등 EOF 로 끝나는 여러 줄 응답) ---
+// 압축을 협상한 세션이면 응답 전체를 "~Z <raw_len> <comp_len>\n" 프레임 하나로 보낸다.
+#define TEXT_COMPRESS_MIN 512
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuf;
+
+static void text_append(TextBuf *tb, const char *str)
+{
+    size_t n = strlen(str);
+    if (tb->len + n + 1 > tb->cap)
+    {
+        size_t new_cap = tb->cap ? tb->cap * 2 : 4096;
+        while (new_cap < tb->len + n + 1)
+            new_cap *= 2;
+        char *p = realloc(tb->data, new_cap);
+        if (!p)
+            return;
+        tb->data = p;
+        tb->cap = new_cap;
+    }
+    memcpy(tb->data + tb->len, str, n + 1);
+    tb->len += n;
+}
+
+static void send_text_response(ClientSlot *slot, TextBuf *tb)
+{
+    if (!tb->data)
+        return;
+
+    if (slot->compress && tb->len >= TEXT_COMPRESS_MIN && compress_worthwhile(tb->data, tb->len))
+    {
+        char *out = malloc(compress_bound(tb->len));
+        size_t out_len = 0;
+        if (out && compress_buffer(tb->data, tb->len, out, &out_len, COMPRESS_LEVEL_FAST) == 0)
+        {
+            char header[64];
+            snprintf(header, sizeof(header), "~Z %zu %zu\n", tb->len, out_len);
+            if (slot_send_all(slot, header, strlen(header)) == 0)
+                slot_send_all(slot, out, out_len);
+            free(out);
+            return;
+        }
+        free(out);
+    }
+
+    slot_send_all(slot, tb->data, tb->len);
+}
+
+static void text_free(TextBuf *tb)
+{
+    free(tb->data);
+    memset(tb, 0, sizeof(*tb));
+}
+
 static void handle_dls(ClientSlot *slot, const char *buf)
 {
     const int BAR_WIDTH = 20;
@@ -203,11 +356,15 @@ static void handle_dls(ClientSlot *slot, const char *buf)
     DlsList list = {0};
     unsigned long long dir_total = 0;
 
+    // 하위 트리를 걷는 동안 발견한 항목 수가 전체 추정치가 된다
+    Job *job = job_begin(slot->username, "dls", target, "entries");
+
     struct dirent *ent;
-    while ((ent = readdir(dir)))
+    while ((ent = readdir(dir)) && !job_cancelled(job))
     {
         if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
             continue;
+        job_add_total(job, 1);
 
         char child[PATH_MAX];
         snprintf(child, sizeof(child), "%s/%s", target, ent->d_name);
@@ -225,12 +382,15 @@ static void handle_dls(ClientSlot *slot, const char *buf)
         {
             is_dir = S_ISDIR(st.st_mode);
 
+            fair_share_ops(1);
             if (is_dir)
-                sz = dls_dir_size(child);
+                sz = dls_dir_size(child, job);
             else if (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))
                 sz = (unsigned long long)st.st_size;
             else
                 sz = 0;
+            if (!is_dir)
+                job_add_done(job, 1);
 
             dir_total += sz;
         }
@@ -240,6 +400,16 @@ static void handle_dls(ClientSlot *slot, const char *buf)
 
     closedir(dir);
 
+    if (job_cancelled(job))
+    {
+        job_end(job, JOB_CANCELLED);
+        dls_list_free(&list);
+        send(slot->sock, "ERR: cancelled\n", 15, 0);
+        send(slot->sock, "EOF\n", 4, 0);
+        return;
+    }
+    job_end(job, JOB_DONE);
+
     struct statvfs vfs;
     unsigned long long fs_total = 0;
     if (statvfs(target, &vfs) == 0)
@@ -260,7 +430,9 @@ static void handle_dls(ClientSlot *slot, const char *buf)
              "- 디렉토리 총 용량: %s (전체 파일시스템의 %.0f%%)\n"
              "- 엔트리 수: %zu개 (상위 %d개만 표시)\n",
              target, dir_human, dir_percent, list.count, TOP_N);
-    send(slot->sock, header, strlen(header), 0);
+
+    TextBuf out = {0};
+    text_append(&out, header);
 
     size_t max_entries = (list.count > (size_t)TOP_N) ? (size_t)TOP_N : list.count;
     for (size_t i = 0; i < max_entries; i++)
@@ -306,10 +478,12 @@ static void handle_dls(ClientSlot *slot, const char *buf)
                          i + 1, display_name, bar, size_str, dir_pct);
         }
 
-        send(slot->sock, line, strlen(line), 0);
+        text_append(&out, line);
     }
 
-    send(slot->sock, "EOF\n", 4, 0);
+    text_append(&out, "EOF\n");
+    send_text_response(slot, &out);
+    text_free(&out);
     dls_list_free(&list);
 }
 
@@ -330,6 +504,141 @@ static void trim_whitespace(char *s)
     while (len > 0 && isspace((unsigned char)s[len - 1])) { s[len - 1] = '\0'; len--; }
 }
 
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// 버퍼에 남은 데이터를 먼저 돌려주고, 비어 있으면 소켓에서 읽는다.
+// 업로드 본문은 모두 여기를 거치므로 사용자의 전송 몫(fair_share)도 여기서 쓴다.
+static ssize_t slot_recv(ClientSlot *slot, void *buf, size_t len)
+{
+    if (slot->rlen > 0)
+    {
+        size_t n = slot->rlen < len ? slot->rlen : len;
+        memcpy(buf, slot->rbuf, n);
+        memmove(slot->rbuf, slot->rbuf + n, slot->rlen - n);
+        slot->rlen -= n;
+        fair_share_bytes(n);
+        return (ssize_t)n;
+    }
+    ssize_t n = recv(slot->sock, buf, len, 0);
+    if (n > 0)
+        fair_share_bytes((size_t)n);
+    return n;
+}
+
+static int slot_recv_exact(ClientSlot *slot, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = slot_recv(slot, p, len);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+#define SLOT_LINE_TOO_LONG (-2)
+
+// 개행까지 한 줄을 읽는다. 연결 종료 시 -1.
+// 버퍼보다 긴 줄은 개행까지 읽어 버리고 SLOT_LINE_TOO_LONG 을 돌려준다 (잘린 앞부분을 명령으로 쓰지 않도록).
+static ssize_t slot_read_line(ClientSlot *slot, char *out, size_t size)
+{
+    size_t pos = 0;
+    bool overflow = false;
+
+    while (1)
+    {
+        char *nl = memchr(slot->rbuf, '\n', slot->rlen);
+        size_t take = nl ? (size_t)(nl - slot->rbuf) : slot->rlen;
+
+        size_t room = size - 1 - pos;
+        size_t copy = take < room ? take : room;
+        if (copy < take)
+            overflow = true;
+        memcpy(out + pos, slot->rbuf, copy);
+        pos += copy;
+
+        size_t consumed = nl ? take + 1 : take;
+        memmove(slot->rbuf, slot->rbuf + consumed, slot->rlen - consumed);
+        slot->rlen -= consumed;
+
+        if (nl)
+            break;
+
+        ssize_t n = recv(slot->sock, slot->rbuf, sizeof(slot->rbuf), 0);
+        if (n <= 0)
+            return -1;
+        slot->rlen = (size_t)n;
+    }
+
+    out[pos] = '\0';
+    return overflow ? SLOT_LINE_TOO_LONG : (ssize_t)pos;
+}
+
+// 다음 명령을 기다리는 동안 WATCH/TAIL 알림을 보낸다. 명령이 도착하면(또는 연결이 끊기면) 돌아온다.
+// 응답 도중에는 부르지 않으므로 EVT 줄이 다른 응답 사이에 끼어들지 않는다.
+static void slot_wait_command(ClientSlot *slot)
+{
+    while ((slot->events || slot->tails) && !memchr(slot->rbuf, '\n', slot->rlen))
+    {
+        struct pollfd pfd[3] = {
+            { .fd = slot->sock, .events = POLLIN },
+            { .fd = slot->events ? dir_events_fd(slot->events) : -1, .events = POLLIN },
+            { .fd = slot->tails ? file_tails_fd(slot->tails) : -1, .events = POLLIN },
+        };
+        if (poll(pfd, 3, -1) < 0 && errno != EINTR)
+            return;
+        TreeSink sink = { slot_send_all, NULL, slot };
+        if (pfd[1].revents & POLLIN && dir_events_flush(slot->events, &sink) < 0)
+            return;
+        if (pfd[2].revents & POLLIN && file_tails_flush(slot->tails, &sink) < 0)
+            return;
+        if (pfd[0].revents)
+            return;
+    }
+}
+
+// 여러 줄 응답을 흘려 보내는 도중 클라이언트가 "CANCEL" 한 줄을 보냈는지 본다 (기다리지 않음).
+// 있으면 그 줄을 소비하고 true. 연결이 끊겨도 true.
+static bool slot_cancel_pending(ClientSlot *slot)
+{
+    struct pollfd pfd = { .fd = slot->sock, .events = POLLIN };
+    if (slot->rlen < sizeof(slot->rbuf) && poll(&pfd, 1, 0) > 0)
+    {
+        ssize_t n = recv(slot->sock, slot->rbuf + slot->rlen, sizeof(slot->rbuf) - slot->rlen, MSG_DONTWAIT);
+        if (n == 0)
+            return true;
+        if (n > 0)
+            slot->rlen += (size_t)n;
+    }
+
+    char *nl = memchr(slot->rbuf, '\n', slot->rlen);
+    if (!nl || strncasecmp(slot->rbuf, "CANCEL", 6) != 0 || (nl - slot->rbuf != 6 && !(nl - slot->rbuf == 7 && slot->rbuf[6] == '\r')))
+        return false;
+    size_t consumed = (size_t)(nl - slot->rbuf) + 1;
+    memmove(slot->rbuf, slot->rbuf + consumed, slot->rlen - consumed);
+    slot->rlen -= consumed;
+    return true;
+}
+
 static bool is_path_under_root(const char *path)
 {
     if (!path || !server_root[0])
@@ -345,9 +654,16 @@ static bool is_path_under_root(const char *path)
     return path[root_len] == '\0' || path[root_len] == '/';
 }
 
-static int delete_path_recursive(const char *target)
+// job 이 있으면 항목마다 진행 상황을 올리고, 취소되면 그 자리에서 멈춘다 (errno = ECANCELED)
+static int delete_path_recursive(const char *target, Job *job)
 {
     struct stat st;
+    if (job_cancelled(job))
+    {
+        errno = ECANCELED;
+        return -1;
+    }
+    fair_share_ops(1);
     if (lstat(target, &st) != 0)
         return -1;
 
@@ -365,8 +681,9 @@ static int delete_path_recursive(const char *target)
 
             char child[PATH_MAX];
             snprintf(child, sizeof(child), "%s/%s", target, ent->d_name);
+            job_add_total(job, 1);
 
-            if (delete_path_recursive(child) != 0)
+            if (delete_path_recursive(child, job) != 0)
             {
                 closedir(dir);
                 return -1;
@@ -384,24 +701,72 @@ static int delete_path_recursive(const char *target)
             return -1;
     }
 
+    job_add_done(job, 1);
     return 0;
 }
 
+// 명령을 처리 중인 슬롯에는 바로 보내지 않고 모아 둔다 (잠금 안에서 부른다).
+// 넘치면 버린다: 긴 전송 동안 채팅이 메모리를 끝없이 잡지 않도록.
+static void slot_hold_locked(ClientSlot *slot, const char *msg, size_t len)
+{
+    if (slot->held_len + len > HELD_CHAT_MAX)
+        return;
+    if (slot->held_len + len > slot->held_cap)
+    {
+        size_t cap = slot->held_cap ? slot->held_cap * 2 : 1024;
+        while (cap < slot->held_len + len)
+            cap *= 2;
+        char *p = realloc(slot->held, cap);
+        if (!p)
+            return;
+        slot->held = p;
+        slot->held_cap = cap;
+    }
+    memcpy(slot->held + slot->held_len, msg, len);
+    slot->held_len += len;
+}
+
 void broadcast(const char *msg, int sender_sock)
 {
+    size_t len = strlen(msg);
     pthread_mutex_lock(&lock);
     for (int i = 0; i < MAX_CLIENTS; i++)
     {
-        if (clients[i].sock > 0 && clients[i].authenticated && clients[i].sock != sender_sock)
+        // 데이터 연결에 채팅을 끼워 넣으면 전송 중인 바이너리 스트림이 깨진다.
+        // 메인 연결도 응답(DOWNLOAD 본문, 트리/매니페스트 프레임 등)을 보내는 중이면 미뤄 둔다.
+        if (clients[i].sock > 0 && clients[i].authenticated && !clients[i].data && clients[i].sock != sender_sock)
         {
-            send(clients[i].sock, msg, strlen(msg), 0);
+            if (clients[i].busy)
+                slot_hold_locked(&clients[i], msg, len);
+            else
+                send(clients[i].sock, msg, len, 0);
         }
     }
     pthread_mutex_unlock(&lock);
 }
 
+// 명령 처리 시작/끝. 끝나면 미뤄 둔 채팅을 보낸다.
+static void slot_set_busy(ClientSlot *slot, bool busy)
+{
+    pthread_mutex_lock(&lock);
+    slot->busy = busy;
+    if (!busy && slot->held_len > 0)
+    {
+        send(slot->sock, slot->held, slot->held_len, MSG_NOSIGNAL);
+        slot->held_len = 0;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
 // --- 명령 처리 함수들 ---
 
+// 세션 스레드를 사용자의 자원 몫에 묶는다: 전송/파일 시스템 버킷과 작업 풀 비중 (fair_share.h)
+static void slot_bind_share(ClientSlot *slot)
+{
+    unsigned weight = fair_share_bind(slot->username, slot->permission_level);
+    worker_pool_set_owner(slot->username, weight);
+}
+
 static void handle_login(ClientSlot *slot, const char *buf, const char *client_ip, int client_port)
 {
     char cmd[16] = {0}, user[64] = {0}, pw_hash[80] = {0};
@@ -419,6 +784,7 @@ static void handle_login(ClientSlot *slot, const char *buf, const char *client_i
         slot->authenticated = true;
         snprintf(slot->username, sizeof(slot->username), "%s", user);
         slot->permission_level = perm;
+        slot_bind_share(slot);
         printf("👤 User logged in: %s (%s:%d)\n", user, client_ip, client_port);
         send(slot->sock, "OK: login successful\n", 21, 0);
     }
@@ -438,20 +804,66 @@ static void handle_login(ClientSlot *slot, const char *buf, const char *client_i
     }
 }
 
+// COMPRESS zlib | none → 이 세션의 텍스트 응답/전송에 압축을 쓸지 협상
+static void handle_compress(ClientSlot *slot, const char *algo)
+{
+    while (*algo == ' ')
+        algo++;
+
+    char resp[64];
+    if (strcasecmp(algo, COMPRESS_ALGO) == 0)
+        slot->compress = true;
+    else if (strcasecmp(algo, "none") == 0)
+        slot->compress = false;
+    else
+    {
+        snprintf(resp, sizeof(resp), "ERR: unsupported compression\n");
+        send(slot->sock, resp, strlen(resp), 0);
+        return;
+    }
+
+    snprintf(resp, sizeof(resp), "OK COMPRESS %s\n", slot->compress ? COMPRESS_ALGO : "none");
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+// 차등 업로드용으로 잡아 둔 기존 파일을 놓는다
+static void delta_base_release(ClientSlot *slot)
+{
+    if (slot->delta_base_fd >= 0)
+        close(slot->delta_base_fd);
+    slot->delta_base_fd = -1;
+    slot->delta_block = 0;
+    slot->delta_blocks = 0;
+}
+
 static void handle_upload_plan(ClientSlot *slot, const char *buf)
 {
     char kind[8] = {0};
     char name[256] = {0};
 
-    if (sscanf(buf, "UPLOAD PLAN %7s %255s", kind, name) != 2)
+    if (sscanf(buf + 11, "%7s %255s", kind, name) != 2)
     {
         const char *err = "ERR: invalid upload plan\n";
         send(slot->sock, err, strlen(err), 0);
         return;
     }
 
+    // UPLOAD PLAN FILE|DIR <name>\t<dir>: 작업 디렉토리 대신 dir 에 만든다.
+    // 데이터 연결에서 올리는 동안 제어 연결이 cd 해도 대상이 바뀌지 않는다.
+    char dir[PATH_MAX] = "";
+    const char *tab = strchr(buf, '\t');
+    struct stat dst;
+    if (tab && (dls_resolve_path(tab + 1, dir) != 0 || stat(dir, &dst) != 0 || !S_ISDIR(dst.st_mode)))
+    {
+        const char *err = "ERR: invalid upload directory\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
     bool is_dir = (strcasecmp(kind, "DIR") == 0);
+    delta_base_release(slot);
     snprintf(slot->pending_upload_file, sizeof(slot->pending_upload_file), "%s", name);
+    snprintf(slot->pending_upload_dir, sizeof(slot->pending_upload_dir), "%s", dir);
 
     printf("[server/upload] PLAN %s %s from %s\n", is_dir ? "DIR" : "FILE", name, slot->username);
 
@@ -460,146 +872,3142 @@ static void handle_upload_plan(ClientSlot *slot, const char *buf)
     send(slot->sock, resp, strlen(resp), 0);
 }
 
+// 계획한 업로드를 만들 디렉토리 (PLAN 에 적은 곳, 없으면 작업 디렉토리)
+static bool upload_plan_dir(const ClientSlot *slot, char *dir, size_t size)
+{
+    if (slot->pending_upload_dir[0])
+    {
+        snprintf(dir, size, "%s", slot->pending_upload_dir);
+        return true;
+    }
+    return getcwd(dir, size) != NULL;
+}
+
+static ssize_t tree_slot_read(void *ctx, void *buf, size_t len);
+static ssize_t tree_slot_read_line(void *ctx, char *out, size_t size);
+
 static void handle_upload_start(ClientSlot *slot, const char *buf)
 {
-    long filesize = atol(buf + 13);
-    char filename[300];
+    long filesize = -1;
+    char expected_hash[CHECKSUM_HEX_LEN] = {0};
+    char encoding[16] = {0};
+    int fields = sscanf(buf + 12, "%ld %64s %15s", &filesize, expected_hash, encoding);
+    if (fields < 1 || filesize < 0)
+    {
+        const char *err = "ERR: invalid upload size\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    if (fields >= 2 && !checksum_is_hex(expected_hash))
+    {
+        const char *err = "ERR: invalid checksum\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    // UPLOAD START <size> <sha256> ZLIB → 본문이 압축 프레임으로 온다
+    bool framed = (fields == 3 && strcasecmp(encoding, COMPRESS_ALGO) == 0);
+    if (fields == 3 && (!framed || !slot->compress))
+    {
+        const char *err = "ERR: compression not negotiated\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
 
+    char filename[256];
     if (strlen(slot->pending_upload_file) > 0)
         snprintf(filename, sizeof(filename), "%s", slot->pending_upload_file);
     else
         snprintf(filename, sizeof(filename), "uploaded_file.bin");
 
+    char dir[PATH_MAX];
+    bool have_dir = slot->pending_upload_file[0] ? upload_plan_dir(slot, dir, sizeof(dir)) : getcwd(dir, sizeof(dir)) != NULL;
+
+    // 초기화
+    slot->pending_upload_file[0] = '\0';
+
+    if (!have_dir)
+    {
+        const char *err = "ERR: cannot create file\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
     printf("[server/upload] Receiving %s (%ld bytes)...\n", filename, filesize);
 
-    FILE *fp = fopen(filename, "wb");
-    if (!fp)
+    // 실제 이름이 아닌 임시 파일에 먼저 기록 (검증 후 커밋)
+    UploadTarget target;
+    if (upload_target_open(&target, dir, filename) != 0)
     {
         const char *err = "ERR: cannot create file\n";
         send(slot->sock, err, strlen(err), 0);
         return;
     }
 
+    // 압축 프레임이면 풀린 데이터를, 아니면 소켓 데이터를 그대로 읽는다
+    TreeSource slot_src = { tree_slot_read, tree_slot_read_line, slot };
+    FrameReader fr;
+    TreeSource src = slot_src;
+    if (framed)
+    {
+        if (frame_reader_init(&fr, &slot_src) != 0)
+        {
+            upload_target_abort(&target);
+            const char *err = "ERR: out of memory\n";
+            send(slot->sock, err, strlen(err), 0);
+            return;
+        }
+        src = frame_reader_source(&fr);
+    }
+
     // Handshake: 준비 완료 신호 전송
     send(slot->sock, "ACK: READY\n", 11, 0);
 
+    ChecksumCtx *hash = checksum_begin();
     long total_received = 0;
+    bool write_failed = false;
     char filebuf[FILE_BUFFER_SIZE];
 
-    while (total_received < filesize)
+    Job *job = job_begin(slot->username, "upload", filename, "bytes");
+    job_set_total(job, (unsigned long long)filesize);
+
+    while (total_received < filesize && !job_cancelled(job))
     {
         size_t to_read = sizeof(filebuf);
         if (filesize - total_received < (long)to_read)
             to_read = filesize - total_received;
 
-        ssize_t n = recv(slot->sock, filebuf, to_read, 0);
+        ssize_t n = src.read(src.ctx, filebuf, to_read);
         if (n <= 0) break; // 연결 끊김 또는 에러
 
-        fwrite(filebuf, 1, n, fp);
+        // 쓰기 실패 후에도 남은 바이트는 소비해 프로토콜 동기를 유지
+        if (!write_failed && write_all(target.fd, filebuf, (size_t)n) != 0)
+            write_failed = true;
+        checksum_update(hash, filebuf, (size_t)n);
         total_received += n;
+        job_add_done(job, (unsigned long long)n);
     }
-    fclose(fp);
-
-    // 초기화
-    slot->pending_upload_file[0] = '\0';
 
-    printf("[server/upload] Completed: %s\n", filename);
-    const char *success_msg = "OK: Upload Complete\n";
-    send(slot->sock, success_msg, strlen(success_msg), 0);
-}
+    char actual_hash[CHECKSUM_HEX_LEN];
+    checksum_end(hash, actual_hash);
 
-static void handle_command(ClientSlot *slot, const char *buf, const char *client_ip, int client_port)
-{
-    // 1. 인증되지 않은 사용자 처리
-    if (!slot->authenticated)
+    if (job_cancelled(job))
     {
-        if (buf[0] == '\0') return;
-        handle_login(slot, buf, client_ip, client_port);
+        // 남은 본문을 받지 않고 끊는다 (클라이언트는 재접속한다)
+        if (framed)
+            frame_reader_free(&fr);
+        upload_target_abort(&target);
+        job_end(job, JOB_CANCELLED);
+        printf("[server/upload] Cancelled: %s (%ld/%ld bytes)\n", filename, total_received, filesize);
+        send(slot->sock, "ERR: cancelled\n", 15, 0);
+        shutdown(slot->sock, SHUT_RDWR);
         return;
     }
 
-    // 2. 명령어 처리
-    // [수정됨] cd, mkdir 인식 로직 개선 (공백 유무와 상관없이 처리)
-    if (strncmp(buf, "cd", 2) == 0 && (buf[2] == ' ' || buf[2] == '\0'))
+    if (framed)
     {
-        char *path = (char*)buf + 2;
-        while (*path == ' ') path++; // 공백 건너뛰기
-
-        if (*path == '\0') {
-             // 경로가 없으면 에러 (혹은 홈 디렉토리로 이동 구현 가능)
-             send(slot->sock, "ERR: path required\n", 19, 0);
+        // 프레임 끝의 END 줄까지 소비
+        char drain;
+        while (total_received == filesize && src.read(src.ctx, &drain, 1) > 0)
+            total_received = -1;
+        if (!fr.ended && total_received >= 0)
+            total_received = -1;
+        frame_reader_free(&fr);
+        if (total_received < 0)
+        {
+            upload_target_abort(&target);
+            job_end(job, JOB_FAILED);
+            printf("[server/upload] Aborted: %s (bad compressed stream)\n", filename);
+            shutdown(slot->sock, SHUT_RDWR);
+            return;
         }
-        else if (chdir(path) == 0)
-            send(slot->sock, "OK: changed directory\n", 22, 0);
-        else
-            send(slot->sock, "ERR: invalid path\n", 18, 0);
     }
-    else if (strncmp(buf, "mkdir", 5) == 0 && (buf[5] == ' ' || buf[5] == '\0'))
-    {
-        char *path = (char*)buf + 5;
-        while (*path == ' ') path++;
 
-        if (*path == '\0') {
-             send(slot->sock, "ERR: path required\n", 19, 0);
-        }
-        else if (mkdir(path, 0755) == 0)
-            send(slot->sock, "OK: dir created\n", 16, 0);
-        else
-            send(slot->sock, "ERR: mkdir failed\n", 18, 0);
-    }
-    else if (strncmp(buf, "ls", 2) == 0)
+    char resp[256];
+    if (total_received < filesize)
     {
-        char tmpbuf[1024];
-        FILE *fp = popen("ls -al", "r");
-        if (fp) {
-            while (fgets(tmpbuf, sizeof(tmpbuf), fp))
-                send(slot->sock, tmpbuf, strlen(tmpbuf), 0);
-            pclose(fp);
-        }
-        send(slot->sock, "EOF\n", 4, 0);
+        upload_target_abort(&target);
+        printf("[server/upload] Aborted: %s (%ld/%ld bytes)\n", filename, total_received, filesize);
+        snprintf(resp, sizeof(resp), "ERR: upload incomplete (%ld/%ld bytes)\n", total_received, filesize);
     }
-    else if (strncmp(buf, "dls", 3) == 0 && (buf[3] == ' ' || buf[3] == '\0'))
+    else if (write_failed)
     {
-        handle_dls(slot, buf + 3);
+        upload_target_abort(&target);
+        snprintf(resp, sizeof(resp), "ERR: write failed\n");
     }
-    else if (strncasecmp(buf, "UPLOAD PLAN", 11) == 0)
+    else if (expected_hash[0] && strcasecmp(expected_hash, actual_hash) != 0)
     {
-        handle_upload_plan(slot, buf);
+        upload_target_abort(&target);
+        printf("[server/upload] Checksum mismatch: %s\n", filename);
+        snprintf(resp, sizeof(resp), "ERR: checksum mismatch\n");
     }
-    else if (strncasecmp(buf, "UPLOAD START", 12) == 0)
+    else if (upload_target_commit(&target, actual_hash) != 0)
     {
-        handle_upload_start(slot, buf);
+        snprintf(resp, sizeof(resp), "ERR: commit failed (%s)\n", strerror(errno));
     }
-    else if (strncasecmp(buf, "DELETE ", 7) == 0)
+    else
     {
-        const char *raw_path = buf + 7;
-        while (*raw_path == ' ')
-            raw_path++;
+        printf("[server/upload] Completed: %s\n", filename);
+        snprintf(resp, sizeof(resp), "OK: Upload Complete\n");
+        upload_dedup_register(dir, filename, actual_hash, slot->username);
+    }
 
-        if (!*raw_path)
-        {
-            const char *msg = "ERR DELETE : invalid path\n";
-            send(slot->sock, msg, strlen(msg), 0);
-            return;
-        }
+    job_end(job, strncmp(resp, "OK", 2) == 0 ? JOB_DONE : JOB_FAILED);
+    send(slot->sock, resp, strlen(resp), 0);
+}
 
-        char resolved[PATH_MAX];
-        if (!realpath(raw_path, resolved))
-        {
-            char msg[256];
-            snprintf(msg, sizeof(msg), "ERR DELETE %s : %s\n", raw_path, strerror(errno));
-            send(slot->sock, msg, strlen(msg), 0);
-            return;
-        }
+// --- 디렉토리 업로드 (레코드 스트림) ---
+// UPLOAD PLAN DIR <name> 다음에 UPLOAD TREE 와 레코드 스트림이 바로 이어진다.
+// 중간 응답 없이 끝까지 받은 뒤 결과 한 줄만 보낸다 (파일 수와 무관하게 한 번의 왕복).
 
-        if (!is_path_under_root(resolved) || strcmp(resolved, server_root) == 0)
-        {
+static ssize_t tree_slot_read(void *ctx, void *buf, size_t len)
+{
+    return slot_recv((ClientSlot *)ctx, buf, len);
+}
+
+static ssize_t tree_slot_read_line(void *ctx, char *out, size_t size)
+{
+    return slot_read_line((ClientSlot *)ctx, out, size);
+}
+
+static void handle_upload_tree(ClientSlot *slot)
+{
+    char name[256];
+    snprintf(name, sizeof(name), "%s", slot->pending_upload_file);
+    slot->pending_upload_file[0] = '\0';
+
+    char cwd[PATH_MAX];
+    int rootfd = -1;
+    char open_err[128] = "";
+
+    // 루트 디렉토리를 만들지 못해도 스트림은 끝까지 소비해야 다음 명령과 어긋나지 않는다
+    if (!name[0] || !upload_name_is_safe(name))
+    {
+        snprintf(open_err, sizeof(open_err), "no directory planned");
+    }
+    else if (!upload_plan_dir(slot, cwd, sizeof(cwd)))
+    {
+        snprintf(open_err, sizeof(open_err), "%s", strerror(errno));
+    }
+    else
+    {
+        int cwdfd = open(cwd, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cwdfd >= 0)
+        {
+            if (mkdirat(cwdfd, name, 0755) != 0 && errno != EEXIST)
+                snprintf(open_err, sizeof(open_err), "%s", strerror(errno));
+            else if ((rootfd = openat(cwdfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0)
+                snprintf(open_err, sizeof(open_err), "%s", strerror(errno));
+            close(cwdfd);
+        }
+        else
+        {
+            snprintf(open_err, sizeof(open_err), "%s", strerror(errno));
+        }
+    }
+
+    printf("[server/upload] Receiving tree %s from %s\n", name, slot->username);
+
+    TreeSource src = { tree_slot_read, tree_slot_read_line, slot };
+    TreeStats st;
+    char err[PATH_MAX + 64];
+    int rc = tree_receive(rootfd, &src, &st, err, sizeof(err));
+
+    if (rc < 0)
+    {
+        // 스트림 동기가 깨졌으므로 연결을 끊는다
+        if (rootfd >= 0)
+            close(rootfd);
+        printf("[server/upload] Tree aborted: %s (%s)\n", name, err[0] ? err : "connection lost");
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char resp[PATH_MAX + 160];
+    if (rootfd < 0)
+    {
+        snprintf(resp, sizeof(resp), "ERR: cannot create directory %s (%s)\n", name, open_err);
+    }
+    else
+    {
+        // 파일마다 fsync 하지 않고 트리 전체를 한 번에 내린다
+        upload_group_sync(rootfd);
+        close(rootfd);
+
+        if (rc == 0)
+            snprintf(resp, sizeof(resp), "OK: tree uploaded (%llu dirs, %llu files, %llu bytes)\n",
+                     st.dirs, st.files, st.bytes);
+        else
+            snprintf(resp, sizeof(resp), "ERR: %llu entries failed (%s)\n", st.errors, err);
+    }
+
+    printf("[server/upload] Tree %s: %llu dirs, %llu files, %llu bytes, %llu errors\n",
+           name, st.dirs, st.files, st.bytes, st.errors);
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+// --- 내용 주소 업로드 ---
+// UPLOAD PLAN FILE <name> 다음에 UPLOAD HAVE <size> <sha256>
+//   → OK: Upload Complete (dedup: reflink|hardlink|copy)  저장소에 같은 내용이 있어 전송 생략
+//   → ERR: unknown content / ERR: dedup disabled          (PLAN 은 유지되므로 평소대로 업로드)
+
+static void handle_upload_have(ClientSlot *slot, const char *buf)
+{
+    long long size = -1;
+    char sha[CHECKSUM_HEX_LEN] = {0};
+    if (sscanf(buf + 12, "%lld %64s", &size, sha) != 2 || size < 0 || !checksum_is_hex(sha))
+    {
+        send(slot->sock, "ERR: invalid upload have\n", 25, 0);
+        return;
+    }
+
+    if (!upload_dedup_enabled())
+    {
+        send(slot->sock, "ERR: dedup disabled\n", 20, 0);
+        return;
+    }
+
+    char dir[PATH_MAX];
+    const char *how = "";
+    if (!slot->pending_upload_file[0] || !upload_plan_dir(slot, dir, sizeof(dir)))
+    {
+        send(slot->sock, "ERR: no file planned\n", 21, 0);
+        return;
+    }
+
+    if (upload_dedup_materialize(dir, slot->pending_upload_file, size, sha, slot->username, &how) != 0)
+    {
+        send(slot->sock, "ERR: unknown content\n", 21, 0);
+        return;
+    }
+
+    printf("[server/upload] Completed (dedup %s): %s\n", how, slot->pending_upload_file);
+    slot->pending_upload_file[0] = '\0';
+
+    char resp[128];
+    snprintf(resp, sizeof(resp), "OK: Upload Complete (dedup: %s)\n", how);
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+// --- 같은 호스트 업로드 (fd 넘기기) ---
+// Unix 소켓으로 붙은 클라이언트만. UPLOAD PLAN FILE <name> 다음에
+// UPLOAD FD <size> → ACK: SEND FD → 클라이언트가 1바이트와 함께 SCM_RIGHTS 로 열린 파일을 넘긴다
+//   → OK: Upload Complete (fd: copy_file_range|sendfile) / ERR: ...
+// 본문이 소켓을 지나지 않고 커널 안에서 임시 파일로 복사된다 (파일시스템이 지원하면 블록 공유).
+// 클라이언트가 ACK 를 받기 전에는 아무것도 보내지 않으므로 fd 가 붙은 바이트는 수신 버퍼에 섞이지 않는다.
+
+#define UPLOAD_FD_STEP (8LL * 1024 * 1024)
+
+static int slot_recv_fd(ClientSlot *slot)
+{
+    char byte;
+    // fd 하나만 받지만, 더 보낸 것도 받아서 닫아야 하므로 몇 개 더 들어갈 자리를 둔다
+    // (자리를 넘친 fd 는 커널이 버린다)
+    union
+    {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * 8)];
+    } ctl;
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf) };
+
+    if (slot->rlen != 0 || recvmsg(slot->sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+        return -1;
+
+    int fd = -1, count = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; i++)
+        {
+            int got;
+            memcpy(&got, CMSG_DATA(c) + i * sizeof(int), sizeof(got));
+            if (count++ == 0)
+                fd = got;
+            else
+                close(got);
+        }
+    }
+    if (count != 1 || (msg.msg_flags & MSG_CTRUNC))
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void handle_upload_fd(ClientSlot *slot, const char *buf)
+{
+    long long size = -1;
+    char dir[PATH_MAX], filename[256], resp[256];
+
+    if (!slot->local)
+    {
+        send(slot->sock, "ERR: fd passing needs a local connection\n", 41, 0);
+        return;
+    }
+    if (sscanf(buf + 10, "%lld", &size) != 1 || size < 0)
+    {
+        send(slot->sock, "ERR: invalid upload size\n", 25, 0);
+        return;
+    }
+    if (!slot->pending_upload_file[0] || !upload_plan_dir(slot, dir, sizeof(dir)))
+    {
+        send(slot->sock, "ERR: no file planned\n", 21, 0);
+        return;
+    }
+    snprintf(filename, sizeof(filename), "%s", slot->pending_upload_file);
+    slot->pending_upload_file[0] = '\0';
+
+    send(slot->sock, "ACK: SEND FD\n", 13, 0);
+    int src = slot_recv_fd(slot);
+    if (src < 0)
+    {
+        // 스트림 위치를 알 수 없으므로 끊는다 (클라이언트는 재접속한다)
+        printf("[server/upload] Aborted: %s (no file descriptor received)\n", filename);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    struct stat before, after;
+    UploadTarget target;
+    if (fstat(src, &before) != 0 || !S_ISREG(before.st_mode) || before.st_size != size)
+    {
+        close(src);
+        send(slot->sock, "ERR: size mismatch\n", 19, 0);
+        return;
+    }
+    if (upload_target_open(&target, dir, filename) != 0)
+    {
+        close(src);
+        send(slot->sock, "ERR: cannot create file\n", 24, 0);
+        return;
+    }
+
+    printf("[server/upload] Receiving %s (%lld bytes, local fd)...\n", filename, size);
+    Job *job = job_begin(slot->username, "upload", filename, "bytes");
+    job_set_total(job, (unsigned long long)size);
+
+    // copy_file_range 가 안 되는 조합(다른 파일시스템의 오래된 커널 등)이면 sendfile 로
+    const char *how = "copy_file_range";
+    loff_t off = 0;
+    int err = 0;
+    while (off < size && !job_cancelled(job))
+    {
+        size_t step = size - off < UPLOAD_FD_STEP ? (size_t)(size - off) : (size_t)UPLOAD_FD_STEP;
+        ssize_t n = -1;
+        if (how[0] == 'c')
+        {
+            n = copy_file_range(src, &off, target.fd, NULL, step, 0);
+            if (n < 0 && off == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+            {
+                how = "sendfile";
+                continue;
+            }
+        }
+        else
+        {
+            off_t soff = off;
+            n = sendfile(target.fd, src, &soff, step);
+            if (n > 0)
+                off = soff;
+        }
+        if (n <= 0)
+        {
+            err = n < 0 ? errno : EIO;   // 0 이면 그 사이 파일이 줄었다
+            break;
+        }
+        job_add_done(job, (unsigned long long)n);
+        fair_share_bytes((size_t)n);
+    }
+
+    // 복사하는 동안 원본이 바뀌었으면 커밋하지 않는다 (평소 업로드의 체크섬 검증에 해당)
+    bool stable = fstat(src, &after) == 0 && after.st_size == before.st_size &&
+                  after.st_mtim.tv_sec == before.st_mtim.tv_sec && after.st_mtim.tv_nsec == before.st_mtim.tv_nsec;
+    close(src);
+
+    if (job_cancelled(job))
+    {
+        upload_target_abort(&target);
+        job_end(job, JOB_CANCELLED);
+        printf("[server/upload] Cancelled: %s (%lld/%lld bytes)\n", filename, (long long)off, size);
+        snprintf(resp, sizeof(resp), "ERR: cancelled\n");
+    }
+    else if (err || !stable)
+    {
+        upload_target_abort(&target);
+        job_end(job, JOB_FAILED);
+        snprintf(resp, sizeof(resp), "ERR: %s\n", err ? strerror(err) : "source changed during upload");
+    }
+    else if (upload_target_commit(&target, NULL) != 0)
+    {
+        job_end(job, JOB_FAILED);
+        snprintf(resp, sizeof(resp), "ERR: commit failed (%s)\n", strerror(errno));
+    }
+    else
+    {
+        job_end(job, JOB_DONE);
+        printf("[server/upload] Completed: %s (%s)\n", filename, how);
+        snprintf(resp, sizeof(resp), "OK: Upload Complete (fd: %s)\n", how);
+
+        // 저장소에 올리려면 내용의 해시가 필요하다 (기억해 두므로 뒤따르는 HASH 확인은 다시 읽지 않는다)
+        char path[PATH_MAX + 256], hex[CHECKSUM_HEX_LEN];
+        long long hashed_size;
+        bool cached;
+        snprintf(path, sizeof(path), "%s/%s", dir, filename);
+        if (upload_dedup_enabled() && file_hash(path, hex, &hashed_size, &cached) == 0)
+            upload_dedup_register(dir, filename, hex, slot->username);
+    }
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+// --- 차등 업로드 (rsync 방식) ---
+// UPLOAD PLAN FILE <name> 다음에
+// UPLOAD DELTA SIGS            → OK SIGS <size> <block> <count>\n + count × 12 바이트 서명
+// UPLOAD DELTA <size> <sha256> + 연산 스트림 (delta.h) → OK: Upload Complete (...)
+// 서명을 보낸 파일은 fd 로 잡아 두므로 그 사이에 다른 업로드로 교체되어도
+// 클라이언트가 본 내용 그대로 블록을 복사한다.
+
+static void handle_upload_delta_sigs(ClientSlot *slot)
+{
+    delta_base_release(slot);
+
+    const char *name = slot->pending_upload_file;
+    if (!name[0] || !upload_name_is_safe(name))
+    {
+        const char *err = "ERR: no file planned\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    char dir[PATH_MAX], path[PATH_MAX + 256];
+    struct stat st;
+    int fd = -1;
+    if (upload_plan_dir(slot, dir, sizeof(dir)))
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        const char *err = "ERR: no base file\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    unsigned block = delta_block_size(st.st_size);
+    DeltaSig *sigs = NULL;
+    long long count = delta_signatures(fd, st.st_size, block, &sigs);
+    unsigned char *wire = count >= 0 ? malloc((size_t)(count > 0 ? count : 1) * DELTA_SIG_SIZE) : NULL;
+    if (!wire)
+    {
+        free(sigs);
+        close(fd);
+        const char *err = "ERR: cannot read base file\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    for (long long i = 0; i < count; i++)
+        delta_sig_encode(&sigs[i], wire + i * DELTA_SIG_SIZE);
+    free(sigs);
+
+    slot->delta_base_fd = fd;
+    slot->delta_block = block;
+    slot->delta_blocks = count;
+
+    char header[128];
+    snprintf(header, sizeof(header), "OK SIGS %lld %u %lld\n", (long long)st.st_size, block, count);
+    if (slot_send_all(slot, header, strlen(header)) == 0)
+        slot_send_all(slot, wire, (size_t)count * DELTA_SIG_SIZE);
+    free(wire);
+
+    printf("[server/upload] DELTA SIGS %s: %lld blocks of %u bytes\n", name, count, block);
+}
+
+static void handle_upload_delta(ClientSlot *slot, const char *buf)
+{
+    long long filesize = -1;
+    char expected_hash[CHECKSUM_HEX_LEN] = {0};
+    if (sscanf(buf + 13, "%lld %64s", &filesize, expected_hash) != 2 || filesize < 0 ||
+        !checksum_is_hex(expected_hash))
+    {
+        // 연산 스트림이 이어서 오므로 형식이 틀리면 동기를 맞출 수 없다
+        const char *err = "ERR: invalid delta upload\n";
+        send(slot->sock, err, strlen(err), 0);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s", slot->pending_upload_file);
+    slot->pending_upload_file[0] = '\0';
+
+    char dir[PATH_MAX];
+    UploadTarget target;
+    bool have_target = false;
+    char err[160] = "";
+
+    if (slot->delta_base_fd < 0 || !filename[0])
+        snprintf(err, sizeof(err), "no delta base (send UPLOAD DELTA SIGS first)");
+    else if (!upload_plan_dir(slot, dir, sizeof(dir)) || upload_target_open(&target, dir, filename) != 0)
+        snprintf(err, sizeof(err), "cannot create file");
+    else
+        have_target = true;
+
+    // 기준 파일이 없어도 E 까지는 소비한다 (out_fd < 0)
+    TreeSource src = { tree_slot_read, tree_slot_read_line, slot };
+    ChecksumCtx *hash = checksum_begin();
+    DeltaStats ds;
+    char apply_err[160];
+    int rc = delta_apply(&src, slot->delta_base_fd, slot->delta_block, (size_t)slot->delta_blocks,
+                         have_target ? target.fd : -1, hash, &ds, apply_err, sizeof(apply_err));
+    char actual_hash[CHECKSUM_HEX_LEN];
+    checksum_end(hash, actual_hash);
+    delta_base_release(slot);
+
+    if (rc < 0)
+    {
+        if (have_target)
+            upload_target_abort(&target);
+        printf("[server/upload] Delta aborted: %s (%s)\n", filename, apply_err[0] ? apply_err : "connection lost");
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    long long total = (long long)(ds.literal + ds.copied);
+    char resp[320];
+    if (!have_target)
+    {
+        snprintf(resp, sizeof(resp), "ERR: %s\n", err);
+    }
+    else if (rc != 0)
+    {
+        upload_target_abort(&target);
+        snprintf(resp, sizeof(resp), "ERR: delta failed (%s)\n", apply_err);
+    }
+    else if (total != filesize)
+    {
+        upload_target_abort(&target);
+        snprintf(resp, sizeof(resp), "ERR: upload incomplete (%lld/%lld bytes)\n", total, filesize);
+    }
+    else if (strcasecmp(expected_hash, actual_hash) != 0)
+    {
+        upload_target_abort(&target);
+        printf("[server/upload] Checksum mismatch: %s\n", filename);
+        snprintf(resp, sizeof(resp), "ERR: checksum mismatch\n");
+    }
+    else if (upload_target_commit(&target, actual_hash) != 0)
+    {
+        snprintf(resp, sizeof(resp), "ERR: commit failed (%s)\n", strerror(errno));
+    }
+    else
+    {
+        printf("[server/upload] Completed (delta): %s, %llu literal / %llu reused bytes\n",
+               filename, ds.literal, ds.copied);
+        snprintf(resp, sizeof(resp), "OK: Upload Complete (delta: %llu literal, %llu reused, %llu on wire)\n",
+                 ds.literal, ds.copied, ds.wire);
+        upload_dedup_register(dir, filename, actual_hash, slot->username);
+    }
+
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+// --- 이어받기 가능한 청크 업로드 ---
+// UPLOAD INIT <size> <chunk_size> <sha256>   → OK UPLOAD <id> <chunk_size> <chunks> <missing>
+// UPLOAD MISSING <id>                        → MISSING <first> <last> ... EOF
+// UPLOAD CHUNK <id> <index> <len> <xxh64>    + <len> 바이트 → OK CHUNK <index>
+// UPLOAD FINISH <id>                         → OK: Upload Complete
+
+// 청크 업로드 작업은 여러 명령과 연결에 걸치므로 아무 스레드도 끝내지 않을 수 있다:
+// INIT 한 연결이 끊기거나 세션이 밀려나면 작업을 끝낸다 (다시 INIT 하면 새 작업으로 이어받는다).
+static void upload_session_dropped(const char *owner, const char *id)
+{
+    job_end(job_find(owner, id), JOB_FAILED);
+}
+
+static void upload_key_clear(ClientSlot *slot, const char *id)
+{
+    pthread_mutex_lock(&lock);
+    if (strcmp(slot->upload_key, id) == 0)
+        slot->upload_key[0] = '\0';
+    pthread_mutex_unlock(&lock);
+}
+
+// 연결이 끝날 때: 같은 사용자의 다른 연결이 그 사이 같은 업로드를 이어받았으면 그대로 둔다
+static void upload_key_abandon(ClientSlot *slot)
+{
+    bool taken = false;
+    char key[UPLOAD_ID_LEN];
+
+    pthread_mutex_lock(&lock);
+    snprintf(key, sizeof(key), "%s", slot->upload_key);
+    slot->upload_key[0] = '\0';
+    for (int i = 0; i < MAX_CLIENTS && key[0] && !taken; i++)
+        taken = &clients[i] != slot && clients[i].sock != 0 && strcmp(clients[i].username, slot->username) == 0 &&
+                strcmp(clients[i].upload_key, key) == 0;
+    pthread_mutex_unlock(&lock);
+
+    if (key[0] && !taken)
+        job_end(job_find(slot->username, key), JOB_FAILED);
+}
+
+static void handle_upload_init(ClientSlot *slot, const char *buf)
+{
+    long long filesize = -1;
+    unsigned chunk_size = 0;
+    char sha[CHECKSUM_HEX_LEN] = {0};
+
+    if (sscanf(buf + 11, "%lld %u %64s", &filesize, &chunk_size, sha) != 3 ||
+        filesize < 0 || !checksum_is_hex(sha))
+    {
+        const char *err = "ERR: invalid upload init\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    if (!slot->pending_upload_file[0])
+    {
+        const char *err = "ERR: upload plan required\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    char dir[PATH_MAX];
+    UploadSession *us = NULL;
+    if (upload_plan_dir(slot, dir, sizeof(dir)))
+        us = upload_session_open(slot->username, dir, slot->pending_upload_file, filesize, chunk_size, sha);
+
+    char resp[256];
+    if (!us)
+    {
+        snprintf(resp, sizeof(resp), "ERR: cannot create upload (%s)\n", strerror(errno));
+        send(slot->sock, resp, strlen(resp), 0);
+        return;
+    }
+
+    printf("[server/upload] INIT %s %s (%lld bytes, %u chunks, %u missing) from %s\n",
+           upload_session_id(us), slot->pending_upload_file, filesize,
+           upload_session_chunk_count(us), upload_session_missing_count(us), slot->username);
+
+    pthread_mutex_lock(&lock);
+    snprintf(slot->upload_key, sizeof(slot->upload_key), "%s", upload_session_id(us));
+    pthread_mutex_unlock(&lock);
+
+    // 재접속해 같은 세션을 이어받으면 기존 작업을 그대로 쓴다
+    Job *job = job_find(slot->username, upload_session_id(us));
+    if (!job && (job = job_begin(slot->username, "upload", slot->pending_upload_file, "bytes")))
+    {
+        unsigned long long have = (unsigned long long)(upload_session_chunk_count(us) - upload_session_missing_count(us)) *
+                                  upload_session_chunk_size(us);
+        job_set_key(job, upload_session_id(us));
+        job_set_total(job, (unsigned long long)filesize);
+        job_set_done(job, have < (unsigned long long)filesize ? have : (unsigned long long)filesize);
+    }
+    slot->pending_upload_file[0] = '\0';
+
+    snprintf(resp, sizeof(resp), "OK UPLOAD %s %u %u %u\n",
+             upload_session_id(us), upload_session_chunk_size(us),
+             upload_session_chunk_count(us), upload_session_missing_count(us));
+    send(slot->sock, resp, strlen(resp), 0);
+    upload_session_put(us);
+}
+
+static void handle_upload_missing(ClientSlot *slot, const char *buf)
+{
+    char id[UPLOAD_ID_LEN] = {0};
+    UploadSession *us = NULL;
+    if (sscanf(buf + 14, "%16s", id) == 1)
+        us = upload_session_get(id, slot->username);
+
+    if (!us)
+    {
+        const char *err = "ERR: unknown upload\nEOF\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    // 빠진 청크를 연속 구간으로 묶어 보낸다
+    unsigned count = upload_session_chunk_count(us);
+    char line[64];
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (upload_session_has_chunk(us, i))
+            continue;
+
+        unsigned first = i;
+        while (i + 1 < count && !upload_session_has_chunk(us, i + 1))
+            i++;
+
+        snprintf(line, sizeof(line), "MISSING %u %u\n", first, i);
+        send(slot->sock, line, strlen(line), 0);
+    }
+
+    send(slot->sock, "EOF\n", 4, 0);
+    upload_session_put(us);
+}
+
+static void handle_upload_chunk(ClientSlot *slot, const char *buf)
+{
+    char id[UPLOAD_ID_LEN] = {0};
+    unsigned index = 0;
+    unsigned long len = 0;
+    unsigned long long hash = 0;
+
+    // 압축된 청크: 헤더 끝에 "Z <comp_len>" 이 붙고 comp_len 바이트가 온다
+    unsigned long comp_len = 0;
+    int fields = sscanf(buf + 12, "%16s %u %lu %16llx Z %lu", id, &index, &len, &hash, &comp_len);
+    if (fields < 4 || len > UPLOAD_MAX_CHUNK || (fields == 5 && comp_len > compress_bound(len)))
+    {
+        // 길이를 알 수 없으면 뒤따르는 데이터를 건너뛸 수 없으므로 연결을 끊는다
+        const char *err = "ERR: invalid chunk header\n";
+        send(slot->sock, err, strlen(err), 0);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char *data = malloc(len ? len : 1);
+    if (!data)
+    {
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    bool compressed = (fields == 5);
+    char *wire = compressed ? malloc(comp_len ? comp_len : 1) : data;
+    if (!wire || slot_recv_exact(slot, wire, compressed ? comp_len : len) != 0)
+    {
+        // 청크 도중 연결 끊김: 기록하지 않음 (재접속 후 다시 받는다)
+        if (compressed)
+            free(wire);
+        free(data);
+        return;
+    }
+
+    bool inflate_failed = false;
+    if (compressed)
+    {
+        inflate_failed = !slot->compress || decompress_buffer(wire, comp_len, data, len) != 0;
+        free(wire);
+    }
+
+    char resp[128];
+    UploadSession *us = upload_session_get(id, slot->username);
+    // CANCEL 은 키 작업을 바로 끝내므로 끝난 작업까지 찾아 취소를 알아챈다
+    Job *job = us ? job_find_any(slot->username, id) : NULL;
+    if (inflate_failed)
+        snprintf(resp, sizeof(resp), "ERR CHUNK %u : bad compressed data\n", index);
+    else if (!us)
+        snprintf(resp, sizeof(resp), "ERR CHUNK %u : unknown upload\n", index);
+    else if (job_cancelled(job))
+    {
+        // 청크 경계에서 멈춘다. 받은 청크는 남아 있으므로 다시 INIT 하면 이어받을 수 있다.
+        job_end(job, JOB_CANCELLED);
+        upload_key_clear(slot, id);
+        snprintf(resp, sizeof(resp), "ERR CHUNK %u : cancelled\n", index);
+    }
+    else if (upload_session_write_chunk(us, index, data, len, hash) == 0)
+    {
+        job_add_done(job, len);
+        snprintf(resp, sizeof(resp), "OK CHUNK %u\n", index);
+    }
+    else if (errno == EBADMSG)
+        snprintf(resp, sizeof(resp), "ERR CHUNK %u : checksum mismatch\n", index);
+    else
+        snprintf(resp, sizeof(resp), "ERR CHUNK %u : %s\n", index, strerror(errno));
+
+    send(slot->sock, resp, strlen(resp), 0);
+    upload_session_put(us);
+    free(data);
+}
+
+static void handle_upload_finish(ClientSlot *slot, const char *buf)
+{
+    char id[UPLOAD_ID_LEN] = {0};
+    UploadSession *us = NULL;
+    if (sscanf(buf + 13, "%16s", id) == 1)
+        us = upload_session_get(id, slot->username);
+
+    char resp[256];
+    bool incomplete = false;
+    Job *job = us ? job_find_any(slot->username, id) : NULL;
+    if (!us)
+    {
+        snprintf(resp, sizeof(resp), "ERR: unknown upload\n");
+    }
+    else if (job_cancelled(job))
+    {
+        snprintf(resp, sizeof(resp), "ERR: cancelled\n");
+    }
+    else if (upload_session_finish(us) == 0)
+    {
+        printf("[server/upload] Completed: %s\n", id);
+        snprintf(resp, sizeof(resp), "OK: Upload Complete\n");
+        job_end(job, JOB_DONE);
+    }
+    else if (errno == EAGAIN)
+    {
+        // 빠진 청크를 더 보내면 되므로 작업은 계속 진행 중
+        incomplete = true;
+        snprintf(resp, sizeof(resp), "ERR: upload incomplete (%u chunks missing)\n",
+                 upload_session_missing_count(us));
+    }
+    else if (errno == EBADMSG)
+    {
+        snprintf(resp, sizeof(resp), "ERR: checksum mismatch\n");
+        job_end(job, JOB_FAILED);
+    }
+    else
+    {
+        snprintf(resp, sizeof(resp), "ERR: commit failed (%s)\n", strerror(errno));
+        job_end(job, JOB_FAILED);
+    }
+
+    // 빠진 청크를 기다리는 경우 말고는 이 업로드는 끝났다
+    if (us && !incomplete)
+        upload_key_clear(slot, id);
+    send(slot->sock, resp, strlen(resp), 0);
+    upload_session_put(us);
+}
+
+// --- 병렬 전송 스트림 ---
+// STREAMS <n>      (제어 연결)  → OK STREAMS <granted> <token>
+// ATTACH <token>   (새 연결)    → OK: attached
+// 붙은 연결은 같은 사용자로 인증되어 UPLOAD CHUNK 등을 병렬로 보낼 수 있다.
+
+static void handle_streams(ClientSlot *slot, const char *buf)
+{
+    int wanted = atoi(buf + 8);
+    if (wanted < 1)
+        wanted = 1;
+    if (wanted > MAX_TRANSFER_STREAMS)
+        wanted = MAX_TRANSFER_STREAMS;
+
+    unsigned char raw[16];
+    if (getrandom(raw, sizeof(raw), 0) != (ssize_t)sizeof(raw))
+    {
+        const char *err = "ERR: cannot create stream token\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+
+    char token[33];
+    for (size_t i = 0; i < sizeof(raw); i++)
+        snprintf(token + i * 2, 3, "%02x", raw[i]);
+
+    time_t now = time(NULL);
+    int granted = 0;
+
+    pthread_mutex_lock(&lock);
+    int free_slots = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (clients[i].sock == 0)
+            free_slots++;
+    }
+
+    // 빈 슬롯 수를 넘겨서 허가하지 않는다 (다른 사용자 접속 여유 1개 유지)
+    granted = wanted < free_slots - 1 ? wanted : free_slots - 1;
+
+    StreamToken *tok = NULL;
+    for (int i = 0; granted > 0 && i < MAX_STREAM_TOKENS; i++)
+    {
+        if (stream_tokens[i].remaining <= 0 || stream_tokens[i].expires < now)
+        {
+            tok = &stream_tokens[i];
+            break;
+        }
+    }
+
+    if (tok)
+    {
+        snprintf(tok->token, sizeof(tok->token), "%s", token);
+        snprintf(tok->username, sizeof(tok->username), "%s", slot->username);
+        tok->permission_level = slot->permission_level;
+        tok->remaining = granted;
+        tok->expires = now + STREAM_TOKEN_TTL;
+    }
+    pthread_mutex_unlock(&lock);
+
+    char resp[128];
+    if (!tok)
+        snprintf(resp, sizeof(resp), "OK STREAMS 0 -\n");
+    else
+        snprintf(resp, sizeof(resp), "OK STREAMS %d %s\n", granted, token);
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+static void handle_attach(ClientSlot *slot, const char *buf, const char *client_ip, int client_port)
+{
+    char token[33] = {0};
+    sscanf(buf + 7, "%32s", token);
+
+    bool ok = false;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < MAX_STREAM_TOKENS; i++)
+    {
+        StreamToken *tok = &stream_tokens[i];
+        if (tok->remaining > 0 && tok->expires >= now && strcmp(tok->token, token) == 0)
+        {
+            tok->remaining--;
+            slot->authenticated = true;
+            slot->data = true;
+            snprintf(slot->username, sizeof(slot->username), "%s", tok->username);
+            slot->permission_level = tok->permission_level;
+            ok = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (ok)
+    {
+        slot_bind_share(slot);
+        printf("🔗 Stream attached: %s (%s:%d)\n", slot->username, client_ip, client_port);
+        traffic_class_mark(slot->sock, true);
+        send(slot->sock, "OK: attached\n", 13, 0);
+    }
+    else
+    {
+        send(slot->sock, "ERR: invalid stream token\n", 26, 0);
+    }
+}
+
+// --- 다운로드 ---
+// DOWNLOAD [ZLIB ]<path>
+// DOWNLOAD [ZLIB ]RANGE <offset> <length|-1> <path>
+//   → OK DOWNLOAD <file_size> <offset> <length> mtime=<sec>.<nsec>  + <length> 바이트 (sendfile)
+//   → OK DOWNLOAD <file_size> <offset> <length> ZLIB mtime=<sec>.<nsec>  + Z/R 프레임 + END
+//     (ZLIB 을 요청했고 세션이 압축을 협상했으며 표본상 압축 이득이 있을 때)
+//   mtime 은 클라이언트가 받다 만 파일을 이어받아도 되는지 (서버 파일이 그대로인지) 확인할 때 쓴다.
+
+// 구간을 블록 단위로 읽어 작업 풀에서 압축해 보낸다
+static void download_compressed(ClientSlot *slot, int fd, const char *path, long long offset, long long length)
+{
+    FrameWriter *fw = frame_writer_new(workers, COMPRESS_LEVEL_FAST, slot_send_bulk, slot);
+    char *block = malloc(COMPRESS_BLOCK);
+    long long sent = 0;
+
+    while (fw && block && sent < length)
+    {
+        size_t want = (length - sent) < COMPRESS_BLOCK ? (size_t)(length - sent) : COMPRESS_BLOCK;
+        ssize_t n = pread(fd, block, want, (off_t)(offset + sent));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0 || frame_writer_put(fw, block, (size_t)n) != 0)
+            break;
+        sent += n;
+    }
+    free(block);
+
+    unsigned long long raw_bytes = 0, wire_bytes = 0;
+    bool ok = fw && sent == length && frame_writer_finish(fw, &raw_bytes, &wire_bytes) == 0;
+    frame_writer_free(fw);
+
+    if (!ok || slot_send_all(slot, "END\n", 4) != 0)
+    {
+        printf("[server/download] Aborted: %s (compressed)\n", path);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    printf("[server/download] Sent %s [%lld+%lld] to %s (%llu bytes on the wire)\n",
+           path, offset, length, slot->username, wire_bytes);
+}
+
+static void handle_download(ClientSlot *slot, const char *buf)
+{
+    long long offset = 0;
+    long long length = -1;
+    bool want_compress = false;
+
+    // DOWNLOAD ZLIB ... : 압축할 가치가 있으면 프레임으로 보내 달라는 요청
+    buf += 9;
+    if (strncasecmp(buf, COMPRESS_ALGO " ", strlen(COMPRESS_ALGO) + 1) == 0)
+    {
+        want_compress = true;
+        buf += strlen(COMPRESS_ALGO) + 1;
+    }
+    const char *raw = buf;
+
+    if (strncasecmp(buf, "RANGE ", 6) == 0)
+    {
+        int consumed = 0;
+        if (sscanf(buf + 6, "%lld %lld %n", &offset, &length, &consumed) < 2 || consumed == 0 || offset < 0)
+        {
+            const char *err = "ERR: invalid range\n";
+            send(slot->sock, err, strlen(err), 0);
+            return;
+        }
+        raw = buf + 6 + consumed;
+    }
+
+    while (*raw == ' ')
+        raw++;
+
+    char path[PATH_MAX];
+    char msg[PATH_MAX + 64];
+    if (!*raw || dls_resolve_path(raw, path) != 0)
+    {
+        snprintf(msg, sizeof(msg), "ERR: cannot access %s\n", *raw ? raw : "<empty>");
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            close(fd);
+        snprintf(msg, sizeof(msg), "ERR: not a regular file %s\n", path);
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    long long size = (long long)st.st_size;
+    if (offset > size)
+    {
+        close(fd);
+        const char *err = "ERR: invalid range\n";
+        send(slot->sock, err, strlen(err), 0);
+        return;
+    }
+    if (length < 0 || offset + length > size)
+        length = size - offset;
+
+    // 순차 읽기 힌트 + 미리 읽기
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+
+    if (want_compress && slot->compress && length > 0 && compress_file_worthwhile(fd, size))
+    {
+        snprintf(msg, sizeof(msg), "OK DOWNLOAD %lld %lld %lld %s mtime=%lld.%09ld\n", size, offset, length,
+                 COMPRESS_ALGO, (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+        send(slot->sock, msg, strlen(msg), 0);
+        download_compressed(slot, fd, path, offset, length);
+        close(fd);
+        return;
+    }
+
+    snprintf(msg, sizeof(msg), "OK DOWNLOAD %lld %lld %lld mtime=%lld.%09ld\n", size, offset, length,
+             (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    send(slot->sock, msg, strlen(msg), 0);
+
+    off_t off = (off_t)offset;
+    long long remaining = length;
+    while (remaining > 0)
+    {
+        // 전송 몫에 맞춰 나눠 보낸다
+        size_t want = remaining > FAIR_SHARE_BLOCK ? (size_t)FAIR_SHARE_BLOCK : (size_t)remaining;
+        ssize_t n = sendfile(slot->sock, fd, &off, want);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            break;
+        remaining -= n;
+        fair_share_bytes((size_t)n);
+    }
+    close(fd);
+
+    if (remaining > 0)
+    {
+        // 약속한 길이를 보내지 못하면 스트림이 어긋나므로 연결을 닫는다
+        printf("[server/download] Aborted: %s (%lld bytes left)\n", path, remaining);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    printf("[server/download] Sent %s [%lld+%lld] to %s\n", path, offset, length, slot->username);
+}
+
+// --- 디렉토리 다운로드 (압축 레코드 스트림) ---
+// DOWNLOAD TREE <path>
+//   → OK: tree stream  + Z/R 프레임 (tree_stream 레코드를 블록 단위로 병렬 압축)
+//   → END <dirs> <files> <bytes> <skipped> <raw_bytes> <wire_bytes>
+// 디스크에 아카이브를 만들지 않고 디렉토리를 걸으며 바로 보낸다.
+
+typedef struct
+{
+    ClientSlot *slot;
+    FrameWriter *fw;
+} TreeSendCtx;
+
+static int tree_frame_write(void *ctx, const void *buf, size_t len)
+{
+    TreeSendCtx *tc = ctx;
+    const char *p = buf;
+    while (len > 0)
+    {
+        size_t n = len < COMPRESS_BLOCK ? len : COMPRESS_BLOCK;
+        if (frame_writer_put(tc->fw, p, n) != 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void handle_download_tree(ClientSlot *slot, const char *buf)
+{
+    const char *raw = buf + 14;
+    while (*raw == ' ')
+        raw++;
+
+    char target[PATH_MAX];
+    int dfd = -1;
+    if (dls_resolve_path(raw, target) != 0 ||
+        (dfd = open(target, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+    {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "ERR: cannot access %s\n", *raw ? raw : "<empty>");
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    TreeSendCtx tc = { slot, frame_writer_new(workers, slot->compress ? COMPRESS_LEVEL_FAST : COMPRESS_LEVEL_NONE,
+                                                    slot_send_bulk, slot) };
+    if (!tc.fw)
+    {
+        close(dfd);
+        send(slot->sock, "ERR: out of memory\n", 19, 0);
+        return;
+    }
+
+    send(slot->sock, "OK: tree stream\n", 16, 0);
+    printf("[server/download] Streaming tree %s to %s\n", target, slot->username);
+
+    TreeSink sink = { tree_frame_write, NULL, &tc };
+    TreeStats st;
+    unsigned long long raw_bytes = 0, wire_bytes = 0;
+    int rc = tree_send(dfd, &sink, &st);
+    close(dfd);
+
+    if (frame_writer_finish(tc.fw, &raw_bytes, &wire_bytes) != 0)
+        rc = -1;
+    frame_writer_free(tc.fw);
+
+    if (rc != 0)
+    {
+        printf("[server/download] Tree aborted: %s\n", target);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char end[256];
+    snprintf(end, sizeof(end), "END %llu %llu %llu %llu %llu %llu\n",
+             st.dirs, st.files, st.bytes, st.skipped, raw_bytes, wire_bytes);
+    send(slot->sock, end, strlen(end), 0);
+    printf("[server/download] Tree %s: %llu files, %llu -> %llu bytes\n", target, st.files, raw_bytes, wire_bytes);
+}
+
+// --- 디렉토리 동기화 ---
+// SYNC MANIFEST <0|1> <dir>
+//   → OK: manifest + Z/R 프레임 (sync_manifest 레코드, 1 이면 파일 해시 포함) → END <entries>
+// SYNC PUSH <ndelete> <raw|zlib> <dir> + 지울 경로 ndelete 줄 + tree_stream 레코드
+//   → OK: sync (...)
+// 클라이언트가 비교를 맡으므로 바뀐 것이 없으면 PUSH 없이 한 번의 왕복으로 끝난다.
+
+// 현재 디렉토리 기준 상대경로 dir 을 연다 (구성요소마다 링크를 따라가지 않음)
+static int open_sync_root(const char *dir, bool create)
+{
+    int fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || strcmp(dir, ".") == 0)
+        return fd;
+
+    if (!tree_path_is_safe(dir))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    const char *p = dir;
+    while (*p)
+    {
+        const char *slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+        char comp[NAME_MAX + 1];
+        memcpy(comp, p, len);
+        comp[len] = '\0';
+
+        int next = openat(fd, comp, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (next < 0 && errno == ENOENT && create && mkdirat(fd, comp, 0755) == 0)
+            next = openat(fd, comp, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        close(fd);
+        if (next < 0)
+            return -1;
+
+        fd = next;
+        p += len;
+        if (*p == '/')
+            p++;
+    }
+    return fd;
+}
+
+// rootfd 기준 상대경로 rel 을 지운다 (중간 구성요소도 링크를 따라가지 않음)
+static int sync_remove(int rootfd, const char *rel)
+{
+    if (!tree_path_is_safe(rel))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const char *slash = strrchr(rel, '/');
+    if (!slash)
+        return fileop_remove_at(rootfd, rel);
+
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%.*s", (int)(slash - rel), rel);
+
+    int pfd = dup(rootfd);
+    char *save = NULL;
+    for (char *comp = strtok_r(parent, "/", &save); comp && pfd >= 0; comp = strtok_r(NULL, "/", &save))
+    {
+        int next = openat(pfd, comp, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        close(pfd);
+        pfd = next;
+    }
+    if (pfd < 0)
+        return errno == ENOENT ? 0 : -1;
+
+    int rc = fileop_remove_at(pfd, slash + 1);
+    close(pfd);
+    return rc;
+}
+
+static void handle_sync_manifest(ClientSlot *slot, const char *buf)
+{
+    int with_hash = 0;
+    int off = 0;
+    if (sscanf(buf, "SYNC MANIFEST %d %n", &with_hash, &off) != 1 || off == 0 || !buf[off])
+    {
+        send(slot->sock, "ERR: invalid sync request\n", 26, 0);
+        return;
+    }
+
+    // 아직 없는 디렉토리면 빈 매니페스트를 보낸다 (전부 새로 보내게 됨)
+    const char *dir = buf + off;
+    int dfd = open_sync_root(dir, false);
+    if (dfd < 0 && errno != ENOENT)
+    {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "ERR: cannot access %s (%s)\n", dir, strerror(errno));
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    TreeSendCtx tc = { slot, frame_writer_new(workers, slot->compress ? COMPRESS_LEVEL_FAST : COMPRESS_LEVEL_NONE,
+                                                    slot_send_bulk, slot) };
+    if (!tc.fw)
+    {
+        if (dfd >= 0)
+            close(dfd);
+        send(slot->sock, "ERR: out of memory\n", 19, 0);
+        return;
+    }
+
+    send(slot->sock, "OK: manifest\n", 13, 0);
+
+    TreeSink sink = { tree_frame_write, NULL, &tc };
+    unsigned long long entries = 0, raw_bytes = 0, wire_bytes = 0;
+    int rc = manifest_send(dfd, with_hash != 0, &sink, &entries);
+    if (dfd >= 0)
+        close(dfd);
+
+    if (frame_writer_finish(tc.fw, &raw_bytes, &wire_bytes) != 0)
+        rc = -1;
+    frame_writer_free(tc.fw);
+
+    if (rc != 0)
+    {
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char end[128];
+    snprintf(end, sizeof(end), "END %llu\n", entries);
+    send(slot->sock, end, strlen(end), 0);
+    printf("[server/sync] Manifest %s: %llu entries, %llu -> %llu bytes\n", dir, entries, raw_bytes, wire_bytes);
+}
+
+static void handle_sync_push(ClientSlot *slot, const char *buf)
+{
+    long long ndelete = -1;
+    char encoding[8] = {0};
+    int off = 0;
+    if (sscanf(buf, "SYNC PUSH %lld %7s %n", &ndelete, encoding, &off) != 2 || off == 0 || !buf[off] ||
+        ndelete < 0 || (strcasecmp(encoding, "raw") != 0 && strcasecmp(encoding, COMPRESS_ALGO) != 0))
+    {
+        // 뒤따르는 스트림의 길이를 알 수 없으므로 연결을 끊는다
+        send(slot->sock, "ERR: invalid sync request\n", 26, 0);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    const char *dir = buf + off;
+    bool framed = strcasecmp(encoding, COMPRESS_ALGO) == 0;
+    char open_err[128] = "";
+    int rootfd = open_sync_root(dir, true);
+    if (rootfd < 0)
+        snprintf(open_err, sizeof(open_err), "%s", strerror(errno));
+
+    printf("[server/sync] Push into %s from %s (%lld deletions)\n", dir, slot->username, ndelete);
+
+    // 삭제 목록: 루트를 열지 못했어도 끝까지 읽어 스트림 동기를 유지한다
+    unsigned long long removed = 0, remove_failed = 0;
+    char line[PATH_MAX + 8];
+    for (long long i = 0; i < ndelete; i++)
+    {
+        ssize_t ln = slot_read_line(slot, line, sizeof(line));
+        if (ln == SLOT_LINE_TOO_LONG)
+        {
+            remove_failed++;
+            continue;
+        }
+        if (ln < 0)
+        {
+            if (rootfd >= 0)
+                close(rootfd);
+            shutdown(slot->sock, SHUT_RDWR);
+            return;
+        }
+        if (rootfd < 0)
+            continue;
+        if (sync_remove(rootfd, line) == 0)
+            removed++;
+        else
+            remove_failed++;
+    }
+
+    TreeSource slot_src = { tree_slot_read, tree_slot_read_line, slot };
+    TreeSource src = slot_src;
+    FrameReader fr;
+    if (framed)
+    {
+        if (!slot->compress || frame_reader_init(&fr, &slot_src) != 0)
+        {
+            if (rootfd >= 0)
+                close(rootfd);
+            send(slot->sock, "ERR: compression not negotiated\n", 32, 0);
+            shutdown(slot->sock, SHUT_RDWR);
+            return;
+        }
+        src = frame_reader_source(&fr);
+    }
+
+    TreeStats st;
+    char err[PATH_MAX + 64];
+    int rc = tree_receive(rootfd, &src, &st, err, sizeof(err));
+
+    if (framed)
+    {
+        // 프레임 끝의 END 줄까지 소비
+        char drain;
+        while (rc >= 0 && src.read(src.ctx, &drain, 1) > 0)
+            rc = -1;
+        if (!fr.ended)
+            rc = -1;
+        frame_reader_free(&fr);
+    }
+
+    if (rc < 0)
+    {
+        if (rootfd >= 0)
+            close(rootfd);
+        printf("[server/sync] Push aborted: %s (%s)\n", dir, err[0] ? err : "connection lost");
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char resp[PATH_MAX + 200];
+    if (rootfd < 0)
+    {
+        snprintf(resp, sizeof(resp), "ERR: cannot create directory %s (%s)\n", dir, open_err);
+    }
+    else
+    {
+        upload_group_sync(rootfd);
+        close(rootfd);
+
+        if (rc == 0 && remove_failed == 0)
+            snprintf(resp, sizeof(resp), "OK: sync (%llu removed, %llu dirs, %llu files, %llu bytes)\n",
+                     removed, st.dirs, st.files, st.bytes);
+        else if (rc == 0)
+            snprintf(resp, sizeof(resp), "ERR: %llu deletions failed (%llu files synced)\n", remove_failed, st.files);
+        else
+            snprintf(resp, sizeof(resp), "ERR: %llu entries failed (%s)\n", st.errors + remove_failed, err);
+    }
+
+    printf("[server/sync] %s: %llu removed, %llu dirs, %llu files, %llu bytes\n",
+           dir, removed, st.dirs, st.files, st.bytes);
+    send(slot->sock, resp, strlen(resp), 0);
+}
+
+// --- 서버 안 복사/이동 ---
+// MOVE [-f] <src> <dst>   → OK MOVE <src> -> <dst>      (renameat2, -f 가 없으면 덮어쓰지 않음)
+// COPY <src> <dst>        → PROGRESS COPY <files>/<total> <bytes>/<total> ... → OK COPY <dst> (...)
+// dst 가 기존 디렉토리면 그 안에 같은 이름으로 만든다. 공백이 있는 경로는 "..." 로 감싼다.
+
+// 공백으로 인자를 나눈다 ("..." 로 감싼 인자는 공백 포함 가능). 인자 수를 돌려준다.
+static int split_args(char *s, char **argv, int max)
+{
+    int argc = 0;
+    while (*s && argc < max)
+    {
+        while (*s == ' ')
+            s++;
+        if (!*s)
+            break;
+
+        if (*s == '"')
+        {
+            argv[argc++] = ++s;
+            while (*s && *s != '"')
+                s++;
+        }
+        else
+        {
+            argv[argc++] = s;
+            while (*s && *s != ' ')
+                s++;
+        }
+        if (*s)
+            *s++ = '\0';
+    }
+    return argc;
+}
+
+// 복사/이동 대상 경로를 정한다. 부모 디렉토리는 서버 루트 안에 있어야 한다.
+static int resolve_target_path(const char *raw, const char *src, char out[PATH_MAX])
+{
+    char resolved[PATH_MAX];
+    struct stat st;
+    const char *src_base = strrchr(src, '/');
+    src_base = src_base ? src_base + 1 : src;
+
+    if (dls_resolve_path(raw, resolved) == 0)
+    {
+        if (stat(resolved, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            if (snprintf(out, PATH_MAX, "%s/%s", resolved, src_base) >= PATH_MAX)
+                return -1;
+        }
+        else
+        {
+            snprintf(out, PATH_MAX, "%s", resolved);
+        }
+    }
+    else
+    {
+        // 아직 없는 이름: 부모만 확인
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%s", raw);
+        char *slash = strrchr(parent, '/');
+        const char *leaf = slash ? raw + (slash - parent) + 1 : raw;
+        if (slash)
+            *slash = '\0';
+
+        if (!upload_name_is_safe(leaf) ||
+            dls_resolve_path(slash ? (parent[0] ? parent : "/") : ".", resolved) != 0 ||
+            snprintf(out, PATH_MAX, "%s/%s", resolved, leaf) >= PATH_MAX)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    // 디렉토리를 자기 자신 안으로 옮기거나 복사할 수 없다
+    size_t n = strlen(src);
+    if (strcmp(out, src) == 0 || (strncmp(out, src, n) == 0 && out[n] == '/'))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static int resolve_new_path(const char *raw, bool allow_root, char out[PATH_MAX]);
+
+// 복사/이동 원본: 마지막 구성요소는 따라가지 않는다 (링크를 옮기면 링크가 옮겨지도록)
+static int resolve_source_path(const char *raw, char out[PATH_MAX])
+{
+    struct stat st;
+    if (resolve_new_path(raw, false, out) != 0 || lstat(out, &st) != 0)
+        return -1;
+    return 0;
+}
+
+typedef struct
+{
+    ClientSlot *slot;
+    Job *job;
+    unsigned long long charged_items;   // 이미 사용자 몫에서 뺀 항목 수와 바이트
+    unsigned long long charged_bytes;
+} CopyContext;
+
+static bool copy_progress(void *ctx, const FileOpProgress *p)
+{
+    CopyContext *c = ctx;
+    char line[160];
+    snprintf(line, sizeof(line), "PROGRESS COPY %llu/%llu %llu/%llu\n",
+             p->files_done, p->files_total, p->bytes_done, p->bytes_total);
+    slot_send_all(c->slot, line, strlen(line));
+
+    job_set_total(c->job, p->bytes_total);
+    job_set_done(c->job, p->bytes_done);
+
+    // 복사는 작업 풀에서 돌지만 새 파일은 이 스레드가 맡기므로, 여기서 기다리면 복사도 늦춰진다.
+    // 네트워크 전송이 아니므로 데이터는 작업 버킷에 쓰고, reflink 로 만든 몫은 세지 않는다.
+    unsigned long long items = p->files_done + p->dirs;
+    unsigned long long copied = p->bytes_done > p->reflinked_bytes ? p->bytes_done - p->reflinked_bytes : 0;
+    fair_share_ops((size_t)(items - c->charged_items));
+    c->charged_items = items;
+    // 두 값을 따로 읽으므로 잠시 줄어 보일 수 있다: 늘었을 때만 쓴다
+    if (copied > c->charged_bytes)
+    {
+        fair_share_disk((size_t)(copied - c->charged_bytes));
+        c->charged_bytes = copied;
+    }
+    return !job_cancelled(c->job);
+}
+
+static void handle_copy(ClientSlot *slot, const char *buf)
+{
+    char args[BUFFER_SIZE];
+    char *argv[3];
+    snprintf(args, sizeof(args), "%s", buf + 5);
+    int argc = split_args(args, argv, 3);
+
+    char src[PATH_MAX], dst[PATH_MAX], msg[PATH_MAX * 2 + 128];
+    if (argc != 2)
+    {
+        send(slot->sock, "ERR COPY : usage COPY <src> <dst>\n", 34, 0);
+        return;
+    }
+    if (resolve_source_path(argv[0], src) != 0 || resolve_target_path(argv[1], src, dst) != 0)
+    {
+        snprintf(msg, sizeof(msg), "ERR COPY %s : %s\n", argv[0], strerror(errno));
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    printf("[server/copy] %s -> %s (%s)\n", src, dst, slot->username);
+
+    FileOpProgress p;
+    char err[PATH_MAX + 64];
+    CopyContext cc = { slot, job_begin(slot->username, "copy", src, "bytes"), 0, 0 };
+    int rc = fileop_copy(workers, src, dst, copy_progress, &cc, &p, err, sizeof(err));
+    job_set_done(cc.job, p.bytes_done);
+    job_end(cc.job, rc == 0 ? JOB_DONE : JOB_FAILED);
+
+    if (rc == 0)
+        snprintf(msg, sizeof(msg), "OK COPY %s (%llu files, %llu bytes, %llu reflinked)\n",
+                 dst, p.files_done, p.bytes_done, p.reflinked);
+    else if (rc > 0 && !job_cancelled(cc.job))
+        snprintf(msg, sizeof(msg), "ERR COPY %s : %llu entries failed (%s)\n", dst, p.errors, err);
+    else
+        snprintf(msg, sizeof(msg), "ERR COPY %s : %s\n", dst, err);
+    send(slot->sock, msg, strlen(msg), 0);
+}
+
+static void handle_move(ClientSlot *slot, const char *buf)
+{
+    char args[BUFFER_SIZE];
+    char *argv[4];
+    snprintf(args, sizeof(args), "%s", buf + 5);
+    int argc = split_args(args, argv, 4);
+
+    bool replace = argc > 0 && strcmp(argv[0], "-f") == 0;
+    char **paths = replace ? argv + 1 : argv;
+    int npaths = replace ? argc - 1 : argc;
+
+    char src[PATH_MAX], dst[PATH_MAX], msg[PATH_MAX * 2 + 128];
+    if (npaths != 2)
+    {
+        send(slot->sock, "ERR MOVE : usage MOVE [-f] <src> <dst>\n", 39, 0);
+        return;
+    }
+    if (resolve_source_path(paths[0], src) != 0 || resolve_target_path(paths[1], src, dst) != 0)
+    {
+        snprintf(msg, sizeof(msg), "ERR MOVE %s : %s\n", paths[0], strerror(errno));
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    const char *note = "";
+    char err[PATH_MAX + 64] = "";
+    int rc = fileop_move(src, dst, replace);
+    if (rc != 0 && errno == EXDEV)
+    {
+        // 다른 파일시스템: 옆에 복사해 두고 바꿔 넣은 뒤 원본을 지운다
+        FileOpProgress p;
+        CopyContext cc = { slot, job_begin(slot->username, "move", src, "bytes"), 0, 0 };
+        rc = fileop_move_copy(workers, src, dst, replace, copy_progress, &cc, &p, err, sizeof(err));
+        job_set_done(cc.job, p.bytes_done);
+        job_end(cc.job, rc == 0 ? JOB_DONE : JOB_FAILED);
+        note = " (copied across filesystems)";
+    }
+
+    if (rc == 0)
+    {
+        printf("[server/move] %s -> %s (%s)\n", src, dst, slot->username);
+        snprintf(msg, sizeof(msg), "OK MOVE %s -> %s%s\n", src, dst, note);
+    }
+    else
+    {
+        snprintf(msg, sizeof(msg), "ERR MOVE %s : %s\n", src, err[0] ? err : strerror(errno));
+    }
+    send(slot->sock, msg, strlen(msg), 0);
+}
+
+// --- 작업 목록 ---
+// JOBS [ALL]   → JOB <id> <state> <kind> <done> <total|?> <unit> <secs> <owner> <what> ... EOF
+// CANCEL <id>  → OK CANCEL <id> / ERR CANCEL <id> : <reason>
+// 작업은 사용자 이름에 묶이므로 다른 연결(재접속 후 포함)에서도 보고 취소할 수 있다.
+// ALL 과 다른 사용자의 작업 취소는 관리자만 쓸 수 있다.
+#define JOBS_ADMIN_LEVEL 10
+#define JOBS_LIST_MAX 128
+
+static void handle_jobs(ClientSlot *slot, const char *arg)
+{
+    while (*arg == ' ')
+        arg++;
+    bool all = strcasecmp(arg, "ALL") == 0 && slot->permission_level >= JOBS_ADMIN_LEVEL;
+
+    JobInfo *list = malloc(JOBS_LIST_MAX * sizeof(*list));
+    size_t n = list ? job_list(slot->username, all, list, JOBS_LIST_MAX) : 0;
+    time_t now = time(NULL);
+
+    TextBuf out = {0};
+    for (size_t i = 0; i < n; i++)
+    {
+        const JobInfo *j = &list[i];
+        char line[512], total[32] = "?";
+        if (j->total > 0)
+            snprintf(total, sizeof(total), "%llu", j->total);
+
+        long secs = (long)((j->state == JOB_RUNNING ? now : j->finished) - j->started);
+        snprintf(line, sizeof(line), "JOB %u %s%s %s %llu %s %s %ld %s %s\n", j->id, job_state_name(j->state),
+                 j->state == JOB_RUNNING && j->cancel_requested ? "(cancelling)" : "", j->kind, j->done, total,
+                 j->unit, secs, j->owner, j->what);
+        text_append(&out, line);
+    }
+    text_append(&out, "EOF\n");
+    send_text_response(slot, &out);
+    text_free(&out);
+    free(list);
+}
+
+static void handle_cancel(ClientSlot *slot, const char *arg)
+{
+    char msg[128];
+    char *end = NULL;
+    unsigned long id = strtoul(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || id == 0)
+        snprintf(msg, sizeof(msg), "ERR CANCEL : usage CANCEL <job id>\n");
+    else if (job_cancel((unsigned)id, slot->username, slot->permission_level >= JOBS_ADMIN_LEVEL) != 0)
+        snprintf(msg, sizeof(msg), "ERR CANCEL %lu : %s\n", id,
+                 errno == EALREADY ? "already finished" : errno == EPERM ? "not your job" : "no such job");
+    else
+    {
+        printf("[server/jobs] Cancel requested for job %lu by %s\n", id, slot->username);
+        snprintf(msg, sizeof(msg), "OK CANCEL %lu\n", id);
+    }
+    send(slot->sock, msg, strlen(msg), 0);
+}
+
+// --- 자원 사용량 ---
+// STATS [ALL] → SHARE <user> <level> <weight> <sessions> <bytes/s 한도|-> <최근 bytes/s> <누적 bytes>
+//               <ops/s 한도|-> <누적 ops> <기다린 ms> <작업 풀 대기 수> ... EOF
+// 다른 사용자의 사용량(ALL)은 관리자만 본다. 한도를 끈 서버(TALKSHELL_SHARE=0)는 줄 없이 EOF.
+static void handle_stats(ClientSlot *slot, const char *arg)
+{
+    while (*arg == ' ')
+        arg++;
+    bool all = strcasecmp(arg, "ALL") == 0 && slot->permission_level >= JOBS_ADMIN_LEVEL;
+
+    FairShareInfo list[FAIR_SHARE_MAX_ACCOUNTS];
+    size_t n = fair_share_list(all ? NULL : slot->username, list, FAIR_SHARE_MAX_ACCOUNTS);
+
+    TextBuf out = {0};
+    for (size_t i = 0; i < n; i++)
+    {
+        const FairShareInfo *u = &list[i];
+        char line[512], bw[32] = "-", ops[32] = "-";
+        if (u->bytes_limit)
+            snprintf(bw, sizeof(bw), "%llu", u->bytes_limit);
+        if (u->ops_limit)
+            snprintf(ops, sizeof(ops), "%llu", u->ops_limit);
+        snprintf(line, sizeof(line), "SHARE %.63s %d %u %d %s %llu %llu %s %llu %llu %zu\n", u->user, u->level, u->weight,
+                 u->sessions, bw, u->bytes_rate, u->bytes, ops, u->ops, u->throttled_ms,
+                 worker_pool_pending(workers, u->user));
+        text_append(&out, line);
+    }
+    text_append(&out, "EOF\n");
+    send_text_response(slot, &out);
+    text_free(&out);
+}
+
+// --- 파일 따라 읽기 ---
+// TAIL <path>[\tlines=<n>][\tfrom=<offset>] → OK TAIL <id> <offset> <path> / ERR TAIL <path> : <reason>
+// 이후 명령을 기다리는 동안 파일 끝에 붙는 내용이 EVT TAIL 줄로 온다 (file_tail.h).
+// from 은 다시 접속한 뒤 마지막으로 받은 위치부터 이어 읽을 때 쓴다.
+static void handle_tail(ClientSlot *slot, const char *arg)
+{
+    char raw[PATH_MAX], path[PATH_MAX], msg[PATH_MAX * 2 + 128];
+    long lines = 10;
+    long long from = -1;
+
+    while (*arg == ' ')
+        arg++;
+    const char *tab = strchr(arg, '\t');
+    snprintf(raw, sizeof(raw), "%.*s", tab ? (int)(tab - arg) : (int)strlen(arg), arg);
+
+    for (const char *opt = tab; opt; opt = strchr(opt + 1, '\t'))
+    {
+        const char *val = NULL;
+        char *end = NULL;
+        if (strncmp(opt, "\tlines=", 7) == 0)
+            lines = strtol(val = opt + 7, &end, 10);
+        else if (strncmp(opt, "\tfrom=", 6) == 0)
+            from = strtoll(val = opt + 6, &end, 10);
+        if (!val || end == val || (*end && *end != '\t') || lines < 0 || lines > FILE_TAIL_LINES_BURST || from < -1)
+        {
+            int len = (int)strcspn(opt + 1, "\t");
+            snprintf(msg, sizeof(msg), "ERR TAIL : bad option %.*s\n", len, opt + 1);
+            send(slot->sock, msg, strlen(msg), 0);
+            return;
+        }
+    }
+
+    int err = 0;
+    unsigned id = 0;
+    long long offset = 0;
+    if (!raw[0])
+        err = EINVAL;
+    else if (dls_resolve_path(raw, path) != 0)
+        err = errno;
+    else if (!slot->tails && !(slot->tails = file_tails_open()))
+        err = errno;
+    else if (file_tails_add(slot->tails, path, from, (int)lines, &id, &offset) != 0)
+        err = errno;
+
+    if (err)
+    {
+        snprintf(msg, sizeof(msg), "ERR TAIL %s : %s\n", raw, err == E2BIG ? "too many files" : strerror(err));
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+    printf("[server/tail] %s follows %s (id %u)\n", slot->username, path, id);
+    snprintf(msg, sizeof(msg), "OK TAIL %u %lld %s\n", id, offset, path);
+    send(slot->sock, msg, strlen(msg), 0);
+}
+
+// TAIL-STOP [<id>] → OK TAIL-STOP <stopped> / ERR TAIL-STOP <id> : no such tail (id 가 없으면 모두)
+static void handle_tail_stop(ClientSlot *slot, const char *arg)
+{
+    char msg[128];
+    char *end = NULL;
+    while (*arg == ' ')
+        arg++;
+    unsigned long id = *arg ? strtoul(arg, &end, 10) : 0;
+
+    int stopped = slot->tails && (!end || *end == '\0') ? file_tails_remove(slot->tails, (unsigned)id) : 0;
+    if (id != 0 && stopped == 0)
+        snprintf(msg, sizeof(msg), "ERR TAIL-STOP %.32s : no such tail\n", arg);
+    else
+        snprintf(msg, sizeof(msg), "OK TAIL-STOP %d\n", stopped);
+    if (slot->tails && file_tails_count(slot->tails) == 0)
+    {
+        file_tails_close(slot->tails);
+        slot->tails = NULL;
+    }
+    send(slot->sock, msg, strlen(msg), 0);
+}
+
+// --- 디렉토리 변경 알림 ---
+// WATCH [<dir>[\t<dir>...]] → OK WATCH <count> / ERR WATCH <dir> : <reason>
+// 보고 있던 목록을 통째로 바꾼다 (빈 목록이면 끔). 이후 명령을 기다리는 동안 EVT 줄이 온다 (dir_events.h).
+static void handle_watch(ClientSlot *slot, const char *arg)
+{
+    char dirs[DIR_EVENTS_MAX_DIRS][PATH_MAX];
+    const char *list[DIR_EVENTS_MAX_DIRS] = {0};
+    size_t count = 0;
+    char msg[PATH_MAX + 128];
+
+    while (*arg == ' ')
+        arg++;
+
+    while (*arg)
+    {
+        const char *tab = strchr(arg, '\t');
+        size_t len = tab ? (size_t)(tab - arg) : strlen(arg);
+        char raw[PATH_MAX];
+        struct stat st;
+
+        snprintf(raw, sizeof(raw), "%.*s", (int)len, arg);
+        arg += tab ? len + 1 : len;
+        if (!raw[0])
+            continue;
+
+        int err = 0;
+        if (count == DIR_EVENTS_MAX_DIRS)
+            err = E2BIG;
+        else if (dls_resolve_path(raw, dirs[count]) != 0 || stat(dirs[count], &st) != 0)
+            err = errno;
+        else if (!S_ISDIR(st.st_mode))
+            err = ENOTDIR;
+
+        if (err)
+        {
+            snprintf(msg, sizeof(msg), "ERR WATCH %s : %s\n", raw, strerror(err));
+            send(slot->sock, msg, strlen(msg), 0);
+            return;
+        }
+        list[count] = dirs[count];
+        count++;
+    }
+
+    if (!slot->events && count > 0 && !(slot->events = dir_events_open()))
+    {
+        snprintf(msg, sizeof(msg), "ERR WATCH : %s\n", strerror(errno));
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    size_t failed = 0;
+    if (slot->events && dir_events_set(slot->events, list, count, &failed) != 0)
+    {
+        snprintf(msg, sizeof(msg), "ERR WATCH %s : %s\n", list[failed], strerror(errno));
+        send(slot->sock, msg, strlen(msg), 0);
+        return;
+    }
+    if (count == 0)
+    {
+        dir_events_close(slot->events);
+        slot->events = NULL;
+    }
+
+    // 저널을 쓰면 지금의 순번도 알려 준다: 다시 접속한 뒤 CHANGES-SINCE 로 그 사이의 변경을 받을 수 있다
+    if (journal_enabled())
+        snprintf(msg, sizeof(msg), "OK WATCH %zu %" PRIu64 "\n", count, journal_latest());
+    else
+        snprintf(msg, sizeof(msg), "OK WATCH %zu\n", count);
+    send(slot->sock, msg, strlen(msg), 0);
+}
+
+// --- 변경 저널 ---
+// CHANGES-SINCE <seq> [<max>] → CHG <journal 줄> ... SEQ <last> <latest> EOF
+//                              → RESET <latest> EOF (seq 가 남아 있는 범위 밖: 목록을 다시 읽고 latest 부터)
+// last < latest 면 남은 기록이 있으므로 CHANGES-SINCE <last> 로 이어서 받는다.
+#define CHANGES_DEFAULT_MAX 10000
+#define CHANGES_MAX 100000
+
+static bool changes_line(void *ctx, const char *line)
+{
+    TextBuf *out = ctx;
+    text_append(out, "CHG ");
+    text_append(out, line);
+    text_append(out, "\n");
+    return true;
+}
+
+static void handle_changes_since(ClientSlot *slot, const char *arg)
+{
+    char *end = NULL;
+    uint64_t since = strtoull(arg, &end, 10);
+    unsigned long max = CHANGES_DEFAULT_MAX;
+    TextBuf out = {0};
+    char line[128];
+
+    if (end == arg || (*end && *end != ' ') || (*end == ' ' && (max = strtoul(end + 1, NULL, 10)) == 0))
+    {
+        text_append(&out, "ERR CHANGES-SINCE : usage CHANGES-SINCE <seq> [<max>]\n");
+    }
+    else
+    {
+        if (max > CHANGES_MAX)
+            max = CHANGES_MAX;
+
+        uint64_t last;
+        int rc = journal_since(since, max, changes_line, &out, &last);
+        if (rc < 0)
+            snprintf(line, sizeof(line), "ERR CHANGES-SINCE : journal disabled\n");
+        else if (rc > 0)
+            snprintf(line, sizeof(line), "RESET %" PRIu64 "\n", journal_latest());
+        else
+            snprintf(line, sizeof(line), "SEQ %" PRIu64 " %" PRIu64 "\n", last, journal_latest());
+        text_append(&out, line);
+    }
+    text_append(&out, "EOF\n");
+    send_text_response(slot, &out);
+    text_free(&out);
+}
+
+// --- 파일 이름 찾기 ---
+// FIND <dir>[\t<조건>...]  (dir 가 비어 있으면 현재 디렉토리)
+//   name=<glob> iname=<glob> contains=<text> type=f|d
+//   size><n> size<<n> (k/m/g/t 단위), newer=<age> older=<age> (s/m/h/d/w 단위), limit=<n>
+//   그 밖의 단어: glob 문자가 있으면 iname, 없으면 contains
+// 응답: F <d|f> <size> <mtime> <path> ... → END FIND <shown> <matched> <ms> <ready|building> → EOF
+#define FIND_DEFAULT_LIMIT 1000
+#define FIND_MAX_LIMIT 100000
+
+static bool parse_scaled(const char *s, const char *units, const long long *scales, long long *out)
+{
+    char *end = NULL;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (end == s || errno || v < 0)
+        return false;
+    if (*end)
+    {
+        const char *u = strchr(units, tolower((unsigned char)*end));
+        if (!u || end[1])
+            return false;
+        v *= scales[u - units];
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_size(const char *s, long long *out)
+{
+    static const long long scales[] = { 1LL << 10, 1LL << 20, 1LL << 30, 1LL << 40 };
+    return parse_scaled(s, "kmgt", scales, out);
+}
+
+static bool parse_age(const char *s, long long *out)
+{
+    static const long long scales[] = { 1, 60, 3600, 86400, 7 * 86400 };
+    return parse_scaled(s, "smhdw", scales, out);
+}
+
+static bool find_result(void *ctx, bool is_dir, long long size, time_t mtime, const char *path)
+{
+    TextBuf *out = ctx;
+    char head[96];
+    snprintf(head, sizeof(head), "F %c %lld %lld ", is_dir ? 'd' : 'f', size, (long long)mtime);
+    text_append(out, head);
+    text_append(out, path);
+    text_append(out, "\n");
+    return true;
+}
+
+static void handle_find(ClientSlot *slot, const char *arg)
+{
+    char args[PATH_MAX + 1024];
+    char dir[PATH_MAX], line[PATH_MAX + 128];
+    TextBuf out = {0};
+    FindQuery q = { .min_size = -1, .max_size = -1, .limit = FIND_DEFAULT_LIMIT };
+    time_t now = time(NULL);
+    const char *bad = NULL;
+
+    snprintf(args, sizeof(args), "%s", *arg == ' ' ? arg + 1 : arg);
+    char *save = NULL;
+    char *tab = strchr(args, '\t');
+    if (tab)
+        *tab = '\0';
+    const char *raw = args[0] ? args : ".";
+
+    for (char *t = tab ? strtok_r(tab + 1, "\t", &save) : NULL; t && !bad; t = strtok_r(NULL, "\t", &save))
+    {
+        long long v;
+        if (strncmp(t, "name=", 5) == 0 || strncmp(t, "iname=", 6) == 0)
+        {
+            q.glob_icase = t[0] == 'i';
+            q.glob = strchr(t, '=') + 1;
+        }
+        else if (strncmp(t, "contains=", 9) == 0)
+            q.contains = t + 9;
+        else if (strcmp(t, "type=f") == 0 || strcmp(t, "type=d") == 0)
+            q.type = t[5];
+        else if (strncmp(t, "size>", 5) == 0 && parse_size(t + 5, &v))
+            q.min_size = v + 1;
+        else if (strncmp(t, "size<", 5) == 0 && parse_size(t + 5, &v) && v > 0)
+            q.max_size = v - 1;
+        else if (strncmp(t, "newer=", 6) == 0 && parse_age(t + 6, &v))
+            q.newer = now - (time_t)v;
+        else if (strncmp(t, "older=", 6) == 0 && parse_age(t + 6, &v))
+            q.older = now - (time_t)v;
+        else if (strncmp(t, "limit=", 6) == 0 && parse_size(t + 6, &v) && v > 0)
+            q.limit = v > FIND_MAX_LIMIT ? FIND_MAX_LIMIT : (size_t)v;
+        else if (!strchr(t, '=') && !strchr(t, '<') && !strchr(t, '>'))
+        {
+            if (strpbrk(t, "*?["))
+            {
+                q.glob = t;
+                q.glob_icase = true;
+            }
+            else
+                q.contains = t;
+        }
+        else
+            bad = t;
+    }
+
+    FindStats stats;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (bad)
+    {
+        snprintf(line, sizeof(line), "ERR FIND : bad condition %.200s\n", bad);
+        text_append(&out, line);
+    }
+    else if (dls_resolve_path(raw, dir) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR FIND %.200s : %s\n", raw, strerror(errno));
+        text_append(&out, line);
+    }
+    else if (file_index_find(dir, &q, find_result, &out, &stats) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR FIND %.200s : %s\n", raw,
+                 errno == ENOSYS ? "index disabled (start the server with TALKSHELL_INDEX=1)" : errno == ENOENT ? "not indexed yet" : strerror(errno));
+        text_append(&out, line);
+    }
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+        size_t shown = stats.matched < q.limit ? stats.matched : q.limit;
+        snprintf(line, sizeof(line), "END FIND %zu %zu %ld %s\n", shown, stats.matched, ms,
+                 stats.ready ? "ready" : "building");
+        text_append(&out, line);
+    }
+    text_append(&out, "EOF\n");
+    send_text_response(slot, &out);
+    text_free(&out);
+}
+
+// --- 경로 자동 완성 ---
+// COMPLETE <path>[\t<옵션>...]   옵션: d (디렉토리만), base=<dir> (상대 경로의 기준, 기본은 서버 작업 디렉토리),
+//                                limit=<n>
+// path 의 마지막 구성요소로 시작하는 이름을 이름 순으로 돌려준다.
+// 응답: C <d|f> <name> ... → END COMPLETE <shown> <all|more> <ms> → EOF
+#define COMPLETE_DEFAULT_LIMIT 100
+#define COMPLETE_MAX_LIMIT 1000
+
+typedef struct
+{
+    TextBuf *out;
+    size_t left;
+} CompleteReply;
+
+static bool complete_result(void *ctx, const char *name, bool is_dir)
+{
+    CompleteReply *r = ctx;
+    // 줄 단위 응답에 실을 수 없는 이름은 넘긴다
+    if (strchr(name, '\n'))
+        return true;
+    text_append(r->out, is_dir ? "C d " : "C f ");
+    text_append(r->out, name);
+    text_append(r->out, "\n");
+    return --r->left > 0;
+}
+
+static void handle_complete(ClientSlot *slot, const char *arg)
+{
+    char args[PATH_MAX + 256], raw[PATH_MAX * 2], dir[PATH_MAX], line[PATH_MAX + 128];
+    const char *base = NULL, *bad = NULL;
+    bool dirs_only = false;
+    size_t limit = COMPLETE_DEFAULT_LIMIT;
+
+    snprintf(args, sizeof(args), "%s", *arg == ' ' ? arg + 1 : arg);
+    char *save = NULL;
+    char *tab = strchr(args, '\t');
+    if (tab)
+    {
+        *tab = '\0';
+        for (char *t = strtok_r(tab + 1, "\t", &save); t; t = strtok_r(NULL, "\t", &save))
+        {
+            if (strcmp(t, "d") == 0)
+                dirs_only = true;
+            else if (strncmp(t, "base=", 5) == 0 && t[5])
+                base = t + 5;
+            else if (strncmp(t, "limit=", 6) == 0 && atol(t + 6) > 0)
+                limit = atol(t + 6) > COMPLETE_MAX_LIMIT ? COMPLETE_MAX_LIMIT : (size_t)atol(t + 6);
+            else if (!bad)
+                bad = t;
+        }
+    }
+
+    // 마지막 '/' 앞은 찾을 디렉토리, 뒤는 이름의 앞부분
+    char *slash = strrchr(args, '/');
+    const char *prefix = slash ? slash + 1 : args;
+    if (slash == args)
+        snprintf(raw, sizeof(raw), "/");
+    else if (slash)
+        snprintf(raw, sizeof(raw), "%.*s", (int)(slash - args), args);
+    else
+        snprintf(raw, sizeof(raw), ".");
+    int err = 0;
+    if (base && raw[0] != '/')
+    {
+        // 잘린 경로로 엉뚱한 디렉토리를 찾지 않도록 넘치면 거부한다
+        char joined[PATH_MAX + sizeof(raw)];
+        int n = snprintf(joined, sizeof(joined), "%s/%s", base, raw);
+        if (n < 0 || (size_t)n >= sizeof(raw))
+            err = ENAMETOOLONG;
+        else
+            memcpy(raw, joined, (size_t)n + 1);
+    }
+
+    if (!bad && !err && dls_resolve_path(raw, dir) != 0)
+        err = errno;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    TextBuf out = {0};
+    CompleteReply reply = { .out = &out, .left = limit };
+    bool more = false;
+    long shown = bad || err ? -1
+                     : name_cache_complete(dir, prefix, dirs_only,
+                                           strcmp(dir, server_root) == 0 ? TREE_WATCH_PRIVATE_PREFIX : NULL,
+                                           complete_result, &reply, &more);
+    if (shown < 0 && !err)
+        err = errno;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+
+    if (bad)
+        snprintf(line, sizeof(line), "ERR COMPLETE : bad option %.200s\n", bad);
+    else if (err)
+        snprintf(line, sizeof(line), "ERR COMPLETE %.200s : %s\n", raw, strerror(err));
+    else
+        snprintf(line, sizeof(line), "END COMPLETE %ld %s %ld\n", shown, more ? "more" : "all", ms);
+    text_append(&out, line);
+    text_append(&out, "EOF\n");
+    send_text_response(slot, &out);
+    text_free(&out);
+}
+
+// --- 내용 찾기 ---
+// GREP <dir>\t<pattern>[\t<옵션>...]   옵션: i (대소문자 무시), re (확장 정규식), name=<glob>, max=<n>
+// 응답: OK GREP <job> → 찾는 대로 M <path>\t<line>\t<text> ...
+//       → END GREP <matches> <matched files> <files> <binary> <bytes> <ms> <done|limit|cancelled> <skipped>
+// skipped 는 내용 색인(GREP-INDEX)으로 열어 보지 않은 파일 수.
+// 찾는 도중 클라이언트가 CANCEL 한 줄을 보내면 (또는 다른 연결에서 CANCEL <job>) 멈춘다.
+#define GREP_DEFAULT_MAX 1000
+#define GREP_MAX 100000
+#define GREP_FLUSH_BYTES (16 * 1024)
+
+typedef struct
+{
+    ClientSlot *slot;
+    Job *job;
+    TextBuf out;
+    bool cancelled;
+    bool failed;
+} GrepReply;
+
+static void grep_flush(GrepReply *r)
+{
+    if (r->out.len > 0 && !r->failed && slot_send_all(r->slot, r->out.data, r->out.len) != 0)
+        r->failed = true;
+    r->out.len = 0;
+}
+
+static bool grep_match(void *ctx, const char *path, unsigned long long line_no, const char *text, size_t len)
+{
+    GrepReply *r = ctx;
+    char head[PATH_MAX + 64];
+    char body[SEARCH_LINE_MAX + 1];
+
+    // 줄 단위 응답이므로 제어 문자는 '?' 로 바꾼다 (CRLF 의 CR 은 버림)
+    if (len > 0 && text[len - 1] == '\r')
+        len--;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        body[i] = (c < 0x20 && c != '\t') || c == 0x7f ? '?' : (char)c;
+    }
+    body[len] = '\0';
+
+    snprintf(head, sizeof(head), "M %s\t%llu\t", path, line_no);
+    text_append(&r->out, head);
+    text_append(&r->out, body);
+    text_append(&r->out, "\n");
+    if (r->out.len >= GREP_FLUSH_BYTES)
+        grep_flush(r);
+    return !r->failed;
+}
+
+static bool grep_poll(void *ctx, const SearchStats *st)
+{
+    GrepReply *r = ctx;
+    job_set_done(r->job, st->bytes);
+    grep_flush(r);
+    if (job_cancelled(r->job) || slot_cancel_pending(r->slot))
+        r->cancelled = true;
+    return !r->cancelled && !r->failed;
+}
+
+static void handle_grep(ClientSlot *slot, const char *arg)
+{
+    char args[PATH_MAX + 1024], dir[PATH_MAX], line[PATH_MAX + 128];
+    SearchQuery q = { .max_matches = GREP_DEFAULT_MAX };
+    const char *bad = NULL;
+
+    snprintf(args, sizeof(args), "%s", *arg == ' ' ? arg + 1 : arg);
+    char *save = NULL;
+    char *tab = strchr(args, '\t');
+    if (tab)
+    {
+        *tab = '\0';
+        q.pattern = strtok_r(tab + 1, "\t", &save);
+    }
+    for (char *t = q.pattern ? strtok_r(NULL, "\t", &save) : NULL; t && !bad; t = strtok_r(NULL, "\t", &save))
+    {
+        if (strcmp(t, "i") == 0)
+            q.icase = true;
+        else if (strcmp(t, "re") == 0)
+            q.regex = true;
+        else if (strncmp(t, "name=", 5) == 0 && t[5])
+            q.name_glob = t + 5;
+        else if (strncmp(t, "max=", 4) == 0 && atol(t + 4) > 0)
+            q.max_matches = atol(t + 4) > GREP_MAX ? GREP_MAX : (size_t)atol(t + 4);
+        else
+            bad = t;
+    }
+
+    if (!q.pattern || bad)
+    {
+        snprintf(line, sizeof(line), "ERR GREP : %s%.200s\n", bad ? "bad option " : "usage GREP <dir>\\t<pattern>[\\t<option>...]",
+                 bad ? bad : "");
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+    if (dls_resolve_path(args[0] ? args : ".", dir) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR GREP %.200s : %s\n", args, strerror(errno));
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+    char err[256] = "";
+    if (text_search_check(&q, err, sizeof(err)) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR GREP : %s\n", err);
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+
+    // 색인된 디렉토리라면 반드시 들어 있어야 하는 문자열로 열어 볼 파일을 줄인다
+    char required[256];
+    size_t required_len = text_search_literal(&q, required, sizeof(required));
+    ContentFilter *filter = content_filter_new(dir, required, required_len);
+    if (filter)
+    {
+        q.may_match = content_filter_may_match;
+        q.may_match_ctx = filter;
+    }
+
+    GrepReply reply = { .slot = slot, .job = job_begin(slot->username, "grep", dir, "bytes") };
+    snprintf(line, sizeof(line), "OK GREP %u\n", job_id(reply.job));
+    slot_send_all(slot, line, strlen(line));
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    SearchStats st;
+    int rc = text_search(workers, dir, &q, grep_match, grep_poll, &reply, &st, err, sizeof(err));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+    grep_flush(&reply);
+    text_free(&reply.out);
+    content_filter_free(filter);
+
+    job_set_done(reply.job, st.bytes);
+    job_end(reply.job, rc < 0 ? JOB_FAILED : reply.cancelled ? JOB_CANCELLED : JOB_DONE);
+    printf("[server/grep] %s in %s by %s: %llu matches, %llu files (%llu skipped), %llu bytes, %ldms\n", q.pattern,
+           dir, slot->username, st.matches, st.files, st.skipped, st.bytes, ms);
+
+    if (rc < 0)
+        snprintf(line, sizeof(line), "ERR GREP : %s\n", err);
+    else
+        snprintf(line, sizeof(line), "END GREP %llu %llu %llu %llu %llu %ld %s %llu\n", st.matches, st.matched_files,
+                 st.files, st.binary, st.bytes, ms, reply.cancelled ? "cancelled" : rc > 0 ? "limit" : "done",
+                 st.skipped);
+    slot_send_all(slot, line, strlen(line));
+}
+
+// --- 중복 파일 ---
+// DUPES <dir>[\t<옵션>...]   옵션: min=<bytes> (이보다 작은 파일은 보지 않음, 기본 1), limit=<묶음 수>
+// 응답: OK DUPES <job> → 찾는 대로 (큰 파일부터)
+//         DUP <size> <count> <reclaimable> <sha256> 뒤에 P <path> 를 count 줄
+//       → END DUPES <groups> <dup files> <reclaimable> <files> <candidates> <bytes read> <ms> <done|limit|cancelled>
+// 찾는 도중 CANCEL 한 줄을 보내면 (또는 다른 연결에서 CANCEL <job>) 멈춘다.
+#define DUPES_DEFAULT_LIMIT 1000
+#define DUPES_MAX_LIMIT 100000
+
+typedef struct
+{
+    GrepReply reply;
+    size_t left;
+    bool limited;
+} DupesReply;
+
+static bool dupes_group(void *ctx, long long size, const char *sha256, const char *const *paths, size_t n)
+{
+    DupesReply *r = ctx;
+    char head[CHECKSUM_HEX_LEN + 96];
+    snprintf(head, sizeof(head), "DUP %lld %zu %llu %s\n", size, n, (unsigned long long)size * (n - 1), sha256);
+    text_append(&r->reply.out, head);
+    for (size_t i = 0; i < n; i++)
+    {
+        // 줄 단위 응답이므로 개행이 든 경로는 '?' 로 바꾼다
+        text_append(&r->reply.out, "P ");
+        size_t at = r->reply.out.len;
+        text_append(&r->reply.out, paths[i]);
+        for (size_t k = at; k < r->reply.out.len; k++)
+            if (r->reply.out.data[k] == '\n')
+                r->reply.out.data[k] = '?';
+        text_append(&r->reply.out, "\n");
+    }
+    grep_flush(&r->reply);
+    if (--r->left == 0)
+        r->limited = true;
+    return !r->limited && !r->reply.failed;
+}
+
+static bool dupes_poll(void *ctx, const DupesStats *st)
+{
+    DupesReply *r = ctx;
+    job_set_done(r->reply.job, st->bytes_read);
+    grep_flush(&r->reply);
+    if (job_cancelled(r->reply.job) || slot_cancel_pending(r->reply.slot))
+        r->reply.cancelled = true;
+    return !r->reply.cancelled && !r->reply.failed;
+}
+
+static void handle_dupes(ClientSlot *slot, const char *arg)
+{
+    char args[PATH_MAX + 256], dir[PATH_MAX], line[PATH_MAX + 160];
+    long long min_size = 1;
+    size_t limit = DUPES_DEFAULT_LIMIT;
+    const char *bad = NULL;
+
+    snprintf(args, sizeof(args), "%s", *arg == ' ' ? arg + 1 : arg);
+    char *save = NULL;
+    char *tab = strchr(args, '\t');
+    if (tab)
+    {
+        *tab = '\0';
+        for (char *t = strtok_r(tab + 1, "\t", &save); t && !bad; t = strtok_r(NULL, "\t", &save))
+        {
+            if (strncmp(t, "min=", 4) == 0 && atoll(t + 4) >= 0)
+                min_size = atoll(t + 4) > 0 ? atoll(t + 4) : 1;
+            else if (strncmp(t, "limit=", 6) == 0 && atol(t + 6) > 0)
+                limit = atol(t + 6) > DUPES_MAX_LIMIT ? DUPES_MAX_LIMIT : (size_t)atol(t + 6);
+            else
+                bad = t;
+        }
+    }
+
+    if (bad)
+    {
+        snprintf(line, sizeof(line), "ERR DUPES : bad option %.200s\n", bad);
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+    if (dls_resolve_path(args[0] ? args : ".", dir) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR DUPES %.200s : %s\n", args, strerror(errno));
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+
+    DupesReply reply = { .reply = { .slot = slot, .job = job_begin(slot->username, "dupes", dir, "bytes") },
+                         .left = limit };
+    snprintf(line, sizeof(line), "OK DUPES %u\n", job_id(reply.reply.job));
+    slot_send_all(slot, line, strlen(line));
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    DupesStats st;
+    char err[256] = "";
+    int rc = dupes_find(workers, dir, min_size, dupes_group, dupes_poll, &reply, &st, err, sizeof(err));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+    grep_flush(&reply.reply);
+    text_free(&reply.reply.out);
+
+    job_set_done(reply.reply.job, st.bytes_read);
+    job_end(reply.reply.job, rc < 0 ? JOB_FAILED : reply.reply.cancelled ? JOB_CANCELLED : JOB_DONE);
+    printf("[server/dupes] %s by %s: %llu groups, %llu reclaimable bytes, %llu files, %llu bytes read, %ldms\n", dir,
+           slot->username, st.groups, st.reclaimable, st.files, st.bytes_read, ms);
+
+    if (rc < 0)
+        snprintf(line, sizeof(line), "ERR DUPES : %s\n", err);
+    else
+        snprintf(line, sizeof(line), "END DUPES %llu %llu %llu %llu %llu %llu %ld %s\n", st.groups, st.dup_files,
+                 st.reclaimable, st.files, st.candidates, st.bytes_read, ms,
+                 reply.reply.cancelled ? "cancelled" : reply.limited ? "limit" : "done");
+    slot_send_all(slot, line, strlen(line));
+}
+
+// --- 내용 색인 ---
+// GREP-INDEX                 → IDX <files> <binary> <bytes> <dir> ... → QUEUE <n> → EOF
+// GREP-INDEX ON|OFF <dir>    → OK GREP-INDEX ON|OFF <dir> (관리자만)
+static void handle_grep_index(ClientSlot *slot, const char *arg)
+{
+    char line[PATH_MAX + 128], dir[PATH_MAX];
+    while (*arg == ' ')
+        arg++;
+
+    if (*arg == '\0')
+    {
+        ContentIndexInfo info[CONTENT_INDEX_MAX_DIRS];
+        TextBuf out = {0};
+        size_t queued;
+
+        size_t n = content_index_list(info, CONTENT_INDEX_MAX_DIRS, &queued);
+        for (size_t i = 0; i < n; i++)
+        {
+            snprintf(line, sizeof(line), "IDX %llu %llu %llu ", info[i].files, info[i].binary, info[i].bytes);
+            text_append(&out, line);
+            text_append(&out, info[i].dir);
+            text_append(&out, "\n");
+        }
+        snprintf(line, sizeof(line), "QUEUE %zu\nEOF\n", queued);
+        text_append(&out, line);
+        send_text_response(slot, &out);
+        text_free(&out);
+        return;
+    }
+
+    bool on = strncasecmp(arg, "ON ", 3) == 0;
+    if (!on && strncasecmp(arg, "OFF ", 4) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR GREP-INDEX : usage GREP-INDEX [ON|OFF <dir>]\n");
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+    const char *raw = arg + (on ? 3 : 4);
+    if (slot->permission_level < JOBS_ADMIN_LEVEL)
+    {
+        snprintf(line, sizeof(line), "ERR GREP-INDEX %.200s : permission denied\n", raw);
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+    if (dls_resolve_path(raw, dir) != 0)
+    {
+        snprintf(line, sizeof(line), "ERR GREP-INDEX %.200s : %s\n", raw, strerror(errno));
+        send(slot->sock, line, strlen(line), 0);
+        return;
+    }
+
+    int rc = on ? content_index_enable(dir) : content_index_disable(dir);
+    int err = errno;
+    if (rc != 0)
+    {
+        snprintf(line, sizeof(line), "ERR GREP-INDEX %.200s : %s\n", raw,
+                 err == EEXIST ? "already indexed" : err == ENOENT ? "not indexed" : strerror(err));
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "OK GREP-INDEX %s %s\n", on ? "ON" : "OFF", dir);
+        printf("[server/grep-index] %s %s by %s\n", on ? "on" : "off", dir, slot->username);
+    }
+    send(slot->sock, line, strlen(line), 0);
+}
+
+// --- 일괄 작업 ---
+// BATCH <count> <bytes>\n 뒤에 <bytes> 바이트의 항목 목록 (한 줄에 하나, 필드는 탭으로 구분)
+//   DELETE\t<path>
+//   MKDIR[\t-p]\t<path>
+//   STAT\t<path>
+//   MOVE[\t-f]\t<src>\t<dst>
+// 응답: OK BATCH <count> → 끝나는 순서대로 ITEM <n> OK ... / ITEM <n> ERR <reason> → END BATCH <ok> <failed>
+// STAT 결과는 ITEM <n> OK <d|f|l|o> <size> <mtime> <mode(8진)>
+#define BATCH_MAX_ITEMS 10000
+#define BATCH_MAX_BYTES (4 * 1024 * 1024)
+
+// 아직 없을 수도 있는 경로를 절대 경로로 만든다. 마지막 구성요소와 아직 없는 상위 디렉토리는
+// 링크를 따라가지 않고, 존재하는 가장 가까운 상위 디렉토리만 realpath 로 서버 루트 안인지 확인한다.
+static int resolve_new_path(const char *raw, bool allow_root, char out[PATH_MAX])
+{
+    char full[PATH_MAX], norm[PATH_MAX], head[PATH_MAX], resolved[PATH_MAX];
+    size_t n = 0;
+
+    if (raw[0] == '/')
+        snprintf(full, sizeof(full), "%s", raw);
+    else if (!getcwd(head, sizeof(head)) || snprintf(full, sizeof(full), "%s/%s", head, raw) >= (int)sizeof(full))
+        return -1;
+
+    // ".", "..", 빈 구성요소 정리
+    for (char *save = NULL, *c = strtok_r(full, "/", &save); c; c = strtok_r(NULL, "/", &save))
+    {
+        if (strcmp(c, ".") == 0)
+            continue;
+        if (strcmp(c, "..") == 0)
+        {
+            while (n > 0 && norm[--n] != '/')
+                ;
+            continue;
+        }
+        size_t len = strlen(c);
+        if (n + len + 2 > sizeof(norm))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        norm[n++] = '/';
+        memcpy(norm + n, c, len);
+        n += len;
+    }
+    if (n == 0)
+        norm[n++] = '/';
+    norm[n] = '\0';
+
+    // 존재하는 가장 가까운 상위 디렉토리를 찾는다
+    memcpy(head, norm, n + 1);
+    char *cut = strrchr(head, '/');
+    while (1)
+    {
+        *cut = '\0';
+        if (realpath(head[0] ? head : "/", resolved))
+            break;
+        if (errno != ENOENT || !(cut = strrchr(head, '/')))
+            return -1;
+    }
+
+    const char *tail = norm + (cut - head);
+    if (snprintf(out, PATH_MAX, "%s%s", strcmp(resolved, "/") == 0 ? "" : resolved, tail) >= PATH_MAX)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (strcmp(out, "/") != 0 && out[strlen(out) - 1] == '/')
+        out[strlen(out) - 1] = '\0';
+
+    if (!is_path_under_root(out) || (!allow_root && strcmp(out, server_root) == 0))
+    {
+        errno = EPERM;
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct
+{
+    ClientSlot *slot;
+    const size_t *number;   // items 번호 → 요청 안의 항목 번호
+    Job *job;
+    unsigned long long ok;
+    unsigned long long failed;
+} BatchReply;
+
+static void batch_send_item(BatchReply *r, size_t n, int err, const char *detail)
+{
+    char line[PATH_MAX + 128];
+    if (err)
+        snprintf(line, sizeof(line), "ITEM %zu ERR %s\n", n, strerror(err));
+    else
+        snprintf(line, sizeof(line), "ITEM %zu OK%s%s\n", n, detail[0] ? " " : "", detail);
+    slot_send_all(r->slot, line, strlen(line));
+
+    if (err)
+        r->failed++;
+    else
+        r->ok++;
+    job_add_done(r->job, 1);
+}
+
+static bool batch_result(void *ctx, size_t index, const FileOpItem *it)
+{
+    BatchReply *r = ctx;
+    char detail[PATH_MAX + 64] = "";
+
+    if (!it->err && it->kind == FILEOP_STAT)
+    {
+        char type = S_ISDIR(it->st.st_mode) ? 'd' : S_ISREG(it->st.st_mode) ? 'f' : S_ISLNK(it->st.st_mode) ? 'l' : 'o';
+        snprintf(detail, sizeof(detail), "%c %lld %lld %o", type, (long long)it->st.st_size,
+                 (long long)it->st.st_mtime, (unsigned)(it->st.st_mode & 07777));
+    }
+    else if (!it->err && it->kind == FILEOP_MOVE)
+    {
+        snprintf(detail, sizeof(detail), "%s", it->dst);
+    }
+    else if (!it->err)
+    {
+        snprintf(detail, sizeof(detail), "%s", it->path);
+    }
+    batch_send_item(r, r->number[index], it->err, detail);
+    return !job_cancelled(r->job);
+}
+
+// 항목 한 줄을 해석해 경로를 확인한다. 실패하면 errno 를 돌려준다.
+static int batch_parse_item(char *line, FileOpItem *it)
+{
+    char path[PATH_MAX], dst[PATH_MAX];
+    char *field[5];
+    memset(it, 0, sizeof(*it));
+
+    int nf = 0;
+    for (char *save = NULL, *f = strtok_r(line, "\t", &save); f && nf < 5; f = strtok_r(NULL, "\t", &save))
+        field[nf++] = f;
+    if (nf < 2)
+        return EINVAL;
+
+    int argi = 1;
+
+    if (strcasecmp(field[0], "DELETE") == 0)
+        it->kind = FILEOP_DELETE;
+    else if (strcasecmp(field[0], "MKDIR") == 0)
+        it->kind = FILEOP_MKDIR;
+    else if (strcasecmp(field[0], "STAT") == 0)
+        it->kind = FILEOP_STAT;
+    else if (strcasecmp(field[0], "MOVE") == 0)
+        it->kind = FILEOP_MOVE;
+    else
+        return EINVAL;
+
+    if ((it->kind == FILEOP_MKDIR && strcmp(field[1], "-p") == 0) ||
+        (it->kind == FILEOP_MOVE && strcmp(field[1], "-f") == 0))
+    {
+        it->flag = true;
+        argi++;
+    }
+    if (nf != argi + (it->kind == FILEOP_MOVE ? 2 : 1))
+        return EINVAL;
+
+    if (resolve_new_path(field[argi], it->kind == FILEOP_STAT, path) != 0)
+        return errno ? errno : EINVAL;
+    if (it->kind == FILEOP_MOVE && resolve_target_path(field[argi + 1], path, dst) != 0)
+        return errno ? errno : EINVAL;
+
+    it->path = strdup(path);
+    it->dst = it->kind == FILEOP_MOVE ? strdup(dst) : NULL;
+    if (!it->path || (it->kind == FILEOP_MOVE && !it->dst))
+        return ENOMEM;
+    return 0;
+}
+
+static void batch_free_items(FileOpItem *items, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free((char *)items[i].path);
+        free((char *)items[i].dst);
+    }
+    free(items);
+}
+
+static void handle_batch(ClientSlot *slot, const char *buf)
+{
+    long long count = -1, bytes = -1;
+    if (sscanf(buf, "BATCH %lld %lld", &count, &bytes) != 2 || count < 0 || bytes < 0 ||
+        count > BATCH_MAX_ITEMS || bytes > BATCH_MAX_BYTES)
+    {
+        // 뒤따르는 목록의 길이를 믿을 수 없으므로 연결을 끊는다
+        send(slot->sock, "ERR: invalid batch request\n", 27, 0);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char *list = malloc((size_t)bytes + 1);
+    if (!list || slot_recv_exact(slot, list, (size_t)bytes) != 0)
+    {
+        free(list);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+    list[bytes] = '\0';
+
+    size_t n = (size_t)count;
+    FileOpItem *items = calloc(n ? n : 1, sizeof(*items));
+    size_t *number = calloc(n ? n : 1, sizeof(*number));
+    if (!items || !number)
+    {
+        free(list);
+        free(items);
+        free(number);
+        send(slot->sock, "ERR: out of memory\n", 19, 0);
+        return;
+    }
+
+    char line[64];
+    snprintf(line, sizeof(line), "OK BATCH %zu\n", n);
+    slot_send_all(slot, line, strlen(line));
+
+    // 해석/검증에 실패한 항목은 바로 보고하고, 나머지만 실행한다
+    BatchReply reply = { .slot = slot, .number = number };
+    snprintf(line, sizeof(line), "%zu items", n);
+    reply.job = job_begin(slot->username, "batch", line, "items");
+    job_set_total(reply.job, n);
+    size_t valid = 0, seen = 0;
+    char *save = NULL;
+    for (char *l = strtok_r(list, "\n", &save); l && seen < n; l = strtok_r(NULL, "\n", &save), seen++)
+    {
+        int err = batch_parse_item(l, &items[valid]);
+        if (err)
+        {
+            free((char *)items[valid].path);
+            free((char *)items[valid].dst);
+            batch_send_item(&reply, seen, err, "");
+            continue;
+        }
+        number[valid++] = seen;
+    }
+    for (; seen < n; seen++)
+        batch_send_item(&reply, seen, EINVAL, "");
+
+    fileop_batch(workers, items, valid, batch_result, &reply);
+    job_end(reply.job, reply.failed ? JOB_FAILED : JOB_DONE);
+
+    printf("[server/batch] %zu items from %s (%llu ok, %llu failed)\n", n, slot->username, reply.ok, reply.failed);
+    snprintf(line, sizeof(line), "END BATCH %llu %llu\n", reply.ok, reply.failed);
+    slot_send_all(slot, line, strlen(line));
+
+    free(list);
+    batch_free_items(items, valid);
+    free(number);
+}
+
+// --- 파일 해시 ---
+// HASH <count> <bytes>\n 뒤에 <bytes> 바이트의 경로 목록 (한 줄에 하나)
+// 응답: OK HASH <count> → 끝나는 순서대로 ITEM <n> OK <sha256> <size> <cached|read> / ITEM <n> ERR <reason>
+//       → END HASH <ok> <failed> <read bytes> <ms>
+// 업로드 뒤 서버에 저장된 내용을 다시 읽어 확인할 때 쓴다. 바뀌지 않은 파일은 기억해 둔 값을 돌려준다.
+typedef struct
+{
+    BatchReply batch;
+    unsigned long long read_bytes;
+} HashReply;
+
+static bool hash_result(void *ctx, size_t index, const FileHashItem *it)
+{
+    HashReply *r = ctx;
+    char detail[CHECKSUM_HEX_LEN + 48];
+    // 해시는 작업 풀(클라이언트와 같이 쓰는 file_hash) 에서 돌므로 결과를 받을 때 몫에서 뺀다
+    fair_share_ops(1);
+    if (!it->err && !it->cached)
+        fair_share_disk((size_t)it->size);
+    snprintf(detail, sizeof(detail), "%s %lld %s", it->hex, it->size, it->cached ? "cached" : "read");
+    if (!it->err && !it->cached)
+        r->read_bytes += (unsigned long long)it->size;
+    batch_send_item(&r->batch, r->batch.number[index], it->err, detail);
+    return !job_cancelled(r->batch.job);
+}
+
+static void handle_hash(ClientSlot *slot, const char *buf)
+{
+    long long count = -1, bytes = -1;
+    if (sscanf(buf, "HASH %lld %lld", &count, &bytes) != 2 || count < 0 || bytes < 0 ||
+        count > BATCH_MAX_ITEMS || bytes > BATCH_MAX_BYTES)
+    {
+        // 뒤따르는 목록의 길이를 믿을 수 없으므로 연결을 끊는다
+        send(slot->sock, "ERR: invalid hash request\n", 26, 0);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+
+    char *list = malloc((size_t)bytes + 1);
+    if (!list || slot_recv_exact(slot, list, (size_t)bytes) != 0)
+    {
+        free(list);
+        shutdown(slot->sock, SHUT_RDWR);
+        return;
+    }
+    list[bytes] = '\0';
+
+    size_t n = (size_t)count;
+    FileHashItem *items = calloc(n ? n : 1, sizeof(*items));
+    size_t *number = calloc(n ? n : 1, sizeof(*number));
+    if (!items || !number)
+    {
+        free(list);
+        free(items);
+        free(number);
+        send(slot->sock, "ERR: out of memory\n", 19, 0);
+        return;
+    }
+
+    char line[64];
+    snprintf(line, sizeof(line), "OK HASH %zu\n", n);
+    slot_send_all(slot, line, strlen(line));
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    HashReply reply = { .batch = { .slot = slot, .number = number } };
+    snprintf(line, sizeof(line), "%zu files", n);
+    reply.batch.job = job_begin(slot->username, "hash", line, "files");
+    job_set_total(reply.batch.job, n);
+
+    // 서버 루트 밖이거나 없는 경로는 바로 보고하고, 나머지만 해시한다
+    size_t valid = 0, seen = 0;
+    char *save = NULL;
+    for (char *l = strtok_r(list, "\n", &save); l && seen < n; l = strtok_r(NULL, "\n", &save), seen++)
+    {
+        char path[PATH_MAX];
+        if (dls_resolve_path(l, path) != 0 || !(items[valid].path = strdup(path)))
+        {
+            batch_send_item(&reply.batch, seen, errno ? errno : EINVAL, "");
+            continue;
+        }
+        number[valid++] = seen;
+    }
+    for (; seen < n; seen++)
+        batch_send_item(&reply.batch, seen, EINVAL, "");
+
+    file_hash_batch(workers, items, valid, hash_result, &reply);
+    job_end(reply.batch.job, job_cancelled(reply.batch.job) ? JOB_CANCELLED : JOB_DONE);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+
+    printf("[server/hash] %zu files from %s (%llu ok, %llu failed, %llu bytes read, %ldms)\n", n, slot->username,
+           reply.batch.ok, reply.batch.failed, reply.read_bytes, ms);
+    char end[128];
+    snprintf(end, sizeof(end), "END HASH %llu %llu %llu %ld\n", reply.batch.ok, reply.batch.failed,
+             reply.read_bytes, ms);
+    slot_send_all(slot, end, strlen(end));
+
+    free(list);
+    for (size_t i = 0; i < valid; i++)
+        free((char *)items[i].path);
+    free(items);
+    free(number);
+}
+
+static void handle_command(ClientSlot *slot, const char *buf, const char *client_ip, int client_port)
+{
+    // 1. 인증되지 않은 사용자 처리
+    if (!slot->authenticated)
+    {
+        if (buf[0] == '\0') return;
+        if (strncasecmp(buf, "ATTACH ", 7) == 0)
+            handle_attach(slot, buf, client_ip, client_port);
+        else
+            handle_login(slot, buf, client_ip, client_port);
+        return;
+    }
+
+    // 2. 명령어 처리
+    // [수정됨] cd, mkdir 인식 로직 개선 (공백 유무와 상관없이 처리)
+    if (strncmp(buf, "cd", 2) == 0 && (buf[2] == ' ' || buf[2] == '\0'))
+    {
+        char *path = (char*)buf + 2;
+        while (*path == ' ') path++; // 공백 건너뛰기
+
+        if (*path == '\0') {
+             // 경로가 없으면 에러 (혹은 홈 디렉토리로 이동 구현 가능)
+             send(slot->sock, "ERR: path required\n", 19, 0);
+        }
+        else if (chdir(path) == 0)
+            send(slot->sock, "OK: changed directory\n", 22, 0);
+        else
+            send(slot->sock, "ERR: invalid path\n", 18, 0);
+    }
+    else if (strncmp(buf, "mkdir", 5) == 0 && (buf[5] == ' ' || buf[5] == '\0'))
+    {
+        char *path = (char*)buf + 5;
+        while (*path == ' ') path++;
+
+        if (*path == '\0') {
+             send(slot->sock, "ERR: path required\n", 19, 0);
+        }
+        else if (mkdir(path, 0755) == 0)
+            send(slot->sock, "OK: dir created\n", 16, 0);
+        else
+            send(slot->sock, "ERR: mkdir failed\n", 18, 0);
+    }
+    else if (strncmp(buf, "ls", 2) == 0)
+    {
+        char tmpbuf[1024];
+        TextBuf out = {0};
+        FILE *fp = popen("ls -al", "r");
+        if (fp) {
+            while (fgets(tmpbuf, sizeof(tmpbuf), fp))
+                text_append(&out, tmpbuf);
+            pclose(fp);
+        }
+        text_append(&out, "EOF\n");
+        send_text_response(slot, &out);
+        text_free(&out);
+    }
+    else if (strncmp(buf, "dls", 3) == 0 && (buf[3] == ' ' || buf[3] == '\0'))
+    {
+        handle_dls(slot, buf + 3);
+    }
+    else if (strncasecmp(buf, "COMPRESS ", 9) == 0)
+    {
+        handle_compress(slot, buf + 9);
+    }
+    else if (strncasecmp(buf, "UPLOAD PLAN", 11) == 0)
+    {
+        handle_upload_plan(slot, buf);
+    }
+    else if (strncasecmp(buf, "UPLOAD START", 12) == 0)
+    {
+        handle_upload_start(slot, buf);
+    }
+    else if (strcasecmp(buf, "UPLOAD TREE") == 0)
+    {
+        handle_upload_tree(slot);
+    }
+    else if (strncasecmp(buf, "UPLOAD FD ", 10) == 0)
+    {
+        handle_upload_fd(slot, buf);
+    }
+    else if (strncasecmp(buf, "UPLOAD HAVE ", 12) == 0)
+    {
+        handle_upload_have(slot, buf);
+    }
+    else if (strcasecmp(buf, "UPLOAD DELTA SIGS") == 0)
+    {
+        handle_upload_delta_sigs(slot);
+    }
+    else if (strncasecmp(buf, "UPLOAD DELTA ", 13) == 0)
+    {
+        handle_upload_delta(slot, buf);
+    }
+    else if (strncasecmp(buf, "UPLOAD INIT ", 12) == 0)
+    {
+        handle_upload_init(slot, buf);
+    }
+    else if (strncasecmp(buf, "UPLOAD MISSING ", 15) == 0)
+    {
+        handle_upload_missing(slot, buf);
+    }
+    else if (strncasecmp(buf, "UPLOAD CHUNK ", 13) == 0)
+    {
+        handle_upload_chunk(slot, buf);
+    }
+    else if (strncasecmp(buf, "UPLOAD FINISH ", 14) == 0)
+    {
+        handle_upload_finish(slot, buf);
+    }
+    else if (strncasecmp(buf, "SYNC MANIFEST ", 14) == 0)
+    {
+        handle_sync_manifest(slot, buf);
+    }
+    else if (strncasecmp(buf, "SYNC PUSH ", 10) == 0)
+    {
+        handle_sync_push(slot, buf);
+    }
+    else if (strncasecmp(buf, "DOWNLOAD TREE ", 14) == 0)
+    {
+        handle_download_tree(slot, buf);
+    }
+    else if (strncasecmp(buf, "DOWNLOAD ", 9) == 0)
+    {
+        handle_download(slot, buf);
+    }
+    else if (strncasecmp(buf, "STREAMS ", 8) == 0)
+    {
+        handle_streams(slot, buf);
+    }
+    else if (strcasecmp(buf, "JOBS") == 0 || strncasecmp(buf, "JOBS ", 5) == 0)
+    {
+        handle_jobs(slot, buf + 4);
+    }
+    else if (strcasecmp(buf, "STATS") == 0 || strncasecmp(buf, "STATS ", 6) == 0)
+    {
+        handle_stats(slot, buf + 5);
+    }
+    else if (strncasecmp(buf, "CANCEL ", 7) == 0)
+    {
+        handle_cancel(slot, buf + 7);
+    }
+    else if (strncasecmp(buf, "FIND", 4) == 0 && (buf[4] == '\0' || buf[4] == ' ' || buf[4] == '\t'))
+    {
+        handle_find(slot, buf + 4);
+    }
+    else if (strncasecmp(buf, "COMPLETE", 8) == 0 && (buf[8] == '\0' || buf[8] == ' ' || buf[8] == '\t'))
+    {
+        handle_complete(slot, buf + 8);
+    }
+    else if (strncasecmp(buf, "DUPES", 5) == 0 && (buf[5] == '\0' || buf[5] == ' ' || buf[5] == '\t'))
+    {
+        handle_dupes(slot, buf + 5);
+    }
+    else if (strncasecmp(buf, "GREP-INDEX", 10) == 0 && (buf[10] == '\0' || buf[10] == ' '))
+    {
+        handle_grep_index(slot, buf + 10);
+    }
+    else if (strncasecmp(buf, "GREP", 4) == 0 && (buf[4] == ' ' || buf[4] == '\t'))
+    {
+        handle_grep(slot, buf + 4);
+    }
+    else if (strncasecmp(buf, "CHANGES-SINCE ", 14) == 0)
+    {
+        handle_changes_since(slot, buf + 14);
+    }
+    else if (strncasecmp(buf, "TAIL-STOP", 9) == 0 && (buf[9] == '\0' || buf[9] == ' '))
+    {
+        handle_tail_stop(slot, buf + 9);
+    }
+    else if (strncasecmp(buf, "TAIL ", 5) == 0)
+    {
+        handle_tail(slot, buf + 5);
+    }
+    else if (strcasecmp(buf, "WATCH") == 0 || strncasecmp(buf, "WATCH ", 6) == 0)
+    {
+        handle_watch(slot, buf + 5);
+    }
+    else if (strncasecmp(buf, "HASH ", 5) == 0)
+    {
+        handle_hash(slot, buf);
+    }
+    else if (strncasecmp(buf, "BATCH ", 6) == 0)
+    {
+        handle_batch(slot, buf);
+    }
+    else if (strncasecmp(buf, "COPY ", 5) == 0)
+    {
+        handle_copy(slot, buf);
+    }
+    else if (strncasecmp(buf, "MOVE ", 5) == 0)
+    {
+        handle_move(slot, buf);
+    }
+    else if (strncasecmp(buf, "DELETE ", 7) == 0)
+    {
+        const char *raw_path = buf + 7;
+        while (*raw_path == ' ')
+            raw_path++;
+
+        if (!*raw_path)
+        {
+            const char *msg = "ERR DELETE : invalid path\n";
+            send(slot->sock, msg, strlen(msg), 0);
+            return;
+        }
+
+        char resolved[PATH_MAX];
+        if (!realpath(raw_path, resolved))
+        {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "ERR DELETE %s : %s\n", raw_path, strerror(errno));
+            send(slot->sock, msg, strlen(msg), 0);
+            return;
+        }
+
+        if (!is_path_under_root(resolved) || strcmp(resolved, server_root) == 0)
+        {
             const char *msg = "ERR INVALID_PATH\n";
             send(slot->sock, msg, strlen(msg), 0);
             return;
         }
 
-        if (delete_path_recursive(resolved) == 0)
+        Job *job = job_begin(slot->username, "delete", resolved, "entries");
+        job_set_total(job, 1);
+        int rc = delete_path_recursive(resolved, job);
+        job_end(job, rc == 0 ? JOB_DONE : JOB_FAILED);
+
+        if (rc == 0)
         {
             char msg[PATH_MAX + 32];
             snprintf(msg, sizeof(msg), "OK DELETE %s\n", resolved);
@@ -630,31 +4038,52 @@ void *client_handler(void *arg)
     ClientSlot *slot = (ClientSlot *)arg;
     int sock = slot->sock;
 
-    struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-    getpeername(sock, (struct sockaddr *)&addr, &len);
-
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, client_ip, sizeof(client_ip));
-    int client_port = ntohs(addr.sin_port);
+    char client_ip[INET_ADDRSTRLEN] = "local";
+    int client_port = 0;
+    if (slot->local)
+    {
+        // Unix 소켓에는 주소가 없으므로 상대 프로세스 번호로 구분한다
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+            client_port = (int)cred.pid;
+    }
+    else
+    {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        getpeername(sock, (struct sockaddr *)&addr, &len);
+        inet_ntop(AF_INET, &addr.sin_addr, client_ip, sizeof(client_ip));
+        client_port = ntohs(addr.sin_port);
+    }
 
     printf("🟢 Client connected: %s:%d\n", client_ip, client_port);
     send(sock, "INFO: login required\n", 21, 0);
 
+    // 클라이언트의 SOCKET_COMMAND_MAX 가 이 크기에 맞춰져 있다
     char buf[BUFFER_SIZE];
     while (1)
     {
-        ssize_t n = recv(sock, buf, sizeof(buf) - 1, 0);
-        if (n <= 0) break; // 연결 종료 또는 에러
+        slot_wait_command(slot);
+        ssize_t n = slot_read_line(slot, buf, sizeof(buf));
+        if (n == SLOT_LINE_TOO_LONG) {
+            send(sock, "ERR line too long\n", 18, 0);
+            continue;
+        }
+        if (n < 0) break; // 연결 종료 또는 에러
 
-        buf[n] = '\0';
         trim_whitespace(buf);
         if (strlen(buf) > 0) {
+            slot_set_busy(slot, true);
             handle_command(slot, buf, client_ip, client_port);
+            slot_set_busy(slot, false);
         }
     }
 
     printf("🔴 Client disconnected: %s:%d\n", client_ip, client_port);
+    upload_key_abandon(slot);
+    fair_share_unbind();
+    worker_pool_set_owner(NULL, 1);
     close(sock);
 
     // 슬롯 초기화
@@ -664,11 +4093,120 @@ void *client_handler(void *arg)
     slot->username[0] = '\0';
     slot->permission_level = 0;
     slot->pending_upload_file[0] = '\0';
+    slot->pending_upload_dir[0] = '\0';
+    slot->compress = false;
+    slot->data = false;
+    slot->busy = false;
+    free(slot->held);
+    slot->held = NULL;
+    slot->held_len = slot->held_cap = 0;
+    delta_base_release(slot);
+    slot->rlen = 0;
+    dir_events_close(slot->events);
+    slot->events = NULL;
+    file_tails_close(slot->tails);
+    slot->tails = NULL;
     pthread_mutex_unlock(&lock);
 
     return NULL;
 }
 
+// 같은 호스트의 클라이언트용 Unix 소켓 (경로 규칙은 local_socket.h).
+// 기본 디렉토리는 없으면 0755 로 만든다. 디렉토리를 믿을 수 없으면(다른 사용자 소유, 누구나 쓸 수 있음)
+// Unix 소켓 없이 TCP 만 연다. 죽은 서버가 남긴 소켓 파일은 지우고 다시 만들지만, 다른 서버가 이미 듣고
+// 있으면 같은 포트를 두 서버가 나눠 갖지 않도록 멈춘다.
+static int listen_unix(int port, char *path, size_t path_len)
+{
+    if (!local_socket_path(port, path, path_len))
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "[WARN] Unix socket path too long: %s\n", path);
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    if (strncmp(path, LOCAL_SOCKET_DIR "/", sizeof(LOCAL_SOCKET_DIR)) == 0 && mkdir(LOCAL_SOCKET_DIR, 0755) != 0 &&
+        errno != EEXIST)
+    {
+        fprintf(stderr, "[WARN] Cannot create %s: %s (local clients use TCP)\n", LOCAL_SOCKET_DIR, strerror(errno));
+        return -1;
+    }
+    if (!local_socket_dir_trusted(path, geteuid()))
+    {
+        fprintf(stderr, "[WARN] Directory of %s is writable by other users or not ours (local clients use TCP)\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            fprintf(stderr, "[ERROR] Another server is listening on %s\n", path);
+            exit(1);
+        }
+        unlink(path);
+    }
+
+    // 로그인은 따로 하므로 같은 호스트의 누구나 붙을 수 있게 둔다 (디렉토리는 서버만 쓸 수 있다)
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || chmod(path, 0666) != 0 || listen(fd, 5) != 0)
+    {
+        fprintf(stderr, "[WARN] Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 빈 칸에 연결을 넣고 처리 스레드를 띄운다
+static void start_client(int clnt_sock, bool local)
+{
+    pthread_mutex_lock(&lock);
+    ClientSlot *target_slot = NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (clients[i].sock == 0)
+        {
+            clients[i].sock = clnt_sock;
+            // 초기화
+            clients[i].authenticated = false;
+            clients[i].username[0] = '\0';
+            clients[i].pending_upload_file[0] = '\0';
+            clients[i].pending_upload_dir[0] = '\0';
+            clients[i].compress = false;
+            clients[i].data = false;
+            clients[i].delta_base_fd = -1;
+            clients[i].rlen = 0;
+            clients[i].local = local;
+            clients[i].upload_key[0] = '\0';
+            target_slot = &clients[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!target_slot)
+    {
+        const char *msg = "ERR: server busy\n";
+        send(clnt_sock, msg, strlen(msg), 0);
+        close(clnt_sock);
+        return;
+    }
+
+    traffic_class_mark(clnt_sock, false);
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, client_handler, target_slot);
+    pthread_detach(tid);
+}
+
 // --- 메인 함수 ---
 
 int main(int argc, char *argv[])
@@ -676,6 +4214,10 @@ int main(int argc, char *argv[])
     char host[256] = "127.0.0.1";
     int port = DEFAULT_PORT;
 
+    // 먼저 끊은 클라이언트에 쓰면 서버 전체가 죽지 않고 EPIPE 로 끝나게 한다
+    // (Unix 소켓은 상대가 닫자마자 다음 쓰기에서 SIGPIPE 가 난다)
+    signal(SIGPIPE, SIG_IGN);
+
     // 인증 모듈 초기화
     if (!auth_init()) {
         fprintf(stderr, "[WARN] Failed to initialize authentication state.\n");
@@ -710,6 +4252,25 @@ int main(int argc, char *argv[])
     {
         getcwd(server_root, sizeof(server_root));
     }
+
+    upload_session_on_drop(upload_session_dropped);
+    if (upload_dedup_init(server_root) != 0)
+        fprintf(stderr, "[WARN] Cannot create dedup store under %s\n", server_root);
+    else if (upload_dedup_enabled())
+        printf("🗃  Dedup store: %s/%s\n", server_root, UPLOAD_DEDUP_DIR);
+    if (journal_init(server_root) != 0)
+        fprintf(stderr, "[WARN] Cannot open change journal under %s\n", server_root);
+    else if (journal_enabled())
+        printf("📝 Change journal: %s/%s (seq %" PRIu64 ")\n", server_root, JOURNAL_DIR, journal_latest());
+    if (file_index_init(server_root) != 0)
+        fprintf(stderr, "[WARN] Cannot build file name index for %s\n", server_root);
+    else if (file_index_enabled())
+        printf("🔎 File name index: %s\n", server_root);
+    if (content_index_init(server_root) != 0)
+        fprintf(stderr, "[WARN] Cannot start content index for %s\n", server_root);
+    // 루트 전체의 재귀 감시는 쓰는 기능이 켜졌을 때만 (내용 색인은 처음 켤 때 스스로 시작한다)
+    if ((journal_enabled() || file_index_enabled() || content_index_active()) && tree_watch_start(server_root) != 0)
+        fprintf(stderr, "[WARN] Cannot watch %s for changes: %s\n", server_root, strerror(errno));
     printf("📁 Server base directory: /home\n");
 
     int serv_sock, clnt_sock;
@@ -730,45 +4291,44 @@ int main(int argc, char *argv[])
     if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
         error_handling("bind() error");
 
+    workers = worker_pool_create(0);
+    if (!fair_share_init())
+        printf("[server/share] Per-user limits disabled (TALKSHELL_SHARE=0)\n");
+    // 풀 작업도 맡긴 세션의 몫에서 쓴다
+    worker_pool_set_context(fair_share_current, fair_share_adopt);
+
     if (listen(serv_sock, 5) == -1)
         error_handling("listen() error");
 
     printf("🚀 ChatOps server listening on port %d...\n", port);
 
+    char unix_path[PATH_MAX];
+    int unix_sock = listen_unix(port, unix_path, sizeof(unix_path));
+    if (unix_sock >= 0)
+        printf("🔌 Local clients: %s\n", unix_path);
+
     while (1)
     {
-        clnt_addr_size = sizeof(clnt_addr);
-        clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
-        if (clnt_sock == -1) continue;
+        struct pollfd pfd[2] = {
+            { .fd = serv_sock, .events = POLLIN },
+            { .fd = unix_sock, .events = POLLIN },
+        };
+        if (poll(pfd, 2, -1) < 0)
+            continue;
 
-        pthread_mutex_lock(&lock);
-        ClientSlot *target_slot = NULL;
-        for (int i = 0; i < MAX_CLIENTS; i++)
+        if (pfd[0].revents & POLLIN)
         {
-            if (clients[i].sock == 0)
-            {
-                clients[i].sock = clnt_sock;
-                // 초기화
-                clients[i].authenticated = false;
-                clients[i].username[0] = '\0';
-                clients[i].pending_upload_file[0] = '\0';
-                target_slot = &clients[i];
-                break;
-            }
+            clnt_addr_size = sizeof(clnt_addr);
+            clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+            if (clnt_sock != -1)
+                start_client(clnt_sock, false);
         }
-        pthread_mutex_unlock(&lock);
-
-        if (!target_slot)
+        if (pfd[1].revents & POLLIN)
         {
-            const char *msg = "ERR: server busy\n";
-            send(clnt_sock, msg, strlen(msg), 0);
-            close(clnt_sock);
-            continue;
+            clnt_sock = accept(unix_sock, NULL, NULL);
+            if (clnt_sock != -1)
+                start_client(clnt_sock, true);
         }
-
-        pthread_t tid;
-        pthread_create(&tid, NULL, client_handler, target_slot);
-        pthread_detach(tid);
     }
 
     close(serv_sock);
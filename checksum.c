@@ -0,0 +1,216 @@
+#include "checksum.h"
+
+#include <openssl/evp.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ChecksumCtx
+{
+    EVP_MD_CTX *md;
+};
+
+static void to_hex(const unsigned char *in, size_t len, char *out_hex)
+{
+    for (size_t i = 0; i < len; i++)
+        sprintf(out_hex + (i * 2), "%02x", in[i]);
+    out_hex[len * 2] = '\0';
+}
+
+// ------------------------------------------------------------
+// XXH64 (리틀엔디언 기준 구현)
+// ------------------------------------------------------------
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+uint64_t checksum_fast64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32)
+    {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + XXH_P1 + XXH_P2;
+        uint64_t v2 = seed + XXH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_P1;
+
+        do
+        {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    }
+    else
+    {
+        h = seed + XXH_P5;
+    }
+
+    h += (uint64_t)len;
+
+    while (p + 8 <= end)
+    {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+        p += 8;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)read32(p) * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+
+    while (p < end)
+    {
+        h ^= (*p) * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+void rolling_init(RollingSum *r, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint32_t a = 0, b = 0;
+
+    // 첫 바이트의 가중치가 len, 마지막 바이트가 1
+    for (size_t i = 0; i < len; i++)
+    {
+        a += p[i];
+        b += (uint32_t)(len - i) * p[i];
+    }
+
+    r->a = a;
+    r->b = b;
+    r->len = (uint32_t)len;
+}
+
+ChecksumCtx *checksum_begin(void)
+{
+    ChecksumCtx *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+
+    ctx->md = EVP_MD_CTX_new();
+    if (!ctx->md || EVP_DigestInit_ex(ctx->md, EVP_sha256(), NULL) != 1)
+    {
+        EVP_MD_CTX_free(ctx->md);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void checksum_update(ChecksumCtx *ctx, const void *data, size_t len)
+{
+    if (ctx && len > 0)
+        EVP_DigestUpdate(ctx->md, data, len);
+}
+
+void checksum_end(ChecksumCtx *ctx, char out_hex[CHECKSUM_HEX_LEN])
+{
+    out_hex[0] = '\0';
+    if (!ctx)
+        return;
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int dlen = 0;
+    if (EVP_DigestFinal_ex(ctx->md, digest, &dlen) == 1)
+        to_hex(digest, dlen, out_hex);
+
+    EVP_MD_CTX_free(ctx->md);
+    free(ctx);
+}
+
+bool checksum_file(const char *path, char out_hex[CHECKSUM_HEX_LEN])
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    ChecksumCtx *ctx = checksum_begin();
+    if (!ctx)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        checksum_update(ctx, buf, n);
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+    checksum_end(ctx, out_hex);
+    return ok && out_hex[0] != '\0';
+}
+
+bool checksum_is_hex(const char *s)
+{
+    if (!s || strlen(s) != CHECKSUM_HEX_LEN - 1)
+        return false;
+
+    for (const char *p = s; *p; p++)
+    {
+        if (!isxdigit((unsigned char)*p))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 업로드 무결성 검증용 SHA-256 (hex 64자 + NUL)
+#define CHECKSUM_HEX_LEN 65
+
+typedef struct ChecksumCtx ChecksumCtx;
+
+// 스트리밍 해시: 수신하면서 바로 누적할 때 사용
+ChecksumCtx *checksum_begin(void);
+void checksum_update(ChecksumCtx *ctx, const void *data, size_t len);
+// 최종 digest 를 hex 로 기록하고 ctx 를 해제한다.
+void checksum_end(ChecksumCtx *ctx, char out_hex[CHECKSUM_HEX_LEN]);
+
+// 청크 단위 검증용 고속 64비트 해시 (XXH64 호환)
+uint64_t checksum_fast64(const void *data, size_t len, uint64_t seed);
+
+// rsync 방식 약한 롤링 체크섬: 창을 한 바이트 밀 때 O(1) 로 갱신된다.
+// 충돌이 있을 수 있으므로 일치 후보는 checksum_fast64 로 다시 확인한다.
+typedef struct
+{
+    uint32_t a;     // 바이트 합
+    uint32_t b;     // 위치 가중 합
+    uint32_t len;   // 창 크기
+} RollingSum;
+
+void rolling_init(RollingSum *r, const void *data, size_t len);
+
+// 창에서 out 이 빠지고 in 이 들어온다
+static inline void rolling_roll(RollingSum *r, unsigned char out, unsigned char in)
+{
+    r->a += (uint32_t)in - out;
+    r->b += r->a - r->len * out;
+}
+
+static inline uint32_t rolling_digest(const RollingSum *r)
+{
+    return (r->a & 0xffff) | (r->b << 16);
+}
+
+bool checksum_file(const char *path, char out_hex[CHECKSUM_HEX_LEN]);
+bool checksum_is_hex(const char *s);
+
+#endif
@@ -0,0 +1,446 @@
+// compress.c
+#include "compress.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// 표본 크기와 개수, 압축할 가치가 있다고 볼 최소 절감률
+#define SAMPLE_SIZE 4096
+#define SAMPLE_COUNT 3
+#define SAMPLE_MAX_RATIO 0.90
+
+size_t compress_bound(size_t len)
+{
+    return (size_t)compressBound((uLong)len);
+}
+
+int compress_buffer(const void *in, size_t len, void *out, size_t *out_len, int level)
+{
+    uLongf n = compressBound((uLong)len);
+    if (level <= COMPRESS_LEVEL_NONE ||
+        compress2((Bytef *)out, &n, (const Bytef *)in, (uLong)len, level) != Z_OK || n >= len)
+        return -1;
+
+    *out_len = n;
+    return 0;
+}
+
+int decompress_buffer(const void *in, size_t len, void *out, size_t out_len)
+{
+    uLongf n = out_len;
+    if (uncompress((Bytef *)out, &n, (const Bytef *)in, (uLong)len) != Z_OK || n != out_len)
+        return -1;
+    return 0;
+}
+
+static bool samples_worthwhile(const unsigned char *const *samples, const size_t *lens, int count)
+{
+    unsigned char out[SAMPLE_SIZE + SAMPLE_SIZE / 8 + 64];
+    size_t in_total = 0, out_total = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        uLongf n = sizeof(out);
+        if (lens[i] == 0)
+            continue;
+        if (compress2(out, &n, samples[i], (uLong)lens[i], COMPRESS_LEVEL_FAST) != Z_OK)
+            n = lens[i];
+        in_total += lens[i];
+        out_total += n;
+    }
+
+    return in_total > 0 && (double)out_total < (double)in_total * SAMPLE_MAX_RATIO;
+}
+
+bool compress_worthwhile(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    const unsigned char *samples[SAMPLE_COUNT];
+    size_t lens[SAMPLE_COUNT];
+
+    if (len <= SAMPLE_SIZE * SAMPLE_COUNT)
+    {
+        samples[0] = p;
+        lens[0] = len;
+        return samples_worthwhile(samples, lens, 1);
+    }
+
+    // 앞, 가운데, 끝에서 하나씩
+    for (int i = 0; i < SAMPLE_COUNT; i++)
+    {
+        size_t off = (len - SAMPLE_SIZE) / (SAMPLE_COUNT - 1) * (size_t)i;
+        samples[i] = p + off;
+        lens[i] = SAMPLE_SIZE;
+    }
+    return samples_worthwhile(samples, lens, SAMPLE_COUNT);
+}
+
+bool compress_file_worthwhile(int fd, long long size)
+{
+    unsigned char buf[SAMPLE_COUNT][SAMPLE_SIZE];
+    const unsigned char *samples[SAMPLE_COUNT];
+    size_t lens[SAMPLE_COUNT];
+    int count = 0;
+
+    for (int i = 0; i < SAMPLE_COUNT; i++)
+    {
+        long long off = (size > SAMPLE_SIZE) ? (size - SAMPLE_SIZE) / (SAMPLE_COUNT - 1) * i : 0;
+        ssize_t n = pread(fd, buf[count], SAMPLE_SIZE, (off_t)off);
+        if (n <= 0)
+            continue;
+        samples[count] = buf[count];
+        lens[count] = (size_t)n;
+        count++;
+        if (size <= SAMPLE_SIZE)
+            break;
+    }
+    return samples_worthwhile(samples, lens, count);
+}
+
+// ------------------------------------------------------------
+// FrameWriter
+// ------------------------------------------------------------
+typedef struct
+{
+    FrameWriter *fw;
+    char *raw;
+    size_t raw_len;
+    char *out;
+    size_t out_len;
+    bool compressed;
+    bool done;
+} FrameBlock;
+
+struct FrameWriter
+{
+    WorkerPool *pool;
+    int level;
+    int (*write)(void *ctx, const void *buf, size_t len);
+    void *ctx;
+
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+
+    // 압축 중이거나 보낼 차례를 기다리는 블록 (넣은 순서대로)
+    FrameBlock **window;
+    size_t window_cap;
+    size_t head;
+    size_t count;
+
+    bool failed;
+    unsigned long long raw_bytes;
+    unsigned long long wire_bytes;
+};
+
+static void compress_block(FrameBlock *b, int level)
+{
+    b->compressed = false;
+    if (level <= COMPRESS_LEVEL_NONE || !compress_worthwhile(b->raw, b->raw_len))
+        return;
+
+    b->out = malloc(compress_bound(b->raw_len));
+    if (b->out && compress_buffer(b->raw, b->raw_len, b->out, &b->out_len, level) == 0)
+        b->compressed = true;
+}
+
+static void compress_task(void *arg)
+{
+    FrameBlock *b = arg;
+    compress_block(b, b->fw->level);
+
+    pthread_mutex_lock(&b->fw->mu);
+    b->done = true;
+    pthread_cond_broadcast(&b->fw->cv);
+    pthread_mutex_unlock(&b->fw->mu);
+}
+
+static void block_free(FrameBlock *b)
+{
+    free(b->raw);
+    free(b->out);
+    free(b);
+}
+
+// 가장 오래된 블록의 압축이 끝나길 기다렸다가 보낸다
+static void emit_oldest(FrameWriter *fw)
+{
+    FrameBlock *b = fw->window[fw->head];
+
+    pthread_mutex_lock(&fw->mu);
+    while (!b->done)
+        pthread_cond_wait(&fw->cv, &fw->mu);
+    pthread_mutex_unlock(&fw->mu);
+
+    fw->head = (fw->head + 1) % fw->window_cap;
+    fw->count--;
+
+    if (!fw->failed)
+    {
+        char header[64];
+        const void *body;
+        size_t body_len;
+        int hl;
+
+        if (b->compressed)
+        {
+            hl = snprintf(header, sizeof(header), "Z %zu %zu\n", b->raw_len, b->out_len);
+            body = b->out;
+            body_len = b->out_len;
+        }
+        else
+        {
+            hl = snprintf(header, sizeof(header), "R %zu\n", b->raw_len);
+            body = b->raw;
+            body_len = b->raw_len;
+        }
+
+        if (fw->write(fw->ctx, header, (size_t)hl) != 0 || fw->write(fw->ctx, body, body_len) != 0)
+            fw->failed = true;
+
+        fw->raw_bytes += b->raw_len;
+        fw->wire_bytes += (unsigned long long)hl + body_len;
+    }
+
+    block_free(b);
+}
+
+FrameWriter *frame_writer_new(WorkerPool *pool, int level,
+                              int (*write)(void *ctx, const void *buf, size_t len), void *ctx)
+{
+    FrameWriter *fw = calloc(1, sizeof(*fw));
+    if (!fw)
+        return NULL;
+
+    fw->pool = pool;
+    fw->level = level;
+    fw->write = write;
+    fw->ctx = ctx;
+
+    // 코어마다 하나씩 압축하면서 다음 블록도 준비할 수 있을 만큼만 앞서 나간다
+    int threads = worker_pool_size(pool);
+    fw->window_cap = threads > 0 ? (size_t)threads * 2 : 1;
+    fw->window = calloc(fw->window_cap, sizeof(FrameBlock *));
+    if (!fw->window)
+    {
+        free(fw);
+        return NULL;
+    }
+
+    pthread_mutex_init(&fw->mu, NULL);
+    pthread_cond_init(&fw->cv, NULL);
+    return fw;
+}
+
+int frame_writer_put(FrameWriter *fw, const void *data, size_t len)
+{
+    if (fw->failed)
+        return -1;
+    if (len == 0)
+        return 0;
+
+    if (fw->count == fw->window_cap)
+        emit_oldest(fw);
+
+    FrameBlock *b = calloc(1, sizeof(*b));
+    if (!b || !(b->raw = malloc(len)))
+    {
+        free(b);
+        fw->failed = true;
+        return -1;
+    }
+    memcpy(b->raw, data, len);
+    b->raw_len = len;
+    b->fw = fw;
+
+    fw->window[(fw->head + fw->count) % fw->window_cap] = b;
+    fw->count++;
+
+    if (fw->level <= COMPRESS_LEVEL_NONE || worker_pool_submit(fw->pool, compress_task, b) != 0)
+    {
+        compress_block(b, fw->level);
+        b->done = true;
+    }
+
+    return fw->failed ? -1 : 0;
+}
+
+int frame_writer_finish(FrameWriter *fw, unsigned long long *raw_bytes, unsigned long long *wire_bytes)
+{
+    while (fw->count > 0)
+        emit_oldest(fw);
+
+    if (raw_bytes)
+        *raw_bytes = fw->raw_bytes;
+    if (wire_bytes)
+        *wire_bytes = fw->wire_bytes;
+    return fw->failed ? -1 : 0;
+}
+
+void frame_writer_free(FrameWriter *fw)
+{
+    if (!fw)
+        return;
+
+    // 작업 풀에 남은 블록이 이 구조체를 참조하므로 모두 끝난 뒤 해제
+    fw->failed = true;
+    while (fw->count > 0)
+        emit_oldest(fw);
+
+    pthread_mutex_destroy(&fw->mu);
+    pthread_cond_destroy(&fw->cv);
+    free(fw->window);
+    free(fw);
+}
+
+// ------------------------------------------------------------
+// FrameReader
+// ------------------------------------------------------------
+static int raw_read_exact(const TreeSource *raw, char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = raw->read(raw->ctx, buf, len);
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// 다음 프레임을 buf 에 풀어 놓는다. END 이면 0, 오류면 -1, 데이터가 있으면 1.
+static int next_frame(FrameReader *fr)
+{
+    char line[256];
+    size_t raw_len, comp_len;
+
+    if (fr->ended || fr->failed)
+        return fr->ended ? 0 : -1;
+
+    if (fr->raw->read_line(fr->raw->ctx, line, sizeof(line)) < 0)
+    {
+        fr->failed = true;
+        return -1;
+    }
+
+    fr->pos = 0;
+    fr->len = 0;
+
+    if (sscanf(line, "Z %zu %zu", &raw_len, &comp_len) == 2 &&
+        raw_len <= COMPRESS_BLOCK && comp_len <= COMPRESS_FRAME_MAX)
+    {
+        if (raw_read_exact(fr->raw, fr->cbuf, comp_len) != 0 ||
+            decompress_buffer(fr->cbuf, comp_len, fr->buf, raw_len) != 0)
+        {
+            fr->failed = true;
+            return -1;
+        }
+        fr->len = raw_len;
+        fr->wire_bytes += comp_len;
+        return 1;
+    }
+
+    if (sscanf(line, "R %zu", &raw_len) == 1 && raw_len <= COMPRESS_BLOCK)
+    {
+        if (raw_read_exact(fr->raw, fr->buf, raw_len) != 0)
+        {
+            fr->failed = true;
+            return -1;
+        }
+        fr->len = raw_len;
+        fr->wire_bytes += raw_len;
+        return 1;
+    }
+
+    if (strncmp(line, "END", 3) == 0)
+    {
+        snprintf(fr->end_line, sizeof(fr->end_line), "%s", line);
+        fr->ended = true;
+        return 0;
+    }
+
+    // 서버가 프레임 대신 오류 줄을 보낸 경우도 여기서 끝낸다
+    snprintf(fr->end_line, sizeof(fr->end_line), "%s", line);
+    fr->failed = true;
+    return -1;
+}
+
+static ssize_t frame_read(void *ctx, void *out, size_t len)
+{
+    FrameReader *fr = ctx;
+
+    while (fr->pos == fr->len)
+    {
+        int rc = next_frame(fr);
+        if (rc <= 0)
+            return rc;
+    }
+
+    size_t n = fr->len - fr->pos;
+    if (n > len)
+        n = len;
+    memcpy(out, fr->buf + fr->pos, n);
+    fr->pos += n;
+    return (ssize_t)n;
+}
+
+static ssize_t frame_read_line(void *ctx, char *out, size_t size)
+{
+    FrameReader *fr = ctx;
+    size_t pos = 0;
+
+    while (1)
+    {
+        if (fr->pos == fr->len && next_frame(fr) <= 0)
+            return -1;
+
+        char *start = fr->buf + fr->pos;
+        size_t avail = fr->len - fr->pos;
+        char *nl = memchr(start, '\n', avail);
+        size_t take = nl ? (size_t)(nl - start) : avail;
+
+        size_t room = size - 1 - pos;
+        size_t copy = take < room ? take : room;
+        memcpy(out + pos, start, copy);
+        pos += copy;
+
+        fr->pos += nl ? take + 1 : take;
+        if (nl)
+            break;
+    }
+
+    out[pos] = '\0';
+    return (ssize_t)pos;
+}
+
+int frame_reader_init(FrameReader *fr, const TreeSource *raw)
+{
+    memset(fr, 0, sizeof(*fr));
+    fr->raw = raw;
+    fr->buf = malloc(COMPRESS_BLOCK);
+    fr->cbuf = malloc(COMPRESS_FRAME_MAX);
+    if (!fr->buf || !fr->cbuf)
+    {
+        frame_reader_free(fr);
+        return -1;
+    }
+    return 0;
+}
+
+void frame_reader_free(FrameReader *fr)
+{
+    free(fr->buf);
+    free(fr->cbuf);
+    fr->buf = NULL;
+    fr->cbuf = NULL;
+}
+
+TreeSource frame_reader_source(FrameReader *fr)
+{
+    TreeSource src = { frame_read, frame_read_line, fr };
+    return src;
+}
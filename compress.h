@@ -0,0 +1,75 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "tree_stream.h"
+#include "worker_pool.h"
+
+// 블록 단위 압축 프레임 (zlib deflate)
+//
+//   Z <raw_len> <comp_len>\n + comp_len 바이트   압축된 블록
+//   R <len>\n + len 바이트                        압축 이득이 없는 블록 (원본 그대로)
+//   END ...\n                                     프레임 스트림 끝 (뒷부분은 호출자가 정함)
+//
+// 블록마다 독립적으로 압축하므로 여러 코어에서 동시에 압축할 수 있다.
+
+#define COMPRESS_BLOCK (256 * 1024)
+#define COMPRESS_LEVEL_NONE 0     // 프레임은 쓰되 압축하지 않음 (세션에서 압축을 끈 경우)
+#define COMPRESS_LEVEL_FAST 1
+#define COMPRESS_FRAME_MAX (COMPRESS_BLOCK + COMPRESS_BLOCK / 8 + 1024)
+
+// 세션/전송 협상에 쓰는 알고리즘 이름 (COMPRESS <name>, ... ZLIB)
+#define COMPRESS_ALGO "zlib"
+
+// ------------------------------------------------------------
+// 단일 버퍼 압축
+// ------------------------------------------------------------
+size_t compress_bound(size_t len);
+// 결과가 원본보다 작을 때만 0 (out 은 compress_bound(len) 바이트 이상)
+int compress_buffer(const void *in, size_t len, void *out, size_t *out_len, int level);
+// 정확히 out_len 바이트로 풀리지 않으면 -1
+int decompress_buffer(const void *in, size_t len, void *out, size_t out_len);
+
+// 데이터 몇 군데를 표본으로 빠르게 압축해 보고 압축할 가치가 있는지 판단한다.
+// 이미 압축된 파일이나 난수에 가까운 바이너리(test_mid.bin 등)는 CPU 만 쓰고 이득이 없다.
+bool compress_worthwhile(const void *data, size_t len);
+bool compress_file_worthwhile(int fd, long long size);
+
+// ------------------------------------------------------------
+// 보내는 쪽: 블록을 작업 풀에서 압축하되, 보내는 순서는 넣은 순서를 유지한다
+// ------------------------------------------------------------
+typedef struct FrameWriter FrameWriter;
+
+// pool 이 NULL 이면 호출한 스레드에서 바로 압축한다
+FrameWriter *frame_writer_new(WorkerPool *pool, int level,
+                              int (*write)(void *ctx, const void *buf, size_t len), void *ctx);
+// 블록 하나를 넣는다 (len <= COMPRESS_BLOCK). 쓰기 실패 후에는 -1.
+int frame_writer_put(FrameWriter *fw, const void *data, size_t len);
+// 남은 블록을 모두 보낸다. 보낸 원본/압축 바이트 수를 돌려준다.
+int frame_writer_finish(FrameWriter *fw, unsigned long long *raw_bytes, unsigned long long *wire_bytes);
+void frame_writer_free(FrameWriter *fw);
+
+// ------------------------------------------------------------
+// 받는 쪽: 프레임을 풀어 TreeSource 로 내준다 (END 줄에서 읽기 종료)
+// ------------------------------------------------------------
+typedef struct
+{
+    const TreeSource *raw;
+    char *buf;          // 풀린 블록
+    size_t len;
+    size_t pos;
+    char *cbuf;         // 압축된 블록 수신용
+    bool ended;
+    bool failed;
+    char end_line[256]; // 받은 END 줄
+    unsigned long long wire_bytes;
+} FrameReader;
+
+int frame_reader_init(FrameReader *fr, const TreeSource *raw);
+void frame_reader_free(FrameReader *fr);
+TreeSource frame_reader_source(FrameReader *fr);
+
+#endif
@@ -0,0 +1,741 @@
+// content_index.c
+#define _GNU_SOURCE
+#include "content_index.h"
+#include "checksum.h"
+#include "tree_stream.h"
+#include "tree_watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CINDEX_BLOCK (1024 * 1024)
+#define CINDEX_SNIFF 8192
+// 덧붙기만 했는지 확인할 때 비교하는 이전 끝부분의 길이
+#define CINDEX_TAIL 4096
+// 조각 종류가 이보다 많은 파일은 목록을 두지 않고 항상 후보로 본다
+#define CINDEX_DENSE (4u * 1024 * 1024)
+#define CINDEX_FILTER_GRAMS 64
+
+typedef struct CFile
+{
+    char *path;
+    uint32_t *grams;         // 정렬됨
+    uint32_t ngrams;
+    bool binary;
+    bool dense;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t tail_sum;       // 색인한 끝 CINDEX_TAIL 바이트의 해시
+    struct CFile *next;
+} CFile;
+
+typedef struct
+{
+    char *path;
+    size_t len;
+    CFile **buckets;
+    size_t nbuckets, count, binary;
+    unsigned long long bytes;
+} CDir;
+
+typedef struct QItem
+{
+    char *path;
+    bool walk;               // 디렉토리: 걸으며 파일을 모두 넣는다
+    struct QItem *next;
+} QItem;
+
+static pthread_rwlock_t cindex_lock = PTHREAD_RWLOCK_INITIALIZER;
+static CDir *dirs[CONTENT_INDEX_MAX_DIRS];
+static int ndirs;
+static char config_path[PATH_MAX];
+static char root_path[PATH_MAX];
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static QItem *queue_head, *queue_tail;
+static size_t queue_len;
+
+struct ContentFilter
+{
+    uint32_t grams[CINDEX_FILTER_GRAMS];
+    size_t ngrams;
+};
+
+// ------------------------------------------------------------
+// 조각
+// ------------------------------------------------------------
+static unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 색인 스레드만 쓰는 작업 공간: 2^24 비트 집합과 새로 켠 조각 목록
+static uint64_t *seen_bits;
+static uint32_t *found;
+static size_t nfound, found_cap;
+
+static bool gram_add(uint32_t g)
+{
+    uint64_t bit = 1ULL << (g & 63);
+    if (seen_bits[g >> 6] & bit)
+        return true;
+    if (nfound == found_cap)
+    {
+        if (found_cap >= CINDEX_DENSE)
+            return false;
+        size_t cap = found_cap ? found_cap * 2 : 65536;
+        uint32_t *p = realloc(found, cap * sizeof(*p));
+        if (!p)
+            return false;
+        found = p;
+        found_cap = cap;
+    }
+    seen_bits[g >> 6] |= bit;
+    found[nfound++] = g;
+    return true;
+}
+
+static void grams_reset(void)
+{
+    for (size_t i = 0; i < nfound; i++)
+        seen_bits[found[i] >> 6] &= ~(1ULL << (found[i] & 63));
+    nfound = 0;
+}
+
+// ------------------------------------------------------------
+// 디렉토리, 파일 (cindex_lock 안에서)
+// ------------------------------------------------------------
+static CDir *dir_for(const char *path)
+{
+    CDir *best = NULL;
+    for (int i = 0; i < ndirs; i++)
+    {
+        CDir *d = dirs[i];
+        if (strncmp(path, d->path, d->len) == 0 && (path[d->len] == '/' || path[d->len] == '\0') &&
+            (!best || d->len > best->len))
+            best = d;
+    }
+    return best;
+}
+
+static size_t path_hash(const char *path)
+{
+    size_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+        h = (h ^ *p) * 1099511628211ULL;
+    return h;
+}
+
+static CFile **file_slot(CDir *d, const char *path)
+{
+    if (!d->nbuckets)
+        return NULL;
+    CFile **p = &d->buckets[path_hash(path) & (d->nbuckets - 1)];
+    while (*p && strcmp((*p)->path, path) != 0)
+        p = &(*p)->next;
+    return p;
+}
+
+static void file_free(CFile *f)
+{
+    free(f->path);
+    free(f->grams);
+    free(f);
+}
+
+static void dir_account(CDir *d, const CFile *f, int sign)
+{
+    d->count += sign;
+    d->binary += f->binary ? sign : 0;
+    d->bytes += (unsigned long long)sign * (f->ngrams * sizeof(uint32_t) + sizeof(*f) + strlen(f->path) + 1);
+}
+
+static void file_put(CDir *d, CFile *f)
+{
+    if (d->count + 1 > d->nbuckets)
+    {
+        size_t n = d->nbuckets ? d->nbuckets * 2 : 1024;
+        CFile **b = calloc(n, sizeof(*b));
+        if (b)
+        {
+            for (size_t i = 0; i < d->nbuckets; i++)
+            {
+                for (CFile *e = d->buckets[i], *next; e; e = next)
+                {
+                    next = e->next;
+                    size_t h = path_hash(e->path) & (n - 1);
+                    e->next = b[h];
+                    b[h] = e;
+                }
+            }
+            free(d->buckets);
+            d->buckets = b;
+            d->nbuckets = n;
+        }
+    }
+    if (!d->nbuckets)
+    {
+        file_free(f);
+        return;
+    }
+
+    CFile **slot = file_slot(d, f->path);
+    if (*slot)
+    {
+        CFile *old = *slot;
+        f->next = old->next;
+        dir_account(d, old, -1);
+        file_free(old);
+    }
+    else
+    {
+        f->next = NULL;
+    }
+    *slot = f;
+    dir_account(d, f, 1);
+}
+
+// path 자신과 그 아래 파일을 지운다
+static void files_remove(CDir *d, const char *path)
+{
+    size_t len = strlen(path);
+    for (size_t i = 0; i < d->nbuckets; i++)
+    {
+        CFile **p = &d->buckets[i];
+        while (*p)
+        {
+            CFile *f = *p;
+            if (strncmp(f->path, path, len) == 0 && (f->path[len] == '\0' || f->path[len] == '/'))
+            {
+                *p = f->next;
+                dir_account(d, f, -1);
+                file_free(f);
+            }
+            else
+            {
+                p = &f->next;
+            }
+        }
+    }
+}
+
+static void dir_free(CDir *d)
+{
+    for (size_t i = 0; i < d->nbuckets; i++)
+        for (CFile *f = d->buckets[i], *next; f; f = next)
+        {
+            next = f->next;
+            file_free(f);
+        }
+    free(d->buckets);
+    free(d->path);
+    free(d);
+}
+
+// ------------------------------------------------------------
+// 색인 대기열
+// ------------------------------------------------------------
+static void enqueue(const char *path, bool walk)
+{
+    QItem *q = malloc(sizeof(*q));
+    if (!q || !(q->path = strdup(path)))
+    {
+        free(q);
+        return;
+    }
+    q->walk = walk;
+    q->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail)
+        queue_tail->next = q;
+    else
+        queue_head = q;
+    queue_tail = q;
+    queue_len++;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static bool under_index(const char *path)
+{
+    pthread_rwlock_rdlock(&cindex_lock);
+    bool yes = dir_for(path) != NULL;
+    pthread_rwlock_unlock(&cindex_lock);
+    return yes;
+}
+
+// ------------------------------------------------------------
+// 파일 하나 색인 (색인 스레드)
+// ------------------------------------------------------------
+static uint64_t tail_sum(int fd, off_t size)
+{
+    char buf[CINDEX_TAIL];
+    off_t from = size > CINDEX_TAIL ? size - CINDEX_TAIL : 0;
+    ssize_t n = pread(fd, buf, (size_t)(size - from), from);
+    return n == size - from ? checksum_fast64(buf, (size_t)n, 0) : 0;
+}
+
+static bool same_stat(const CFile *f, const struct stat *st)
+{
+    return f->ino == st->st_ino && f->size == st->st_size && f->mtime.tv_sec == st->st_mtim.tv_sec &&
+           f->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// from 부터 끝까지 읽어 조각을 모은다. 실패 시 -1, 너무 많으면 1.
+static int scan_file(int fd, off_t from, off_t size, char *buf)
+{
+    uint32_t key = 0;
+    int have = 0;
+    for (off_t off = from; off < size;)
+    {
+        ssize_t n = pread(fd, buf, CINDEX_BLOCK, off);
+        if (n <= 0)
+            return -1;
+        for (ssize_t i = 0; i < n; i++)
+        {
+            unsigned char c = (unsigned char)buf[i];
+            if (c == '\n')
+            {
+                have = 0;
+                continue;
+            }
+            key = (key << 8 | fold(c)) & 0xffffff;
+            if (++have >= 3 && !gram_add(key))
+                return 1;
+        }
+        // 읽은 부분은 페이지 캐시에서 내려 GREP 이 쓰는 캐시를 밀어내지 않는다
+        posix_fadvise(fd, off, n, POSIX_FADV_DONTNEED);
+        off += n;
+    }
+    return 0;
+}
+
+static void index_file(const char *path, char *buf)
+{
+    CFile old = {0};
+    bool have_old = false;
+
+    pthread_rwlock_rdlock(&cindex_lock);
+    CDir *d = dir_for(path);
+    CFile **slot = d ? file_slot(d, path) : NULL;
+    if (slot && *slot)
+    {
+        old = **slot;
+        have_old = true;
+    }
+    pthread_rwlock_unlock(&cindex_lock);
+    if (!d)
+        return;
+
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            close(fd);
+        pthread_rwlock_wrlock(&cindex_lock);
+        if ((d = dir_for(path)))
+            files_remove(d, path);
+        pthread_rwlock_unlock(&cindex_lock);
+        return;
+    }
+    if (have_old && same_stat(&old, &st))
+    {
+        close(fd);
+        return;
+    }
+
+    CFile *f = calloc(1, sizeof(*f));
+    if (!f || !(f->path = strdup(path)))
+    {
+        free(f);
+        close(fd);
+        return;
+    }
+    f->ino = st.st_ino;
+    f->size = st.st_size;
+    f->mtime = st.st_mtim;
+
+    // 같은 파일이 늘어나기만 했으면(이전 끝부분이 그대로) 늘어난 부분만 읽는다
+    off_t from = 0;
+    if (have_old && !old.binary && !old.dense && old.ino == st.st_ino && st.st_size > old.size &&
+        tail_sum(fd, old.size) == old.tail_sum)
+    {
+        pthread_rwlock_rdlock(&cindex_lock);
+        CDir *again = dir_for(path);
+        CFile **cur = again ? file_slot(again, path) : NULL;
+        // 읽는 사이에 목록이 바뀌지 않았을 때만 이어 쓴다
+        if (cur && *cur && (*cur)->ino == old.ino && (*cur)->size == old.size &&
+            (*cur)->mtime.tv_sec == old.mtime.tv_sec && (*cur)->mtime.tv_nsec == old.mtime.tv_nsec)
+        {
+            for (uint32_t i = 0; i < (*cur)->ngrams; i++)
+                gram_add((*cur)->grams[i]);
+            from = old.size > 2 ? old.size - 2 : 0;
+        }
+        pthread_rwlock_unlock(&cindex_lock);
+    }
+
+    if (from == 0)
+    {
+        grams_reset();
+        ssize_t n = pread(fd, buf, CINDEX_SNIFF, 0);
+        f->binary = n > 0 && memchr(buf, '\0', (size_t)n) != NULL;
+    }
+    if (!f->binary)
+    {
+        int rc = scan_file(fd, from, st.st_size, buf);
+        if (rc < 0)
+        {
+            grams_reset();
+            file_free(f);
+            close(fd);
+            return;
+        }
+        f->dense = rc > 0;
+    }
+    f->tail_sum = tail_sum(fd, st.st_size);
+    close(fd);
+
+    if (!f->binary && !f->dense && nfound > 0)
+    {
+        f->grams = malloc(nfound * sizeof(*f->grams));
+        if (f->grams)
+        {
+            memcpy(f->grams, found, nfound * sizeof(*f->grams));
+            qsort(f->grams, nfound, sizeof(*f->grams), cmp_u32);
+            f->ngrams = (uint32_t)nfound;
+        }
+        else
+        {
+            f->dense = true;
+        }
+    }
+    grams_reset();
+
+    pthread_rwlock_wrlock(&cindex_lock);
+    if ((d = dir_for(path)))
+        file_put(d, f);
+    else
+        file_free(f);
+    pthread_rwlock_unlock(&cindex_lock);
+}
+
+static int walk_visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    (void)parentfd;
+    const char *base = ctx;
+    if (!sb)
+        return 0;
+    if (S_ISDIR(sb->st_mode))
+        return !strchr(rel, '/') && strncmp(name, TREE_WATCH_PRIVATE_PREFIX, sizeof(TREE_WATCH_PRIVATE_PREFIX) - 1) == 0;
+    if (S_ISREG(sb->st_mode))
+    {
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", base, rel) < (int)sizeof(path))
+            enqueue(path, false);
+    }
+    return 0;
+}
+
+static void *indexer_main(void *arg)
+{
+    (void)arg;
+    char *buf = malloc(CINDEX_BLOCK);
+    if (!buf)
+        return NULL;
+
+    while (1)
+    {
+        pthread_mutex_lock(&queue_lock);
+        while (!queue_head)
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        QItem *q = queue_head;
+        queue_head = q->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (q->walk)
+        {
+            int dfd = under_index(q->path) ? open(q->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC) : -1;
+            if (dfd >= 0)
+            {
+                tree_walk(dfd, walk_visit, q->path);
+                close(dfd);
+            }
+        }
+        else
+        {
+            index_file(q->path, buf);
+        }
+
+        pthread_mutex_lock(&queue_lock);
+        queue_len--;
+        pthread_mutex_unlock(&queue_lock);
+        free(q->path);
+        free(q);
+    }
+    return NULL;
+}
+
+// ------------------------------------------------------------
+// 변경 반영 (감시 스레드)
+// ------------------------------------------------------------
+static void forget(const char *path)
+{
+    pthread_rwlock_wrlock(&cindex_lock);
+    CDir *d = dir_for(path);
+    if (d)
+        files_remove(d, path);
+    pthread_rwlock_unlock(&cindex_lock);
+}
+
+static void on_change(void *ctx, const TreeChange *c)
+{
+    (void)ctx;
+    switch (c->kind)
+    {
+    case TREE_ADD:
+    case TREE_MOD:
+        if (!c->is_dir && under_index(c->path))
+            enqueue(c->path, false);
+        break;
+    case TREE_DEL:
+        forget(c->path);
+        break;
+    case TREE_REN:
+        forget(c->path);
+        if (under_index(c->newpath))
+            enqueue(c->newpath, c->is_dir);
+        break;
+    case TREE_LOST:
+        // 놓친 변경이 있을 수 있다: 모두 다시 확인한다 (바뀌지 않은 파일은 stat 만 보고 넘어간다)
+        pthread_rwlock_rdlock(&cindex_lock);
+        for (int i = 0; i < ndirs; i++)
+            enqueue(dirs[i]->path, true);
+        pthread_rwlock_unlock(&cindex_lock);
+        break;
+    case TREE_SEEN:
+    case TREE_SYNCED:
+        break;
+    }
+}
+
+// ------------------------------------------------------------
+// 설정
+// ------------------------------------------------------------
+static void save_config(void)
+{
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config_path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return;
+    for (int i = 0; i < ndirs; i++)
+        fprintf(fp, "%s\n", dirs[i]->path);
+    if (fclose(fp) == 0)
+        rename(tmp, config_path);
+}
+
+static int add_dir(const char *dir)
+{
+    for (int i = 0; i < ndirs; i++)
+    {
+        if (strcmp(dirs[i]->path, dir) == 0)
+        {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+    if (ndirs == CONTENT_INDEX_MAX_DIRS)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    CDir *d = calloc(1, sizeof(*d));
+    if (!d || !(d->path = strdup(dir)))
+    {
+        free(d);
+        errno = ENOMEM;
+        return -1;
+    }
+    d->len = strlen(dir);
+    dirs[ndirs++] = d;
+    return 0;
+}
+
+int content_index_init(const char *root)
+{
+    snprintf(config_path, sizeof(config_path), "%s/%s", root, CONTENT_INDEX_CONFIG);
+    snprintf(root_path, sizeof(root_path), "%s", root);
+    seen_bits = calloc((1u << 24) / 64, sizeof(*seen_bits));
+    if (!seen_bits || tree_watch_subscribe(on_change, NULL) != 0)
+        return -1;
+
+    FILE *fp = fopen(config_path, "r");
+    if (fp)
+    {
+        char line[PATH_MAX];
+        while (fgets(line, sizeof(line), fp))
+        {
+            line[strcspn(line, "\n")] = '\0';
+            if (line[0] == '/' && add_dir(line) == 0)
+                enqueue(line, true);
+        }
+        fclose(fp);
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, indexer_main, NULL) != 0)
+        return -1;
+    pthread_detach(tid);
+    return 0;
+}
+
+int content_index_enable(const char *dir)
+{
+    pthread_rwlock_wrlock(&cindex_lock);
+    int rc = add_dir(dir);
+    if (rc == 0)
+        save_config();
+    pthread_rwlock_unlock(&cindex_lock);
+    if (rc == 0)
+    {
+        enqueue(dir, true);
+        // 켠 디렉토리가 없으면 서버는 감시 스레드 없이 뜬다: 처음 켤 때 시작한다
+        if (tree_watch_start(root_path) != 0)
+            fprintf(stderr, "[WARN] Cannot watch %s for changes: %s\n", root_path, strerror(errno));
+    }
+    return rc;
+}
+
+bool content_index_active(void)
+{
+    pthread_rwlock_rdlock(&cindex_lock);
+    bool active = ndirs > 0;
+    pthread_rwlock_unlock(&cindex_lock);
+    return active;
+}
+
+int content_index_disable(const char *dir)
+{
+    pthread_rwlock_wrlock(&cindex_lock);
+    int found_at = -1;
+    for (int i = 0; i < ndirs; i++)
+        if (strcmp(dirs[i]->path, dir) == 0)
+            found_at = i;
+    if (found_at >= 0)
+    {
+        dir_free(dirs[found_at]);
+        dirs[found_at] = dirs[--ndirs];
+        save_config();
+    }
+    pthread_rwlock_unlock(&cindex_lock);
+
+    if (found_at < 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    return 0;
+}
+
+size_t content_index_list(ContentIndexInfo *out, size_t max, size_t *queued)
+{
+    size_t n = 0;
+    pthread_rwlock_rdlock(&cindex_lock);
+    for (int i = 0; i < ndirs && n < max; i++, n++)
+    {
+        snprintf(out[n].dir, sizeof(out[n].dir), "%s", dirs[i]->path);
+        out[n].files = dirs[i]->count;
+        out[n].binary = dirs[i]->binary;
+        out[n].bytes = dirs[i]->bytes;
+    }
+    pthread_rwlock_unlock(&cindex_lock);
+
+    pthread_mutex_lock(&queue_lock);
+    *queued = queue_len;
+    pthread_mutex_unlock(&queue_lock);
+    return n;
+}
+
+// ------------------------------------------------------------
+// 찾기
+// ------------------------------------------------------------
+ContentFilter *content_filter_new(const char *dir, const char *literal, size_t len)
+{
+    if (len < 3)
+        return NULL;
+
+    // dir 가 색인된 곳 아래이거나, dir 아래에 색인된 곳이 있어야 쓸모가 있다
+    bool useful = false;
+    size_t dlen = strlen(dir);
+    pthread_rwlock_rdlock(&cindex_lock);
+    useful = dir_for(dir) != NULL;
+    for (int i = 0; i < ndirs && !useful; i++)
+        useful = strncmp(dirs[i]->path, dir, dlen) == 0 && (dlen == 1 || dirs[i]->path[dlen] == '/');
+    pthread_rwlock_unlock(&cindex_lock);
+    if (!useful)
+        return NULL;
+
+    ContentFilter *f = calloc(1, sizeof(*f));
+    if (!f)
+        return NULL;
+    for (size_t i = 0; i + 3 <= len && f->ngrams < CINDEX_FILTER_GRAMS; i++)
+    {
+        f->grams[f->ngrams++] = (uint32_t)fold((unsigned char)literal[i]) << 16 |
+                                (uint32_t)fold((unsigned char)literal[i + 1]) << 8 | fold((unsigned char)literal[i + 2]);
+    }
+    return f;
+}
+
+bool content_filter_may_match(void *filter, const char *path, const struct stat *sb)
+{
+    ContentFilter *cf = filter;
+    bool may = true, stale = false;
+
+    pthread_rwlock_rdlock(&cindex_lock);
+    CDir *d = dir_for(path);
+    CFile **slot = d ? file_slot(d, path) : NULL;
+    CFile *f = slot ? *slot : NULL;
+    if (d && (!f || !same_stat(f, sb)))
+    {
+        stale = true;
+    }
+    else if (f && f->binary)
+    {
+        may = false;
+    }
+    else if (f && !f->dense)
+    {
+        for (size_t i = 0; i < cf->ngrams && may; i++)
+            may = bsearch(&cf->grams[i], f->grams, f->ngrams, sizeof(*f->grams), cmp_u32) != NULL;
+    }
+    pthread_rwlock_unlock(&cindex_lock);
+
+    // 색인이 없거나 오래된 파일은 이번에는 그대로 찾고, 다음을 위해 다시 색인한다
+    if (stale)
+        enqueue(path, false);
+    return may;
+}
+
+void content_filter_free(ContentFilter *f)
+{
+    free(f);
+}
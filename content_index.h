@@ -0,0 +1,51 @@
+#ifndef CONTENT_INDEX_H
+#define CONTENT_INDEX_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+// 디렉토리별 내용 trigram 색인 (GREP-INDEX ON <dir> 로 켠 디렉토리만)
+//
+// 파일마다 내용에 들어 있는 3바이트 조각(ASCII 대소문자 무시, 개행을 넘지 않음)의 정렬된 목록을 둔다.
+// GREP 은 찾는 문자열의 조각이 모두 들어 있는 파일만 열어 확인한다. 색인한 뒤 크기/수정 시각이
+// 바뀐 파일은 (다시 색인할 때까지) 항상 후보로 보므로 결과가 빠지는 일은 없다.
+//
+// 색인은 백그라운드 스레드 하나가 만든다. tree_watch 가 알려 주는 변경(업로드 완료, 쓰기 뒤 닫힘,
+// 이름 변경, 삭제)으로 갱신하고, 뒤에 덧붙기만 한 파일(로그)은 늘어난 부분만 읽는다.
+// 켠 디렉토리 목록은 <root>/CONTENT_INDEX_CONFIG 에 남겨 서버를 다시 시작하면 다시 만든다.
+
+#define CONTENT_INDEX_CONFIG ".talkshell-cindex"
+#define CONTENT_INDEX_MAX_DIRS 16
+
+typedef struct
+{
+    char dir[PATH_MAX];
+    unsigned long long files;        // 색인한 파일 (바이너리 포함)
+    unsigned long long binary;
+    unsigned long long bytes;        // 조각 목록이 쓰는 메모리
+} ContentIndexInfo;
+
+// 설정을 읽고 변경 구독을 등록한다 (tree_watch_start 전에). 실패 시 -1.
+int content_index_init(const char *root);
+
+// dir(절대 경로, realpath) 의 색인을 켜거나 끈다. 실패 시 -1 (errno: EEXIST 이미 켬, ENOENT 켜지 않음,
+// ENOSPC 디렉토리 수 한도)
+int content_index_enable(const char *dir);
+int content_index_disable(const char *dir);
+// 켠 디렉토리가 하나라도 있으면 true (이때만 tree_watch 가 필요하다)
+bool content_index_active(void);
+
+// 켠 디렉토리 목록. 돌려준 개수. *queued 에 색인을 기다리는 항목 수.
+size_t content_index_list(ContentIndexInfo *out, size_t max, size_t *queued);
+
+// 찾는 문자열 하나로 후보를 거르는 필터. dir 아래에 색인된 곳이 없거나 문자열이 3바이트보다 짧으면 NULL.
+typedef struct ContentFilter ContentFilter;
+
+ContentFilter *content_filter_new(const char *dir, const char *literal, size_t len);
+// false = path 에는 literal 이 없다 (sb 는 path 의 lstat). 색인이 없거나 오래되었으면 true.
+bool content_filter_may_match(void *filter, const char *path, const struct stat *sb);
+void content_filter_free(ContentFilter *f);
+
+#endif
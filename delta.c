@@ -0,0 +1,527 @@
+// delta.c
+#include "delta.h"
+#include "compress.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 작은 B 연산 여러 개를 한 번의 send 로 묶기 위한 송신 버퍼 크기
+#define DELTA_SEND_BUFFER (64 * 1024)
+// 서명 계산 시 한 번에 읽는 크기
+#define DELTA_READ_BUFFER (1024 * 1024)
+
+typedef struct
+{
+    char type;      // 'L' 리터럴 (offset, len) / 'B' 블록 복사 (first, count)
+    uint64_t a;
+    uint64_t b;
+} DeltaOp;
+
+struct DeltaPlan
+{
+    DeltaOp *ops;
+    size_t count;
+    size_t cap;
+    bool failed;
+};
+
+unsigned delta_block_size(long long size)
+{
+    // 블록이 작을수록 변경 부분만 정확히 골라내지만 서명이 늘어난다 (sqrt 가 균형점)
+    long long block = DELTA_MIN_BLOCK;
+    while (block < DELTA_MAX_BLOCK && block * block < size)
+        block += 1024;
+    return (unsigned)block;
+}
+
+static int pread_all(int fd, void *buf, size_t len, off_t off)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, p, len, off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        off += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+long long delta_signatures(int fd, long long size, unsigned block, DeltaSig **out)
+{
+    *out = NULL;
+    if (block == 0 || size < 0)
+        return -1;
+
+    long long count = size / block;
+    DeltaSig *sigs = malloc((size_t)(count > 0 ? count : 1) * sizeof(*sigs));
+    // 블록 크기의 배수로 읽어 블록이 읽기 경계에 걸치지 않게 한다
+    size_t chunk = (DELTA_READ_BUFFER / block) * block;
+    char *buf = malloc(chunk);
+    if (!sigs || !buf)
+    {
+        free(sigs);
+        free(buf);
+        return -1;
+    }
+
+    long long done = 0;
+    while (done < count)
+    {
+        long long n = (long long)(chunk / block);
+        if (n > count - done)
+            n = count - done;
+
+        if (pread_all(fd, buf, (size_t)n * block, (off_t)done * block) != 0)
+        {
+            free(sigs);
+            free(buf);
+            return -1;
+        }
+
+        for (long long i = 0; i < n; i++)
+        {
+            const char *p = buf + (size_t)i * block;
+            RollingSum r;
+            rolling_init(&r, p, block);
+            sigs[done + i].weak = rolling_digest(&r);
+            sigs[done + i].strong = checksum_fast64(p, block, 0);
+        }
+        done += n;
+    }
+
+    free(buf);
+    *out = sigs;
+    return count;
+}
+
+void delta_sig_encode(const DeltaSig *sig, unsigned char out[DELTA_SIG_SIZE])
+{
+    for (int i = 0; i < 4; i++)
+        out[i] = (unsigned char)(sig->weak >> (8 * i));
+    for (int i = 0; i < 8; i++)
+        out[4 + i] = (unsigned char)(sig->strong >> (8 * i));
+}
+
+void delta_sig_decode(const unsigned char in[DELTA_SIG_SIZE], DeltaSig *sig)
+{
+    sig->weak = 0;
+    sig->strong = 0;
+    for (int i = 0; i < 4; i++)
+        sig->weak |= (uint32_t)in[i] << (8 * i);
+    for (int i = 0; i < 8; i++)
+        sig->strong |= (uint64_t)in[4 + i] << (8 * i);
+}
+
+// ------------------------------------------------------------
+// 클라이언트: 연산 목록 만들기
+// ------------------------------------------------------------
+static void plan_push(DeltaPlan *p, char type, uint64_t a, uint64_t b)
+{
+    if (p->failed)
+        return;
+
+    // 바로 이어지는 블록은 B 연산 하나로 합친다
+    if (type == 'B' && p->count > 0)
+    {
+        DeltaOp *last = &p->ops[p->count - 1];
+        if (last->type == 'B' && last->a + last->b == a)
+        {
+            last->b += b;
+            return;
+        }
+    }
+
+    if (p->count == p->cap)
+    {
+        size_t cap = p->cap ? p->cap * 2 : 64;
+        DeltaOp *ops = realloc(p->ops, cap * sizeof(*ops));
+        if (!ops)
+        {
+            p->failed = true;
+            return;
+        }
+        p->ops = ops;
+        p->cap = cap;
+    }
+
+    p->ops[p->count++] = (DeltaOp){ type, a, b };
+}
+
+static inline uint32_t weak_slot(uint32_t weak, uint32_t mask)
+{
+    return ((weak ^ (weak >> 16)) * 0x9E3779B1u) & mask;
+}
+
+DeltaPlan *delta_plan(const unsigned char *data, size_t len, const DeltaSig *sigs, size_t count,
+                      unsigned block, DeltaStats *st)
+{
+    memset(st, 0, sizeof(*st));
+
+    DeltaPlan *plan = calloc(1, sizeof(*plan));
+    if (!plan)
+        return NULL;
+
+    // weak 값 → 블록 번호 체인 (open hashing)
+    uint32_t buckets = 1;
+    while (buckets < count * 2)
+        buckets <<= 1;
+    uint32_t mask = buckets - 1;
+    long long *head = malloc(buckets * sizeof(*head));
+    long long *next = malloc((count > 0 ? count : 1) * sizeof(*next));
+    if (!head || !next)
+    {
+        free(head);
+        free(next);
+        free(plan);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < buckets; i++)
+        head[i] = -1;
+    // 뒤에서부터 넣어 체인이 블록 번호 순서가 되게 한다
+    for (size_t i = count; i-- > 0;)
+    {
+        uint32_t s = weak_slot(sigs[i].weak, mask);
+        next[i] = head[s];
+        head[s] = (long long)i;
+    }
+
+    size_t pos = 0;
+    size_t literal_start = 0;
+    long long expect = -1;   // 직전에 맞은 블록의 다음 번호 (순서대로 맞는 경우가 대부분)
+    RollingSum r;
+
+    if (count > 0 && len >= block)
+        rolling_init(&r, data, block);
+
+    while (count > 0 && pos + block <= len)
+    {
+        uint32_t weak = rolling_digest(&r);
+        long long match = -1;
+        long long cand = head[weak_slot(weak, mask)];
+
+        if (cand >= 0)
+        {
+            uint64_t strong = 0;
+            bool have_strong = false;
+
+            if (expect >= 0 && (size_t)expect < count && sigs[expect].weak == weak)
+            {
+                strong = checksum_fast64(data + pos, block, 0);
+                have_strong = true;
+                if (sigs[expect].strong == strong)
+                    match = expect;
+            }
+
+            for (; match < 0 && cand >= 0; cand = next[cand])
+            {
+                if (sigs[cand].weak != weak)
+                    continue;
+                if (!have_strong)
+                {
+                    strong = checksum_fast64(data + pos, block, 0);
+                    have_strong = true;
+                }
+                if (sigs[cand].strong == strong)
+                    match = cand;
+            }
+        }
+
+        if (match >= 0)
+        {
+            if (pos > literal_start)
+                plan_push(plan, 'L', literal_start, pos - literal_start);
+            plan_push(plan, 'B', (uint64_t)match, 1);
+            st->blocks++;
+            st->copied += block;
+            expect = match + 1;
+
+            pos += block;
+            literal_start = pos;
+            if (pos + block <= len)
+                rolling_init(&r, data + pos, block);
+            continue;
+        }
+
+        if (pos + block >= len)
+            break;
+        rolling_roll(&r, data[pos], data[pos + block]);
+        pos++;
+    }
+
+    if (len > literal_start)
+        plan_push(plan, 'L', literal_start, len - literal_start);
+
+    for (size_t i = 0; i < plan->count; i++)
+        if (plan->ops[i].type == 'L')
+            st->literal += plan->ops[i].b;
+
+    free(head);
+    free(next);
+
+    if (plan->failed)
+    {
+        delta_plan_free(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+void delta_plan_free(DeltaPlan *plan)
+{
+    if (!plan)
+        return;
+    free(plan->ops);
+    free(plan);
+}
+
+// ------------------------------------------------------------
+// 클라이언트: 연산 보내기
+// ------------------------------------------------------------
+typedef struct
+{
+    const TreeSink *sink;
+    char buf[DELTA_SEND_BUFFER];
+    size_t len;
+    bool failed;
+} DeltaWriter;
+
+static void dw_flush(DeltaWriter *w)
+{
+    if (w->failed || w->len == 0)
+        return;
+    if (w->sink->write(w->sink->ctx, w->buf, w->len) != 0)
+        w->failed = true;
+    w->len = 0;
+}
+
+static void dw_put(DeltaWriter *w, const void *data, size_t len)
+{
+    if (w->failed)
+        return;
+
+    // 큰 리터럴은 버퍼를 거치지 않고 바로 보낸다
+    if (len > sizeof(w->buf) - w->len)
+    {
+        dw_flush(w);
+        if (len >= sizeof(w->buf))
+        {
+            if (!w->failed && w->sink->write(w->sink->ctx, data, len) != 0)
+                w->failed = true;
+            return;
+        }
+    }
+
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+int delta_send(const DeltaPlan *plan, const unsigned char *data, bool compress,
+               const TreeSink *sink, DeltaStats *st)
+{
+    DeltaWriter *w = malloc(sizeof(*w));
+    unsigned char *zbuf = compress ? malloc(compress_bound(DELTA_MAX_LITERAL)) : NULL;
+    if (!w)
+    {
+        free(zbuf);
+        return -1;
+    }
+    w->sink = sink;
+    w->len = 0;
+    w->failed = false;
+    st->wire = 0;
+
+    char header[96];
+    for (size_t i = 0; i < plan->count && !w->failed; i++)
+    {
+        const DeltaOp *op = &plan->ops[i];
+        if (op->type == 'B')
+        {
+            int n = snprintf(header, sizeof(header), "B %llu %llu\n",
+                             (unsigned long long)op->a, (unsigned long long)op->b);
+            dw_put(w, header, (size_t)n);
+            continue;
+        }
+
+        for (uint64_t off = 0; off < op->b && !w->failed;)
+        {
+            size_t piece = (op->b - off) < DELTA_MAX_LITERAL ? (size_t)(op->b - off) : DELTA_MAX_LITERAL;
+            const unsigned char *p = data + op->a + off;
+            size_t zlen = 0;
+            int n;
+
+            if (zbuf && piece >= 512 && compress_worthwhile(p, piece) &&
+                compress_buffer(p, piece, zbuf, &zlen, COMPRESS_LEVEL_FAST) == 0)
+            {
+                n = snprintf(header, sizeof(header), "Z %zu %zu\n", piece, zlen);
+                dw_put(w, header, (size_t)n);
+                dw_put(w, zbuf, zlen);
+                st->wire += zlen;
+            }
+            else
+            {
+                n = snprintf(header, sizeof(header), "L %zu\n", piece);
+                dw_put(w, header, (size_t)n);
+                dw_put(w, p, piece);
+                st->wire += piece;
+            }
+            off += piece;
+        }
+    }
+
+    dw_put(w, "E\n", 2);
+    dw_flush(w);
+
+    int rc = w->failed ? -1 : 0;
+    free(zbuf);
+    free(w);
+    return rc;
+}
+
+// ------------------------------------------------------------
+// 서버: 연산 적용
+// ------------------------------------------------------------
+static int read_exact(const TreeSource *src, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = src->read(src->ctx, p, len);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_all_fd(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int delta_apply(const TreeSource *src, int base_fd, unsigned block, size_t block_count,
+                int out_fd, ChecksumCtx *hash, DeltaStats *st, char *err, size_t err_len)
+{
+    memset(st, 0, sizeof(*st));
+    err[0] = '\0';
+
+    size_t io_size = block > DELTA_MAX_LITERAL ? block : DELTA_MAX_LITERAL;
+    char *io = malloc(io_size);
+    char *zbuf = malloc(COMPRESS_FRAME_MAX);
+    if (!io || !zbuf)
+    {
+        free(io);
+        free(zbuf);
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+
+    // 오류가 나도 E 까지 소비해야 다음 명령과 어긋나지 않는다
+    bool failed = (out_fd < 0);
+    int rc = -1;
+    char line[128];
+
+    while (src->read_line(src->ctx, line, sizeof(line)) >= 0)
+    {
+        unsigned long long a = 0, b = 0;
+
+        if (strcmp(line, "E") == 0)
+        {
+            rc = failed ? 1 : 0;
+            break;
+        }
+
+        if (sscanf(line, "B %llu %llu", &a, &b) == 2 && line[0] == 'B')
+        {
+            if (a >= block_count || b > block_count - a)
+            {
+                if (!failed)
+                    snprintf(err, err_len, "block %llu out of range", a + b);
+                failed = true;
+                continue;
+            }
+
+            for (unsigned long long i = 0; i < b && !failed; i++)
+            {
+                if (pread_all(base_fd, io, block, (off_t)((a + i) * block)) != 0)
+                {
+                    snprintf(err, err_len, "cannot read base block %llu", a + i);
+                    failed = true;
+                    break;
+                }
+                if (write_all_fd(out_fd, io, block) != 0)
+                {
+                    snprintf(err, err_len, "%s", strerror(errno));
+                    failed = true;
+                    break;
+                }
+                checksum_update(hash, io, block);
+            }
+            st->blocks += b;
+            st->copied += b * block;
+        }
+        else if (sscanf(line, "L %llu", &a) == 1 && line[0] == 'L')
+        {
+            if (a > DELTA_MAX_LITERAL || read_exact(src, io, (size_t)a) != 0)
+            {
+                snprintf(err, err_len, "bad literal");
+                break;
+            }
+            if (!failed && write_all_fd(out_fd, io, (size_t)a) != 0)
+            {
+                snprintf(err, err_len, "%s", strerror(errno));
+                failed = true;
+            }
+            if (!failed)
+                checksum_update(hash, io, (size_t)a);
+            st->literal += a;
+            st->wire += a;
+        }
+        else if (sscanf(line, "Z %llu %llu", &a, &b) == 2 && line[0] == 'Z')
+        {
+            if (a > DELTA_MAX_LITERAL || b > COMPRESS_FRAME_MAX || read_exact(src, zbuf, (size_t)b) != 0 ||
+                decompress_buffer(zbuf, (size_t)b, io, (size_t)a) != 0)
+            {
+                snprintf(err, err_len, "bad compressed literal");
+                break;
+            }
+            if (!failed && write_all_fd(out_fd, io, (size_t)a) != 0)
+            {
+                snprintf(err, err_len, "%s", strerror(errno));
+                failed = true;
+            }
+            if (!failed)
+                checksum_update(hash, io, (size_t)a);
+            st->literal += a;
+            st->wire += b;
+        }
+        else
+        {
+            snprintf(err, err_len, "bad delta op");
+            break;
+        }
+    }
+
+    free(io);
+    free(zbuf);
+    return rc;
+}
@@ -0,0 +1,68 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "checksum.h"
+#include "tree_stream.h"
+
+// rsync 방식 차등 업로드
+//
+// 1) 서버가 기존 파일을 block 바이트씩 나눠 블록마다 (롤링 체크섬, XXH64) 서명을 보낸다.
+// 2) 클라이언트는 새 파일에서 롤링 체크섬으로 일치하는 블록을 찾고,
+//    나머지 바이트만 리터럴로 보낸다.
+//
+//   L <len>\n + len 바이트          리터럴
+//   Z <raw_len> <comp_len>\n + 바이트   압축된 리터럴 (압축을 협상한 세션)
+//   B <first> <count>\n              기존 파일의 first 번째 블록부터 count 개 복사
+//   E\n                              끝
+//
+// 서버는 이 연산으로 임시 파일을 다시 만들고 SHA-256 을 검증한 뒤 커밋한다.
+
+#define DELTA_MIN_BLOCK 2048
+#define DELTA_MAX_BLOCK (128 * 1024)
+#define DELTA_SIG_SIZE 12              // 전송 시 블록 하나당 바이트 (weak u32 + strong u64, LE)
+#define DELTA_MAX_LITERAL (256 * 1024) // L/Z 연산 하나의 최대 원본 길이
+
+typedef struct
+{
+    uint32_t weak;
+    uint64_t strong;
+} DeltaSig;
+
+typedef struct
+{
+    unsigned long long literal;   // 리터럴로 보낸(받은) 원본 바이트
+    unsigned long long copied;    // 기존 블록에서 재사용한 바이트
+    unsigned long long blocks;    // 재사용한 블록 수
+    unsigned long long wire;      // 실제로 오간 리터럴 바이트 (압축 후)
+} DeltaStats;
+
+typedef struct DeltaPlan DeltaPlan;
+
+// 파일 크기에 맞는 블록 크기 (대략 sqrt(size), 1KiB 단위)
+unsigned delta_block_size(long long size);
+
+// 서버: 기존 파일의 전체 블록 서명을 만든다 (마지막 자투리 블록은 제외).
+// 성공 시 블록 수, 실패 시 -1. *out 은 호출자가 free.
+long long delta_signatures(int fd, long long size, unsigned block, DeltaSig **out);
+void delta_sig_encode(const DeltaSig *sig, unsigned char out[DELTA_SIG_SIZE]);
+void delta_sig_decode(const unsigned char in[DELTA_SIG_SIZE], DeltaSig *sig);
+
+// 클라이언트: data 를 서명과 비교해 연산 목록을 만든다 (st 에 리터럴/복사 바이트 기록)
+DeltaPlan *delta_plan(const unsigned char *data, size_t len, const DeltaSig *sigs, size_t count,
+                      unsigned block, DeltaStats *st);
+// 연산 목록을 E 까지 sink 로 보낸다. compress 면 이득이 있는 리터럴은 압축한다.
+int delta_send(const DeltaPlan *plan, const unsigned char *data, bool compress,
+               const TreeSink *sink, DeltaStats *st);
+void delta_plan_free(DeltaPlan *plan);
+
+// 서버: 연산 스트림을 읽어 base_fd 의 블록과 리터럴로 out_fd 에 파일을 다시 만든다.
+// out_fd < 0 이면 스트림만 끝까지 소비한다. hash 가 있으면 기록한 내용을 누적한다.
+// 반환: 0 = 성공, 1 = 끝까지 받았으나 쓰기/참조 오류(err), -1 = 연결 종료 또는 형식 오류
+int delta_apply(const TreeSource *src, int base_fd, unsigned block, size_t block_count,
+                int out_fd, ChecksumCtx *hash, DeltaStats *st, char *err, size_t err_len);
+
+#endif
@@ -0,0 +1,474 @@
+// dir_events.c
+#define _GNU_SOURCE
+#include "dir_events.h"
+#include "watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// 디렉토리 하나에 쌓아 둘 수 있는 알림 수 (넘으면 RESCAN 하나로 바꾼다)
+#define DIR_EVENTS_MAX_PENDING 2048
+
+#define DIR_EVENTS_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | \
+                         IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct
+{
+    char op;          // 'A' 추가, 'D' 삭제, 'R' 이름 변경, 'S' 크기 변경
+    bool is_dir;
+    bool existed;     // 마지막으로 보낸 뒤 처음 본 이벤트 전에도 있던 항목
+    char *name;
+    char *newname;    // 'R' 만
+} Pending;
+
+typedef struct
+{
+    struct DirEvents *owner;
+    int handle;
+    char dir[PATH_MAX];
+    Pending *items;
+    size_t count;
+    size_t cap;
+    bool rescan;
+    // 짝이 될 IN_MOVED_TO 를 기다리는 IN_MOVED_FROM
+    char *from_name;
+    uint32_t from_cookie;
+    bool from_is_dir;
+} Sub;
+
+struct DirEvents
+{
+    pthread_mutex_t mu;
+    int fd;                 // eventfd
+    Sub subs[DIR_EVENTS_MAX_DIRS];   // owner 가 NULL 이면 빈 칸
+    bool pending;
+    bool signalled;
+    struct timespec first;  // 보내지 않은 첫 이벤트 시각
+    struct timespec last;   // 마지막 이벤트 시각
+};
+
+static long ms_since(const struct timespec *t, const struct timespec *now)
+{
+    return (now->tv_sec - t->tv_sec) * 1000 + (now->tv_nsec - t->tv_nsec) / 1000000;
+}
+
+static void pending_free(Pending *p)
+{
+    free(p->name);
+    free(p->newname);
+}
+
+static void sub_clear(Sub *s)
+{
+    for (size_t i = 0; i < s->count; i++)
+        pending_free(&s->items[i]);
+    s->count = 0;
+    free(s->from_name);
+    s->from_name = NULL;
+}
+
+static void sub_rescan(Sub *s)
+{
+    sub_clear(s);
+    s->rescan = true;
+}
+
+static void sub_append(Sub *s, char op, const char *name, const char *newname, bool is_dir, bool existed)
+{
+    if (s->rescan)
+        return;
+    if (s->count == DIR_EVENTS_MAX_PENDING)
+    {
+        sub_rescan(s);
+        return;
+    }
+    if (s->count == s->cap)
+    {
+        size_t cap = s->cap ? s->cap * 2 : 16;
+        Pending *n = realloc(s->items, cap * sizeof(*n));
+        if (!n)
+        {
+            sub_rescan(s);
+            return;
+        }
+        s->items = n;
+        s->cap = cap;
+    }
+
+    Pending *p = &s->items[s->count];
+    *p = (Pending){ .op = op, .is_dir = is_dir, .existed = existed, .name = strdup(name),
+                    .newname = newname ? strdup(newname) : NULL };
+    if (!p->name || (newname && !p->newname))
+    {
+        pending_free(p);
+        sub_rescan(s);
+        return;
+    }
+    s->count++;
+}
+
+// name 에 대한 마지막 대기 알림 (name 으로 바뀐 이름 변경 포함).
+// 그 사이에 name 에서 다른 이름으로 바뀐 적이 있으면 합칠 수 없으므로 NULL.
+static Pending *sub_find(Sub *s, const char *name)
+{
+    for (size_t i = s->count; i-- > 0;)
+    {
+        Pending *p = &s->items[i];
+        if (p->op == 'R')
+        {
+            if (strcmp(p->newname, name) == 0)
+                return p;
+            if (strcmp(p->name, name) == 0)
+                return NULL;
+            continue;
+        }
+        if (strcmp(p->name, name) == 0)
+            return p;
+    }
+    return NULL;
+}
+
+static void sub_drop(Sub *s, Pending *p)
+{
+    size_t i = (size_t)(p - s->items);
+    pending_free(p);
+    memmove(p, p + 1, (s->count - i - 1) * sizeof(*p));
+    s->count--;
+}
+
+static void sub_record(Sub *s, char op, const char *name, bool is_dir)
+{
+    Pending *p = sub_find(s, name);
+
+    if (p && p->op == 'R')
+    {
+        // 이름을 바꾼 뒤 지웠으면 원래 이름의 삭제, 크기 변경은 보낼 때 읽으므로 그대로 둔다
+        if (op == 'D')
+        {
+            free(p->newname);
+            p->newname = NULL;
+            p->op = 'D';
+            p->is_dir = is_dir;
+        }
+        else if (op == 'A')
+            sub_append(s, 'A', name, NULL, is_dir, true);
+        return;
+    }
+
+    switch (op)
+    {
+    case 'A':
+        if (p)
+        {
+            // 지웠다 다시 만든 항목: 추가(덮어쓰기) 하나로
+            p->op = 'A';
+            p->is_dir = is_dir;
+        }
+        else
+            sub_append(s, 'A', name, NULL, is_dir, false);
+        break;
+    case 'D':
+        if (p && p->op == 'A' && !p->existed)
+            sub_drop(s, p);          // 만들었다 지운 항목: 알릴 필요 없음
+        else if (p)
+        {
+            p->op = 'D';
+            p->is_dir = is_dir;
+        }
+        else
+            sub_append(s, 'D', name, NULL, is_dir, true);
+        break;
+    case 'S':
+        // 추가/크기 변경이 이미 대기 중이면 보낼 때 크기를 읽으므로 그대로 둔다
+        if (!p)
+            sub_append(s, 'S', name, NULL, false, true);
+        break;
+    }
+}
+
+static void sub_rename(Sub *s, const char *from, const char *to, bool is_dir)
+{
+    Pending *p = sub_find(s, from);
+    if (p && p->op == 'A' && !p->existed)
+    {
+        // 새로 만든 항목의 이름 변경: 새 이름으로 추가한 것과 같다
+        sub_drop(s, p);
+        sub_record(s, 'A', to, is_dir);
+        return;
+    }
+    if (p && p->op == 'R')
+    {
+        // 연달아 바꾼 이름은 처음 이름 → 마지막 이름 하나로 (제자리로 돌아왔으면 없앤다)
+        if (strcmp(p->name, to) == 0)
+            sub_drop(s, p);
+        else
+        {
+            char *n = strdup(to);
+            if (!n)
+            {
+                sub_rescan(s);
+                return;
+            }
+            free(p->newname);
+            p->newname = n;
+        }
+        return;
+    }
+    sub_append(s, 'R', from, to, is_dir, true);
+}
+
+// 짝을 찾지 못한 IN_MOVED_FROM 은 밖으로 옮겨진 것이므로 삭제로 처리
+static void sub_settle_move(Sub *s)
+{
+    if (!s->from_name)
+        return;
+    sub_record(s, 'D', s->from_name, s->from_is_dir);
+    free(s->from_name);
+    s->from_name = NULL;
+}
+
+static void sub_event(void *ctx, const WatchEvent *ev)
+{
+    Sub *s = ctx;
+    DirEvents *de = s->owner;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&de->mu);
+    if (!ev)
+    {
+        // tick: 잠잠해졌거나 너무 오래 기다렸으면 세션 스레드를 깨운다
+        sub_settle_move(s);
+        if (de->pending && !de->signalled &&
+            (ms_since(&de->last, &now) >= DIR_EVENTS_QUIET_MS || ms_since(&de->first, &now) >= DIR_EVENTS_MAX_DELAY_MS))
+        {
+            uint64_t one = 1;
+            if (write(de->fd, &one, sizeof(one)) == (ssize_t)sizeof(one))
+                de->signalled = true;
+        }
+        pthread_mutex_unlock(&de->mu);
+        return;
+    }
+
+    bool is_dir = (ev->mask & IN_ISDIR) != 0;
+    bool paired = (ev->mask & IN_MOVED_TO) && s->from_name && s->from_cookie == ev->cookie;
+    if (!paired)
+        sub_settle_move(s);
+
+    if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+        sub_rescan(s);
+    else if (paired)
+    {
+        sub_rename(s, s->from_name, ev->name, is_dir);
+        free(s->from_name);
+        s->from_name = NULL;
+    }
+    else if (ev->mask & IN_MOVED_FROM)
+    {
+        s->from_name = strdup(ev->name);
+        s->from_cookie = ev->cookie;
+        s->from_is_dir = is_dir;
+    }
+    else if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+        sub_record(s, 'A', ev->name, is_dir);
+    else if (ev->mask & IN_DELETE)
+        sub_record(s, 'D', ev->name, is_dir);
+    else if (!is_dir && ev->mask & (IN_MODIFY | IN_CLOSE_WRITE))
+        sub_record(s, 'S', ev->name, false);
+
+    if (!de->pending)
+        de->first = now;
+    de->pending = true;
+    de->last = now;
+    pthread_mutex_unlock(&de->mu);
+}
+
+DirEvents *dir_events_open(void)
+{
+    DirEvents *de = calloc(1, sizeof(*de));
+    if (!de)
+        return NULL;
+    de->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (de->fd < 0)
+    {
+        free(de);
+        return NULL;
+    }
+    pthread_mutex_init(&de->mu, NULL);
+    return de;
+}
+
+static void sub_stop(Sub *s)
+{
+    // watch_remove 가 돌아오면 콜백이 더는 불리지 않으므로 잠금 없이 정리해도 된다
+    watch_remove(s->handle);
+    sub_clear(s);
+    free(s->items);
+    memset(s, 0, sizeof(*s));
+}
+
+void dir_events_close(DirEvents *de)
+{
+    if (!de)
+        return;
+    for (size_t i = 0; i < DIR_EVENTS_MAX_DIRS; i++)
+        if (de->subs[i].owner)
+            sub_stop(&de->subs[i]);
+    close(de->fd);
+    pthread_mutex_destroy(&de->mu);
+    free(de);
+}
+
+int dir_events_fd(const DirEvents *de)
+{
+    return de->fd;
+}
+
+int dir_events_set(DirEvents *de, const char *const *dirs, size_t count, size_t *failed)
+{
+    if (count > DIR_EVENTS_MAX_DIRS)
+    {
+        *failed = DIR_EVENTS_MAX_DIRS;
+        errno = E2BIG;
+        return -1;
+    }
+
+    // 더 이상 보지 않는 디렉토리 정리 (Sub 는 감시 스레드가 주소로 참조하므로 자리를 옮기지 않는다)
+    for (size_t i = 0; i < DIR_EVENTS_MAX_DIRS; i++)
+    {
+        Sub *s = &de->subs[i];
+        if (!s->owner)
+            continue;
+        bool keep = false;
+        for (size_t k = 0; k < count && !keep; k++)
+            keep = strcmp(s->dir, dirs[k]) == 0;
+        if (!keep)
+            sub_stop(s);
+    }
+
+    int rc = 0;
+    for (size_t k = 0; k < count && rc == 0; k++)
+    {
+        Sub *free_slot = NULL;
+        bool have = false;
+        for (size_t i = 0; i < DIR_EVENTS_MAX_DIRS; i++)
+        {
+            Sub *s = &de->subs[i];
+            if (s->owner && strcmp(s->dir, dirs[k]) == 0)
+                have = true;
+            else if (!s->owner && !free_slot)
+                free_slot = s;
+        }
+        if (have)
+            continue;
+
+        Sub *s = free_slot;
+        snprintf(s->dir, sizeof(s->dir), "%s", dirs[k]);
+        s->owner = de;
+        s->handle = watch_add(s->dir, DIR_EVENTS_MASK, true, sub_event, s);
+        if (s->handle < 0)
+        {
+            int err = errno;
+            memset(s, 0, sizeof(*s));
+            *failed = k;
+            errno = err;
+            rc = -1;
+        }
+    }
+
+    return rc;
+}
+
+static int sink_line(const TreeSink *sink, const char *line)
+{
+    return sink->write(sink->ctx, line, strlen(line));
+}
+
+static long long entry_size(const char *dir, const char *name)
+{
+    char path[PATH_MAX * 2];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (lstat(path, &st) != 0 || S_ISDIR(st.st_mode))
+        return 0;
+    return (long long)st.st_size;
+}
+
+int dir_events_flush(DirEvents *de, const TreeSink *sink)
+{
+    uint64_t drain;
+    if (read(de->fd, &drain, sizeof(drain)) < 0 && errno != EAGAIN)
+        return -1;
+
+    // 대기 중인 알림을 잠금 안에서 떼어 내고, 크기 조회와 전송은 잠금 밖에서
+    Sub taken[DIR_EVENTS_MAX_DIRS];
+    size_t ntaken = 0;
+    pthread_mutex_lock(&de->mu);
+    for (size_t i = 0; i < DIR_EVENTS_MAX_DIRS; i++)
+    {
+        Sub *s = &de->subs[i];
+        if (!s->owner || (s->count == 0 && !s->rescan))
+            continue;
+        Sub *t = &taken[ntaken++];
+        memcpy(t->dir, s->dir, sizeof(t->dir));
+        t->items = s->items;
+        t->count = s->count;
+        t->rescan = s->rescan;
+        s->items = NULL;
+        s->count = s->cap = 0;
+        s->rescan = false;
+    }
+    de->pending = false;
+    de->signalled = false;
+    pthread_mutex_unlock(&de->mu);
+
+    int lines = 0;
+    char line[PATH_MAX * 3 + 64];
+    for (size_t i = 0; i < ntaken; i++)
+    {
+        Sub *t = &taken[i];
+        if (t->rescan)
+        {
+            snprintf(line, sizeof(line), "EVT RESCAN %s\n", t->dir);
+            if (lines >= 0 && sink_line(sink, line) == 0)
+                lines++;
+            else
+                lines = -1;
+        }
+
+        for (size_t k = 0; k < t->count; k++)
+        {
+            Pending *p = &t->items[k];
+            char kind = p->is_dir ? 'd' : 'f';
+            if (t->rescan || lines < 0)
+                ;   // 목록을 다시 읽을 것이므로 개별 알림은 버린다
+            else if (p->op == 'A')
+                snprintf(line, sizeof(line), "EVT ADD %c %lld %s\t%s\n", kind, entry_size(t->dir, p->name), t->dir, p->name);
+            else if (p->op == 'D')
+                snprintf(line, sizeof(line), "EVT DEL %c 0 %s\t%s\n", kind, t->dir, p->name);
+            else if (p->op == 'R')
+                snprintf(line, sizeof(line), "EVT REN %c %lld %s\t%s\t%s\n", kind, entry_size(t->dir, p->newname),
+                         t->dir, p->name, p->newname);
+            else
+                snprintf(line, sizeof(line), "EVT SIZE f %lld %s\t%s\n", entry_size(t->dir, p->name), t->dir, p->name);
+
+            if (!t->rescan && lines >= 0)
+                lines = sink_line(sink, line) == 0 ? lines + 1 : -1;
+            pending_free(p);
+        }
+        free(t->items);
+    }
+    return lines;
+}
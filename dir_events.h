@@ -0,0 +1,41 @@
+#ifndef DIR_EVENTS_H
+#define DIR_EVENTS_H
+
+#include <stddef.h>
+
+#include "tree_stream.h"
+
+// 클라이언트 세션 하나가 보고 있는 디렉토리들의 변경 알림 (WATCH)
+//
+// 감시 스레드(watch.c)가 받은 inotify 이벤트를 항목 이름별로 합쳐 두었다가
+// (만들었다 지운 파일은 아예 사라지고, 여러 번의 쓰기는 크기 변경 하나가 된다)
+// 이벤트가 DIR_EVENTS_QUIET_MS 동안 잠잠하거나 첫 이벤트 뒤 DIR_EVENTS_MAX_DELAY_MS 가 지나면
+// dir_events_fd() 를 읽기 가능 상태로 만든다. 세션 스레드는 명령을 기다리는 동안에만
+// dir_events_flush() 로 아래 줄들을 보낸다 (응답 도중에는 끼어들지 않는다).
+//
+//   EVT ADD <d|f> <size> <dir>\t<name>
+//   EVT DEL <d|f> 0 <dir>\t<name>
+//   EVT REN <d|f> <size> <dir>\t<old>\t<new>
+//   EVT SIZE f <size> <dir>\t<name>
+//   EVT RESCAN <dir>      (이벤트가 넘쳤거나 디렉토리 자체가 사라짐: 목록을 다시 읽어야 함)
+
+#define DIR_EVENTS_MAX_DIRS 4
+#define DIR_EVENTS_QUIET_MS 100
+#define DIR_EVENTS_MAX_DELAY_MS 500
+
+typedef struct DirEvents DirEvents;
+
+DirEvents *dir_events_open(void);
+void dir_events_close(DirEvents *de);
+
+// 보낼 알림이 준비되면 읽기 가능해지는 fd (poll 용)
+int dir_events_fd(const DirEvents *de);
+
+// 감시할 디렉토리 목록을 바꾼다 (절대 경로, 호출자가 검증). 이미 보고 있던 디렉토리는 대기 중인 알림을 유지한다.
+// 실패 시 -1 (errno), *failed 에 실패한 디렉토리 번호.
+int dir_events_set(DirEvents *de, const char *const *dirs, size_t count, size_t *failed);
+
+// 준비된 알림을 EVT 줄로 sink 에 보낸다. 보낸 줄 수, 쓰기 실패 시 -1.
+int dir_events_flush(DirEvents *de, const TreeSink *sink);
+
+#endif
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 // [기존 함수 유지]
@@ -20,7 +21,7 @@ static void vec_push(char ***arr, int *count, int *cap, const char *s)
     (*count)++;
 }
 
-static void file_vec_push(FileEntry **arr, int *count, int *cap, const char *name, bool is_dir)
+static void file_vec_push(FileEntry **arr, int *count, int *cap, const char *name, bool is_dir, long long size)
 {
     if (*count + 1 > *cap) {
         *cap = (*cap == 0) ? 16 : (*cap * 2);
@@ -28,6 +29,7 @@ static void file_vec_push(FileEntry **arr, int *count, int *cap, const char *nam
     }
     (*arr)[*count].name = strdup(name);
     (*arr)[*count].is_dir = is_dir;
+    (*arr)[*count].size = size;
     (*count)++;
 }
 
@@ -146,6 +148,17 @@ void dirlist_draw(WINDOW *win, DirList *dl, bool focused) {
     wrefresh(win);
 }
 
+// 파일 크기를 짧게 (예: 512B, 1.5K, 20M)
+void format_size(long long size, char *out, size_t len)
+{
+    const char *units = "BKMGT";
+    double v = (double)size;
+    int u = 0;
+    while (v >= 1024 && u < 4) { v /= 1024; u++; }
+    if (u == 0) snprintf(out, len, "%lldB", size);
+    else        snprintf(out, len, v < 10 ? "%.1f%c" : "%.0f%c", v, units[u]);
+}
+
 // --- FileList (기존 유지) ---
 void filelist_init(FileList *fl) { memset(fl, 0, sizeof(*fl)); fl->selected = 0; fl->top_index = 0; }
 void filelist_free(FileList *fl) {
@@ -182,10 +195,11 @@ void filelist_scan(FileList *fl, const char *dir_abs)
         while (line) {
             if (line[0] == '-' || line[0] == 'd') { 
                 char name[256];
-                if (sscanf(line, "%*s %*s %*s %*s %*s %*s %*s %*s %255s", name) == 1) {
+                long long size = 0;
+                if (sscanf(line, "%*s %*s %*s %*s %lld %*s %*s %*s %255s", &size, name) == 2) {
                     if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) { line = strtok(NULL, "\n"); continue; }
                     bool is_dir = (line[0] == 'd');
-                    file_vec_push(&fl->items, &fl->count, &fl->cap, name, is_dir);
+                    file_vec_push(&fl->items, &fl->count, &fl->cap, name, is_dir, is_dir ? 0 : size);
                 }
             }
             line = strtok(NULL, "\n");
@@ -197,8 +211,10 @@ void filelist_scan(FileList *fl, const char *dir_abs)
         while ((e = readdir(d))) {
             if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
             char p[PATH_MAX]; path_join(p, dir_abs, e->d_name);
-            bool is_dir = is_directory(p);
-            file_vec_push(&fl->items, &fl->count, &fl->cap, e->d_name, is_dir);
+            struct stat st;
+            bool ok = stat(p, &st) == 0;
+            bool is_dir = ok && S_ISDIR(st.st_mode);
+            file_vec_push(&fl->items, &fl->count, &fl->cap, e->d_name, is_dir, ok && !is_dir ? (long long)st.st_size : 0);
         }
         closedir(d);
     }
@@ -224,12 +240,121 @@ void filelist_draw(WINDOW *win, FileList *fl, bool focused) {
         int sel = (idx == fl->selected);
         if (sel && focused) wattron(win, A_REVERSE);
         if (ent->is_dir) mvwprintw(win, i + 1, 2, "%c %s/", sel ? '>' : ' ', ent->name);
-        else             mvwprintw(win, i + 1, 2, "%c %-.*s  ", sel ? '>' : ' ', w - 6, ent->name);
+        else {
+            char size[16];
+            format_size(ent->size, size, sizeof(size));
+            int name_w = w - 6 - (int)strlen(size) - 1;
+            if (name_w < 1) name_w = 1;
+            mvwprintw(win, i + 1, 2, "%c %-*.*s %s", sel ? '>' : ' ', name_w, name_w, ent->name, size);
+        }
         if (sel && focused) wattroff(win, A_REVERSE);
     }
     wrefresh(win);
 }
 
+// --- 변경 알림 반영 (WATCH) ---
+// 정렬된 목록에서 name 이 들어갈 자리. *found 에 같은 이름이 있는지 기록.
+static int dir_find_slot(DirList *dl, const char *abs, bool *found)
+{
+    int lo = 0, hi = dl->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcasecmp(dl->items[mid], abs) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    // strcasecmp 로 같은 이름이 여럿일 수 있으므로 정확히 같은 항목을 찾는다
+    *found = false;
+    for (int i = lo; i < dl->count && strcasecmp(dl->items[i], abs) == 0; i++)
+        if (strcmp(dl->items[i], abs) == 0) { *found = true; return i; }
+    return lo;
+}
+
+void dirlist_insert(DirList *dl, const char *abs)
+{
+    bool found;
+    int at = dir_find_slot(dl, abs, &found);
+    if (found) return;
+
+    char *copy = strdup(abs);
+    if (!copy) return;
+    if (dl->count + 1 > dl->cap) {
+        int cap = (dl->cap == 0) ? 16 : (dl->cap * 2);
+        char **items = realloc(dl->items, sizeof(char *) * cap);
+        if (!items) { free(copy); return; }
+        dl->items = items; dl->cap = cap;
+    }
+    memmove(dl->items + at + 1, dl->items + at, sizeof(char *) * (dl->count - at));
+    dl->items[at] = copy;
+    dl->count++;
+    if (dl->selected >= at) dl->selected++;
+}
+
+void dirlist_remove(DirList *dl, const char *abs)
+{
+    bool found;
+    int at = dir_find_slot(dl, abs, &found);
+    if (!found) return;
+
+    free(dl->items[at]);
+    memmove(dl->items + at, dl->items + at + 1, sizeof(char *) * (dl->count - at - 1));
+    dl->count--;
+    // 선택한 디렉토리가 사라지면 선택 없음 (-1)
+    if (dl->selected == at) dl->selected = -1;
+    else if (dl->selected > at) dl->selected--;
+}
+
+static int file_find_slot(FileList *fl, const char *name, bool *found)
+{
+    int lo = 0, hi = fl->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcasecmp(fl->items[mid].name, name) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *found = false;
+    for (int i = lo; i < fl->count && strcasecmp(fl->items[i].name, name) == 0; i++)
+        if (strcmp(fl->items[i].name, name) == 0) { *found = true; return i; }
+    return lo;
+}
+
+void filelist_insert(FileList *fl, const char *name, bool is_dir, long long size)
+{
+    bool found;
+    int at = file_find_slot(fl, name, &found);
+    if (found) {
+        fl->items[at].is_dir = is_dir;
+        fl->items[at].size = size;
+        return;
+    }
+
+    char *copy = strdup(name);
+    if (!copy) return;
+    if (fl->count + 1 > fl->cap) {
+        int cap = (fl->cap == 0) ? 16 : (fl->cap * 2);
+        FileEntry *items = realloc(fl->items, sizeof(FileEntry) * cap);
+        if (!items) { free(copy); return; }
+        fl->items = items; fl->cap = cap;
+    }
+    memmove(fl->items + at + 1, fl->items + at, sizeof(FileEntry) * (fl->count - at));
+    fl->items[at] = (FileEntry){ .name = copy, .is_dir = is_dir, .size = size };
+    fl->count++;
+    if (fl->selected < 0) fl->selected = 0;
+    else if (fl->selected >= at && fl->count > 1) fl->selected++;
+}
+
+void filelist_remove(FileList *fl, const char *name)
+{
+    bool found;
+    int at = file_find_slot(fl, name, &found);
+    if (!found) return;
+
+    free(fl->items[at].name);
+    memmove(fl->items + at, fl->items + at + 1, sizeof(FileEntry) * (fl->count - at - 1));
+    fl->count--;
+    // 선택한 항목이 사라지면 바로 다음 항목(마지막이었으면 이전 항목)을 선택
+    if (fl->selected > at || fl->selected >= fl->count) fl->selected--;
+}
+
 int socket_is_connected(void) { return (sockfd >= 0); }
 static int cmp_local_entry(const void *a, const void *b) { return strcasecmp(((LocalEntry*)a)->name, ((LocalEntry*)b)->name); }
 static void lb_push(LocalBrowser *lb, const char *name, bool is_dir) {
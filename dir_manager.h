@@ -9,6 +9,7 @@
 typedef struct {
     char *name;
     bool is_dir; // 폴더인지 여부 (stat 역할)
+    long long size;
 } FileEntry;
 
 typedef struct {
@@ -50,8 +51,18 @@ void filelist_free(FileList *fl);
 void filelist_scan(FileList *fl, const char *dir_abs);
 void filelist_draw(WINDOW *win, FileList *fl, bool focused);
 
+// 변경 알림(WATCH)을 목록을 다시 읽지 않고 반영한다. 정렬 순서와 선택한 항목은 유지된다.
+// 이미 있는 항목을 추가하면 속성만 바꾸고, 없는 항목을 지우면 아무 일도 하지 않는다.
+void dirlist_insert(DirList *dl, const char *abs);
+void dirlist_remove(DirList *dl, const char *abs);
+void filelist_insert(FileList *fl, const char *name, bool is_dir, long long size);
+void filelist_remove(FileList *fl, const char *name);
+
 int socket_is_connected(void);
 
+// 크기를 짧게 (예: 512B, 1.5K, 20M)
+void format_size(long long size, char *out, size_t len);
+
 void localbrowser_init(LocalBrowser *lb);
 void localbrowser_free(LocalBrowser *lb);
 int localbrowser_scan(LocalBrowser *lb, const char *cwd);
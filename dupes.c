@@ -0,0 +1,451 @@
+// dupes.c
+#define _GNU_SOURCE
+#include "dupes.h"
+#include "fair_share.h"
+#include "file_hash.h"
+#include "tree_stream.h"
+#include "tree_watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// 결과가 없어도 poll 을 부르는 간격
+#define DUPES_POLL_MS 200
+
+typedef struct
+{
+    size_t path;             // arena 안의 위치
+    long long size;
+    dev_t dev;
+    ino_t ino;
+} DupFile;
+
+// 크기가 겹친 파일 하나의 계산 결과
+typedef struct
+{
+    const DupFile *file;
+    const char *path;
+    uint64_t edge;
+    int err;
+    bool cached;
+    unsigned long long read;
+    char hex[CHECKSUM_HEX_LEN];
+} DupWork;
+
+typedef struct
+{
+    WorkerPool *pool;
+    const char *dir;
+    long long min_size;
+    DupesGroupFn group;
+    DupesPollFn poll;
+    void *ctx;
+    DupesStats *stats;
+    bool stop;
+    int err;                 // 메모리가 모자라 끝까지 보지 못함 (errno)
+
+    char *arena;
+    size_t arena_len, arena_cap;
+    DupFile *files;
+    size_t nfiles, files_cap;
+
+    struct timespec last_poll;
+    unsigned visits;
+} Dupes;
+
+static long ms_since(const struct timespec *t)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) * 1000 + (now.tv_nsec - t->tv_nsec) / 1000000;
+}
+
+static void do_poll(Dupes *d)
+{
+    clock_gettime(CLOCK_MONOTONIC, &d->last_poll);
+    if (d->poll && !d->poll(d->ctx, d->stats))
+        d->stop = true;
+}
+
+// ------------------------------------------------------------
+// 작업 풀에서 0..n-1 을 나눠 실행 (호출한 스레드는 기다리며 poll)
+// ------------------------------------------------------------
+typedef struct
+{
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    size_t next, n;
+    int running;
+    bool stop;
+    void (*fn)(DupWork *w);
+    DupWork **items;
+} ParallelRun;
+
+static void parallel_task(void *arg)
+{
+    ParallelRun *r = arg;
+    pthread_mutex_lock(&r->mu);
+    while (!r->stop && r->next < r->n)
+    {
+        size_t i = r->next++;
+        pthread_mutex_unlock(&r->mu);
+        r->fn(r->items[i]);
+        pthread_mutex_lock(&r->mu);
+    }
+    r->running--;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mu);
+}
+
+static void run_parallel(Dupes *d, void (*fn)(DupWork *w), DupWork **items, size_t n)
+{
+    ParallelRun r = { .n = n, .fn = fn, .items = items };
+    pthread_mutex_init(&r.mu, NULL);
+    pthread_cond_init(&r.cond, NULL);
+
+    int threads = d->pool ? worker_pool_size(d->pool) : 1;
+    if ((size_t)threads > n)
+        threads = (int)n;
+    r.running = threads;
+    for (int i = 0; i < threads; i++)
+        if (!d->pool || worker_pool_submit(d->pool, parallel_task, &r) != 0)
+            parallel_task(&r);
+
+    pthread_mutex_lock(&r.mu);
+    while (r.running > 0)
+    {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += DUPES_POLL_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&r.cond, &r.mu, &until) != 0 && !d->stop)
+        {
+            pthread_mutex_unlock(&r.mu);
+            do_poll(d);
+            pthread_mutex_lock(&r.mu);
+            r.stop = d->stop;
+        }
+    }
+    pthread_mutex_unlock(&r.mu);
+    pthread_mutex_destroy(&r.mu);
+    pthread_cond_destroy(&r.cond);
+}
+
+// ------------------------------------------------------------
+// 단계별 계산 (작업 스레드)
+// ------------------------------------------------------------
+static void edge_hash(DupWork *w)
+{
+    unsigned char buf[DUPES_EDGE * 2];
+    long long size = w->file->size;
+    fair_share_ops(1);
+    int fd = open(w->path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size != size)
+    {
+        w->err = fd < 0 ? errno : ESTALE;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    // 앞 DUPES_EDGE 바이트와, 그 뒤에 남은 부분의 끝 DUPES_EDGE 바이트
+    size_t head = size < DUPES_EDGE ? (size_t)size : DUPES_EDGE;
+    size_t tail = size - (long long)head < DUPES_EDGE ? (size_t)(size - (long long)head) : DUPES_EDGE;
+    ssize_t a = pread(fd, buf, head, 0);
+    ssize_t b = tail ? pread(fd, buf + head, tail, size - (long long)tail) : 0;
+    close(fd);
+    if (a != (ssize_t)head || b != (ssize_t)tail)
+    {
+        w->err = a < 0 || b < 0 ? errno : ESTALE;
+        return;
+    }
+    w->edge = checksum_fast64(buf, head + tail, (uint64_t)size);
+    w->read = head + tail;
+}
+
+static void full_hash(DupWork *w)
+{
+    long long size;
+    fair_share_ops(1);
+    if (file_hash(w->path, w->hex, &size, &w->cached) != 0)
+        w->err = errno ? errno : EIO;
+    else if (size != w->file->size)
+        w->err = ESTALE;
+    else if (!w->cached)
+    {
+        w->read += (unsigned long long)size;
+        fair_share_disk((size_t)size);
+    }
+}
+
+// ------------------------------------------------------------
+// 묶기
+// ------------------------------------------------------------
+static int cmp_file(const void *a, const void *b)
+{
+    const DupFile *x = a, *y = b;
+    if (x->size != y->size)
+        return x->size > y->size ? -1 : 1;
+    if (x->dev != y->dev)
+        return x->dev < y->dev ? -1 : 1;
+    return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+static int cmp_edge(const void *a, const void *b)
+{
+    const DupWork *x = *(DupWork *const *)a, *y = *(DupWork *const *)b;
+    if (x->err || y->err)
+        return !!x->err - !!y->err;
+    if (x->file->size != y->file->size)
+        return x->file->size > y->file->size ? -1 : 1;
+    return x->edge < y->edge ? -1 : x->edge > y->edge;
+}
+
+static int cmp_full(const void *a, const void *b)
+{
+    const DupWork *x = *(DupWork *const *)a, *y = *(DupWork *const *)b;
+    if (x->err || y->err)
+        return !!x->err - !!y->err;
+    if (x->file->size != y->file->size)
+        return x->file->size > y->file->size ? -1 : 1;
+    int c = strcmp(x->hex, y->hex);
+    return c ? c : strcmp(x->path, y->path);
+}
+
+// 정렬된 items 에서 same 이 참인 연속 구간 중 길이 2 이상인 것만 앞으로 모은다. 남은 개수.
+static size_t keep_runs(DupWork **items, size_t n, bool (*same)(const DupWork *, const DupWork *))
+{
+    size_t out = 0;
+    for (size_t i = 0; i < n;)
+    {
+        size_t j = i + 1;
+        while (j < n && !items[i]->err && same(items[i], items[j]))
+            j++;
+        if (j - i >= 2 && !items[i]->err)
+            for (size_t k = i; k < j; k++)
+                items[out++] = items[k];
+        i = j;
+    }
+    return out;
+}
+
+static bool same_edge(const DupWork *x, const DupWork *y)
+{
+    return !y->err && x->file->size == y->file->size && x->edge == y->edge;
+}
+
+static bool same_full(const DupWork *x, const DupWork *y)
+{
+    return !y->err && x->file->size == y->file->size && strcmp(x->hex, y->hex) == 0;
+}
+
+static void count_work(Dupes *d, DupWork *work, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        d->stats->bytes_read += work[i].read;
+        work[i].read = 0;
+    }
+}
+
+// 크기가 겹친 파일들을 앞/뒤 해시 → 전체 해시로 확인하고 묶음을 넘긴다
+static void process_chunk(Dupes *d, DupWork *work, size_t n)
+{
+    DupWork **items = malloc(n * sizeof(*items));
+    const char **paths = malloc(n * sizeof(*paths));
+    if (!items || !paths)
+    {
+        free(items);
+        free(paths);
+        d->stats->errors += n;
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        items[i] = &work[i];
+
+    run_parallel(d, edge_hash, items, n);
+    count_work(d, work, n);
+    qsort(items, n, sizeof(*items), cmp_edge);
+    size_t left = keep_runs(items, n, same_edge);
+
+    d->stats->full_hashed += left;
+    if (!d->stop && left > 0)
+        run_parallel(d, full_hash, items, left);
+    count_work(d, work, n);
+    for (size_t i = 0; i < n; i++)
+        d->stats->errors += work[i].err && work[i].err != ECANCELED ? 1 : 0;
+    if (d->stop)
+        goto out;
+
+    qsort(items, left, sizeof(*items), cmp_full);
+    left = keep_runs(items, left, same_full);
+    for (size_t i = 0; i < left && !d->stop;)
+    {
+        size_t j = i;
+        while (j < left && same_full(items[i], items[j]))
+        {
+            paths[j - i] = items[j]->path;
+            j++;
+        }
+        long long size = items[i]->file->size;
+        d->stats->groups++;
+        d->stats->dup_files += j - i - 1;
+        d->stats->reclaimable += (unsigned long long)size * (j - i - 1);
+        if (!d->group(d->ctx, size, items[i]->hex, paths, j - i))
+            d->stop = true;
+        i = j;
+    }
+
+out:
+    free(items);
+    free(paths);
+}
+
+// ------------------------------------------------------------
+// 걷기
+// ------------------------------------------------------------
+static int visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    (void)parentfd;
+    Dupes *d = ctx;
+    if ((++d->visits & 1023) == 0 && ms_since(&d->last_poll) >= DUPES_POLL_MS)
+        do_poll(d);
+    if (d->stop)
+        return -1;
+    fair_share_ops(1);
+    if (!sb)
+    {
+        d->stats->errors++;
+        return 0;
+    }
+    if (S_ISDIR(sb->st_mode))
+        return !strchr(rel, '/') &&
+               strncmp(name, TREE_WATCH_PRIVATE_PREFIX, sizeof(TREE_WATCH_PRIVATE_PREFIX) - 1) == 0;
+    if (!S_ISREG(sb->st_mode) || sb->st_size < d->min_size)
+        return 0;
+
+    size_t len = strlen(d->dir) + strlen(rel) + 2;
+    if (d->arena_len + len > d->arena_cap)
+    {
+        size_t cap = d->arena_cap ? d->arena_cap * 2 : 1 << 20;
+        while (cap < d->arena_len + len)
+            cap *= 2;
+        char *p = realloc(d->arena, cap);
+        if (!p)
+        {
+            d->err = ENOMEM;
+            return -1;
+        }
+        d->arena = p;
+        d->arena_cap = cap;
+    }
+    if (d->nfiles == d->files_cap)
+    {
+        size_t cap = d->files_cap ? d->files_cap * 2 : 4096;
+        DupFile *p = realloc(d->files, cap * sizeof(*p));
+        if (!p)
+        {
+            d->err = ENOMEM;
+            return -1;
+        }
+        d->files = p;
+        d->files_cap = cap;
+    }
+
+    snprintf(d->arena + d->arena_len, len, "%s/%s", d->dir, rel);
+    d->files[d->nfiles++] = (DupFile){ d->arena_len, sb->st_size, sb->st_dev, sb->st_ino };
+    d->arena_len += len;
+    d->stats->files++;
+    return 0;
+}
+
+int dupes_find(WorkerPool *pool, const char *dir, long long min_size, DupesGroupFn group, DupesPollFn poll,
+               void *ctx, DupesStats *stats, char *err, size_t err_len)
+{
+    memset(stats, 0, sizeof(*stats));
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+    {
+        snprintf(err, err_len, "%s", strerror(errno));
+        return -1;
+    }
+
+    Dupes d = { .pool = pool, .dir = strcmp(dir, "/") == 0 ? "" : dir, .min_size = min_size, .group = group,
+                .poll = poll, .ctx = ctx, .stats = stats };
+    clock_gettime(CLOCK_MONOTONIC, &d.last_poll);
+    int rc = tree_walk(dfd, visit, &d);
+    int walk_errno = errno;
+    close(dfd);
+    if (d.err || (rc < 0 && !d.stop))
+    {
+        snprintf(err, err_len, "%s", strerror(d.err ? d.err : walk_errno ? walk_errno : EIO));
+        free(d.arena);
+        free(d.files);
+        return -1;
+    }
+
+    // 큰 크기부터, 크기가 같은 파일이 둘 이상(하드 링크는 하나로)인 것만 모아 나눠 처리한다
+    qsort(d.files, d.nfiles, sizeof(*d.files), cmp_file);
+    DupWork *work = malloc(DUPES_CHUNK_FILES * 2 * sizeof(*work));
+    size_t nwork = 0, cap = work ? DUPES_CHUNK_FILES * 2 : 0;
+    for (size_t i = 0; i < d.nfiles && !d.stop && !d.err;)
+    {
+        size_t j = i;
+        size_t start = nwork;
+        for (; j < d.nfiles && d.files[j].size == d.files[i].size; j++)
+        {
+            if (j > i && d.files[j].dev == d.files[j - 1].dev && d.files[j].ino == d.files[j - 1].ino)
+                continue;
+            if (nwork == cap)
+            {
+                size_t ncap = cap ? cap * 2 : DUPES_CHUNK_FILES;
+                DupWork *p = realloc(work, ncap * sizeof(*p));
+                if (!p)
+                {
+                    // 크기 묶음 일부만 비교하면 묶음이 빠지므로 여기서 실패로 끝낸다
+                    d.err = ENOMEM;
+                    break;
+                }
+                work = p;
+                cap = ncap;
+            }
+            work[nwork++] = (DupWork){ .file = &d.files[j], .path = d.arena + d.files[j].path };
+        }
+        if (d.err)
+            break;
+        if (nwork - start < 2)
+            nwork = start;
+        stats->candidates += nwork - start;
+        i = j;
+
+        if (nwork >= DUPES_CHUNK_FILES || (i >= d.nfiles && nwork > 0))
+        {
+            process_chunk(&d, work, nwork);
+            nwork = 0;
+            do_poll(&d);
+        }
+    }
+
+    free(work);
+    free(d.arena);
+    free(d.files);
+    if (d.err)
+    {
+        snprintf(err, err_len, "%s", strerror(d.err));
+        return -1;
+    }
+    return d.stop ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+#ifndef DUPES_H
+#define DUPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "checksum.h"
+#include "worker_pool.h"
+
+// 디렉토리 아래 내용이 같은 파일 찾기 (DUPES)
+//
+// 트리를 한 번 걸어 파일을 크기별로 모은 뒤, 크기가 같은 파일이 둘 이상인 것만
+//   1) 앞/뒤 DUPES_EDGE 바이트의 해시로 나누고
+//   2) 그래도 같은 것만 전체 SHA-256 (file_hash, 바뀌지 않은 파일은 기억해 둔 값) 으로 확인한다.
+// 두 단계 모두 작업 풀에서 파일마다 병렬로 계산한다. 크기 묶음은 트리를 다 걸어야 완성되므로
+// 결과는 걷기가 끝난 뒤부터 나오고, 그 뒤로는 큰 크기부터 DUPES_CHUNK_FILES 개 정도씩 끝내고
+// 넘기므로 절약량이 큰 묶음이 먼저 나온다. 걷는 동안에도 poll 은 불린다.
+// 같은 inode(하드 링크) 는 한 파일로 보고, 심볼릭 링크와 일반 파일이 아닌 항목은 보지 않는다.
+
+#define DUPES_EDGE 4096
+#define DUPES_CHUNK_FILES 512
+
+typedef struct
+{
+    unsigned long long files;          // 본 파일 (min_size 이상)
+    unsigned long long candidates;     // 크기가 겹친 파일
+    unsigned long long full_hashed;    // 앞/뒤까지 겹쳐 전체 해시한 파일
+    unsigned long long bytes_read;     // 읽은 바이트 (기억해 둔 해시는 제외)
+    unsigned long long errors;         // 읽지 못한 파일
+    unsigned long long groups;
+    unsigned long long dup_files;      // 묶음마다 하나를 뺀 나머지 파일 수
+    unsigned long long reclaimable;    // 그 파일들의 크기 합
+} DupesStats;
+
+// 같은 내용의 파일 묶음 하나 (paths 는 n 개, 2 이상). false = 중단.
+typedef bool (*DupesGroupFn)(void *ctx, long long size, const char *sha256, const char *const *paths, size_t n);
+// 결과가 없어도 호출한 스레드에서 주기적으로 불린다 (취소 확인, 진행 상황). false = 중단.
+typedef bool (*DupesPollFn)(void *ctx, const DupesStats *st);
+
+// 반환: 0 = 끝까지, 1 = 중단됨, -1 = 실패 (err 에 이유)
+int dupes_find(WorkerPool *pool, const char *dir, long long min_size, DupesGroupFn group, DupesPollFn poll,
+               void *ctx, DupesStats *stats, char *err, size_t err_len);
+
+#endif
@@ -0,0 +1,379 @@
+// fair_share.c
+#define _GNU_SOURCE
+#include "fair_share.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    int level;
+    unsigned long long bytes_limit;
+    unsigned long long ops_limit;
+    unsigned weight;
+} ShareRule;
+
+typedef struct
+{
+    double tokens;            // 음수면 빚 (그만큼 잠들어 갚는다)
+    long long last_ns;
+} Bucket;
+
+typedef struct
+{
+    bool used;
+    FairShareInfo info;
+    Bucket bytes_bucket;
+    Bucket ops_bucket;
+    long long window_start_ns;   // 최근 전송량을 재는 구간
+    unsigned long long window_bytes;
+    long long last_charge_ns;    // 마지막으로 자원을 쓴 때 (기다리는 중이면 다 기다린 때)
+} ShareAccount;
+
+// 일반 사용자 / 운영자 / 관리자
+static const ShareRule default_rules[] = {
+    { 0, 16ULL << 20, 2000, 1 },
+    { 5, 64ULL << 20, 10000, 2 },
+    { 10, 0, 0, 4 },
+};
+
+static ShareRule rules[FAIR_SHARE_MAX_RULES];
+static size_t rule_count;
+static bool enabled;
+
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static ShareAccount accounts[FAIR_SHARE_MAX_USERS];
+// 한도 줄마다 하나: 사용자 계정이 모자랄 때 (rules 와 같은 순서)
+static ShareAccount overflow[FAIR_SHARE_MAX_RULES];
+
+// 이 세션 스레드가 묶인 계정 (묶여 있는 동안 다른 사용자에게 넘어가지 않는다)
+static __thread ShareAccount *bound;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool parse_amount(const char *s, char **end, unsigned long long *out)
+{
+    if (!isdigit((unsigned char)*s))
+        return false;
+    errno = 0;
+    unsigned long long v = strtoull(s, end, 10);
+    if (errno == ERANGE)
+        return false;
+    int shift = 0;
+    switch (toupper((unsigned char)**end))
+    {
+    case 'K': shift = 10; break;
+    case 'M': shift = 20; break;
+    case 'G': shift = 30; break;
+    }
+    if (shift)
+    {
+        if (v > (ULLONG_MAX >> shift))
+            return false;
+        v <<= shift;
+        (*end)++;
+    }
+    *out = v;
+    return true;
+}
+
+static int rule_cmp(const void *a, const void *b)
+{
+    const ShareRule *ra = a, *rb = b;
+    return (ra->level > rb->level) - (ra->level < rb->level);
+}
+
+// "<level>:<bytes/s>:<ops/s>:<weight>,..."
+static bool parse_rules(const char *spec)
+{
+    ShareRule parsed[FAIR_SHARE_MAX_RULES];
+    size_t n = 0;
+    const char *p = spec;
+
+    while (*p)
+    {
+        ShareRule r;
+        char *end;
+        long level = strtol(p, &end, 10);
+        if (end == p || *end != ':' || n == FAIR_SHARE_MAX_RULES)
+            return false;
+        p = end + 1;
+        if (!parse_amount(p, &end, &r.bytes_limit) || *end != ':')
+            return false;
+        p = end + 1;
+        if (!parse_amount(p, &end, &r.ops_limit) || *end != ':')
+            return false;
+        p = end + 1;
+        unsigned long weight = strtoul(p, &end, 10);
+        if (end == p || weight == 0 || weight > 100 || (*end && *end != ','))
+            return false;
+        r.level = (int)level;
+        r.weight = (unsigned)weight;
+        parsed[n++] = r;
+        p = *end ? end + 1 : end;
+    }
+    if (n == 0)
+        return false;
+
+    qsort(parsed, n, sizeof(parsed[0]), rule_cmp);
+    memcpy(rules, parsed, n * sizeof(parsed[0]));
+    rule_count = n;
+    return true;
+}
+
+bool fair_share_init(void)
+{
+    const char *env = getenv("TALKSHELL_SHARE");
+    enabled = !(env && strcmp(env, "0") == 0);
+
+    rule_count = sizeof(default_rules) / sizeof(default_rules[0]);
+    memcpy(rules, default_rules, sizeof(default_rules));
+    if (enabled && env && *env && !parse_rules(env))
+        printf("[server/share] Invalid TALKSHELL_SHARE \"%s\", using defaults\n", env);
+    return enabled;
+}
+
+// level 이하인 줄 중 가장 높은 줄 (모든 줄보다 낮으면 첫 줄)
+static size_t rule_for(int level)
+{
+    size_t r = 0;
+    for (size_t i = 1; i < rule_count; i++)
+        if (rules[i].level <= level)
+            r = i;
+    return r;
+}
+
+static double burst_of(unsigned long long limit, unsigned long long min_burst)
+{
+    double burst = (double)limit * FAIR_SHARE_BURST_SEC;
+    return burst > (double)min_burst ? burst : (double)min_burst;
+}
+
+static void bucket_refill(Bucket *b, unsigned long long limit, unsigned long long min_burst, long long now)
+{
+    double burst = burst_of(limit, min_burst);
+    b->tokens += (double)(now - b->last_ns) * (double)limit / 1e9;
+    if (b->tokens > burst)
+        b->tokens = burst;
+    b->last_ns = now;
+}
+
+// n 만큼 꺼낸다. 반환: 빚을 갚기 위해 기다려야 할 시간 (ns)
+static long long bucket_take(Bucket *b, unsigned long long limit, unsigned long long min_burst, size_t n,
+                             long long now)
+{
+    bucket_refill(b, limit, min_burst, now);
+    b->tokens -= (double)n;
+    double max_debt = (double)limit * FAIR_SHARE_MAX_DEBT_SEC;
+    if (max_debt < (double)min_burst * 4)
+        max_debt = (double)min_burst * 4;
+    if (b->tokens < -max_debt)
+        b->tokens = -max_debt;
+    return b->tokens < 0 ? (long long)(-b->tokens * 1e9 / (double)limit) : 0;
+}
+
+static void unbind_locked(void)
+{
+    if (!bound)
+        return;
+    bound->info.sessions--;
+    bound->info.last_active = time(NULL);
+    bound = NULL;
+}
+
+static void account_reset(ShareAccount *acct, const char *name, const ShareRule *r, long long now)
+{
+    memset(acct, 0, sizeof(*acct));
+    acct->used = true;
+    snprintf(acct->info.user, sizeof(acct->info.user), "%s", name);
+    acct->bytes_bucket.tokens = burst_of(r->bytes_limit, FAIR_SHARE_MIN_BURST_BYTES);
+    acct->bytes_bucket.last_ns = now;
+    acct->ops_bucket.tokens = burst_of(r->ops_limit, FAIR_SHARE_MIN_BURST_OPS);
+    acct->ops_bucket.last_ns = now;
+    acct->window_start_ns = now;
+}
+
+unsigned fair_share_bind(const char *user, int level)
+{
+    if (!enabled)
+        return 1;
+
+    size_t ri = rule_for(level);
+    const ShareRule *r = &rules[ri];
+    long long now = now_ns();
+    ShareAccount *acct = NULL, *spare = NULL;
+
+    pthread_mutex_lock(&share_lock);
+    unbind_locked();
+
+    // 같은 사용자, 없으면 빈 칸이나 아무도 묶여 있지 않은 가장 오래된 계정
+    for (int i = 0; i < FAIR_SHARE_MAX_USERS && !acct; i++)
+    {
+        ShareAccount *a = &accounts[i];
+        if (a->used && strcmp(a->info.user, user) == 0)
+            acct = a;
+        else if (!a->used && (!spare || spare->used))
+            spare = a;
+        else if (a->used && a->info.sessions == 0 && (!spare || (spare->used && a->info.last_active < spare->info.last_active)))
+            spare = a;
+    }
+    if (!acct && spare)
+    {
+        acct = spare;
+        account_reset(acct, user, r, now);
+    }
+    bool shared = !acct;
+    if (shared)
+    {
+        // 계정이 모두 다른 세션에 묶여 있다: 제한 없이 두지 않고 같은 줄의 공용 계정에 묶는다
+        acct = &overflow[ri];
+        if (!acct->used)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "*overflow-%d", r->level);
+            account_reset(acct, name, r, now);
+        }
+        if (acct->info.sessions == 0)
+            printf("[server/share] All %d accounts in use, %s shares %s\n", FAIR_SHARE_MAX_USERS, user, acct->info.user);
+    }
+
+    acct->info.level = shared ? r->level : level;
+    acct->info.weight = r->weight;
+    acct->info.bytes_limit = r->bytes_limit;
+    acct->info.ops_limit = r->ops_limit;
+    acct->info.sessions++;
+    acct->info.last_active = time(NULL);
+    bound = acct;
+    pthread_mutex_unlock(&share_lock);
+    return r->weight;
+}
+
+void fair_share_unbind(void)
+{
+    pthread_mutex_lock(&share_lock);
+    unbind_locked();
+    pthread_mutex_unlock(&share_lock);
+}
+
+// 최근 FAIR_SHARE_ACTIVE_MS 안에 a 말고 다른 계정이 자원을 썼는가 (share_lock)
+static bool contended_locked(const ShareAccount *a, long long now)
+{
+    long long since = now - (long long)FAIR_SHARE_ACTIVE_MS * 1000000LL;
+    for (int i = 0; i < FAIR_SHARE_MAX_ACCOUNTS; i++)
+    {
+        const ShareAccount *o = i < FAIR_SHARE_MAX_USERS ? &accounts[i] : &overflow[i - FAIR_SHARE_MAX_USERS];
+        if (o != a && o->used && o->last_charge_ns > since)
+            return true;
+    }
+    return false;
+}
+
+void *fair_share_current(void)
+{
+    return bound;
+}
+
+void fair_share_adopt(void *account)
+{
+    bound = account;
+}
+
+static void sleep_ns(long long ns)
+{
+    struct timespec ts = { ns / 1000000000LL, ns % 1000000000LL };
+    while (nanosleep(&ts, &ts) != 0)
+        ;
+}
+
+static void charge(bool ops, size_t n)
+{
+    ShareAccount *a = bound;
+    if (!a || n == 0)
+        return;
+
+    long long now = now_ns(), wait = 0;
+    pthread_mutex_lock(&share_lock);
+    // 혼자 쓰고 있으면 한도를 걸지 않는다 (버킷은 채워 두어 경쟁이 시작되면 몰아 쓸 몫부터 쓴다)
+    bool contended = contended_locked(a, now);
+    a->last_charge_ns = now;
+    if (ops)
+    {
+        a->info.ops += n;
+        if (a->info.ops_limit && contended)
+            wait = bucket_take(&a->ops_bucket, a->info.ops_limit, FAIR_SHARE_MIN_BURST_OPS, n, now);
+        else if (a->info.ops_limit)
+            bucket_refill(&a->ops_bucket, a->info.ops_limit, FAIR_SHARE_MIN_BURST_OPS, now);
+    }
+    else
+    {
+        a->info.bytes += n;
+        a->window_bytes += n;
+        if (now - a->window_start_ns >= 1000000000LL)
+        {
+            a->info.bytes_rate = (unsigned long long)((double)a->window_bytes * 1e9 / (double)(now - a->window_start_ns));
+            a->window_bytes = 0;
+            a->window_start_ns = now;
+        }
+        if (a->info.bytes_limit && contended)
+            wait = bucket_take(&a->bytes_bucket, a->info.bytes_limit, FAIR_SHARE_MIN_BURST_BYTES, n, now);
+        else if (a->info.bytes_limit)
+            bucket_refill(&a->bytes_bucket, a->info.bytes_limit, FAIR_SHARE_MIN_BURST_BYTES, now);
+    }
+    a->info.throttled_ms += (unsigned long long)(wait / 1000000);
+    a->last_charge_ns = now + wait;   // 빚을 갚으며 자는 동안에도 경쟁 중인 계정이다
+    a->info.last_active = time(NULL);
+    pthread_mutex_unlock(&share_lock);
+
+    if (wait > 0)
+        sleep_ns(wait);
+}
+
+void fair_share_bytes(size_t n)
+{
+    charge(false, n);
+}
+
+void fair_share_ops(size_t n)
+{
+    charge(true, n);
+}
+
+void fair_share_disk(size_t n)
+{
+    static __thread size_t carry;
+    carry += n;
+    size_t blocks = carry / FAIR_SHARE_BLOCK;
+    carry %= FAIR_SHARE_BLOCK;
+    charge(true, blocks);
+}
+
+size_t fair_share_list(const char *user, FairShareInfo *out, size_t max)
+{
+    size_t n = 0;
+    long long now = now_ns();
+
+    pthread_mutex_lock(&share_lock);
+    for (int i = 0; i < FAIR_SHARE_MAX_ACCOUNTS && n < max; i++)
+    {
+        const ShareAccount *a = i < FAIR_SHARE_MAX_USERS ? &accounts[i] : &overflow[i - FAIR_SHARE_MAX_USERS];
+        if (!a->used || (user && strcmp(a->info.user, user) != 0))
+            continue;
+        out[n] = a->info;
+        // 최근 2초 동안 전송이 없었으면 지금 속도는 0 이다
+        if (now - a->window_start_ns >= 2000000000LL)
+            out[n].bytes_rate = 0;
+        n++;
+    }
+    pthread_mutex_unlock(&share_lock);
+    return n;
+}
@@ -0,0 +1,82 @@
+#ifndef FAIR_SHARE_H
+#define FAIR_SHARE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// 사용자별 자원 몫: 한 사용자의 큰 전송이나 큰 트리 작업이 다른 사용자를 굶기지 않게 한다.
+//
+// 세션 스레드는 로그인(또는 ATTACH) 뒤 fair_share_bind() 로 사용자 계정에 묶인다. 같은 사용자의
+// 세션과 데이터 연결은 한 계정을 함께 쓰므로 연결을 여러 개 열어도 몫이 늘지 않는다.
+//   - 전송: 초당 바이트 토큰 버킷. 본문을 받거나 보낸 뒤 fair_share_bytes() 가 빚진 만큼 잠들어
+//     TCP 흐름 제어로 상대를 늦춘다 (1초치까지는 몰아 쓸 수 있다).
+//   - 파일 시스템 작업: 같은 방식의 초당 작업 수 버킷. 재귀 DELETE, dls, COPY/MOVE 가 항목마다 쓴다.
+//     네트워크를 거치지 않는 서버 안 복사의 데이터는 전송 버킷이 아니라 여기에 FAIR_SHARE_BLOCK 마다
+//     작업 하나로 쓴다 (reflink 로 만든 몫은 쓰지 않는다).
+//   - 한 번에 진 빚은 FAIR_SHARE_MAX_DEBT_SEC 초치까지만 남긴다: 큰 작업 하나가 같은 사용자의 다른
+//     연결까지 몇 분씩 세우지 않는다.
+//   - 작업 풀: 세션 스레드가 맡기는 작업에 사용자 이름과 비중을 붙여 (worker_pool_set_owner)
+//     풀이 사용자 사이를 비중대로 번갈아 꺼낸다. 작업을 도는 동안 풀 스레드도 맡긴 세션의 계정에
+//     묶이므로 (worker_pool_set_context) BATCH, GREP, DUPES 의 파일 시스템 작업도 같은 버킷에 쓴다.
+//   - 한도는 경쟁이 있을 때만 건다: 최근 FAIR_SHARE_ACTIVE_MS 안에 다른 계정이 자원을 쓰지 않았으면
+//     사용량만 세고 기다리지 않는다. 한가한 서버에서 혼자 쓰는 사용자는 느려지지 않는다.
+//
+// 한도는 permission_level 에 따라 정한다. TALKSHELL_SHARE 로 바꿀 수 있다:
+//   TALKSHELL_SHARE="<최소 level>:<bytes/s>:<ops/s>:<비중>,..."   (K/M/G 접미사, 0 = 제한 없음)
+// 사용자에게는 최소 level 이 자기 level 이하인 줄 중 가장 높은 줄이 적용된다. TALKSHELL_SHARE=0 이면 끈다.
+
+#define FAIR_SHARE_MAX_USERS 64
+#define FAIR_SHARE_MAX_RULES 8
+// 사용자 계정이 모두 묶여 있으면 같은 한도 줄의 공용 계정("*overflow-<level>")을 함께 쓴다
+#define FAIR_SHARE_MAX_ACCOUNTS (FAIR_SHARE_MAX_USERS + FAIR_SHARE_MAX_RULES)
+// 버킷 크기: 초당 한도의 이만큼, 최소 FAIR_SHARE_MIN_BURST_* 까지 몰아 쓸 수 있다
+#define FAIR_SHARE_BURST_SEC 1
+#define FAIR_SHARE_MIN_BURST_BYTES (256 * 1024)
+#define FAIR_SHARE_MIN_BURST_OPS 64
+// 한 번에 보내는 큰 본문(sendfile 등)을 이 단위로 나눠 버킷에 맞춘다
+#define FAIR_SHARE_BLOCK (1024 * 1024)
+// 버킷이 질 수 있는 빚: 초당 한도의 이만큼 (최소 버킷 크기의 4배)
+#define FAIR_SHARE_MAX_DEBT_SEC 2
+// 다른 계정이 이 시간 안에 자원을 썼으면 경쟁 중으로 본다
+#define FAIR_SHARE_ACTIVE_MS 1000
+
+typedef struct
+{
+    char user[64];
+    int level;
+    unsigned weight;
+    unsigned long long bytes_limit;    // 초당, 0 = 제한 없음
+    unsigned long long ops_limit;
+    int sessions;                      // 지금 묶여 있는 세션 스레드 수
+    unsigned long long bytes;          // 누적 전송량
+    unsigned long long ops;            // 누적 파일 시스템 작업 수
+    unsigned long long bytes_rate;     // 최근 초당 전송량
+    unsigned long long throttled_ms;   // 한도 때문에 기다린 시간 합
+    time_t last_active;
+} FairShareInfo;
+
+// 서버 시작 때 한 번 (환경 변수를 읽는다). 끈 상태면 false.
+bool fair_share_init(void);
+
+// 이 스레드를 user 계정에 묶는다 (level 이 바뀌었으면 한도도 바뀐다). 작업 풀 비중을 돌려준다.
+unsigned fair_share_bind(const char *user, int level);
+// 연결이 끝날 때
+void fair_share_unbind(void);
+
+// 이 스레드의 사용자가 n 바이트를 보내거나 받았다. 한도를 넘었으면 그만큼 잠든다.
+void fair_share_bytes(size_t n);
+// n 개의 파일 시스템 작업 (항목 삭제, stat, 복사 ...)
+void fair_share_ops(size_t n);
+// 서버 안에서 복사한 n 바이트 (FAIR_SHARE_BLOCK 마다 작업 하나, 나머지는 다음 번에 이어 센다)
+void fair_share_disk(size_t n);
+
+// 이 스레드가 묶인 계정 (작업 풀이 작업과 함께 넘긴다). adopt 는 세션 수를 바꾸지 않고 잠깐 묶는다
+// (NULL 이면 풀어 둔다).
+void *fair_share_current(void);
+void fair_share_adopt(void *account);
+
+// 계정 목록 (user 가 NULL 이면 공용 계정까지 전부). 돌려준 개수.
+size_t fair_share_list(const char *user, FairShareInfo *out, size_t max);
+
+#endif
@@ -0,0 +1,237 @@
+// file_hash.c
+#define _GNU_SOURCE
+#include "file_hash.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HASH_READ_BLOCK (1024 * 1024)
+// 작업 풀 스레드당 동시에 맡기는 파일 수 (취소하면 맡기지 않은 파일은 읽지 않는다)
+#define HASH_WINDOW_PER_THREAD 2
+
+typedef struct
+{
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char hex[CHECKSUM_HEX_LEN];
+} HashCacheEntry;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static HashCacheEntry cache[FILE_HASH_CACHE_SLOTS];
+
+static HashCacheEntry *cache_slot(const struct stat *st)
+{
+    uint64_t h = ((uint64_t)st->st_dev * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)st->st_ino * 0xc2b2ae3d27d4eb4fULL);
+    return &cache[(h >> 17) % FILE_HASH_CACHE_SLOTS];
+}
+
+static bool cache_matches(const HashCacheEntry *e, const struct stat *st)
+{
+    return e->hex[0] && e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+int file_hash(const char *path, char out[CHECKSUM_HEX_LEN], long long *size, bool *cached)
+{
+    *cached = false;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0)
+        return -1;
+    int err = fstat(fd, &st) != 0 ? errno : S_ISDIR(st.st_mode) ? EISDIR : !S_ISREG(st.st_mode) ? EINVAL : 0;
+    if (err)
+    {
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    *size = st.st_size;
+
+    pthread_mutex_lock(&cache_lock);
+    HashCacheEntry *e = cache_slot(&st);
+    bool hit = cache_matches(e, &st);
+    if (hit)
+        memcpy(out, e->hex, CHECKSUM_HEX_LEN);
+    pthread_mutex_unlock(&cache_lock);
+    if (hit)
+    {
+        close(fd);
+        *cached = true;
+        return 0;
+    }
+
+    ChecksumCtx *ctx = checksum_begin();
+    char *buf = malloc(HASH_READ_BLOCK);
+    if (!ctx || !buf)
+    {
+        checksum_end(ctx, out);
+        free(buf);
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    ssize_t n;
+    while ((n = read(fd, buf, HASH_READ_BLOCK)) > 0)
+        checksum_update(ctx, buf, (size_t)n);
+    err = n < 0 ? errno : 0;
+    free(buf);
+    checksum_end(ctx, out);
+
+    // 읽는 동안 바뀌지 않았을 때만 기억한다
+    struct stat after;
+    bool stable = !err && fstat(fd, &after) == 0 && after.st_size == st.st_size &&
+                  after.st_mtim.tv_sec == st.st_mtim.tv_sec && after.st_mtim.tv_nsec == st.st_mtim.tv_nsec;
+    close(fd);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    if (stable)
+    {
+        pthread_mutex_lock(&cache_lock);
+        e = cache_slot(&st);
+        e->dev = st.st_dev;
+        e->ino = st.st_ino;
+        e->size = st.st_size;
+        e->mtime = st.st_mtim;
+        memcpy(e->hex, out, CHECKSUM_HEX_LEN);
+        pthread_mutex_unlock(&cache_lock);
+    }
+    return 0;
+}
+
+void file_hash_remember(int fd, const char *hex)
+{
+    struct stat st;
+    if (fd < 0 || !checksum_is_hex(hex) || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    pthread_mutex_lock(&cache_lock);
+    HashCacheEntry *e = cache_slot(&st);
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->size = st.st_size;
+    e->mtime = st.st_mtim;
+    for (int i = 0; i < CHECKSUM_HEX_LEN; i++)
+        e->hex[i] = (char)tolower((unsigned char)hex[i]);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// ------------------------------------------------------------
+// 여러 파일
+// ------------------------------------------------------------
+typedef struct
+{
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    size_t *done;            // 끝난 순서대로 항목 번호
+    size_t done_head, done_tail;
+} HashBatch;
+
+typedef struct
+{
+    HashBatch *b;
+    FileHashItem *item;
+    size_t index;
+} HashTask;
+
+static void run_item(FileHashItem *item)
+{
+    item->err = file_hash(item->path, item->hex, &item->size, &item->cached) == 0 ? 0 : (errno ? errno : EIO);
+}
+
+static void hash_task(void *arg)
+{
+    HashTask *t = arg;
+    HashBatch *b = t->b;
+
+    run_item(t->item);
+
+    pthread_mutex_lock(&b->mu);
+    b->done[b->done_tail++] = t->index;
+    pthread_cond_signal(&b->cond);
+    pthread_mutex_unlock(&b->mu);
+}
+
+void file_hash_batch(WorkerPool *pool, FileHashItem *items, size_t count, FileHashResultFn result, void *ctx)
+{
+    HashBatch b;
+    memset(&b, 0, sizeof(b));
+    b.done = calloc(count ? count : 1, sizeof(*b.done));
+    HashTask *tasks = calloc(count ? count : 1, sizeof(*tasks));
+    if (!b.done || !tasks)
+        pool = NULL;   // 메모리가 부족하면 하나씩 바로 실행
+
+    bool go_on = true;
+    if (!pool)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (go_on)
+                run_item(&items[i]);
+            else
+                items[i].err = ECANCELED;
+            if (result && !result(ctx, i, &items[i]))
+                go_on = false;
+        }
+        free(b.done);
+        free(tasks);
+        return;
+    }
+
+    pthread_mutex_init(&b.mu, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    size_t window = (size_t)worker_pool_size(pool) * HASH_WINDOW_PER_THREAD;
+    size_t next = 0, reported = 0;
+    pthread_mutex_lock(&b.mu);
+    while (reported < count)
+    {
+        // 창이 빌 때마다 다음 파일을 맡긴다. 취소되면 남은 파일은 읽지 않고 보고한다.
+        while (next < count && next - reported < window)
+        {
+            size_t i = next++;
+            if (!go_on)
+            {
+                items[i].err = ECANCELED;
+                b.done[b.done_tail++] = i;
+                continue;
+            }
+            tasks[i] = (HashTask){ &b, &items[i], i };
+            pthread_mutex_unlock(&b.mu);
+            if (worker_pool_submit(pool, hash_task, &tasks[i]) != 0)
+                hash_task(&tasks[i]);
+            pthread_mutex_lock(&b.mu);
+        }
+
+        while (b.done_head == b.done_tail)
+            pthread_cond_wait(&b.cond, &b.mu);
+        while (b.done_head < b.done_tail)
+        {
+            size_t idx = b.done[b.done_head++];
+            reported++;
+            pthread_mutex_unlock(&b.mu);
+            if (result && !result(ctx, idx, &items[idx]))
+                go_on = false;
+            pthread_mutex_lock(&b.mu);
+        }
+    }
+    pthread_mutex_unlock(&b.mu);
+
+    pthread_mutex_destroy(&b.mu);
+    pthread_cond_destroy(&b.cond);
+    free(b.done);
+    free(tasks);
+}
@@ -0,0 +1,42 @@
+#ifndef FILE_HASH_H
+#define FILE_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "checksum.h"
+#include "worker_pool.h"
+
+// 파일 SHA-256 (업로드 검증, HASH 명령)
+//
+// 결과는 (장치, inode, 크기, 수정 시각) 을 키로 기억해 두고, 파일이 그대로면 다시 읽지 않는다.
+// 읽는 도중 파일이 바뀌었으면 결과는 돌려주되 기억하지 않는다. 여러 파일은 작업 풀에서 파일마다
+// 병렬로 해시한다 (한 파일 안은 순서대로라 나눌 수 없다). SHA-256 자체는 OpenSSL 이 CPU 에 맞는
+// 구현(SHA 확장 명령 등)을 고른다.
+
+#define FILE_HASH_CACHE_SLOTS 8192
+
+typedef struct
+{
+    const char *path;        // 호출자가 검증한 경로
+    // 결과
+    int err;                 // 0 이면 성공, 아니면 errno
+    char hex[CHECKSUM_HEX_LEN];
+    long long size;
+    bool cached;             // 기억해 둔 결과 (파일을 읽지 않음)
+} FileHashItem;
+
+// 파일 하나. 0 = 성공, -1 = 실패 (errno)
+int file_hash(const char *path, char out[CHECKSUM_HEX_LEN], long long *size, bool *cached);
+
+// 업로드하면서 이미 검증한 내용의 해시를 fd 가 가리키는 파일의 결과로 기억해 둔다
+// (뒤따르는 HASH 확인이 파일을 다시 읽지 않도록)
+void file_hash_remember(int fd, const char *hex);
+
+// 항목이 끝날 때마다 file_hash_batch 를 부른 스레드에서 완료 순서대로 불린다.
+// false 를 돌려주면 취소: 아직 시작하지 않은 항목은 읽지 않고 ECANCELED 로 보고한다.
+typedef bool (*FileHashResultFn)(void *ctx, size_t index, const FileHashItem *item);
+
+void file_hash_batch(WorkerPool *pool, FileHashItem *items, size_t count, FileHashResultFn result, void *ctx);
+
+#endif
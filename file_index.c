@@ -0,0 +1,713 @@
+// file_index.c
+#define _GNU_SOURCE
+#include "file_index.h"
+#include "tree_watch.h"
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define NONE UINT32_MAX
+// 지워진 항목이 이만큼 넘게 쌓이고 살아 있는 항목보다 많아지면 새로 짓는다
+#define INDEX_COMPACT_MIN 65536
+
+// 항목 하나. 자식은 first_child 에서 시작하는 이중 연결 목록.
+typedef struct
+{
+    uint32_t parent;
+    uint32_t first_child, next_sibling, prev_sibling;
+    uint32_t hash_next;      // (parent, name) 해시의 같은 버킷
+    uint32_t name;           // arena 안의 위치 (NUL 로 끝남)
+    uint16_t name_len;
+    uint8_t is_dir;
+    uint8_t alive;
+    long long size;
+    time_t mtime;
+} Entry;
+
+// trigram 하나의 항목 번호 목록 (번호가 늘어나는 순서)
+typedef struct
+{
+    uint32_t key;            // 0 = 빈 칸
+    uint32_t len, cap;
+    uint32_t *ids;
+} Posting;
+
+typedef struct
+{
+    Entry *entries;
+    uint32_t count, cap;
+    uint32_t live, dead;
+
+    char *arena;
+    size_t arena_len, arena_cap;
+
+    uint32_t *buckets;       // (parent, name) → 항목
+    uint32_t nbuckets;       // 2의 거듭제곱
+
+    Posting *postings;       // trigram → 항목 목록 (열린 주소법)
+    uint32_t npostings, posting_used;
+} Index;
+
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static Index *index_cur;
+static bool index_ready;
+static char root_path[PATH_MAX];
+static size_t root_len;
+
+// ------------------------------------------------------------
+// 해시, trigram
+// ------------------------------------------------------------
+static uint32_t name_hash(uint32_t parent, const char *name, size_t len)
+{
+    uint32_t h = 2166136261u ^ parent * 2654435761u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+static unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static uint32_t trigram(const char *s)
+{
+    return (uint32_t)fold(s[0]) << 16 | (uint32_t)fold(s[1]) << 8 | fold(s[2]);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static Posting *posting_find(const Index *ix, uint32_t key)
+{
+    if (!ix->npostings)
+        return NULL;
+    for (uint32_t i = key * 2654435761u & (ix->npostings - 1);; i = (i + 1) & (ix->npostings - 1))
+    {
+        if (ix->postings[i].key == key)
+            return &ix->postings[i];
+        if (ix->postings[i].key == 0)
+            return NULL;
+    }
+}
+
+static Posting *posting_get(Index *ix, uint32_t key)
+{
+    if ((ix->posting_used + 1) * 10 > ix->npostings * 7)
+    {
+        uint32_t n = ix->npostings ? ix->npostings * 2 : 4096;
+        Posting *p = calloc(n, sizeof(*p));
+        if (!p)
+            return NULL;
+        for (uint32_t i = 0; i < ix->npostings; i++)
+        {
+            if (!ix->postings[i].key)
+                continue;
+            uint32_t j = ix->postings[i].key * 2654435761u & (n - 1);
+            while (p[j].key)
+                j = (j + 1) & (n - 1);
+            p[j] = ix->postings[i];
+        }
+        free(ix->postings);
+        ix->postings = p;
+        ix->npostings = n;
+    }
+
+    uint32_t i = key * 2654435761u & (ix->npostings - 1);
+    while (ix->postings[i].key && ix->postings[i].key != key)
+        i = (i + 1) & (ix->npostings - 1);
+    if (!ix->postings[i].key)
+    {
+        ix->postings[i].key = key;
+        ix->posting_used++;
+    }
+    return &ix->postings[i];
+}
+
+static void postings_add(Index *ix, uint32_t id, const char *name, size_t len)
+{
+    uint32_t keys[NAME_MAX];
+    size_t n = 0;
+    for (size_t i = 0; i + 3 <= len && n < NAME_MAX; i++)
+        keys[n++] = trigram(name + i);
+    qsort(keys, n, sizeof(keys[0]), cmp_u32);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i > 0 && keys[i] == keys[i - 1])
+            continue;
+        Posting *p = posting_get(ix, keys[i]);
+        if (!p)
+            return;
+        if (p->len == p->cap)
+        {
+            uint32_t cap = p->cap ? p->cap * 2 : 4;
+            uint32_t *ids = realloc(p->ids, cap * sizeof(*ids));
+            if (!ids)
+                return;
+            p->ids = ids;
+            p->cap = cap;
+        }
+        p->ids[p->len++] = id;
+    }
+}
+
+// ------------------------------------------------------------
+// 항목
+// ------------------------------------------------------------
+static const char *entry_name(const Index *ix, uint32_t id)
+{
+    return ix->arena + ix->entries[id].name;
+}
+
+static uint32_t entry_lookup(const Index *ix, uint32_t parent, const char *name, size_t len)
+{
+    for (uint32_t id = ix->buckets[name_hash(parent, name, len) & (ix->nbuckets - 1)]; id != NONE;
+         id = ix->entries[id].hash_next)
+    {
+        const Entry *e = &ix->entries[id];
+        if (e->parent == parent && e->name_len == len && memcmp(ix->arena + e->name, name, len) == 0)
+            return id;
+    }
+    return NONE;
+}
+
+static void hash_insert(Index *ix, uint32_t id)
+{
+    Entry *e = &ix->entries[id];
+    uint32_t *b = &ix->buckets[name_hash(e->parent, entry_name(ix, id), e->name_len) & (ix->nbuckets - 1)];
+    e->hash_next = *b;
+    *b = id;
+}
+
+static void hash_remove(Index *ix, uint32_t id)
+{
+    Entry *e = &ix->entries[id];
+    uint32_t *p = &ix->buckets[name_hash(e->parent, entry_name(ix, id), e->name_len) & (ix->nbuckets - 1)];
+    while (*p != NONE && *p != id)
+        p = &ix->entries[*p].hash_next;
+    if (*p == id)
+        *p = e->hash_next;
+}
+
+static int hash_grow(Index *ix)
+{
+    uint32_t n = ix->nbuckets ? ix->nbuckets * 2 : 4096;
+    uint32_t *b = malloc(n * sizeof(*b));
+    if (!b)
+        return -1;
+    memset(b, 0xff, n * sizeof(*b));
+    free(ix->buckets);
+    ix->buckets = b;
+    ix->nbuckets = n;
+    for (uint32_t id = 0; id < ix->count; id++)
+        if (ix->entries[id].alive)
+            hash_insert(ix, id);
+    return 0;
+}
+
+static void link_child(Index *ix, uint32_t parent, uint32_t id)
+{
+    Entry *e = &ix->entries[id];
+    e->parent = parent;
+    e->prev_sibling = NONE;
+    e->next_sibling = parent == NONE ? NONE : ix->entries[parent].first_child;
+    if (e->next_sibling != NONE)
+        ix->entries[e->next_sibling].prev_sibling = id;
+    if (parent != NONE)
+        ix->entries[parent].first_child = id;
+}
+
+static void unlink_child(Index *ix, uint32_t id)
+{
+    Entry *e = &ix->entries[id];
+    if (e->prev_sibling != NONE)
+        ix->entries[e->prev_sibling].next_sibling = e->next_sibling;
+    else if (e->parent != NONE)
+        ix->entries[e->parent].first_child = e->next_sibling;
+    if (e->next_sibling != NONE)
+        ix->entries[e->next_sibling].prev_sibling = e->prev_sibling;
+    e->prev_sibling = e->next_sibling = NONE;
+}
+
+static uint32_t entry_new(Index *ix, uint32_t parent, const char *name, size_t len, bool is_dir, long long size,
+                          time_t mtime)
+{
+    if (len > UINT16_MAX || ix->count == NONE - 1)
+        return NONE;
+    if (ix->live + 1 > ix->nbuckets && hash_grow(ix) != 0)
+        return NONE;
+    if (ix->count == ix->cap)
+    {
+        uint32_t cap = ix->cap ? ix->cap * 2 : 4096;
+        Entry *e = realloc(ix->entries, cap * sizeof(*e));
+        if (!e)
+            return NONE;
+        ix->entries = e;
+        ix->cap = cap;
+    }
+    if (ix->arena_len + len + 1 > ix->arena_cap)
+    {
+        size_t cap = ix->arena_cap ? ix->arena_cap * 2 : 64 * 1024;
+        while (cap < ix->arena_len + len + 1)
+            cap *= 2;
+        if (cap > UINT32_MAX)
+            return NONE;
+        char *a = realloc(ix->arena, cap);
+        if (!a)
+            return NONE;
+        ix->arena = a;
+        ix->arena_cap = cap;
+    }
+
+    uint32_t id = ix->count++;
+    Entry *e = &ix->entries[id];
+    e->first_child = NONE;
+    e->name = (uint32_t)ix->arena_len;
+    e->name_len = (uint16_t)len;
+    e->is_dir = is_dir;
+    e->alive = 1;
+    e->size = size;
+    e->mtime = mtime;
+    memcpy(ix->arena + ix->arena_len, name, len);
+    ix->arena[ix->arena_len + len] = '\0';
+    ix->arena_len += len + 1;
+    ix->live++;
+
+    link_child(ix, parent, id);
+    hash_insert(ix, id);
+    postings_add(ix, id, name, len);
+    return id;
+}
+
+// id 와 그 하위 항목을 모두 지운다. 자식을 하나씩 떼어 내며 내려가고, 잎부터 지우며 올라온다.
+static void entry_remove(Index *ix, uint32_t id)
+{
+    unlink_child(ix, id);
+    uint32_t cur = id;
+    while (1)
+    {
+        Entry *e = &ix->entries[cur];
+        if (e->first_child != NONE)
+        {
+            uint32_t child = e->first_child;
+            e->first_child = ix->entries[child].next_sibling;
+            cur = child;
+            continue;
+        }
+        hash_remove(ix, cur);
+        e->alive = 0;
+        ix->live--;
+        ix->dead++;
+        if (cur == id)
+            break;
+        cur = e->parent;
+    }
+}
+
+static Index *index_new(void)
+{
+    Index *ix = calloc(1, sizeof(*ix));
+    if (!ix)
+        return NULL;
+    if (hash_grow(ix) != 0 || entry_new(ix, NONE, root_path, root_len, true, 0, 0) != 0)
+    {
+        free(ix->buckets);
+        free(ix->entries);
+        free(ix->arena);
+        free(ix);
+        return NULL;
+    }
+    return ix;
+}
+
+static void index_free(Index *ix)
+{
+    if (!ix)
+        return;
+    for (uint32_t i = 0; i < ix->npostings; i++)
+        free(ix->postings[i].ids);
+    free(ix->postings);
+    free(ix->buckets);
+    free(ix->entries);
+    free(ix->arena);
+    free(ix);
+}
+
+// 살아 있는 항목만 트리 순서대로 새 색인에 옮긴다 (trigram 목록의 지워진 번호도 함께 사라진다)
+static Index *index_compact(const Index *old)
+{
+    Index *ix = index_new();
+    uint32_t *map = ix ? malloc(old->count * sizeof(*map)) : NULL;
+    if (!map)
+    {
+        index_free(ix);
+        return NULL;
+    }
+
+    map[0] = 0;
+    uint32_t cur = old->entries[0].first_child;
+    while (cur != NONE)
+    {
+        const Entry *e = &old->entries[cur];
+        map[cur] = entry_new(ix, map[e->parent], old->arena + e->name, e->name_len, e->is_dir, e->size, e->mtime);
+        if (map[cur] == NONE)
+        {
+            free(map);
+            index_free(ix);
+            return NULL;
+        }
+
+        if (e->first_child != NONE)
+        {
+            cur = e->first_child;
+            continue;
+        }
+        while (cur != 0 && old->entries[cur].next_sibling == NONE)
+            cur = old->entries[cur].parent;
+        cur = cur == 0 ? NONE : old->entries[cur].next_sibling;
+    }
+    free(map);
+    return ix;
+}
+
+// 절대 경로 → 항목 번호 (루트 밖이거나 없으면 NONE)
+static uint32_t path_lookup(const Index *ix, const char *path)
+{
+    if (strncmp(path, root_path, root_len) != 0 || (path[root_len] != '/' && path[root_len] != '\0'))
+        return NONE;
+
+    uint32_t id = 0;
+    const char *p = path + root_len;
+    while (*p && id != NONE)
+    {
+        while (*p == '/')
+            p++;
+        const char *end = strchrnul(p, '/');
+        if (end > p)
+            id = entry_lookup(ix, id, p, (size_t)(end - p));
+        p = end;
+    }
+    return id;
+}
+
+// 경로의 부모 항목과 마지막 구성요소
+static uint32_t parent_lookup(const Index *ix, const char *path, const char **name)
+{
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash < path + root_len)
+        return NONE;
+    *name = slash + 1;
+
+    char parent[PATH_MAX];
+    size_t len = (size_t)(slash - path);
+    memcpy(parent, path, len);
+    parent[len] = '\0';
+    return path_lookup(ix, parent);
+}
+
+// ------------------------------------------------------------
+// 변경 반영 (감시 스레드)
+// ------------------------------------------------------------
+static void put(Index *ix, const TreeChange *c)
+{
+    const char *name;
+    uint32_t parent = parent_lookup(ix, c->path, &name);
+    if (parent == NONE || !*name)
+        return;
+
+    long long size = c->st && !c->is_dir ? (long long)c->st->st_size : 0;
+    time_t mtime = c->st ? c->st->st_mtime : 0;
+    uint32_t id = entry_lookup(ix, parent, name, strlen(name));
+    if (id != NONE && ix->entries[id].is_dir == c->is_dir)
+    {
+        ix->entries[id].size = size;
+        ix->entries[id].mtime = mtime;
+        return;
+    }
+    if (id != NONE)
+        entry_remove(ix, id);
+    entry_new(ix, parent, name, strlen(name), c->is_dir, size, mtime);
+}
+
+// 이름이 바뀐 항목은 새 번호로 다시 만들고 자식을 옮겨 단다 (trigram 목록이 번호 순서를 유지하도록)
+static void rename_entry(Index *ix, const TreeChange *c)
+{
+    uint32_t old = path_lookup(ix, c->path);
+    if (old == NONE)
+    {
+        put(ix, &(TreeChange){ TREE_ADD, c->is_dir, c->newpath, NULL, c->st });
+        return;
+    }
+
+    const char *name;
+    uint32_t parent = parent_lookup(ix, c->newpath, &name);
+    uint32_t existing = parent == NONE ? NONE : entry_lookup(ix, parent, name, strlen(name));
+    if (existing != NONE && existing != old)
+        entry_remove(ix, existing);
+
+    uint32_t id = NONE;
+    if (parent != NONE)
+    {
+        const Entry *e = &ix->entries[old];
+        long long size = c->st && !c->is_dir ? (long long)c->st->st_size : e->size;
+        time_t mtime = c->st ? c->st->st_mtime : e->mtime;
+        id = entry_new(ix, parent, name, strlen(name), e->is_dir, size, mtime);
+    }
+    if (id == NONE)
+    {
+        entry_remove(ix, old);
+        return;
+    }
+
+    uint32_t first = ix->entries[old].first_child;
+    ix->entries[old].first_child = NONE;
+    ix->entries[id].first_child = first;
+    // 해시 키가 (parent, name) 이므로 부모가 바뀐 자식은 다시 넣어야 찾을 수 있다
+    for (uint32_t child = first; child != NONE; child = ix->entries[child].next_sibling)
+    {
+        hash_remove(ix, child);
+        ix->entries[child].parent = id;
+        hash_insert(ix, child);
+    }
+    entry_remove(ix, old);
+}
+
+static void on_change(void *ctx, const TreeChange *c)
+{
+    (void)ctx;
+    pthread_rwlock_wrlock(&index_lock);
+    Index *ix = index_cur;
+
+    switch (c->kind)
+    {
+    case TREE_SEEN:
+    case TREE_ADD:
+    case TREE_MOD:
+        put(ix, c);
+        break;
+    case TREE_DEL:
+    {
+        uint32_t id = path_lookup(ix, c->path);
+        if (id != NONE && id != 0)
+            entry_remove(ix, id);
+        break;
+    }
+    case TREE_REN:
+        rename_entry(ix, c);
+        break;
+    case TREE_SYNCED:
+        index_ready = true;
+        break;
+    case TREE_LOST:
+    {
+        // 루트부터 다시 걷는다 (SEEN ... SYNCED)
+        Index *fresh = index_new();
+        if (fresh)
+        {
+            index_free(index_cur);
+            index_cur = fresh;
+        }
+        index_ready = false;
+        break;
+    }
+    }
+
+    if (index_cur->dead > INDEX_COMPACT_MIN && index_cur->dead > index_cur->live)
+    {
+        Index *fresh = index_compact(index_cur);
+        if (fresh)
+        {
+            index_free(index_cur);
+            index_cur = fresh;
+        }
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+
+int file_index_init(const char *root)
+{
+    // 루트 전체에 재귀 inotify 를 걸므로 켠 서버에서만 (저널, 중복 제거와 같은 방식)
+    const char *env = getenv("TALKSHELL_INDEX");
+    if (!env || strcmp(env, "1") != 0)
+        return 0;
+
+    root_len = strlen(root);
+    if (root_len >= sizeof(root_path))
+        return -1;
+    memcpy(root_path, root, root_len + 1);
+    // "/" 가 루트면 경로 앞부분 비교에 빈 문자열을 쓴다
+    if (root_len == 1)
+        root_len = 0;
+
+    index_cur = index_new();
+    if (!index_cur || tree_watch_subscribe(on_change, NULL) != 0)
+    {
+        index_free(index_cur);
+        index_cur = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+bool file_index_enabled(void)
+{
+    return index_cur != NULL;
+}
+
+// ------------------------------------------------------------
+// 찾기
+// ------------------------------------------------------------
+
+// glob 에서 반드시 들어 있어야 하는 글자 조각들의 trigram 중 목록이 가장 짧은 것
+static void narrow_literal(const Index *ix, const char *s, size_t len, const Posting **best, bool *none)
+{
+    for (size_t i = 0; i + 3 <= len && !*none; i++)
+    {
+        const Posting *p = posting_find(ix, trigram(s + i));
+        if (!p || p->len == 0)
+            *none = true;
+        else if (!*best || p->len < (*best)->len)
+            *best = p;
+    }
+}
+
+static void narrow_glob(const Index *ix, const char *glob, const Posting **best, bool *none)
+{
+    char run[NAME_MAX + 1];
+    size_t n = 0;
+    for (const char *p = glob;; p++)
+    {
+        bool literal = *p && *p != '*' && *p != '?' && *p != '[';
+        if (*p == '\\' && p[1])
+            p++;
+        if (literal && n < NAME_MAX)
+        {
+            run[n++] = *p;
+            continue;
+        }
+        narrow_literal(ix, run, n, best, none);
+        n = 0;
+        if (!*p)
+            break;
+        // [...] 는 한 글자로 건너뛴다
+        if (*p == '[')
+        {
+            const char *close = p[1] ? strchr(p + 2, ']') : NULL;
+            if (close)
+                p = close;
+        }
+    }
+}
+
+static bool under(const Index *ix, uint32_t id, uint32_t dir)
+{
+    if (dir == 0)
+        return true;
+    for (uint32_t p = ix->entries[id].parent; p != NONE; p = ix->entries[p].parent)
+        if (p == dir)
+            return true;
+    return false;
+}
+
+static bool matches(const Index *ix, uint32_t id, const FindQuery *q)
+{
+    const Entry *e = &ix->entries[id];
+    if (!e->alive || id == 0)
+        return false;
+    if ((q->type == 'f' && e->is_dir) || (q->type == 'd' && !e->is_dir))
+        return false;
+    if ((q->min_size >= 0 && e->size < q->min_size) || (q->max_size >= 0 && e->size > q->max_size))
+        return false;
+    if ((q->newer && e->mtime < q->newer) || (q->older && e->mtime >= q->older))
+        return false;
+
+    const char *name = entry_name(ix, id);
+    if (q->contains && !strcasestr(name, q->contains))
+        return false;
+    if (q->glob && fnmatch(q->glob, name, q->glob_icase ? FNM_CASEFOLD : 0) != 0)
+        return false;
+    return true;
+}
+
+static void build_path(const Index *ix, uint32_t id, char out[PATH_MAX])
+{
+    uint32_t chain[PATH_MAX / 2];
+    int depth = 0;
+    for (uint32_t p = id; p != 0 && p != NONE && depth < (int)(sizeof(chain) / sizeof(chain[0])); p = ix->entries[p].parent)
+        chain[depth++] = p;
+
+    size_t len = root_len;
+    memcpy(out, root_path, len);
+    while (depth-- > 0)
+    {
+        const Entry *e = &ix->entries[chain[depth]];
+        if (len + 1 + e->name_len >= PATH_MAX)
+            break;
+        out[len++] = '/';
+        memcpy(out + len, ix->arena + e->name, e->name_len);
+        len += e->name_len;
+    }
+    out[len] = '\0';
+}
+
+int file_index_find(const char *dir, const FindQuery *q, FindResultFn fn, void *ctx, FindStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!index_cur)
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&index_lock);
+    const Index *ix = index_cur;
+    stats->entries = ix->live;
+    stats->ready = index_ready;
+
+    uint32_t top = path_lookup(ix, dir);
+    if (top == NONE)
+    {
+        pthread_rwlock_unlock(&index_lock);
+        errno = ENOENT;
+        return -1;
+    }
+
+    const Posting *best = NULL;
+    bool none = false;
+    if (q->contains)
+        narrow_literal(ix, q->contains, strlen(q->contains), &best, &none);
+    if (q->glob)
+        narrow_glob(ix, q->glob, &best, &none);
+
+    size_t total = none ? 0 : best ? best->len : ix->count;
+    bool more = true;
+    char path[PATH_MAX];
+    for (size_t i = 0; i < total; i++)
+    {
+        uint32_t id = best ? best->ids[i] : (uint32_t)i;
+        stats->candidates++;
+        if (!matches(ix, id, q) || !under(ix, id, top))
+            continue;
+        stats->matched++;
+        if (!more || stats->matched > q->limit)
+            continue;
+
+        const Entry *e = &ix->entries[id];
+        build_path(ix, id, path);
+        more = fn(ctx, e->is_dir, e->size, e->mtime, path);
+    }
+
+    pthread_rwlock_unlock(&index_lock);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// 서버 루트 아래 파일 이름 색인 (FIND, TALKSHELL_INDEX=1 일 때만).
+//
+// tree_watch 가 알려 주는 변경으로 메모리 안의 트리(이름, 크기, 수정 시각)를 갱신한다.
+// 항목은 하나의 배열에, 이름은 하나의 문자열 영역(arena)에 모아 두고, 이름의 3글자 조각(trigram,
+// ASCII 대소문자 무시)마다 그 조각을 가진 항목 번호 목록을 둔다. 이름 조건이 있으면 가장 짧은
+// 목록의 후보만 확인하므로 항목 수와 상관없이 빠르다.
+
+typedef struct
+{
+    const char *glob;        // 이름(경로의 마지막 구성요소) glob, NULL = 조건 없음
+    bool glob_icase;         // glob 을 대소문자 무시로
+    const char *contains;    // 이름에 들어 있는 문자열 (대소문자 무시), NULL = 조건 없음
+    char type;               // 'f', 'd', 0 = 둘 다
+    long long min_size;      // -1 = 조건 없음
+    long long max_size;
+    time_t newer;            // mtime >= newer (0 = 조건 없음)
+    time_t older;            // mtime < older (0 = 조건 없음)
+    size_t limit;            // 넘겨 줄 최대 개수 (일치 개수는 끝까지 센다)
+} FindQuery;
+
+typedef struct
+{
+    size_t matched;          // 조건에 맞은 항목 수 (limit 을 넘은 것 포함)
+    size_t candidates;       // 확인한 후보 수
+    size_t entries;          // 색인의 항목 수
+    bool ready;              // 처음 걷기가 끝났는지 (false 면 결과가 일부일 수 있음)
+} FindStats;
+
+// 결과 하나 (path 는 절대 경로). false 면 더 넘기지 않는다.
+typedef bool (*FindResultFn)(void *ctx, bool is_dir, long long size, time_t mtime, const char *path);
+
+// 감시 구독을 등록한다 (tree_watch_start 전에). 0 = 성공 또는 꺼짐, -1 = 실패
+int file_index_init(const char *root);
+bool file_index_enabled(void);
+
+// dir(절대 경로, realpath) 아래에서 q 에 맞는 항목을 찾는다 (dir 자신은 제외).
+// 반환: 0 = 성공, -1 = 실패 (errno: ENOSYS 색인 꺼짐, ENOENT dir 가 색인에 없음)
+int file_index_find(const char *dir, const FindQuery *q, FindResultFn fn, void *ctx, FindStats *stats);
+
+#endif
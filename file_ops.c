@@ -0,0 +1,756 @@
+// file_ops.c
+#define _GNU_SOURCE
+#include "file_ops.h"
+#include "fair_share.h"
+#include "tree_stream.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// copy_file_range 한 번에 넘기는 최대 크기 (진행 상황을 이 단위로 갱신)
+#define COPY_SPAN (8 * 1024 * 1024)
+// 진행 상황 보고 간격
+#define PROGRESS_INTERVAL_MS 250
+
+static unsigned int copy_seq = 0;
+
+typedef struct
+{
+    int src_root;
+    int dst_root;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    unsigned long long pending;
+    bool cancelled;
+    bool inline_copy;      // 단일 파일: 호출한 스레드에서 복사하므로 복사 중에도 보고할 수 있다
+    FileOpProgressFn progress;
+    void *progress_ctx;
+    struct timespec last_report;
+    FileOpProgress p;      // bytes_done, reflinked_bytes 는 작업 스레드가 원자적으로 더한다
+    char err[PATH_MAX + 64];
+    int err_no;            // 첫 오류의 errno
+} CopyJob;
+
+typedef struct
+{
+    CopyJob *job;
+    char rel[];
+} CopyTask;
+
+int fileop_move(const char *src, const char *dst, bool replace)
+{
+    if (!replace)
+    {
+        if (renameat2(AT_FDCWD, src, AT_FDCWD, dst, RENAME_NOREPLACE) == 0)
+            return 0;
+        if (errno != EINVAL && errno != ENOSYS)
+            return -1;
+
+        // RENAME_NOREPLACE 를 지원하지 않는 파일시스템: 미리 확인하고 일반 rename
+        struct stat st;
+        if (lstat(dst, &st) == 0)
+        {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+    return rename(src, dst);
+}
+
+static void job_error(CopyJob *job, const char *what, const char *path, int err)
+{
+    pthread_mutex_lock(&job->mu);
+    if (job->p.errors++ == 0)
+    {
+        snprintf(job->err, sizeof(job->err), "%s %s: %s", what, path, strerror(err));
+        job->err_no = err;
+    }
+    pthread_mutex_unlock(&job->mu);
+}
+
+static void snapshot(CopyJob *job, FileOpProgress *out)
+{
+    pthread_mutex_lock(&job->mu);
+    *out = job->p;
+    pthread_mutex_unlock(&job->mu);
+    out->bytes_done = __atomic_load_n(&job->p.bytes_done, __ATOMIC_RELAXED);
+    out->reflinked_bytes = __atomic_load_n(&job->p.reflinked_bytes, __ATOMIC_RELAXED);
+}
+
+// 호출한 스레드에서만 부른다: 보고 간격이 지났으면 진행 상황을 알리고 취소 여부를 받는다
+static void copy_report(CopyJob *job, bool force)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - job->last_report.tv_sec) * 1000 + (now.tv_nsec - job->last_report.tv_nsec) / 1000000;
+    if (!job->progress || (!force && ms < PROGRESS_INTERVAL_MS))
+        return;
+
+    job->last_report = now;
+    FileOpProgress p;
+    snapshot(job, &p);
+    if (!job->progress(job->progress_ctx, &p))
+        __atomic_store_n(&job->cancelled, true, __ATOMIC_RELAXED);
+}
+
+// 데이터 복사: reflink 를 먼저 시도하고, 안 되면 커널 안에서 copy_file_range
+static int copy_data(CopyJob *job, int in, int out, long long size, bool *reflinked)
+{
+    if (size > 0 && ioctl(out, FICLONE, in) == 0)
+    {
+        *reflinked = true;
+        __atomic_add_fetch(&job->p.reflinked_bytes, (unsigned long long)size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&job->p.bytes_done, (unsigned long long)size, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    loff_t off = 0;
+    while (off < size)
+    {
+        if (__atomic_load_n(&job->cancelled, __ATOMIC_RELAXED))
+        {
+            errno = ECANCELED;
+            return -1;
+        }
+
+        size_t want = (size - off) < COPY_SPAN ? (size_t)(size - off) : COPY_SPAN;
+        ssize_t n = copy_file_range(in, &off, out, NULL, want, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+        {
+            // 커널/파일시스템이 지원하지 않으면 일반 read/write
+            char buf[256 * 1024];
+            ssize_t r = pread(in, buf, want < sizeof(buf) ? want : sizeof(buf), off);
+            if (r <= 0)
+                return -1;
+            for (ssize_t w = 0; w < r;)
+            {
+                ssize_t k = write(out, buf + w, (size_t)(r - w));
+                if (k < 0 && errno == EINTR)
+                    continue;
+                if (k <= 0)
+                    return -1;
+                w += k;
+            }
+            off += r;
+            n = r;
+        }
+        else if (n <= 0)
+        {
+            if (n == 0)
+                errno = EIO;   // 복사 도중 원본이 줄어듦
+            return -1;
+        }
+
+        __atomic_add_fetch(&job->p.bytes_done, (unsigned long long)n, __ATOMIC_RELAXED);
+        if (job->inline_copy)
+            copy_report(job, false);
+    }
+    return 0;
+}
+
+// sdir/sname 을 ddir/dleaf 로 복사한다. 숨김 임시 이름에 쓴 뒤 이름을 바꾸므로
+// 복사 중인 파일이 실제 이름으로 보이지 않는다. mode 와 mtime 은 원본을 따른다.
+static int copy_one(CopyJob *job, int sdir, const char *sname, int ddir, const char *dleaf, const char *label)
+{
+    int in = openat(sdir, sname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (in < 0 || fstat(in, &st) != 0)
+    {
+        job_error(job, "cannot open", label, errno);
+        if (in >= 0)
+            close(in);
+        return -1;
+    }
+
+    char tmp[NAME_MAX + 1];
+    snprintf(tmp, sizeof(tmp), ".%.200s.copy-%d-%u", dleaf, (int)getpid(),
+             __atomic_add_fetch(&copy_seq, 1, __ATOMIC_RELAXED));
+    int out = openat(ddir, tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (out < 0)
+    {
+        job_error(job, "cannot create", label, errno);
+        close(in);
+        return -1;
+    }
+
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    bool reflinked = false;
+    int rc = copy_data(job, in, out, (long long)st.st_size, &reflinked);
+    if (rc == 0)
+    {
+        struct timespec ts[2] = { { .tv_sec = 0, .tv_nsec = UTIME_OMIT }, st.st_mtim };
+        fchmod(out, st.st_mode & 07777);
+        futimens(out, ts);
+    }
+    else
+    {
+        job_error(job, "copy failed for", label, errno);
+    }
+
+    close(in);
+    if (close(out) != 0 && rc == 0)
+    {
+        job_error(job, "write failed for", label, errno);
+        rc = -1;
+    }
+
+    if (rc == 0 && renameat2(ddir, tmp, ddir, dleaf, RENAME_NOREPLACE) != 0 &&
+        !((errno == EINVAL || errno == ENOSYS) && renameat(ddir, tmp, ddir, dleaf) == 0))
+    {
+        job_error(job, "cannot create", label, errno);
+        rc = -1;
+    }
+    if (rc != 0)
+        unlinkat(ddir, tmp, 0);
+
+    pthread_mutex_lock(&job->mu);
+    job->p.files_done++;
+    if (reflinked)
+        job->p.reflinked++;
+    pthread_mutex_unlock(&job->mu);
+    return rc;
+}
+
+static void copy_task(void *arg)
+{
+    CopyTask *t = arg;
+    CopyJob *job = t->job;
+
+    // 부모 디렉토리는 걷는 쪽에서 이미 만들어 두었다
+    const char *slash = strrchr(t->rel, '/');
+    int ddir = job->dst_root;
+    if (slash)
+    {
+        *(char *)slash = '\0';
+        ddir = openat(job->dst_root, t->rel, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        *(char *)slash = '/';
+    }
+
+    if (__atomic_load_n(&job->cancelled, __ATOMIC_RELAXED))
+        ;   // 취소됨: 남은 파일은 건너뛴다
+    else if (ddir < 0)
+        job_error(job, "cannot open parent of", t->rel, errno);
+    else
+        copy_one(job, job->src_root, t->rel, ddir, slash ? slash + 1 : t->rel, t->rel);
+
+    if (ddir >= 0 && ddir != job->dst_root)
+        close(ddir);
+    free(t);
+
+    pthread_mutex_lock(&job->mu);
+    if (--job->pending == 0)
+        pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mu);
+}
+
+typedef struct
+{
+    CopyJob *job;
+    WorkerPool *pool;
+} CopyWalk;
+
+static int copy_visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    CopyWalk *w = ctx;
+    CopyJob *job = w->job;
+
+    copy_report(job, false);
+    if (__atomic_load_n(&job->cancelled, __ATOMIC_RELAXED))
+        return -1;
+
+    if (!sb)
+    {
+        job_error(job, "cannot read", rel[0] ? rel : name, errno ? errno : EIO);
+        return 0;
+    }
+
+    if (S_ISDIR(sb->st_mode))
+    {
+        if (mkdirat(job->dst_root, rel, (sb->st_mode & 07777) | 0700) != 0)
+        {
+            job_error(job, "cannot create directory", rel, errno);
+            return 1;   // 하위 항목은 건너뜀
+        }
+        job->p.dirs++;
+        return 0;
+    }
+
+    if (S_ISLNK(sb->st_mode))
+    {
+        // 링크는 가리키는 대상이 아니라 링크 자체를 복사한다
+        char target[PATH_MAX];
+        ssize_t n = readlinkat(parentfd, name, target, sizeof(target) - 1);
+        if (n < 0 || (target[n] = '\0', symlinkat(target, job->dst_root, rel) != 0))
+            job_error(job, "cannot copy link", rel, errno);
+        return 0;
+    }
+
+    if (!S_ISREG(sb->st_mode))
+        return 0;
+
+    size_t len = strlen(rel) + 1;
+    CopyTask *t = malloc(sizeof(*t) + len);
+    if (!t)
+    {
+        job_error(job, "out of memory at", rel, ENOMEM);
+        return 0;
+    }
+    t->job = job;
+    memcpy(t->rel, rel, len);
+
+    pthread_mutex_lock(&job->mu);
+    job->pending++;
+    job->p.files_total++;
+    job->p.bytes_total += (unsigned long long)sb->st_size;
+    pthread_mutex_unlock(&job->mu);
+
+    if (!w->pool || worker_pool_submit(w->pool, copy_task, t) != 0)
+        copy_task(t);
+    return 0;
+}
+
+int fileop_copy(WorkerPool *pool, const char *src, const char *dst, FileOpProgressFn progress, void *ctx,
+                FileOpProgress *out, char *err, size_t err_len)
+{
+    memset(out, 0, sizeof(*out));
+    err[0] = '\0';
+
+    struct stat st;
+    if (lstat(src, &st) != 0)
+    {
+        snprintf(err, err_len, "%s", strerror(errno));
+        return -1;
+    }
+    if (!(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)))
+    {
+        snprintf(err, err_len, "%s", S_ISLNK(st.st_mode) ? "cannot copy a link" : "not a regular file or directory");
+        return -1;
+    }
+
+    CopyJob job;
+    memset(&job, 0, sizeof(job));
+    pthread_mutex_init(&job.mu, NULL);
+    pthread_cond_init(&job.cond, NULL);
+    job.src_root = -1;
+    job.dst_root = -1;
+    job.progress = progress;
+    job.progress_ctx = ctx;
+    clock_gettime(CLOCK_MONOTONIC, &job.last_report);
+
+    int rc = -1;
+    if (S_ISREG(st.st_mode))
+    {
+        // 단일 파일: 호출한 스레드에서 바로 복사
+        char dparent[PATH_MAX];
+        snprintf(dparent, sizeof(dparent), "%s", dst);
+        char *slash = strrchr(dparent, '/');
+        const char *leaf = slash ? slash + 1 : dst;
+        if (slash)
+            *slash = '\0';
+
+        int ddir = open(slash ? (dparent[0] ? dparent : "/") : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        job.p.files_total = 1;
+        job.p.bytes_total = (unsigned long long)st.st_size;
+        job.inline_copy = true;
+        if (ddir < 0)
+        {
+            job.err_no = errno;
+            snprintf(err, err_len, "%s", strerror(errno));
+        }
+        else
+        {
+            rc = copy_one(&job, AT_FDCWD, src, ddir, leaf, leaf) == 0 ? 0 : -1;
+            close(ddir);
+        }
+    }
+    else if (mkdir(dst, (st.st_mode & 07777) | 0700) != 0)
+    {
+        job.err_no = errno;
+        snprintf(err, err_len, "%s", strerror(errno));
+    }
+    else
+    {
+        job.src_root = open(src, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        job.dst_root = open(dst, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (job.src_root < 0 || job.dst_root < 0)
+        {
+            job.err_no = errno;
+            snprintf(err, err_len, "%s", strerror(errno));
+        }
+        else
+        {
+            CopyWalk w = { &job, pool };
+            tree_walk(job.src_root, copy_visit, &w);
+
+            // 남은 파일 복사가 끝날 때까지 주기적으로 진행 상황을 알린다
+            pthread_mutex_lock(&job.mu);
+            while (job.pending > 0)
+            {
+                struct timespec until;
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_nsec += PROGRESS_INTERVAL_MS * 1000000L;
+                if (until.tv_nsec >= 1000000000L)
+                {
+                    until.tv_sec++;
+                    until.tv_nsec -= 1000000000L;
+                }
+
+                if (pthread_cond_timedwait(&job.cond, &job.mu, &until) == ETIMEDOUT)
+                {
+                    pthread_mutex_unlock(&job.mu);
+                    copy_report(&job, true);
+                    pthread_mutex_lock(&job.mu);
+                }
+            }
+            pthread_mutex_unlock(&job.mu);
+            rc = job.p.errors ? 1 : 0;
+        }
+        job.p.dirs++;
+    }
+
+    snapshot(&job, out);
+    if (job.cancelled)
+    {
+        snprintf(err, err_len, "%s", strerror(ECANCELED));
+        rc = rc == 0 ? 1 : rc;
+    }
+    else if (rc != 0 && job.err[0])
+        snprintf(err, err_len, "%s", job.err);
+
+    if (job.src_root >= 0)
+        close(job.src_root);
+    if (job.dst_root >= 0)
+        close(job.dst_root);
+    pthread_mutex_destroy(&job.mu);
+    pthread_cond_destroy(&job.cond);
+    if (rc != 0)
+        errno = job.cancelled ? ECANCELED : job.err_no ? job.err_no : EIO;
+    return rc;
+}
+
+int fileop_move_copy(WorkerPool *pool, const char *src, const char *dst, bool replace, FileOpProgressFn progress,
+                     void *ctx, FileOpProgress *out, char *err, size_t err_len)
+{
+    struct stat st;
+    memset(out, 0, sizeof(*out));
+    err[0] = '\0';
+    if (!replace && lstat(dst, &st) == 0)
+    {
+        errno = EEXIST;
+        snprintf(err, err_len, "%s", strerror(errno));
+        return -1;
+    }
+
+    // dst 옆의 숨김 이름에 다 복사한 뒤 한 번에 바꿔 넣는다: 실패해도 dst 에 반쪽짜리가 남지 않는다
+    const char *slash = strrchr(dst, '/');
+    const char *leaf = slash ? slash + 1 : dst;
+    int dir_len = slash ? (int)(slash - dst) + 1 : 0;
+    char tmp[PATH_MAX];
+    bool fresh = false;
+    for (int attempt = 0; attempt < 16 && !fresh; attempt++)
+    {
+        int n = snprintf(tmp, sizeof(tmp), "%.*s.%.200s.move-%d-%u", dir_len, dst, leaf, (int)getpid(),
+                         __atomic_add_fetch(&copy_seq, 1, __ATOMIC_RELAXED));
+        if (n < 0 || n >= (int)sizeof(tmp))
+        {
+            errno = ENAMETOOLONG;
+            snprintf(err, err_len, "%s", strerror(errno));
+            return -1;
+        }
+        fresh = lstat(tmp, &st) != 0 && errno == ENOENT;
+    }
+    if (!fresh)
+    {
+        errno = EEXIST;
+        snprintf(err, err_len, "%s", strerror(errno));
+        return -1;
+    }
+
+    int saved;
+    if (fileop_copy(pool, src, tmp, progress, ctx, out, err, err_len) != 0)
+    {
+        saved = errno;
+        // 파일 하나면 err 에 임시 이름이 들어 있으므로 오류만 남긴다
+        if (lstat(src, &st) == 0 && !S_ISDIR(st.st_mode))
+            snprintf(err, err_len, "%s", strerror(saved));
+        fileop_remove_at(AT_FDCWD, tmp);
+        errno = saved;
+        return -1;
+    }
+
+    if (fileop_move(tmp, dst, replace) != 0)
+    {
+        saved = errno;
+        snprintf(err, err_len, "%s", strerror(saved));
+        fileop_remove_at(AT_FDCWD, tmp);
+        errno = saved;
+        return -1;
+    }
+
+    // dst 는 이미 완성됐으므로 원본을 다 지우지 못해도 되돌리지 않는다
+    if (fileop_remove_at(AT_FDCWD, src) != 0)
+    {
+        saved = errno;
+        snprintf(err, err_len, "copied, but cannot remove the source: %s", strerror(saved));
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+int fileop_remove_at(int parentfd, const char *name)
+{
+    fair_share_ops(1);
+    if (unlinkat(parentfd, name, 0) == 0 || errno == ENOENT)
+        return 0;
+    if (errno != EISDIR && errno != EPERM)
+        return -1;
+
+    int fd = openat(parentfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    int rc = 0;
+    struct dirent *ent;
+    while (rc == 0 && (ent = readdir(d)) != NULL)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        rc = fileop_remove_at(dirfd(d), ent->d_name);
+    }
+    closedir(d);
+
+    if (rc == 0 && unlinkat(parentfd, name, AT_REMOVEDIR) != 0 && errno != ENOENT)
+        rc = -1;
+    return rc;
+}
+
+// ------------------------------------------------------------
+// 일괄 작업
+// ------------------------------------------------------------
+typedef struct
+{
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    bool *finished;
+    size_t *done;          // 끝났지만 아직 보고하지 않은 항목 (완료 순서)
+    size_t done_head;
+    size_t done_tail;
+    bool stop;             // 결과 콜백이 취소를 요청함
+} Batch;
+
+typedef struct
+{
+    Batch *b;
+    FileOpItem *item;
+    size_t index;
+} BatchTask;
+
+static int make_dirs(char *path)
+{
+    struct stat st;
+    for (int tries = 0; tries < 2; tries++)
+    {
+        if (mkdir(path, 0755) == 0)
+            return 0;
+        if (errno == EEXIST)
+        {
+            // 다른 항목이 같은 상위 디렉토리를 동시에 만들 수 있다
+            if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+                return 0;
+            errno = EEXIST;
+            return -1;
+        }
+        if (errno != ENOENT || tries > 0)
+            return -1;
+
+        char *slash = strrchr(path, '/');
+        if (!slash || slash == path)
+            return -1;
+        *slash = '\0';
+        int rc = make_dirs(path);
+        *slash = '/';
+        if (rc != 0)
+            return -1;
+    }
+    return -1;
+}
+
+static int run_item(FileOpItem *it)
+{
+    char path[PATH_MAX];
+
+    switch (it->kind)
+    {
+    case FILEOP_DELETE:
+        if (lstat(it->path, &it->st) != 0)
+            return -1;
+        return fileop_remove_at(AT_FDCWD, it->path);
+    case FILEOP_MKDIR:
+        fair_share_ops(1);
+        if (!it->flag)
+            return mkdir(it->path, 0755);
+        snprintf(path, sizeof(path), "%s", it->path);
+        return make_dirs(path);
+    case FILEOP_STAT:
+        fair_share_ops(1);
+        return lstat(it->path, &it->st);
+    case FILEOP_MOVE:
+        fair_share_ops(1);
+        return fileop_move(it->path, it->dst, it->flag);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static void batch_task(void *arg)
+{
+    BatchTask *t = arg;
+    Batch *b = t->b;
+
+    t->item->err = run_item(t->item) == 0 ? 0 : (errno ? errno : EIO);
+
+    pthread_mutex_lock(&b->mu);
+    b->finished[t->index] = true;
+    b->done[b->done_tail++] = t->index;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->mu);
+}
+
+// a 와 b 가 같은 경로이거나 한쪽이 다른 쪽의 하위 경로인가
+static bool paths_overlap(const char *a, const char *b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+    if (strncmp(a, b, la < lb ? la : lb) != 0)
+        return false;
+    return la == lb || (la < lb ? b[la] == '/' : a[lb] == '/');
+}
+
+static bool items_conflict(const FileOpItem *x, const FileOpItem *y)
+{
+    if (x->kind == FILEOP_STAT && y->kind == FILEOP_STAT)
+        return false;
+
+    const char *xp[2] = { x->path, x->kind == FILEOP_MOVE ? x->dst : NULL };
+    const char *yp[2] = { y->path, y->kind == FILEOP_MOVE ? y->dst : NULL };
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+            if (xp[i] && yp[j] && paths_overlap(xp[i], yp[j]))
+                return true;
+    return false;
+}
+
+// b->mu 를 잡은 상태에서 부른다: 끝난 항목을 모두 보고한다 (보고하는 동안은 잠금을 푼다)
+static void batch_report(Batch *b, FileOpItem *items, FileOpResultFn result, void *ctx)
+{
+    while (b->done_head < b->done_tail)
+    {
+        size_t idx = b->done[b->done_head++];
+        pthread_mutex_unlock(&b->mu);
+        bool go_on = !result || result(ctx, idx, &items[idx]);
+        pthread_mutex_lock(&b->mu);
+        if (!go_on)
+            b->stop = true;
+    }
+}
+
+void fileop_batch(WorkerPool *pool, FileOpItem *items, size_t count, FileOpResultFn result, void *ctx)
+{
+    Batch b;
+    memset(&b, 0, sizeof(b));
+    b.finished = calloc(count ? count : 1, sizeof(*b.finished));
+    b.done = calloc(count ? count : 1, sizeof(*b.done));
+    BatchTask *tasks = calloc(count ? count : 1, sizeof(*tasks));
+    if (!b.finished || !b.done || !tasks)
+        pool = NULL;   // 메모리가 부족하면 아래에서 하나씩 바로 실행
+
+    if (!pool)
+    {
+        bool go_on = true;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!go_on)
+                items[i].err = ECANCELED;
+            else
+                items[i].err = run_item(&items[i]) == 0 ? 0 : (errno ? errno : EIO);
+            if (result && !result(ctx, i, &items[i]))
+                go_on = false;
+        }
+        free(b.finished);
+        free(b.done);
+        free(tasks);
+        return;
+    }
+
+    pthread_mutex_init(&b.mu, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    size_t oldest = 0;   // 이보다 앞선 항목은 모두 끝났다
+    pthread_mutex_lock(&b.mu);
+    for (size_t i = 0; i < count; i++)
+    {
+        // 겹치는 앞선 항목이 끝날 때까지 기다린다 (그동안 끝난 항목은 바로 보고)
+        for (size_t j = oldest; j < i; j++)
+        {
+            while (!b.finished[j] && items_conflict(&items[i], &items[j]))
+            {
+                batch_report(&b, items, result, ctx);
+                if (!b.finished[j])
+                    pthread_cond_wait(&b.cond, &b.mu);
+            }
+        }
+        while (oldest < i && b.finished[oldest])
+            oldest++;
+
+        if (b.stop)
+        {
+            // 취소됨: 실행하지 않고 끝난 것으로 보고
+            items[i].err = ECANCELED;
+            b.finished[i] = true;
+            b.done[b.done_tail++] = i;
+            batch_report(&b, items, result, ctx);
+            continue;
+        }
+
+        tasks[i] = (BatchTask){ &b, &items[i], i };
+        pthread_mutex_unlock(&b.mu);
+        if (worker_pool_submit(pool, batch_task, &tasks[i]) != 0)
+            batch_task(&tasks[i]);
+        pthread_mutex_lock(&b.mu);
+        batch_report(&b, items, result, ctx);
+    }
+
+    while (b.done_head < count)
+    {
+        if (b.done_head == b.done_tail)
+            pthread_cond_wait(&b.cond, &b.mu);
+        batch_report(&b, items, result, ctx);
+    }
+    pthread_mutex_unlock(&b.mu);
+
+    pthread_mutex_destroy(&b.mu);
+    pthread_cond_destroy(&b.cond);
+    free(b.finished);
+    free(b.done);
+    free(tasks);
+}
@@ -0,0 +1,81 @@
+#ifndef FILE_OPS_H
+#define FILE_OPS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "worker_pool.h"
+
+// 서버 안에서 끝나는 파일 복사/이동 (클라이언트를 거쳐 내려받고 다시 올릴 필요가 없다)
+//
+// 이동은 renameat2 한 번, 복사는 파일마다 FICLONE(reflink) → copy_file_range 순으로 시도한다.
+// 디렉토리 복사는 트리를 걸으며 디렉토리를 먼저 만들고, 파일은 작업 풀에서 병렬로 복사한다.
+// 경로 검증(서버 루트 밖 금지 등)은 호출자가 한다.
+
+typedef struct
+{
+    unsigned long long files_total;
+    unsigned long long files_done;
+    unsigned long long bytes_total;
+    unsigned long long bytes_done;
+    unsigned long long dirs;
+    unsigned long long errors;
+    unsigned long long reflinked;   // reflink 로 만든 파일 수 (데이터 복사 없음)
+    unsigned long long reflinked_bytes;   // bytes_done 중 reflink 로 만든 몫
+} FileOpProgress;
+
+// 진행 상황 콜백: 복사하는 동안 호출한 스레드에서 주기적으로 불린다.
+// false 를 돌려주면 취소: 새 파일 복사를 시작하지 않고, 복사 중인 파일도 다음 구간에서 멈춘다.
+typedef bool (*FileOpProgressFn)(void *ctx, const FileOpProgress *p);
+
+// src → dst 이름 변경. replace 가 false 면 dst 가 있을 때 실패 (EEXIST).
+// 다른 파일시스템이면 -1 (errno = EXDEV).
+int fileop_move(const char *src, const char *dst, bool replace);
+
+// src(파일 또는 디렉토리) 를 dst 로 복사한다. dst 는 없어야 한다.
+// 반환: 0 = 전부 성공, 1 = 디렉토리 복사 중 일부 항목 실패 (err 에 첫 오류), -1 = 실패.
+// 실패하면 errno 는 첫 오류 (취소는 ECANCELED).
+int fileop_copy(WorkerPool *pool, const char *src, const char *dst, FileOpProgressFn progress, void *ctx,
+                FileOpProgress *out, char *err, size_t err_len);
+
+// 다른 파일시스템으로의 이동: dst 옆 숨김 이름에 복사 → dst 로 이름 변경(replace 규칙은 fileop_move 와 같음)
+// → 원본 삭제. 복사나 이름 변경이 실패하면 만든 것을 지우고 -1 (errno 유지, err 에 설명).
+int fileop_move_copy(WorkerPool *pool, const char *src, const char *dst, bool replace, FileOpProgressFn progress,
+                     void *ctx, FileOpProgress *out, char *err, size_t err_len);
+
+// parentfd 기준 name 을 지운다 (디렉토리면 하위 항목까지, 링크는 따라가지 않음). 없으면 성공.
+int fileop_remove_at(int parentfd, const char *name);
+
+// ------------------------------------------------------------
+// 일괄 작업 (BATCH)
+// ------------------------------------------------------------
+// 경로는 호출자가 검증한 절대 경로여야 한다. 서로 겹치지 않는 항목은 작업 풀에서 동시에 실행하고,
+// 앞선 항목과 경로가 겹치면(같은 경로이거나 한쪽이 다른 쪽의 하위) 그 항목이 끝난 뒤에 실행한다.
+
+typedef enum
+{
+    FILEOP_DELETE,
+    FILEOP_MKDIR,     // parents 면 mkdir -p
+    FILEOP_STAT,
+    FILEOP_MOVE,      // 다른 파일시스템(EXDEV)은 실패로 돌려준다
+} FileOpKind;
+
+typedef struct
+{
+    FileOpKind kind;
+    bool flag;              // MKDIR: -p, MOVE: 덮어쓰기 허용
+    const char *path;       // 대상 (MOVE 는 원본)
+    const char *dst;        // MOVE 대상
+    // 결과
+    int err;                // 0 이면 성공, 아니면 errno
+    struct stat st;         // STAT 결과 (lstat)
+} FileOpItem;
+
+// 항목이 끝날 때마다 fileop_batch 를 부른 스레드에서 완료 순서대로 불린다.
+// false 를 돌려주면 취소: 아직 시작하지 않은 항목은 실행하지 않고 ECANCELED 로 보고한다.
+typedef bool (*FileOpResultFn)(void *ctx, size_t index, const FileOpItem *item);
+
+void fileop_batch(WorkerPool *pool, FileOpItem *items, size_t count, FileOpResultFn result, void *ctx);
+
+#endif
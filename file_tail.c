@@ -0,0 +1,548 @@
+// file_tail.c
+#define _GNU_SOURCE
+#include "file_tail.h"
+#include "watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILE_TAIL_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                        IN_DELETE_SELF | IN_MOVE_SELF)
+// 마지막 몇 줄을 찾을 때 끝에서 거슬러 읽는 최대 양
+#define FILE_TAIL_START_WINDOW (64 * 1024)
+// 건너뛸 때 남겨 두는 끝부분
+#define FILE_TAIL_SKIP_KEEP (FILE_TAIL_LINE_MAX * 8)
+#define FILE_TAIL_READ_BLOCK (16 * 1024)
+
+// tail_read 결과
+#define PUMP_MORE 1       // 보내지 못한 내용이 남음
+#define PUMP_PARTIAL 2    // 개행을 기다리는 줄이 있음
+
+typedef struct
+{
+    struct FileTails *owner;   // NULL 이면 빈 칸
+    unsigned id;
+    int handle;                // 부모 디렉토리 감시
+    int dirfd;                 // 부모 디렉토리 (O_PATH): 교체된 파일은 이 안에서만 다시 연다
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    char path[PATH_MAX];
+    char name[NAME_MAX + 1];
+    long long offset;          // 다음에 읽을 위치
+    char part[FILE_TAIL_LINE_MAX];   // 읽었지만 개행이 오지 않아 보내지 않은 줄
+    size_t part_len;
+    struct timespec part_at;   // part 가 마지막으로 늘어난 시각
+    bool resync;               // 줄 중간부터 읽기 시작함: 다음 개행까지 버린다
+    bool missing;              // GONE 을 보냄
+    double tokens;             // 보낼 수 있는 줄 수
+    struct timespec refill;
+    // 감시 스레드가 owner->mu 안에서 세운다
+    bool recheck;              // 같은 이름의 파일이 바뀌었거나 사라졌을 수 있음
+    bool dir_gone;
+} Tail;
+
+struct FileTails
+{
+    pthread_mutex_t mu;
+    int fd;                    // eventfd
+    Tail tails[FILE_TAIL_MAX_FILES];
+    unsigned next_id;
+    bool pending;
+    bool signalled;
+    bool retry;                // wake 에 다시 보낸다 (밀린 내용, 개행을 기다리는 줄)
+    struct timespec first;     // 보내지 않은 첫 이벤트 시각
+    struct timespec last;      // 마지막 이벤트 시각
+    struct timespec wake;
+};
+
+static long ms_since(const struct timespec *t, const struct timespec *now)
+{
+    return (now->tv_sec - t->tv_sec) * 1000 + (now->tv_nsec - t->tv_nsec) / 1000000;
+}
+
+static void after_ms(struct timespec *out, const struct timespec *from, long ms)
+{
+    *out = *from;
+    out->tv_sec += ms / 1000;
+    out->tv_nsec += (ms % 1000) * 1000000;
+    if (out->tv_nsec >= 1000000000)
+    {
+        out->tv_sec++;
+        out->tv_nsec -= 1000000000;
+    }
+}
+
+// mu 안에서 부른다
+static void tails_signal(FileTails *ft)
+{
+    uint64_t one = 1;
+    if (!ft->signalled && write(ft->fd, &one, sizeof(one)) == (ssize_t)sizeof(one))
+        ft->signalled = true;
+}
+
+static void tail_event(void *ctx, const WatchEvent *ev)
+{
+    Tail *t = ctx;
+    FileTails *ft = t->owner;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&ft->mu);
+    if (!ev)
+    {
+        // tick: 쓰기가 잠잠해졌거나 너무 오래 기다렸으면 세션 스레드를 깨운다
+        if ((ft->pending && (ms_since(&ft->last, &now) >= FILE_TAIL_QUIET_MS ||
+                             ms_since(&ft->first, &now) >= FILE_TAIL_MAX_DELAY_MS)) ||
+            (ft->retry && ms_since(&ft->wake, &now) >= 0))
+            tails_signal(ft);
+        pthread_mutex_unlock(&ft->mu);
+        return;
+    }
+
+    if (ev->mask & IN_Q_OVERFLOW)
+        t->recheck = true;
+    else if (!ev->name[0] && ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+        t->dir_gone = true;
+    else if (strcmp(ev->name, t->name) != 0)
+    {
+        pthread_mutex_unlock(&ft->mu);
+        return;
+    }
+    else if (!(ev->mask & (IN_MODIFY | IN_CLOSE_WRITE)))
+        t->recheck = true;
+
+    if (!ft->pending)
+        ft->first = now;
+    ft->pending = true;
+    ft->last = now;
+    pthread_mutex_unlock(&ft->mu);
+}
+
+FileTails *file_tails_open(void)
+{
+    FileTails *ft = calloc(1, sizeof(*ft));
+    if (!ft)
+        return NULL;
+    ft->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ft->fd < 0)
+    {
+        free(ft);
+        return NULL;
+    }
+    pthread_mutex_init(&ft->mu, NULL);
+    return ft;
+}
+
+static void tail_stop(Tail *t)
+{
+    // watch_remove 가 돌아오면 콜백이 더는 불리지 않으므로 잠금 없이 정리해도 된다
+    watch_remove(t->handle);
+    close(t->fd);
+    close(t->dirfd);
+    memset(t, 0, sizeof(*t));
+}
+
+void file_tails_close(FileTails *ft)
+{
+    if (!ft)
+        return;
+    file_tails_remove(ft, 0);
+    close(ft->fd);
+    pthread_mutex_destroy(&ft->mu);
+    free(ft);
+}
+
+int file_tails_fd(const FileTails *ft)
+{
+    return ft->fd;
+}
+
+int file_tails_count(const FileTails *ft)
+{
+    int n = 0;
+    for (size_t i = 0; i < FILE_TAIL_MAX_FILES; i++)
+        n += ft->tails[i].owner != NULL;
+    return n;
+}
+
+// 끝에서 lines 줄 앞의 위치. 창 안에서 다 찾지 못하면 창 처음부터 (첫 줄은 잘렸으므로 *resync).
+static long long start_offset(int fd, long long size, int lines, bool *resync)
+{
+    *resync = false;
+    if (lines <= 0 || size == 0)
+        return size;
+
+    size_t window = size < FILE_TAIL_START_WINDOW ? (size_t)size : FILE_TAIL_START_WINDOW;
+    char *buf = malloc(window);
+    if (!buf)
+        return size;
+    long long base = size - (long long)window;
+    ssize_t n = pread(fd, buf, window, base);
+    long long start = base;
+    if (n != (ssize_t)window)
+        start = size;
+    else
+    {
+        // 마지막 개행은 줄의 끝이지 새 줄의 시작이 아니다
+        size_t i = window;
+        if (buf[i - 1] == '\n')
+            i--;
+        int found = 0;
+        while (i > 0 && found < lines)
+            if (buf[--i] == '\n')
+                found++;
+        if (found == lines)
+            start = base + (long long)i + 1;
+        else
+            *resync = base > 0;
+    }
+    free(buf);
+    return start;
+}
+
+int file_tails_add(FileTails *ft, const char *path, long long from, int lines, unsigned *id, long long *offset)
+{
+    Tail *t = NULL;
+    for (size_t i = 0; i < FILE_TAIL_MAX_FILES && !t; i++)
+        if (!ft->tails[i].owner)
+            t = &ft->tails[i];
+    const char *slash = strrchr(path, '/');
+    if (!t || !slash || !slash[1] || strlen(path) >= sizeof(t->path) || strlen(slash + 1) >= sizeof(t->name))
+    {
+        errno = t ? EINVAL : E2BIG;
+        return -1;
+    }
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    int dirfd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        return -1;
+    int fd = openat(dirfd, slash + 1, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    struct stat st;
+    int err = fd < 0 ? errno : fstat(fd, &st) != 0 ? errno : S_ISDIR(st.st_mode) ? EISDIR : !S_ISREG(st.st_mode) ? EINVAL : 0;
+    if (err)
+    {
+        if (fd >= 0)
+            close(fd);
+        close(dirfd);
+        errno = err;
+        return -1;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->dirfd = dirfd;
+    t->fd = fd;
+    t->dev = st.st_dev;
+    t->ino = st.st_ino;
+    snprintf(t->path, sizeof(t->path), "%s", path);
+    snprintf(t->name, sizeof(t->name), "%s", slash + 1);
+    // 다시 접속했는데 그 사이 파일이 줄었으면 처음부터
+    if (from >= 0)
+        t->offset = from <= st.st_size ? from : 0;
+    else
+        t->offset = start_offset(fd, st.st_size, lines, &t->resync);
+    t->tokens = FILE_TAIL_LINES_BURST;
+    clock_gettime(CLOCK_MONOTONIC, &t->refill);
+    t->owner = ft;
+
+    t->handle = watch_add(dir, FILE_TAIL_MASK, true, tail_event, t);
+    if (t->handle < 0)
+    {
+        err = errno;
+        close(fd);
+        close(dirfd);
+        memset(t, 0, sizeof(*t));
+        errno = err;
+        return -1;
+    }
+
+    if (++ft->next_id == 0)
+        ft->next_id = 1;
+    t->id = ft->next_id;
+    *id = t->id;
+    *offset = t->offset;
+
+    // 시작 위치 뒤에 이미 있는 내용(마지막 몇 줄)을 바로 보낸다
+    pthread_mutex_lock(&ft->mu);
+    tails_signal(ft);
+    pthread_mutex_unlock(&ft->mu);
+    return 0;
+}
+
+int file_tails_remove(FileTails *ft, unsigned id)
+{
+    int n = 0;
+    for (size_t i = 0; i < FILE_TAIL_MAX_FILES; i++)
+    {
+        if (ft->tails[i].owner && (id == 0 || ft->tails[i].id == id))
+        {
+            tail_stop(&ft->tails[i]);
+            n++;
+        }
+    }
+    return n;
+}
+
+// "EVT TAIL <id> <offset> <kind>[ <text>]"
+static int emit(const TreeSink *sink, const Tail *t, long long offset, const char *kind, const char *text, size_t len)
+{
+    char line[FILE_TAIL_LINE_MAX * 4 + 96];
+    size_t n = (size_t)snprintf(line, sizeof(line), "EVT TAIL %u %lld %s", t->id, offset, kind);
+    if (text)
+    {
+        line[n++] = ' ';
+        for (size_t i = 0; i < len; i++)
+        {
+            unsigned char c = (unsigned char)text[i];
+            if (c == '\\')
+                n += (size_t)sprintf(line + n, "\\\\");
+            else if (c == '\t')
+                n += (size_t)sprintf(line + n, "\\t");
+            else if (c == '\r')
+                n += (size_t)sprintf(line + n, "\\r");
+            else if (c < 0x20 || c == 0x7f)
+                n += (size_t)sprintf(line + n, "\\x%02x", c);
+            else
+                line[n++] = (char)c;
+        }
+    }
+    line[n++] = '\n';
+    return sink->write(sink->ctx, line, n);
+}
+
+// 지금 fd 에서 offset 뒤에 붙은 바이트를 읽어 보낸다. 반환: PUMP_* 비트, 쓰기 실패 시 -1
+static int tail_read(Tail *t, const TreeSink *sink, int *lines, const struct timespec *now)
+{
+    struct stat st;
+    if (fstat(t->fd, &st) != 0)
+        return 0;
+
+    if (st.st_size < t->offset)
+    {
+        if (emit(sink, t, 0, "TRUNC", NULL, 0) != 0)
+            return -1;
+        (*lines)++;
+        t->offset = 0;
+        t->part_len = 0;
+        t->resync = false;
+    }
+
+    // 초당 FILE_TAIL_LINES_PER_SEC 줄씩 채워지는 토큰
+    double elapsed = (double)ms_since(&t->refill, now) / 1000.0;
+    t->tokens += elapsed * FILE_TAIL_LINES_PER_SEC;
+    if (t->tokens > FILE_TAIL_LINES_BURST)
+        t->tokens = FILE_TAIL_LINES_BURST;
+    t->refill = *now;
+
+    char buf[FILE_TAIL_READ_BLOCK];
+    bool grew = false;
+    while (t->offset < st.st_size && t->tokens >= 1)
+    {
+        long long left = st.st_size - t->offset;
+        ssize_t n = pread(t->fd, buf, left < (long long)sizeof(buf) ? (size_t)left : sizeof(buf), t->offset);
+        if (n <= 0)
+            break;
+
+        ssize_t i = 0;
+        for (; i < n && t->tokens >= 1; i++)
+        {
+            char c = buf[i];
+            if (t->resync)
+            {
+                t->resync = c != '\n';
+                continue;
+            }
+            if (c != '\n')
+            {
+                t->part[t->part_len++] = c;
+                grew = true;
+                if (t->part_len < sizeof(t->part))
+                    continue;
+            }
+            // 개행이 왔거나 한 줄에 담을 수 있는 만큼 찼다
+            if (emit(sink, t, t->offset + i + 1, c == '\n' ? "L" : "P", t->part, t->part_len) != 0)
+                return -1;
+            (*lines)++;
+            t->part_len = 0;
+            t->tokens -= 1;
+        }
+        t->offset += i;
+    }
+    if (grew)
+        t->part_at = *now;
+
+    // 보내는 속도보다 훨씬 빨리 늘어나면 끝부분만 남기고 건너뛴다 (읽지 않음)
+    long long backlog = st.st_size - t->offset;
+    if (backlog > FILE_TAIL_MAX_BACKLOG)
+    {
+        long long to = st.st_size - FILE_TAIL_SKIP_KEEP;
+        char skipped[32];
+        int len = snprintf(skipped, sizeof(skipped), "%lld", to - t->offset + (long long)t->part_len);
+        if (emit(sink, t, to, "SKIP", skipped, (size_t)len) != 0)
+            return -1;
+        (*lines)++;
+        t->offset = to;
+        t->part_len = 0;
+        t->resync = true;
+    }
+    if (t->offset < st.st_size)
+        return PUMP_MORE;
+
+    if (t->part_len > 0)
+    {
+        if (ms_since(&t->part_at, now) < FILE_TAIL_PARTIAL_MS)
+            return PUMP_PARTIAL;
+        if (emit(sink, t, t->offset, "P", t->part, t->part_len) != 0)
+            return -1;
+        (*lines)++;
+        t->part_len = 0;
+    }
+    return 0;
+}
+
+// 같은 이름이 다른 파일로 바뀌었거나 사라졌는지 본다 (기존 파일에 남은 내용은 먼저 읽어 둔 뒤).
+// 새 파일은 열어 둔 부모 디렉토리 안에서 링크를 따라가지 않고 연다: 심볼릭 링크로 바꿔 놓아
+// 서버 루트 밖의 파일을 읽게 할 수 없다 (링크는 일반 파일이 아니므로 GONE 으로 본다).
+static int tail_recheck(Tail *t, const TreeSink *sink, int *lines)
+{
+    struct stat st;
+    if (fstatat(t->dirfd, t->name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (t->missing)
+            return 0;
+        t->missing = true;
+        (*lines)++;
+        return emit(sink, t, t->offset, "GONE", NULL, 0);
+    }
+    t->missing = false;
+    if (st.st_dev == t->dev && st.st_ino == t->ino)
+        return 0;
+
+    int fd = openat(t->dirfd, t->name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    // stat 과 open 사이에 다시 바뀌었으면 다음 이벤트에서 다시 본다
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return 0;
+    }
+
+    struct stat old;
+    if (fstat(t->fd, &old) == 0 && old.st_size > t->offset)
+    {
+        char skipped[32];
+        int len = snprintf(skipped, sizeof(skipped), "%lld", old.st_size - t->offset);
+        if (emit(sink, t, old.st_size, "SKIP", skipped, (size_t)len) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        (*lines)++;
+    }
+    if (t->part_len > 0)
+    {
+        if (emit(sink, t, t->offset, "P", t->part, t->part_len) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        (*lines)++;
+    }
+
+    close(t->fd);
+    t->fd = fd;
+    t->dev = st.st_dev;
+    t->ino = st.st_ino;
+    t->offset = 0;
+    t->part_len = 0;
+    t->resync = false;
+    (*lines)++;
+    if (emit(sink, t, 0, "ROTATE", NULL, 0) != 0)
+        return -1;
+    return 0;
+}
+
+int file_tails_flush(FileTails *ft, const TreeSink *sink)
+{
+    uint64_t drain;
+    if (read(ft->fd, &drain, sizeof(drain)) < 0 && errno != EAGAIN)
+        return -1;
+
+    // 감시 스레드가 세운 표시를 잠금 안에서 떼어 내고, 읽기와 전송은 잠금 밖에서
+    bool recheck[FILE_TAIL_MAX_FILES], dir_gone[FILE_TAIL_MAX_FILES];
+    pthread_mutex_lock(&ft->mu);
+    for (size_t i = 0; i < FILE_TAIL_MAX_FILES; i++)
+    {
+        Tail *t = &ft->tails[i];
+        recheck[i] = t->recheck;
+        dir_gone[i] = t->dir_gone;
+        t->recheck = t->dir_gone = false;
+    }
+    ft->pending = false;
+    ft->signalled = false;
+    ft->retry = false;
+    pthread_mutex_unlock(&ft->mu);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int lines = 0, state = 0;
+    struct timespec wake = now;
+    long wait_ms = -1;
+    for (size_t i = 0; i < FILE_TAIL_MAX_FILES; i++)
+    {
+        Tail *t = &ft->tails[i];
+        if (!t->owner)
+            continue;
+
+        // 변경 표시가 없어도 모두 읽어 본다: 밀려 있던 내용과 개행을 기다리던 줄도 여기서 나간다
+        int rc = tail_read(t, sink, &lines, &now);
+        if (rc >= 0 && recheck[i] && !dir_gone[i])
+        {
+            rc = tail_recheck(t, sink, &lines);
+            if (rc == 0)
+                rc = tail_read(t, sink, &lines, &now);
+        }
+        if (rc < 0)
+            return -1;
+        if (dir_gone[i])
+        {
+            if (emit(sink, t, t->offset, "END", NULL, 0) != 0)
+                return -1;
+            lines++;
+            tail_stop(t);
+            continue;
+        }
+
+        // 다음에 다시 볼 시각: 밀린 내용은 토큰 하나가 찰 때, 개행을 기다리는 줄은 기다림이 끝날 때
+        long ms = rc & PUMP_MORE ? 1000 / FILE_TAIL_LINES_PER_SEC
+                  : rc & PUMP_PARTIAL ? FILE_TAIL_PARTIAL_MS - ms_since(&t->part_at, &now) : -1;
+        if (ms >= 0 && (wait_ms < 0 || ms < wait_ms))
+            wait_ms = ms;
+        state |= rc;
+    }
+
+    if (state)
+    {
+        after_ms(&wake, &now, wait_ms < FILE_TAIL_MAX_DELAY_MS ? wait_ms : FILE_TAIL_MAX_DELAY_MS);
+        pthread_mutex_lock(&ft->mu);
+        ft->retry = true;
+        ft->wake = wake;
+        pthread_mutex_unlock(&ft->mu);
+    }
+    return lines;
+}
@@ -0,0 +1,62 @@
+#ifndef FILE_TAIL_H
+#define FILE_TAIL_H
+
+#include <stddef.h>
+
+#include "tree_stream.h"
+
+// 클라이언트 세션 하나가 따라 읽고 있는 서버 파일들 (TAIL, "tail -F" 처럼)
+//
+// 파일이 있는 디렉토리를 감시 스레드(watch.c)로 보다가 그 이름에 쓰기가 생기면, 이벤트가
+// FILE_TAIL_QUIET_MS 동안 잠잠하거나 첫 이벤트 뒤 FILE_TAIL_MAX_DELAY_MS 가 지났을 때
+// file_tails_fd() 를 읽기 가능 상태로 만든다. 세션 스레드는 명령을 기다리는 동안에만
+// file_tails_flush() 로 마지막으로 읽은 위치 뒤에 붙은 바이트만 읽어 줄 단위로 보낸다.
+//
+//   EVT TAIL <id> <offset> L <text>     완성된 줄 (offset = 이 줄 다음 바이트 위치)
+//   EVT TAIL <id> <offset> P <text>     아직 개행이 오지 않았거나 너무 긴 줄의 앞부분
+//   EVT TAIL <id> <offset> SKIP <bytes> 너무 빨리 늘어나 보내지 않고 건너뛴 양
+//   EVT TAIL <id> 0 TRUNC               파일이 줄어들어 처음부터 다시 읽음
+//   EVT TAIL <id> 0 ROTATE              같은 이름의 새 파일로 바뀜 (처음부터 읽음)
+//   EVT TAIL <id> <offset> GONE         파일이 사라짐 (같은 이름으로 다시 생기면 이어서 읽음)
+//   EVT TAIL <id> <offset> END          디렉토리가 사라져 더 따라갈 수 없음 (목록에서 빠짐)
+//
+// text 는 한 줄에 FILE_TAIL_LINE_MAX 바이트까지이고, '\\' 와 제어 문자를 \\, \t, \r, \xHH 로
+// 바꿔 보내므로 바이너리 파일이어도 알림 줄이 깨지지 않는다.
+// 세션마다 파일별로 초당 FILE_TAIL_LINES_PER_SEC 줄(몰아서 FILE_TAIL_LINES_BURST 줄)까지만 보내고,
+// 못 보낸 양이 FILE_TAIL_MAX_BACKLOG 를 넘으면 끝부분만 남기고 건너뛴다.
+
+#define FILE_TAIL_MAX_FILES 4
+#define FILE_TAIL_LINE_MAX 512
+#define FILE_TAIL_QUIET_MS 100
+#define FILE_TAIL_MAX_DELAY_MS 300
+// 개행 없이 멈춘 줄을 P 로 보내기까지 기다리는 시간
+#define FILE_TAIL_PARTIAL_MS 1000
+#define FILE_TAIL_LINES_PER_SEC 50
+#define FILE_TAIL_LINES_BURST 200
+#define FILE_TAIL_MAX_BACKLOG (256 * 1024)
+
+typedef struct FileTails FileTails;
+
+FileTails *file_tails_open(void);
+void file_tails_close(FileTails *ft);
+
+// 보낼 내용이 생기면 읽기 가능해지는 fd (poll 용)
+int file_tails_fd(const FileTails *ft);
+
+// 따라 읽을 파일을 더한다 (절대 경로, 호출자가 검증한 일반 파일).
+// 부모 디렉토리를 열어 두고 그 안의 이름만 링크를 따라가지 않고 다시 열므로, 교체된 파일이
+// 심볼릭 링크면 따라가지 않는다.
+// from >= 0 이면 그 위치부터 (다시 접속한 뒤 이어 읽기), 아니면 마지막 lines 줄부터.
+// 반환: 0 (id, 시작 위치), 실패 시 -1 (errno, 가득 차면 E2BIG)
+int file_tails_add(FileTails *ft, const char *path, long long from, int lines, unsigned *id, long long *offset);
+
+// id 가 0 이면 모두. 반환: 멈춘 수 (없으면 0)
+int file_tails_remove(FileTails *ft, unsigned id);
+
+// 따라 읽고 있는 파일 수
+int file_tails_count(const FileTails *ft);
+
+// 준비된 내용을 EVT TAIL 줄로 sink 에 보낸다. 보낸 줄 수, 쓰기 실패 시 -1.
+int file_tails_flush(FileTails *ft, const TreeSink *sink);
+
+#endif
@@ -3,6 +3,14 @@
 #include <string.h>
 #include <ctype.h>
 
+static InputCompleteFn completer;
+static void *completer_ctx;
+
+void input_set_completer(InputCompleteFn fn, void *ctx) {
+    completer = fn;
+    completer_ctx = ctx;
+}
+
 void input_draw(WINDOW *win, bool focused) {
     werase(win); box(win,0,0);
     if (focused) wattron(win, A_BOLD | A_STANDOUT);
@@ -46,6 +54,20 @@ int input_capture_line(WINDOW *win, char *out, int maxlen, int first_ch) {
             continue;
         }
 
+        // Tab: 자동 완성 후 줄 전체를 다시 그린다
+        if (ch == '\t' && completer) {
+            out[pos] = '\0';
+            if (completer(completer_ctx, out, &pos, maxlen) == 0) {
+                for (int cx = x; cx < w - 1; cx++)
+                    mvwaddch(win, y, cx, ' ');
+                mvwaddnstr(win, y, x, out, w - 1 - x);
+                wmove(win, y, x + pos < w - 1 ? x + pos : w - 2);
+                wrefresh(win);
+                ch = -1;
+                continue;
+            }
+        }
+
         if ((ch == KEY_BACKSPACE || ch == 127 || ch == '\b') && pos > 0) {
             pos--;
             mvwaddch(win, y, x + pos, ' ');
@@ -11,6 +11,11 @@ typedef enum {
     FOCUS_INPUT = 3
 } FocusArea;
 
+// Tab 을 눌렀을 때 부르는 자동 완성. buf 의 앞 *len 바이트가 지금까지 입력한 내용 (cap 은 buf 크기).
+// 내용과 *len 을 고쳐 돌려준다. 0 = 처리함, -1 = 처리하지 않음 (예전처럼 탭 문자를 넣음)
+typedef int (*InputCompleteFn)(void *ctx, char *buf, int *len, int cap);
+void input_set_completer(InputCompleteFn fn, void *ctx);
+
 void input_draw(WINDOW *win, bool focused);
 // Enter, F1~F3, Shift+Tab 등의 특수키로 입력 종료 후 종료 키를 반환
 int  input_capture_line(WINDOW *win, char *out, int maxlen, int first_ch);
@@ -0,0 +1,253 @@
+// jobs.c
+#include "jobs.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_JOBS 128
+// 끝난 작업은 이 시간 동안 목록에 남겨 다시 접속한 뒤에도 결과를 볼 수 있게 한다
+#define JOB_KEEP_SECONDS 600
+// 키가 붙은 작업(청크 업로드 등)이 이 시간 동안 진행이 없으면 버려진 것으로 본다
+#define JOB_IDLE_SECONDS 900
+
+struct Job
+{
+    bool used;
+    char key[64];
+    JobInfo info;                      // done/total/cancel 은 잠금 없이 원자적으로 읽고 쓴다
+    time_t last_progress;              // 마지막으로 done 이 바뀐 시각 (원자적)
+};
+
+static Job jobs[MAX_JOBS];
+static unsigned next_id = 1;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void finish_locked(Job *j, JobState state, time_t now)
+{
+    j->info.state = state;
+    j->info.finished = now;
+}
+
+// 진행이 끊긴 키 작업을 끝낸다 (목록을 보거나 새 칸이 필요할 때)
+static void expire_idle_locked(time_t now)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->used || j->info.state != JOB_RUNNING || !j->key[0])
+            continue;
+        time_t last = __atomic_load_n(&j->last_progress, __ATOMIC_RELAXED);
+        if (now - (last > j->info.started ? last : j->info.started) >= JOB_IDLE_SECONDS)
+            finish_locked(j, JOB_FAILED, now);
+    }
+}
+
+Job *job_begin(const char *owner, const char *kind, const char *what, const char *unit)
+{
+    time_t now = time(NULL);
+    Job *slot = NULL;
+
+    pthread_mutex_lock(&jobs_lock);
+    expire_idle_locked(now);
+    // 빈 칸, 없으면 보관 기간이 지난 끝난 작업 중 가장 오래된 것을 쓴다
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->used)
+        {
+            slot = j;
+            break;
+        }
+        if (j->info.state != JOB_RUNNING && now - j->info.finished >= JOB_KEEP_SECONDS &&
+            (!slot || j->info.finished < slot->info.finished))
+            slot = j;
+    }
+
+    if (slot)
+    {
+        memset(slot, 0, sizeof(*slot));
+        slot->used = true;
+        slot->info.id = next_id++;
+        snprintf(slot->info.owner, sizeof(slot->info.owner), "%s", owner);
+        snprintf(slot->info.kind, sizeof(slot->info.kind), "%s", kind);
+        snprintf(slot->info.what, sizeof(slot->info.what), "%s", what);
+        snprintf(slot->info.unit, sizeof(slot->info.unit), "%s", unit);
+        slot->info.state = JOB_RUNNING;
+        slot->info.started = now;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    return slot;
+}
+
+void job_set_key(Job *job, const char *key)
+{
+    if (!job)
+        return;
+    pthread_mutex_lock(&jobs_lock);
+    snprintf(job->key, sizeof(job->key), "%s", key);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+static Job *find_keyed(const char *owner, const char *key, bool running_only)
+{
+    Job *found = NULL;
+    pthread_mutex_lock(&jobs_lock);
+    expire_idle_locked(time(NULL));
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->used || !j->key[0] || strcmp(j->key, key) != 0 || strcmp(j->info.owner, owner) != 0 ||
+            (running_only && j->info.state != JOB_RUNNING))
+            continue;
+        if (!found || j->info.id > found->info.id)
+            found = j;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    return found;
+}
+
+Job *job_find(const char *owner, const char *key)
+{
+    return find_keyed(owner, key, true);
+}
+
+Job *job_find_any(const char *owner, const char *key)
+{
+    return find_keyed(owner, key, false);
+}
+
+void job_end(Job *job, JobState state)
+{
+    if (!job)
+        return;
+    pthread_mutex_lock(&jobs_lock);
+    if (job->info.state == JOB_RUNNING)
+    {
+        // 취소 요청을 받고 끝났으면 실패가 아니라 취소로 기록
+        if (state == JOB_FAILED && __atomic_load_n(&job->info.cancel_requested, __ATOMIC_RELAXED))
+            state = JOB_CANCELLED;
+        finish_locked(job, state, time(NULL));
+    }
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+void job_set_total(Job *job, unsigned long long total)
+{
+    if (job)
+        __atomic_store_n(&job->info.total, total, __ATOMIC_RELAXED);
+}
+
+void job_add_total(Job *job, unsigned long long n)
+{
+    if (job)
+        __atomic_add_fetch(&job->info.total, n, __ATOMIC_RELAXED);
+}
+
+void job_set_done(Job *job, unsigned long long done)
+{
+    if (!job)
+        return;
+    __atomic_store_n(&job->info.done, done, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->last_progress, time(NULL), __ATOMIC_RELAXED);
+}
+
+void job_add_done(Job *job, unsigned long long n)
+{
+    if (!job)
+        return;
+    __atomic_add_fetch(&job->info.done, n, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->last_progress, time(NULL), __ATOMIC_RELAXED);
+}
+
+bool job_cancelled(const Job *job)
+{
+    return job && __atomic_load_n(&job->info.cancel_requested, __ATOMIC_RELAXED);
+}
+
+unsigned job_id(const Job *job)
+{
+    return job ? job->info.id : 0;
+}
+
+int job_cancel(unsigned id, const char *owner, bool any_owner)
+{
+    int rc = -1;
+    errno = ENOENT;
+
+    pthread_mutex_lock(&jobs_lock);
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->used || j->info.id != id)
+            continue;
+
+        if (!any_owner && strcmp(j->info.owner, owner) != 0)
+            errno = EPERM;
+        else if (j->info.state != JOB_RUNNING)
+            errno = EALREADY;
+        else
+        {
+            __atomic_store_n(&j->info.cancel_requested, true, __ATOMIC_RELAXED);
+            // 키 작업은 다음 명령이 올 때까지 아무도 확인하지 않을 수 있으므로 여기서 끝낸다
+            if (j->key[0])
+                finish_locked(j, JOB_CANCELLED, time(NULL));
+            rc = 0;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    return rc;
+}
+
+size_t job_list(const char *owner, bool any_owner, JobInfo *out, size_t max)
+{
+    size_t n = 0;
+
+    pthread_mutex_lock(&jobs_lock);
+    expire_idle_locked(time(NULL));
+    for (int i = 0; i < MAX_JOBS && n < max; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->used || (!any_owner && strcmp(j->info.owner, owner) != 0))
+            continue;
+
+        out[n] = j->info;
+        out[n].done = __atomic_load_n(&j->info.done, __ATOMIC_RELAXED);
+        out[n].total = __atomic_load_n(&j->info.total, __ATOMIC_RELAXED);
+        out[n].cancel_requested = __atomic_load_n(&j->info.cancel_requested, __ATOMIC_RELAXED);
+        n++;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    // 삽입 정렬: 번호 순 (목록이 작다)
+    for (size_t i = 1; i < n; i++)
+    {
+        JobInfo tmp = out[i];
+        size_t k = i;
+        while (k > 0 && out[k - 1].id > tmp.id)
+        {
+            out[k] = out[k - 1];
+            k--;
+        }
+        out[k] = tmp;
+    }
+    return n;
+}
+
+const char *job_state_name(JobState state)
+{
+    switch (state)
+    {
+    case JOB_RUNNING:
+        return "running";
+    case JOB_DONE:
+        return "done";
+    case JOB_FAILED:
+        return "failed";
+    case JOB_CANCELLED:
+        return "cancelled";
+    }
+    return "?";
+}
@@ -0,0 +1,69 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// 서버 작업 목록: 오래 걸리는 명령(dls, 재귀 DELETE, 업로드, COPY ...) 마다 번호를 붙이고
+// 진행 상황과 취소 요청을 기록한다. 작업은 연결이 아니라 사용자 이름에 묶이므로
+// 연결이 끊겼다가 다시 접속해도 JOBS/CANCEL 로 보고 멈출 수 있다.
+//
+// 취소는 협조적이다: 작업 쪽이 디렉토리 항목이나 청크 경계에서 job_cancelled() 를 확인한다.
+// 모든 함수는 job 이 NULL 이어도 된다 (목록이 가득 차면 작업은 기록 없이 그대로 실행된다).
+
+typedef struct Job Job;
+
+typedef enum
+{
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED,
+} JobState;
+
+typedef struct
+{
+    unsigned id;
+    char owner[64];
+    char kind[16];
+    char what[256];
+    char unit[8];               // "bytes", "entries", "items" ...
+    unsigned long long done;
+    unsigned long long total;   // 0 이면 아직 모름 (걷는 동안 늘어나는 추정치일 수 있음)
+    JobState state;
+    bool cancel_requested;
+    time_t started;
+    time_t finished;
+} JobInfo;
+
+Job *job_begin(const char *owner, const char *kind, const char *what, const char *unit);
+void job_end(Job *job, JobState state);
+
+// 여러 명령에 걸친 작업(청크 업로드 등)은 키를 붙여 두고 다음 명령에서 다시 찾는다.
+// 끝난 작업의 칸은 보관 기간 동안 재사용되지 않으므로, 찾은 포인터는 job_end 직후에도 안전하다.
+// 키가 붙은 작업은 돌고 있는 스레드가 없을 수 있으므로
+//   - 취소 요청을 받으면 바로 취소로 끝난다 (다음 명령이 job_cancelled 로 알아챈다).
+//   - JOB_IDLE_SECONDS 동안 진행이 없으면 버려진 것으로 보고 실패로 끝낸다.
+void job_set_key(Job *job, const char *key);
+// 진행 중인 작업만
+Job *job_find(const char *owner, const char *key);
+// 끝난 작업까지 포함해 그 키의 가장 최근 작업 (취소되었는지 확인할 때)
+Job *job_find_any(const char *owner, const char *key);
+
+void job_set_total(Job *job, unsigned long long total);
+void job_add_total(Job *job, unsigned long long n);
+void job_set_done(Job *job, unsigned long long done);
+void job_add_done(Job *job, unsigned long long n);
+bool job_cancelled(const Job *job);
+unsigned job_id(const Job *job);
+
+// 취소 요청. 0 = 요청함, -1 = 실패 (errno: ENOENT 없음, EPERM 다른 사용자, EALREADY 이미 끝남)
+// any_owner 면 다른 사용자의 작업도 취소할 수 있다 (관리자).
+int job_cancel(unsigned id, const char *owner, bool any_owner);
+
+// owner 의 작업(any_owner 면 전부)을 번호 순으로 돌려준다. 돌려준 개수.
+size_t job_list(const char *owner, bool any_owner, JobInfo *out, size_t max);
+const char *job_state_name(JobState state);
+
+#endif
@@ -0,0 +1,309 @@
+// journal.c
+#define _GNU_SOURCE
+#include "journal.h"
+#include "tree_watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// 기록을 디스크에 내리는 간격과 체크포인트(마지막으로 살아 있던 시각) 갱신 간격
+#define JOURNAL_SYNC_SECONDS 1
+#define JOURNAL_CHECKPOINT_SECONDS 10
+#define JOURNAL_RING (2 * JOURNAL_SEGMENT_ENTRIES)
+
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static char journal_dir[PATH_MAX - 32];   // 안에 두는 파일 이름이 붙을 자리를 남긴다
+static int cur_fd = -1;
+static size_t cur_entries;
+static bool dirty;
+
+// 최근 기록 (디스크의 두 파일과 같은 내용). 순번이 연속이므로 ring[(head + i) % JOURNAL_RING] 의 순번은 oldest + i.
+static char **ring;
+static size_t head, count;
+static uint64_t oldest_seq, next_seq = 1;
+
+// 시작할 때 걷는 동안만: 이 시각 뒤에 바뀐 항목은 꺼져 있던 동안 바뀐 것
+static bool catching_up;
+static time_t checkpoint;
+
+static void journal_path(char out[PATH_MAX], const char *name)
+{
+    snprintf(out, PATH_MAX, "%s/%s", journal_dir, name);
+}
+
+static void ring_push(uint64_t seq, char *line)
+{
+    if (count == JOURNAL_RING)
+    {
+        free(ring[head]);
+        head = (head + 1) % JOURNAL_RING;
+        count--;
+        oldest_seq++;
+    }
+    if (count == 0)
+        oldest_seq = seq;
+    ring[(head + count) % JOURNAL_RING] = line;
+    count++;
+}
+
+static int open_current(void)
+{
+    char path[PATH_MAX];
+    journal_path(path, "cur.log");
+    cur_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    return cur_fd >= 0 ? 0 : -1;
+}
+
+// cur.log 이 가득 차면 old.log 로 넘기고 새로 시작한다 (그 전의 old.log 는 버려짐)
+static void rotate(void)
+{
+    char cur[PATH_MAX], old[PATH_MAX];
+    journal_path(cur, "cur.log");
+    journal_path(old, "old.log");
+
+    fdatasync(cur_fd);
+    close(cur_fd);
+    cur_fd = -1;
+    if (rename(cur, old) != 0 || open_current() != 0)
+        fprintf(stderr, "[WARN] journal rotation failed: %s\n", strerror(errno));
+    cur_entries = 0;
+}
+
+static void append(const char *op, bool is_dir, long long size, const char *path, const char *newpath)
+{
+    // 줄 단위 형식이므로 이름에 개행이 있는 항목은 기록하지 않는다
+    if (strchr(path, '\n') || (newpath && strchr(newpath, '\n')))
+        return;
+
+    pthread_mutex_lock(&journal_lock);
+    uint64_t seq = next_seq++;
+    char *line = NULL;
+    int n = asprintf(&line, "%" PRIu64 " %lld %s %c %lld %s%s%s\n", seq, (long long)time(NULL), op,
+                     is_dir ? 'd' : 'f', size, path, newpath ? "\t" : "", newpath ? newpath : "");
+    if (n > 0)
+    {
+        if (cur_fd >= 0 && write(cur_fd, line, (size_t)n) != n)
+            fprintf(stderr, "[WARN] journal write failed: %s\n", strerror(errno));
+        dirty = true;
+        line[n - 1] = '\0';
+        ring_push(seq, line);
+        if (++cur_entries >= JOURNAL_SEGMENT_ENTRIES)
+            rotate();
+    }
+    pthread_mutex_unlock(&journal_lock);
+}
+
+static void on_change(void *ctx, const TreeChange *c)
+{
+    (void)ctx;
+    long long size = c->st && !c->is_dir ? (long long)c->st->st_size : 0;
+
+    switch (c->kind)
+    {
+    case TREE_SEEN:
+        if (catching_up && c->st && c->st->st_ctime >= checkpoint)
+            append(c->is_dir ? "RESCAN" : "MOD", c->is_dir, size, c->path, NULL);
+        break;
+    case TREE_SYNCED:
+        pthread_mutex_lock(&journal_lock);
+        catching_up = false;
+        pthread_mutex_unlock(&journal_lock);
+        break;
+    case TREE_ADD:
+        append("ADD", c->is_dir, size, c->path, NULL);
+        break;
+    case TREE_DEL:
+        append("DEL", c->is_dir, 0, c->path, NULL);
+        break;
+    case TREE_MOD:
+        append("MOD", false, size, c->path, NULL);
+        break;
+    case TREE_REN:
+        append("REN", c->is_dir, size, c->path, c->newpath);
+        break;
+    case TREE_LOST:
+        append("RESCAN", true, 0, c->path, NULL);
+        break;
+    }
+}
+
+static void write_checkpoint(time_t now)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    journal_path(path, "checkpoint");
+    journal_path(tmp, "checkpoint.tmp");
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return;
+    fprintf(fp, "%lld\n", (long long)now);
+    if (fflush(fp) == 0 && fdatasync(fileno(fp)) == 0 && fclose(fp) == 0)
+        rename(tmp, path);
+    else
+        fclose(fp);
+}
+
+static void *journal_flusher(void *arg)
+{
+    (void)arg;
+    time_t last_checkpoint = 0;
+
+    while (1)
+    {
+        sleep(JOURNAL_SYNC_SECONDS);
+
+        pthread_mutex_lock(&journal_lock);
+        int fd = cur_fd >= 0 ? dup(cur_fd) : -1;
+        bool need = dirty;
+        dirty = false;
+        bool synced = !catching_up;
+        pthread_mutex_unlock(&journal_lock);
+
+        if (fd >= 0)
+        {
+            if (need)
+                fdatasync(fd);
+            close(fd);
+        }
+
+        // 시작할 때의 걷기가 끝나기 전에 체크포인트를 옮기면 꺼져 있던 동안의 변경을 잃을 수 있다
+        time_t now = time(NULL);
+        if (synced && now - last_checkpoint >= JOURNAL_CHECKPOINT_SECONDS)
+        {
+            write_checkpoint(now);
+            last_checkpoint = now;
+        }
+    }
+    return NULL;
+}
+
+static void load_segment(const char *name, bool current, time_t *last_time)
+{
+    char path[PATH_MAX];
+    journal_path(path, name);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &cap, fp)) > 0)
+    {
+        uint64_t seq;
+        long long t;
+        // 중간에 끊긴 마지막 줄(개행 없음)이나 순번이 맞지 않는 줄은 버린다
+        if (line[n - 1] != '\n' || sscanf(line, "%" SCNu64 " %lld", &seq, &t) != 2 ||
+            (count > 0 && seq != next_seq))
+            continue;
+
+        line[n - 1] = '\0';
+        char *copy = strdup(line);
+        if (!copy)
+            break;
+        ring_push(seq, copy);
+        next_seq = seq + 1;
+        *last_time = (time_t)t;
+        if (current)
+            cur_entries++;
+    }
+    free(line);
+    fclose(fp);
+}
+
+int journal_init(const char *root)
+{
+    const char *env = getenv("TALKSHELL_JOURNAL");
+    if (!env || strcmp(env, "1") != 0)
+        return 0;
+
+    int n = snprintf(journal_dir, sizeof(journal_dir), "%s/%s", root, JOURNAL_DIR);
+    if (n < 0 || n >= (int)sizeof(journal_dir) || (mkdir(journal_dir, 0700) != 0 && errno != EEXIST))
+        goto fail;
+
+    ring = calloc(JOURNAL_RING, sizeof(*ring));
+    if (!ring)
+        goto fail;
+
+    time_t last_time = 0;
+    load_segment("old.log", false, &last_time);
+    load_segment("cur.log", true, &last_time);
+
+    // 기록이 있었으면 그 뒤(체크포인트가 더 나중이면 그 뒤)의 변경을 시작할 때 메운다
+    char path[PATH_MAX];
+    journal_path(path, "checkpoint");
+    FILE *fp = fopen(path, "r");
+    long long saved = 0;
+    if (fp)
+    {
+        if (fscanf(fp, "%lld", &saved) != 1)
+            saved = 0;
+        fclose(fp);
+    }
+    checkpoint = saved > last_time ? (time_t)saved : last_time;
+    catching_up = count > 0 || saved > 0;
+
+    if (open_current() != 0 || tree_watch_subscribe(on_change, NULL) != 0)
+        goto fail;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, journal_flusher, NULL) != 0)
+        goto fail;
+    pthread_detach(tid);
+    return 0;
+
+fail:
+    if (cur_fd >= 0)
+        close(cur_fd);
+    cur_fd = -1;
+    journal_dir[0] = '\0';
+    return -1;
+}
+
+bool journal_enabled(void)
+{
+    return journal_dir[0] != '\0';
+}
+
+uint64_t journal_latest(void)
+{
+    pthread_mutex_lock(&journal_lock);
+    uint64_t seq = next_seq - 1;
+    pthread_mutex_unlock(&journal_lock);
+    return seq;
+}
+
+int journal_since(uint64_t since, size_t max, JournalLineFn fn, void *ctx, uint64_t *last)
+{
+    *last = since;
+    if (!journal_enabled())
+        return -1;
+
+    int rc = 0;
+    pthread_mutex_lock(&journal_lock);
+    uint64_t latest = next_seq - 1;
+    if (since > latest || (count > 0 && since + 1 < oldest_seq) || (count == 0 && since != latest))
+    {
+        rc = 1;
+    }
+    else
+    {
+        for (uint64_t seq = since + 1; seq <= latest && max > 0; seq++, max--)
+        {
+            if (!fn(ctx, ring[(head + (seq - oldest_seq)) % JOURNAL_RING]))
+                break;
+            *last = seq;
+        }
+    }
+    pthread_mutex_unlock(&journal_lock);
+    return rc;
+}
@@ -0,0 +1,36 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 서버 루트의 변경 저널 (TALKSHELL_JOURNAL=1 일 때만)
+//
+// tree_watch 가 알려 주는 변경(업로드, 삭제, mkdir, 이동, 서버 밖에서의 변경)을 순번을 붙여
+// <root>/.talkshell-journal/ 에 한 줄씩 덧붙인다. 파일 하나가 JOURNAL_SEGMENT_ENTRIES 줄이 되면
+// 새 파일로 넘어가고 이전 파일 하나만 남기므로 최근 2 * JOURNAL_SEGMENT_ENTRIES 개 안쪽만 유지된다.
+//
+//   <seq> <unix time> <ADD|DEL|MOD|REN|RESCAN> <d|f> <size> <path>[\t<new path>]
+//
+// 순번은 서버를 다시 시작해도 이어진다. 서버가 꺼져 있던 동안의 변경은 시작할 때 트리를 걸며
+// 마지막 기록 시각 뒤에 ctime 이 바뀐 항목을 MOD(파일) / RESCAN(디렉토리: 항목이 생기거나 없어짐)
+// 으로 기록해 메운다.
+
+#define JOURNAL_DIR ".talkshell-journal"
+#define JOURNAL_SEGMENT_ENTRIES 50000
+
+int journal_init(const char *root);
+bool journal_enabled(void);
+// 마지막으로 기록한 순번 (없으면 0)
+uint64_t journal_latest(void);
+
+// 기록 한 줄을 받는 콜백 (개행 없음). false 면 중단.
+typedef bool (*JournalLineFn)(void *ctx, const char *line);
+
+// since 뒤의 기록을 최대 max 개 순서대로 넘긴다. *last 에 마지막으로 넘긴 순번(없으면 since).
+// 반환: 0 = 성공, 1 = since 가 유지 범위 밖(너무 오래되었거나 다른 저널): 처음부터 다시 읽어야 함,
+//       -1 = 저널을 쓰지 않음
+int journal_since(uint64_t since, size_t max, JournalLineFn fn, void *ctx, uint64_t *last);
+
+#endif
@@ -0,0 +1,35 @@
+// local_socket.c
+#include "local_socket.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+bool local_socket_path(int port, char *out, size_t len)
+{
+    const char *env = getenv("TALKSHELL_UNIX");
+    if (env && strcmp(env, "0") == 0)
+        return false;
+    if (env && env[0])
+        snprintf(out, len, "%s", env);
+    else
+        snprintf(out, len, "%s/%d.sock", LOCAL_SOCKET_DIR, port);
+    return true;
+}
+
+bool local_socket_dir_trusted(const char *path, uid_t owner)
+{
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash)
+        snprintf(dir, sizeof(dir), ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+
+    // 링크를 따라가지 않는다: 디렉토리 자리에 놓인 링크도 바꿔치기다
+    struct stat st;
+    return lstat(dir, &st) == 0 && S_ISDIR(st.st_mode) && (st.st_uid == owner || st.st_uid == 0) &&
+           (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
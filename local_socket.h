@@ -0,0 +1,22 @@
+#ifndef LOCAL_SOCKET_H
+#define LOCAL_SOCKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// 같은 호스트의 클라이언트용 Unix 소켓 경로 규칙 (서버 listen_unix 와 클라이언트 connect_local 이 함께 쓴다)
+//
+// 기본 경로는 LOCAL_SOCKET_DIR/<port>.sock 이다. 디렉토리는 서버 사용자가 0755 로 만들므로 다른 사용자가
+// 소켓을 먼저 만들어 두거나 바꿔치기할 수 없다 (/tmp 처럼 누구나 쓸 수 있는 곳은 쓰지 않는다).
+// TALKSHELL_UNIX=0 이면 끄고, 다른 값이면 그 경로를 쓴다 (그 부모 디렉토리도 같은 조건을 만족해야 한다).
+
+#define LOCAL_SOCKET_DIR "/run/talkshell"
+
+// 소켓 경로. 꺼져 있으면 false.
+bool local_socket_path(int port, char *out, size_t len);
+
+// path 가 들어 있는 디렉토리가 owner(또는 root) 소유의 진짜 디렉토리이고 다른 사용자가 쓸 수 없으면 true
+bool local_socket_dir_trusted(const char *path, uid_t owner);
+
+#endif
@@ -0,0 +1,227 @@
+// name_cache.c
+#define _GNU_SOURCE
+#include "name_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// arena 의 항목 하나: [디렉토리 여부 1바이트][이름][NUL]
+typedef struct
+{
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime, ctime;
+    char *arena;
+    uint32_t *names;         // arena 안의 항목 위치, 이름 순 정렬
+    size_t count;
+    uint64_t used;           // 마지막으로 쓴 순번 (가장 오래된 것을 버림)
+} NameDir;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static NameDir *cache[NAME_CACHE_DIRS];
+static uint64_t use_clock;
+
+static void dir_free(NameDir *d)
+{
+    if (!d)
+        return;
+    free(d->path);
+    free(d->arena);
+    free(d->names);
+    free(d);
+}
+
+static bool same_version(const NameDir *d, const struct stat *st)
+{
+    return d->dev == st->st_dev && d->ino == st->st_ino && d->mtime.tv_sec == st->st_mtim.tv_sec &&
+           d->mtime.tv_nsec == st->st_mtim.tv_nsec && d->ctime.tv_sec == st->st_ctim.tv_sec &&
+           d->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static const char *entry_name(const NameDir *d, size_t i)
+{
+    return d->arena + d->names[i] + 1;
+}
+
+// qsort 에는 문맥을 넘길 수 없어 정렬하는 동안만 쓰는 스레드별 arena
+static __thread const char *sort_arena;
+
+static int cmp_entry(const void *a, const void *b)
+{
+    return strcmp(sort_arena + *(const uint32_t *)a + 1, sort_arena + *(const uint32_t *)b + 1);
+}
+
+// 디렉토리를 읽어 정렬된 목록을 만든다 (잠금 밖에서). st 는 읽기 전에 잰 디렉토리 stat 이라
+// 읽는 도중 바뀌었으면 다음 요청에서 다시 읽는다.
+static NameDir *dir_load(const char *path, const struct stat *st)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dp = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dp)
+    {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    NameDir *d = calloc(1, sizeof(*d));
+    size_t arena_len = 0, arena_cap = 0, cap = 0;
+    struct dirent *de;
+    while (d && (de = readdir(dp)) != NULL)
+    {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+
+        bool is_dir = de->d_type == DT_DIR;
+        if (de->d_type == DT_UNKNOWN || de->d_type == DT_LNK)
+        {
+            // 디렉토리를 가리키는 링크도 cd 할 수 있으므로 따라가 본다
+            struct stat sb;
+            is_dir = fstatat(dirfd(dp), de->d_name, &sb, 0) == 0 && S_ISDIR(sb.st_mode);
+        }
+
+        size_t len = strlen(de->d_name) + 2;
+        if (arena_len + len > UINT32_MAX)
+            break;
+        if (arena_len + len > arena_cap)
+        {
+            size_t ncap = arena_cap ? arena_cap * 2 : 16384;
+            char *p = realloc(d->arena, ncap);
+            if (!p)
+                goto fail;
+            d->arena = p;
+            arena_cap = ncap;
+        }
+        if (d->count == cap)
+        {
+            size_t ncap = cap ? cap * 2 : 256;
+            uint32_t *p = realloc(d->names, ncap * sizeof(*p));
+            if (!p)
+                goto fail;
+            d->names = p;
+            cap = ncap;
+        }
+        d->arena[arena_len] = is_dir;
+        memcpy(d->arena + arena_len + 1, de->d_name, len - 1);
+        d->names[d->count++] = (uint32_t)arena_len;
+        arena_len += len;
+    }
+    closedir(dp);
+    if (!d || !(d->path = strdup(path)))
+    {
+        dir_free(d);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    sort_arena = d->arena;
+    qsort(d->names, d->count, sizeof(*d->names), cmp_entry);
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime = st->st_mtim;
+    d->ctime = st->st_ctim;
+    return d;
+
+fail:
+    closedir(dp);
+    dir_free(d);
+    errno = ENOMEM;
+    return NULL;
+}
+
+// 캐시에서 path 를 찾는다 (cache_lock 안에서). 없으면 NULL, *slot 에 넣을 자리.
+static NameDir *cache_find(const char *path, int *slot)
+{
+    int oldest = 0;
+    for (int i = 0; i < NAME_CACHE_DIRS; i++)
+    {
+        if (cache[i] && strcmp(cache[i]->path, path) == 0)
+        {
+            *slot = i;
+            return cache[i];
+        }
+        if (!cache[i] || (cache[oldest] && cache[i]->used < cache[oldest]->used))
+            oldest = i;
+    }
+    *slot = oldest;
+    return NULL;
+}
+
+// 이름 순 배열에서 prefix 이상인 첫 위치
+static size_t lower_bound(const NameDir *d, const char *prefix)
+{
+    size_t lo = 0, hi = d->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(entry_name(d, mid), prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+long name_cache_complete(const char *dir, const char *prefix, bool dirs_only, const char *hide_prefix,
+                         NameCacheFn fn, void *ctx, bool *more)
+{
+    struct stat st;
+    *more = false;
+    if (stat(dir, &st) != 0)
+        return -1;
+    if (!S_ISDIR(st.st_mode))
+    {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    int slot;
+    pthread_mutex_lock(&cache_lock);
+    NameDir *d = cache_find(dir, &slot);
+    if (!d || !same_version(d, &st))
+    {
+        pthread_mutex_unlock(&cache_lock);
+        NameDir *fresh = dir_load(dir, &st);
+        if (!fresh)
+            return -1;
+
+        // 읽는 동안 다른 요청이 같은 디렉토리를 넣었을 수 있으므로 자리를 다시 찾는다
+        pthread_mutex_lock(&cache_lock);
+        cache_find(dir, &slot);
+        dir_free(cache[slot]);
+        cache[slot] = d = fresh;
+    }
+    d->used = ++use_clock;
+
+    size_t plen = strlen(prefix), hlen = hide_prefix ? strlen(hide_prefix) : 0;
+    bool show_hidden = prefix[0] == '.';
+    long sent = 0;
+    bool stopped = false;
+    for (size_t i = lower_bound(d, prefix); i < d->count; i++)
+    {
+        const char *name = entry_name(d, i);
+        bool is_dir = d->arena[d->names[i]];
+        if (strncmp(name, prefix, plen) != 0)
+            break;
+        if ((name[0] == '.' && !show_hidden) || (dirs_only && !is_dir) ||
+            (hlen && strncmp(name, hide_prefix, hlen) == 0))
+            continue;
+        if (stopped)
+        {
+            *more = true;
+            break;
+        }
+        sent++;
+        stopped = !fn(ctx, name, is_dir);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return sent;
+}
@@ -0,0 +1,26 @@
+#ifndef NAME_CACHE_H
+#define NAME_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 디렉토리별 정렬된 이름 목록 캐시 (COMPLETE 경로 자동 완성)
+//
+// 한 번 읽은 디렉토리는 이름을 정렬해 두고, 앞부분이 같은 이름을 이진 탐색으로 찾는다.
+// 디렉토리의 inode/수정 시각/변경 시각이 그대로면 다시 읽지 않으므로 항목 수와 상관없이 빠르다.
+// 최근에 쓴 NAME_CACHE_DIRS 개의 디렉토리만 남긴다.
+
+#define NAME_CACHE_DIRS 64
+
+// 찾은 이름 하나 (name 은 NUL 로 끝남). false 면 더 넘기지 않는다.
+typedef bool (*NameCacheFn)(void *ctx, const char *name, bool is_dir);
+
+// dir(절대 경로) 에서 prefix 로 시작하는 이름을 정렬 순서대로 넘긴다.
+// prefix 가 '.' 로 시작하지 않으면 숨김 항목은 빼고, dirs_only 면 디렉토리(디렉토리를 가리키는
+// 심볼릭 링크 포함)만. hide_prefix 로 시작하는 이름도 뺀다 (NULL = 없음).
+// fn 이 false 를 돌려 멈췄는데 남은 이름이 더 있으면 *more = true.
+// 반환: 넘긴 개수, 실패 시 -1 (errno).
+long name_cache_complete(const char *dir, const char *prefix, bool dirs_only, const char *hide_prefix,
+                         NameCacheFn fn, void *ctx, bool *more);
+
+#endif
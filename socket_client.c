@@ -1,44 +1,441 @@
+#define _GNU_SOURCE
 #include "socket_client.h"
+#include "compress.h"
+#include "local_socket.h"
+#include "traffic_class.h"
+#include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 int sockfd = -1;
 
-int socket_connect_to(const char *server_ip, int port) {
+// 재접속/추가 스트림용 마지막 접속 정보
+static char last_ip[64];
+static int last_port;
+
+// 메인(제어) 연결
+static SocketStream main_stream = { .fd = -1 };
+
+// socket_bind_thread 로 이 스레드에 묶은 데이터 연결 (NULL 이면 메인 연결)
+static __thread SocketStream *thread_stream;
+
+// 압축된 텍스트 응답("~Z <raw> <comp>")을 풀어 둔 버퍼. 소켓 데이터보다 먼저 읽힌다.
+// 스레드마다 자기 연결의 응답을 풀어 둔다.
+static __thread char *text_buf;
+static __thread size_t text_len;
+static __thread size_t text_pos;
+
+// 응답을 기다리다 앞에서 만난 서버 알림(EVT 줄). socket_poll_pushed 가 꺼내 간다.
+#define PUSHED_MAX_LINES 4096
+static char *pushed[PUSHED_MAX_LINES];
+static size_t pushed_head;
+static size_t pushed_count;
+static bool pushed_dropped;
+
+static SocketStream *cur_stream(void) {
+    return thread_stream ? thread_stream : &main_stream;
+}
+
+// 같은 호스트의 서버면 TCP 대신 Unix 소켓으로 붙는다 (경로 규칙은 local_socket.h).
+// 로그인 정보를 보내기 전에 상대를 확인한다: 소켓 디렉토리가 상대 프로세스의 사용자(또는 root)
+// 소유이고 다른 사용자가 쓸 수 없어야 한다. 아니면 다른 사용자가 만든 가짜 소켓일 수 있으므로 TCP 로 붙는다.
+static int connect_local(const char *server_ip, int port) {
+    if (strcmp(server_ip, "127.0.0.1") != 0 && strcmp(server_ip, "localhost") != 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (!local_socket_path(port, addr.sun_path, sizeof(addr.sun_path)))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 ||
+        !local_socket_dir_trusted(addr.sun_path, cred.uid)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int connect_raw(const char *server_ip, int port) {
+    int local = connect_local(server_ip, port);
+    if (local >= 0)
+        return local;
+
     struct sockaddr_in serv;
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&serv, 0, sizeof(serv));
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
     serv.sin_family = AF_INET;
     serv.sin_port = htons(port);
     inet_pton(AF_INET, server_ip, &serv.sin_addr);
-    return connect(sockfd, (struct sockaddr*)&serv, sizeof(serv));
+    if (connect(fd, (struct sockaddr*)&serv, sizeof(serv)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-void socket_send_cmd(const char *cmd) {
-    if (sockfd < 0)
-        return;
+// --- SocketStream: 연결별 수신 버퍼를 가진 소켓 ---
+
+int stream_open(SocketStream *st) {
+    st->rlen = 0;
+    st->fd = last_ip[0] ? connect_raw(last_ip, last_port) : -1;
+    if (st->fd >= 0)
+        traffic_class_mark(st->fd, true);
+    return st->fd >= 0 ? 0 : -1;
+}
+
+void stream_close(SocketStream *st) {
+    if (st->fd >= 0) {
+        close(st->fd);
+        st->fd = -1;
+    }
+    st->rlen = 0;
+}
+
+int stream_send_all(SocketStream *st, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(st->fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
 
-    char line[512];
+int stream_send_line(SocketStream *st, const char *cmd) {
+    // 자르지 않고 통째로 보낸다: 서버 버퍼보다 길면 서버가 ERR line too long 으로 답해 응답 순서가 유지된다
+    char stack[512];
     size_t len = strlen(cmd);
-    if (len >= sizeof(line))
-        len = sizeof(line) - 1;
+    char *line = len < sizeof(stack) ? stack : malloc(len + 1);
+    if (!line)
+        return -1;
     memcpy(line, cmd, len);
     line[len] = '\n';
-    //line[len + 1] = '\0';//이래야 끝으로 인식.
-    send(sockfd, line, len + 1, 0);
+    int rc = stream_send_all(st, line, len + 1);
+    if (line != stack)
+        free(line);
+    return rc;
+}
+
+int stream_recv_line(SocketStream *st, char *out, size_t size) {
+    size_t pos = 0;
+
+    while (1) {
+        char *nl = memchr(st->rbuf, '\n', st->rlen);
+        size_t take = nl ? (size_t)(nl - st->rbuf) : st->rlen;
+
+        size_t room = size - 1 - pos;
+        size_t copy = take < room ? take : room;
+        memcpy(out + pos, st->rbuf, copy);
+        pos += copy;
+
+        size_t consumed = nl ? take + 1 : take;
+        memmove(st->rbuf, st->rbuf + consumed, st->rlen - consumed);
+        st->rlen -= consumed;
+
+        if (nl)
+            break;
+
+        ssize_t n = recv(st->fd, st->rbuf, sizeof(st->rbuf), 0);
+        if (n <= 0)
+            return -1;
+        st->rlen = (size_t)n;
+    }
+
+    out[pos] = 0;
+    return (int)pos;
+}
+
+int stream_recv_some(SocketStream *st, void *buf, size_t len) {
+    // 줄 단위로 읽다가 남은 데이터가 있으면 먼저 돌려준다
+    if (st->rlen > 0) {
+        size_t n = st->rlen < len ? st->rlen : len;
+        memcpy(buf, st->rbuf, n);
+        memmove(st->rbuf, st->rbuf + n, st->rlen - n);
+        st->rlen -= n;
+        return (int)n;
+    }
+    return (int)recv(st->fd, buf, len, 0);
+}
+
+int stream_recv_exact(SocketStream *st, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        int n = stream_recv_some(st, p, len);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// --- 메인 연결용 래퍼 (기존 인터페이스) ---
+
+int socket_connect_to(const char *server_ip, int port) {
+    if (server_ip != last_ip)
+        snprintf(last_ip, sizeof(last_ip), "%s", server_ip);
+    last_port = port;
+
+    main_stream.rlen = 0;
+    main_stream.fd = connect_raw(last_ip, last_port);
+    sockfd = main_stream.fd;
+    if (sockfd >= 0)
+        traffic_class_mark(sockfd, false);
+    return sockfd >= 0 ? 0 : -1;
+}
+
+void socket_bind_thread(SocketStream *st) {
+    thread_stream = st;
+    free(text_buf);
+    text_buf = NULL;
+    text_len = text_pos = 0;
+}
+
+bool socket_is_local(void) {
+    struct sockaddr_storage name;
+    socklen_t len = sizeof(name);
+    int fd = cur_stream()->fd;
+    return fd >= 0 && getsockname(fd, (struct sockaddr *)&name, &len) == 0 && name.ss_family == AF_UNIX;
+}
+
+int socket_send_fd(int fd) {
+    char byte = 'F';
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf) };
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(fd));
+    return sendmsg(cur_stream()->fd, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+int socket_reconnect(void) {
+    socket_close();
+    if (!last_ip[0])
+        return -1;
+    return socket_connect_to(last_ip, last_port);
+}
+
+void socket_send_cmd(const char *cmd) {
+    SocketStream *st = cur_stream();
+    if (st->fd < 0)
+        return;
+    stream_send_line(st, cmd);
+}
+
+int socket_send_all(const void *data, size_t len) {
+    return stream_send_all(cur_stream(), data, len);
+}
+
+static void pushed_add(const char *line, size_t len) {
+    if (pushed_count == PUSHED_MAX_LINES) {
+        pushed_dropped = true;
+        return;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        pushed_dropped = true;
+        return;
+    }
+    memcpy(copy, line, len);
+    copy[len] = 0;
+    pushed[(pushed_head + pushed_count++) % PUSHED_MAX_LINES] = copy;
+}
+
+// 수신 버퍼 맨 앞의 EVT 줄들을 알림 큐로 옮긴다. 서버는 명령을 기다리는 동안에만 알림을 보내므로
+// 응답 첫머리에서만 나타난다. wait 면 줄이 잘려 있거나 버퍼가 비었을 때 나머지를 받아 오고,
+// 아니면 완성된 줄만 옮기고 돌아간다.
+static void stash_pushed_lines(bool wait) {
+    // 데이터 연결에는 알림이 오지 않는다
+    while (!thread_stream) {
+        if (main_stream.rlen == 0 && !wait)
+            return;
+        size_t cmp = main_stream.rlen < 4 ? main_stream.rlen : 4;
+        if (memcmp(main_stream.rbuf, "EVT ", cmp) != 0)
+            return;
+
+        char *nl = main_stream.rlen >= 4 ? memchr(main_stream.rbuf, '\n', main_stream.rlen) : NULL;
+        if (!nl) {
+            if (!wait || main_stream.rlen == sizeof(main_stream.rbuf))
+                return;
+            ssize_t n = recv(main_stream.fd, main_stream.rbuf + main_stream.rlen,
+                             sizeof(main_stream.rbuf) - main_stream.rlen, 0);
+            if (n <= 0)
+                return;
+            main_stream.rlen += (size_t)n;
+            continue;
+        }
+
+        size_t len = (size_t)(nl - main_stream.rbuf);
+        pushed_add(main_stream.rbuf, len);
+        memmove(main_stream.rbuf, nl + 1, main_stream.rlen - len - 1);
+        main_stream.rlen -= len + 1;
+    }
+}
+
+// 응답이 "~Z " 로 시작하면 프레임 전체를 받아 text_buf 에 풀어 둔다.
+// 응답을 기다리는 시점에만 호출하므로 바이너리 본문과 섞이지 않는다.
+static void inflate_pending_text(void) {
+    SocketStream *st = cur_stream();
+    if (text_pos < text_len)
+        return;
+
+    stash_pushed_lines(true);
+
+    while (st->rlen < 3) {
+        if (st->rlen > 0 && memcmp(st->rbuf, "~Z ", st->rlen) != 0)
+            return;
+        ssize_t n = recv(st->fd, st->rbuf + st->rlen,
+                         sizeof(st->rbuf) - st->rlen, 0);
+        if (n <= 0)
+            return;
+        st->rlen += (size_t)n;
+    }
+    if (memcmp(st->rbuf, "~Z ", 3) != 0)
+        return;
+
+    char header[64];
+    size_t raw_len = 0, comp_len = 0;
+    if (stream_recv_line(st, header, sizeof(header)) < 0 ||
+        sscanf(header, "~Z %zu %zu", &raw_len, &comp_len) != 2)
+        return;
+
+    char *comp = malloc(comp_len ? comp_len : 1);
+    char *raw = malloc(raw_len + 1);
+    if (comp && raw && stream_recv_exact(st, comp, comp_len) == 0 &&
+        decompress_buffer(comp, comp_len, raw, raw_len) == 0) {
+        free(text_buf);
+        text_buf = raw;
+        text_len = raw_len;
+        text_pos = 0;
+        raw = NULL;
+    }
+    free(comp);
+    free(raw);
 }
 
 int socket_recv_response(char *outbuf, size_t size) {
-    int n = recv(sockfd, outbuf, size - 1, 0);
+    SocketStream *st = cur_stream();
+    inflate_pending_text();
+    if (text_pos < text_len) {
+        size_t n = text_len - text_pos;
+        if (n > size - 1)
+            n = size - 1;
+        memcpy(outbuf, text_buf + text_pos, n);
+        text_pos += n;
+        outbuf[n] = 0;
+        return (int)n;
+    }
+
+    while (st->rlen == 0) {
+        ssize_t r = recv(st->fd, st->rbuf, sizeof(st->rbuf), 0);
+        if (r <= 0)
+            return (int)r;
+        st->rlen = (size_t)r;
+        stash_pushed_lines(true);
+    }
+
+    // 응답 끝에 바로 이어 온 알림은 다음 호출(응답 첫머리)에서 걸러지도록 남겨 둔다
+    size_t avail = st->rlen < size - 1 ? st->rlen : size - 1;
+    char *evt = memmem(st->rbuf, avail, "\nEVT ", 5);
+    int n = stream_recv_some(st, outbuf, evt ? (size_t)(evt - st->rbuf) + 1 : size - 1);
     if (n > 0) outbuf[n] = 0;
     return n;
 }
 
+int socket_recv_line(char *out, size_t size) {
+    SocketStream *st = cur_stream();
+    inflate_pending_text();
+    if (text_pos < text_len) {
+        char *start = text_buf + text_pos;
+        char *nl = memchr(start, '\n', text_len - text_pos);
+        size_t take = nl ? (size_t)(nl - start) : text_len - text_pos;
+        size_t copy = take < size - 1 ? take : size - 1;
+        memcpy(out, start, copy);
+        out[copy] = 0;
+        text_pos += nl ? take + 1 : take;
+        return (int)copy;
+    }
+    return stream_recv_line(st, out, size);
+}
+
+int socket_recv_exact(void *buf, size_t len) {
+    return stream_recv_exact(cur_stream(), buf, len);
+}
+
+int socket_recv_some(void *buf, size_t len) {
+    return stream_recv_some(cur_stream(), buf, len);
+}
+
+int socket_poll_pushed(char *out, size_t size) {
+    if (pushed_count == 0 && text_pos >= text_len && main_stream.fd >= 0) {
+        if (!memchr(main_stream.rbuf, '\n', main_stream.rlen) && main_stream.rlen < sizeof(main_stream.rbuf)) {
+            ssize_t n = recv(main_stream.fd, main_stream.rbuf + main_stream.rlen,
+                             sizeof(main_stream.rbuf) - main_stream.rlen, MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                return -1;
+            if (n > 0)
+                main_stream.rlen += (size_t)n;
+        }
+
+        // 요청 없이 온 줄: 알림이 아니면 (다른 사용자의 채팅 등) 그대로 한 줄을 돌려준다
+        char *nl = memchr(main_stream.rbuf, '\n', main_stream.rlen);
+        if (!nl)
+            return 0;
+        stash_pushed_lines(false);
+        if (pushed_count == 0)
+            return stream_recv_line(&main_stream, out, size) < 0 ? -1 : 1;
+    }
+
+    if (pushed_count == 0)
+        return 0;
+    char *line = pushed[pushed_head];
+    pushed_head = (pushed_head + 1) % PUSHED_MAX_LINES;
+    pushed_count--;
+    snprintf(out, size, "%s", line);
+    free(line);
+    return 1;
+}
+
+bool socket_pushed_dropped(void) {
+    bool dropped = pushed_dropped;
+    pushed_dropped = false;
+    return dropped;
+}
+
 void socket_close(void) {
-    if (sockfd >= 0) {
-        close(sockfd);
-        sockfd = -1;
+    free(text_buf);
+    text_buf = NULL;
+    text_len = text_pos = 0;
+    while (pushed_count > 0) {
+        free(pushed[pushed_head]);
+        pushed_head = (pushed_head + 1) % PUSHED_MAX_LINES;
+        pushed_count--;
     }
+    pushed_dropped = false;
+    stream_close(&main_stream);
+    sockfd = -1;
 }
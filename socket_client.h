@@ -1,11 +1,52 @@
 #ifndef SOCKET_CLIENT_H
 #define SOCKET_CLIENT_H
 
+#include <stdbool.h>
 #include <stddef.h>
+
+// 연결별 수신 버퍼를 가진 소켓 (병렬 전송 스트림에서 사용)
+typedef struct {
+    int fd;
+    char rbuf[8192];
+    size_t rlen;
+} SocketStream;
+
+// 마지막으로 접속했던 서버에 새 연결을 연다
+int stream_open(SocketStream *st);
+void stream_close(SocketStream *st);
+int stream_send_all(SocketStream *st, const void *data, size_t len);
+// 서버가 한 명령 줄로 받아 주는 최대 길이 (개행 제외). 더 긴 줄은 ERR line too long 으로 거절된다.
+#define SOCKET_COMMAND_MAX 1023
+int stream_send_line(SocketStream *st, const char *cmd);
+int stream_recv_line(SocketStream *st, char *out, size_t size);
+int stream_recv_some(SocketStream *st, void *buf, size_t len);
+int stream_recv_exact(SocketStream *st, void *buf, size_t len);
+
 extern int sockfd;
+// 이 스레드의 socket_* 호출이 st 를 쓰게 한다 (NULL 이면 메인 연결로 돌아감).
+// 데이터 연결로 업로드하는 스레드가 UI 스레드의 메인 연결과 섞이지 않도록 쓴다.
+void socket_bind_thread(SocketStream *st);
 int socket_connect_to(const char *server_ip, int port);
 void socket_send_cmd(const char *cmd);
+// 부분 전송 없이 len 바이트를 모두 보낸다 (실패 시 -1)
+int socket_send_all(const void *data, size_t len);
 int socket_recv_response(char *outbuf, size_t size);
+// 개행 전까지 한 줄을 읽는다 (개행 제외, 연결 종료 시 -1)
+int socket_recv_line(char *out, size_t size);
+int socket_recv_exact(void *buf, size_t len);
+// 받은 만큼만 돌려준다 (버퍼에 남은 데이터 우선, 연결 종료 시 0 이하)
+int socket_recv_some(void *buf, size_t len);
+// 요청 없이 서버가 보낸 줄(WATCH 의 EVT 알림 등)을 기다리지 않고 하나 꺼낸다.
+// 반환: 1 = out 에 한 줄, 0 = 없음, -1 = 연결 종료. 응답을 기다리는 중이 아닐 때만 부른다.
+int socket_poll_pushed(char *out, size_t size);
+// 알림 큐가 넘쳐 버린 줄이 있었으면 true (한 번 읽으면 초기화): 목록을 다시 읽어야 한다
+bool socket_pushed_dropped(void);
+// 같은 호스트의 서버에 Unix 소켓으로 붙어 있으면 true
+bool socket_is_local(void);
+// 열린 파일을 서버에 넘긴다 (SCM_RIGHTS, socket_is_local 일 때만). 실패 시 -1
+int socket_send_fd(int fd);
+// 마지막으로 접속했던 서버에 다시 연결
+int socket_reconnect(void);
 void socket_close(void);
 
 #endif
@@ -0,0 +1,402 @@
+// sync_manifest.c
+#define _GNU_SOURCE
+#include "sync_manifest.h"
+#include "checksum.h"
+#include "compress.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 매니페스트 송신 버퍼 (압축 프레임 한 블록에 그대로 들어가는 크기)
+#define MANIFEST_SEND_BUFFER COMPRESS_BLOCK
+
+void manifest_init(Manifest *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+void manifest_free(Manifest *m)
+{
+    free(m->items);
+    free(m->arena);
+    free(m->index);
+    memset(m, 0, sizeof(*m));
+}
+
+static size_t path_slot(const char *path, size_t cap)
+{
+    return (size_t)checksum_fast64(path, strlen(path), 0) & (cap - 1);
+}
+
+static int index_grow(Manifest *m)
+{
+    size_t cap = m->index_cap ? m->index_cap * 2 : 1024;
+    size_t *index = calloc(cap, sizeof(*index));
+    if (!index)
+        return -1;
+
+    for (size_t i = 0; i < m->count; i++)
+    {
+        size_t s = path_slot(m->arena + m->items[i].path, cap);
+        while (index[s])
+            s = (s + 1) & (cap - 1);
+        index[s] = i + 1;
+    }
+
+    free(m->index);
+    m->index = index;
+    m->index_cap = cap;
+    return 0;
+}
+
+int manifest_add(Manifest *m, char type, const char *path, long long size, long long mtime,
+                 bool has_hash, uint64_t hash)
+{
+    size_t len = strlen(path) + 1;
+
+    if (m->count == m->cap)
+    {
+        size_t cap = m->cap ? m->cap * 2 : 1024;
+        ManifestEntry *items = realloc(m->items, cap * sizeof(*items));
+        if (!items)
+            return -1;
+        m->items = items;
+        m->cap = cap;
+    }
+    if (m->arena_len + len > m->arena_cap)
+    {
+        size_t cap = m->arena_cap ? m->arena_cap * 2 : 64 * 1024;
+        while (cap < m->arena_len + len)
+            cap *= 2;
+        char *arena = realloc(m->arena, cap);
+        if (!arena)
+            return -1;
+        m->arena = arena;
+        m->arena_cap = cap;
+    }
+    // 부하율 1/2 이하 유지
+    if ((m->count + 1) * 2 > m->index_cap && index_grow(m) != 0)
+        return -1;
+
+    memcpy(m->arena + m->arena_len, path, len);
+    m->items[m->count] = (ManifestEntry){
+        .path = m->arena_len, .size = size, .mtime = mtime,
+        .hash = hash, .has_hash = has_hash, .type = type,
+    };
+    m->arena_len += len;
+
+    size_t s = path_slot(path, m->index_cap);
+    while (m->index[s])
+        s = (s + 1) & (m->index_cap - 1);
+    m->index[s] = ++m->count;
+    return 0;
+}
+
+const ManifestEntry *manifest_find(const Manifest *m, const char *path)
+{
+    if (m->index_cap == 0)
+        return NULL;
+
+    size_t s = path_slot(path, m->index_cap);
+    while (m->index[s])
+    {
+        const ManifestEntry *e = &m->items[m->index[s] - 1];
+        if (strcmp(m->arena + e->path, path) == 0)
+            return e;
+        s = (s + 1) & (m->index_cap - 1);
+    }
+    return NULL;
+}
+
+static bool hash_fd(int fd, uint64_t *out)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) != 0)
+        return false;
+    if (sb.st_size == 0)
+    {
+        *out = checksum_fast64("", 0, 0);
+        return true;
+    }
+
+    void *p = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    posix_madvise(p, (size_t)sb.st_size, POSIX_MADV_SEQUENTIAL);
+    *out = checksum_fast64(p, (size_t)sb.st_size, 0);
+    munmap(p, (size_t)sb.st_size);
+    return true;
+}
+
+bool manifest_hash_file(int dirfd, const char *path, uint64_t *out)
+{
+    int fd = openat(dirfd, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool ok = hash_fd(fd, out);
+    close(fd);
+    return ok;
+}
+
+// ------------------------------------------------------------
+// 로컬 스캔
+// ------------------------------------------------------------
+typedef struct
+{
+    Manifest *m;
+    char *bad;
+    size_t bad_len;
+} ScanCtx;
+
+static int scan_visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    (void)parentfd;
+    ScanCtx *c = ctx;
+    // 읽지 못한 항목을 빼고 넘어가면 그 아래가 로컬에서 지워진 것처럼 보여
+    // --delete 가 원격 쪽을 통째로 지운다. 스캔 전체를 실패시킨다.
+    if (!sb)
+    {
+        // 줄바꿈이 든 이름/너무 긴 경로는 어느 쪽 매니페스트에도 올라가지 않으므로 건너뛴다
+        // (tree_walk 는 이때 rel 에 name 을 붙이지 않고 부모 경로를 넘긴다)
+        size_t rl = strlen(rel), nl = strlen(name);
+        if (nl > 0 && !(rl >= nl && strcmp(rel + rl - nl, name) == 0 &&
+                        (rl == nl || rel[rl - nl - 1] == '/')))
+            return 0;
+        int saved = errno ? errno : EIO;
+        if (c->bad && c->bad_len)
+            snprintf(c->bad, c->bad_len, "%s", rel[0] ? rel : ".");
+        errno = saved;
+        return -1;
+    }
+    // 링크/특수 파일은 tree_stream 으로 보내지 않으므로 매니페스트에도 넣지 않는다
+    if (!rel[0])
+        return 0;
+    if (S_ISDIR(sb->st_mode))
+        return manifest_add(c->m, 'D', rel, 0, 0, false, 0) == 0 ? 0 : -1;
+    if (S_ISREG(sb->st_mode))
+        return manifest_add(c->m, 'F', rel, (long long)sb->st_size, (long long)sb->st_mtime, false, 0) == 0 ? 0 : -1;
+    return 0;
+}
+
+int manifest_scan(Manifest *m, int dirfd, char *bad, size_t bad_len)
+{
+    ScanCtx c = { m, bad, bad_len };
+    if (bad && bad_len)
+        bad[0] = '\0';
+    errno = 0;
+    return tree_walk(dirfd, scan_visit, &c);
+}
+
+// ------------------------------------------------------------
+// 송신 (서버)
+// ------------------------------------------------------------
+typedef struct
+{
+    const TreeSink *sink;
+    bool with_hash;
+    char *buf;
+    size_t len;
+    bool failed;
+    unsigned long long entries;
+} ManifestWriter;
+
+static void mw_flush(ManifestWriter *w)
+{
+    if (!w->failed && w->len > 0 && w->sink->write(w->sink->ctx, w->buf, w->len) != 0)
+        w->failed = true;
+    w->len = 0;
+}
+
+static void mw_put(ManifestWriter *w, const char *line, size_t len)
+{
+    if (w->len + len > MANIFEST_SEND_BUFFER)
+        mw_flush(w);
+    memcpy(w->buf + w->len, line, len);
+    w->len += len;
+}
+
+static int send_visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    ManifestWriter *w = ctx;
+    char line[PATH_MAX + 96];
+    int n;
+
+    if (!sb || !rel[0])
+        return 0;
+
+    if (S_ISDIR(sb->st_mode))
+    {
+        n = snprintf(line, sizeof(line), "D %s\n", rel);
+    }
+    else if (S_ISREG(sb->st_mode))
+    {
+        char hex[17] = "-";
+        uint64_t h;
+        if (w->with_hash && manifest_hash_file(parentfd, name, &h))
+            snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+        n = snprintf(line, sizeof(line), "F %lld %lld %s %s\n",
+                     (long long)sb->st_size, (long long)sb->st_mtime, hex, rel);
+    }
+    else
+    {
+        return 0;
+    }
+
+    mw_put(w, line, (size_t)n);
+    w->entries++;
+    return w->failed ? -1 : 0;
+}
+
+int manifest_send(int dirfd, bool with_hash, const TreeSink *sink, unsigned long long *entries)
+{
+    ManifestWriter w = { .sink = sink, .with_hash = with_hash };
+    w.buf = malloc(MANIFEST_SEND_BUFFER);
+    if (!w.buf)
+        return -1;
+
+    if (dirfd >= 0)
+        tree_walk(dirfd, send_visit, &w);
+    mw_put(&w, "E\n", 2);
+    mw_flush(&w);
+
+    free(w.buf);
+    if (entries)
+        *entries = w.entries;
+    return w.failed ? -1 : 0;
+}
+
+// ------------------------------------------------------------
+// 수신 (클라이언트)
+// ------------------------------------------------------------
+int manifest_receive(Manifest *m, const TreeSource *src)
+{
+    char line[PATH_MAX + 96];
+
+    while (src->read_line(src->ctx, line, sizeof(line)) >= 0)
+    {
+        long long size, mtime;
+        char hex[20];
+        int off = 0;
+
+        if (strcmp(line, "E") == 0)
+            return 0;
+
+        if (line[0] == 'D' && line[1] == ' ')
+        {
+            if (manifest_add(m, 'D', line + 2, 0, 0, false, 0) != 0)
+                return -1;
+        }
+        else if (line[0] == 'F' && sscanf(line, "F %lld %lld %19s %n", &size, &mtime, hex, &off) == 3 && off > 0)
+        {
+            char *end = NULL;
+            unsigned long long h = strtoull(hex, &end, 16);
+            bool has_hash = end && *end == '\0' && strlen(hex) == 16;
+            if (manifest_add(m, 'F', line + off, size, mtime, has_hash, has_hash ? h : 0) != 0)
+                return -1;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// ------------------------------------------------------------
+// 비교 (클라이언트)
+// ------------------------------------------------------------
+static int list_push(const char ***list, size_t *count, size_t *cap, const char *path)
+{
+    if (*count == *cap)
+    {
+        size_t n = *cap ? *cap * 2 : 256;
+        const char **p = realloc(*list, n * sizeof(*p));
+        if (!p)
+            return -1;
+        *list = p;
+        *cap = n;
+    }
+    (*list)[(*count)++] = path;
+    return 0;
+}
+
+static bool file_changed(const ManifestEntry *l, const ManifestEntry *r, int local_dirfd, const char *path)
+{
+    if (l->size != r->size)
+        return true;
+    if (l->mtime == r->mtime)
+        return false;
+
+    // mtime 만 다르면 (다시 빌드했지만 내용은 같은 경우) 해시로 확인
+    uint64_t h;
+    if (r->has_hash && manifest_hash_file(local_dirfd, path, &h))
+        return h != r->hash;
+    return true;
+}
+
+int manifest_diff(const Manifest *local, const Manifest *remote, int local_dirfd, bool deletions,
+                  SyncDiff *out)
+{
+    size_t send_cap = 0, remove_cap = 0;
+    memset(out, 0, sizeof(*out));
+
+    // 삭제 먼저: 받는 쪽 순서(부모 → 자식)대로 보고, 부모가 지워질 항목은 건너뛴다
+    for (size_t i = 0; i < remote->count; i++)
+    {
+        const ManifestEntry *r = &remote->items[i];
+        const char *path = manifest_path(remote, r);
+        const ManifestEntry *l = manifest_find(local, path);
+
+        bool kind_changed = l && l->type != r->type;
+        if (!(kind_changed || (!l && deletions)))
+            continue;
+
+        const char *slash = strrchr(path, '/');
+        if (slash)
+        {
+            char parent[PATH_MAX];
+            snprintf(parent, sizeof(parent), "%.*s", (int)(slash - path), path);
+            const ManifestEntry *lp = manifest_find(local, parent);
+            if (!lp || lp->type != 'D')
+                continue;
+        }
+
+        if (list_push(&out->remove, &out->remove_count, &remove_cap, path) != 0)
+            return -1;
+    }
+
+    for (size_t i = 0; i < local->count; i++)
+    {
+        const ManifestEntry *l = &local->items[i];
+        const char *path = manifest_path(local, l);
+        const ManifestEntry *r = manifest_find(remote, path);
+
+        bool send = !r || r->type != l->type ||
+                    (l->type == 'F' && file_changed(l, r, local_dirfd, path));
+        if (!send)
+        {
+            out->unchanged++;
+            continue;
+        }
+
+        if (list_push(&out->send, &out->send_count, &send_cap, path) != 0)
+            return -1;
+        if (l->type == 'F')
+            out->send_bytes += (unsigned long long)l->size;
+    }
+
+    return 0;
+}
+
+void sync_diff_free(SyncDiff *d)
+{
+    free(d->send);
+    free(d->remove);
+    memset(d, 0, sizeof(*d));
+}
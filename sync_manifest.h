@@ -0,0 +1,80 @@
+#ifndef SYNC_MANIFEST_H
+#define SYNC_MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tree_stream.h"
+
+// 디렉토리 동기화(SYNC)용 매니페스트: 본문 없이 경로/크기/mtime(/해시) 만 주고받는다
+//
+//   D <path>\n
+//   F <size> <mtime> <xxh64 hex | -> <path>\n
+//   E\n
+//
+// 양쪽 매니페스트를 비교해 새로 생겼거나 바뀐 항목만 tree_stream 레코드로 보내고,
+// 받는 쪽에만 있는 항목은 (요청한 경우) 지운다.
+
+typedef struct
+{
+    size_t path;          // arena 오프셋
+    long long size;
+    long long mtime;
+    uint64_t hash;
+    bool has_hash;
+    char type;            // 'D' 또는 'F'
+} ManifestEntry;
+
+typedef struct
+{
+    ManifestEntry *items;
+    size_t count;
+    size_t cap;
+    char *arena;          // 경로 문자열 (NUL 구분)
+    size_t arena_len;
+    size_t arena_cap;
+    size_t *index;        // 경로 해시 → items 번호 + 1 (0 은 빈 칸)
+    size_t index_cap;
+} Manifest;
+
+void manifest_init(Manifest *m);
+void manifest_free(Manifest *m);
+
+static inline const char *manifest_path(const Manifest *m, const ManifestEntry *e)
+{
+    return m->arena + e->path;
+}
+
+int manifest_add(Manifest *m, char type, const char *path, long long size, long long mtime,
+                 bool has_hash, uint64_t hash);
+const ManifestEntry *manifest_find(const Manifest *m, const char *path);
+
+// 로컬 디렉토리를 걸어 매니페스트를 만든다 (해시는 비교할 때 필요한 것만 계산).
+// 읽을 수 없는 항목이 하나라도 있으면 -1, bad 에 그 경로를 남긴다.
+int manifest_scan(Manifest *m, int dirfd, char *bad, size_t bad_len);
+// dirfd 아래를 걸으며 매니페스트 레코드를 바로 sink 로 보낸다 (E 포함). 보낸 항목 수를 기록.
+int manifest_send(int dirfd, bool with_hash, const TreeSink *sink, unsigned long long *entries);
+// E 까지 읽어 m 에 채운다. 형식 오류나 연결 종료 시 -1.
+int manifest_receive(Manifest *m, const TreeSource *src);
+
+// 파일 내용의 XXH64 (manifest 의 해시와 같은 방식)
+bool manifest_hash_file(int dirfd, const char *path, uint64_t *out);
+
+typedef struct
+{
+    const char **send;    // 보낼 항목 (local 의 경로, 부모가 자식보다 먼저)
+    size_t send_count;
+    const char **remove;  // 받는 쪽에서 지울 항목 (하위 항목은 포함하지 않음)
+    size_t remove_count;
+    unsigned long long send_bytes;
+    unsigned long long unchanged;
+} SyncDiff;
+
+// local 과 remote 를 비교한다. deletions 가 false 여도 종류가 바뀐 항목(파일↔디렉토리)은 지운다.
+// remote 에 해시가 있으면 크기는 같고 mtime 만 다른 파일은 내용을 비교한다.
+int manifest_diff(const Manifest *local, const Manifest *remote, int local_dirfd, bool deletions,
+                  SyncDiff *out);
+void sync_diff_free(SyncDiff *d);
+
+#endif
@@ -0,0 +1,798 @@
+// text_search.c
+#define _GNU_SOURCE
+#include "text_search.h"
+#include "fair_share.h"
+#include "tree_stream.h"
+#include "tree_watch.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEARCH_SNIFF 8192
+// 조각 끝에 걸친 마지막 줄을 위해 조각 뒤로 더 매핑하는 크기 (줄이 더 길면 두 배씩 늘린다)
+#define SEARCH_TAIL (64 * 1024)
+#define SEARCH_POLL_MS 200
+// 작업 풀 스레드 하나당 동시에 걸어 둘 작업 수 (결과를 순서대로 내보내느라 묶이는 메모리의 한도)
+#define SEARCH_WINDOW_PER_THREAD 4
+
+// ------------------------------------------------------------
+// 문자열 찾기: 드문 글자 하나를 memchr 로 훑고 후보 위치에서 전체를 비교한다
+// ------------------------------------------------------------
+typedef struct
+{
+    const char *text;        // NULL 이면 없음 (정규식을 줄마다 확인)
+    size_t len;
+    bool icase;
+    size_t rare;             // text 안에서 훑을 글자의 위치
+} Literal;
+
+// 클수록 드문 글자 (영어 문장, 로그 기준의 대략적인 순위)
+static int byte_rank(unsigned char c, bool icase)
+{
+    static const char common[] = " etaoinsrhldcumfpgwybvkxjqz";
+    if (icase || (c >= 'a' && c <= 'z'))
+    {
+        const char *p = strchr(common, tolower(c));
+        if (p && c)
+            return (int)(p - common);
+    }
+    if (isdigit(c))
+        return 20;
+    if (isupper(c))
+        return 30;
+    return c < 0x80 ? 35 : 40;
+}
+
+static void literal_init(Literal *l, const char *text, size_t len, bool icase)
+{
+    l->text = len ? text : NULL;
+    l->len = len;
+    l->icase = icase;
+    l->rare = 0;
+    for (size_t i = 1; i < len; i++)
+        if (byte_rank((unsigned char)text[i], icase) > byte_rank((unsigned char)text[l->rare], icase))
+            l->rare = i;
+}
+
+static bool literal_equal(const Literal *l, const char *p)
+{
+    if (!l->icase)
+        return memcmp(p, l->text, l->len) == 0;
+    for (size_t i = 0; i < l->len; i++)
+        if (tolower((unsigned char)p[i]) != tolower((unsigned char)l->text[i]))
+            return false;
+    return true;
+}
+
+static const char *literal_find(const Literal *l, const char *p, const char *end)
+{
+    if ((size_t)(end - p) < l->len)
+        return NULL;
+
+    unsigned char c = (unsigned char)l->text[l->rare];
+    unsigned char alt = l->icase ? (unsigned char)(islower(c) ? toupper(c) : tolower(c)) : c;
+    const char *scan = p + l->rare;
+    const char *limit = end - (l->len - l->rare - 1);
+
+    // 대소문자를 무시하면 두 글자를 따로 훑는다: 앞서 찾은 위치가 아직 앞에 있으면 다시 훑지 않는다
+    const char *next_c = NULL, *next_alt = alt != c ? NULL : limit;
+    while (scan < limit)
+    {
+        if (!next_c || next_c < scan)
+        {
+            next_c = memchr(scan, c, (size_t)(limit - scan));
+            if (!next_c)
+                next_c = limit;
+        }
+        if (!next_alt || next_alt < scan)
+        {
+            next_alt = memchr(scan, alt, (size_t)(limit - scan));
+            if (!next_alt)
+                next_alt = limit;
+        }
+        const char *hit = next_c < next_alt ? next_c : next_alt;
+        if (hit == limit)
+            return NULL;
+        if (literal_equal(l, hit - l->rare))
+            return hit - l->rare;
+        scan = hit + 1;
+    }
+    return NULL;
+}
+
+// 정규식에 반드시 들어 있는 가장 긴 문자열 (괄호 밖, 뒤에 ?, *, { 가 붙지 않은 글자만).
+// 괄호 밖에 | 가 있으면 알 수 없으므로 0.
+static size_t regex_literal(const char *re, char *out, size_t cap)
+{
+    char run[256];
+    size_t n = 0, best = 0;
+    int depth = 0;
+
+    for (const char *p = re;; p++)
+    {
+        char c = *p;
+        bool literal = false;
+        if (c == '\\' && p[1] && !isalnum((unsigned char)p[1]))
+        {
+            c = *++p;
+            literal = true;
+        }
+        else if (c && c != '\\' && !strchr(".^$+*?{}()[]|", c))
+        {
+            literal = true;
+        }
+
+        if (literal && p[1] != '?' && p[1] != '*' && p[1] != '{')
+        {
+            if (depth == 0 && n < sizeof(run))
+                run[n++] = c;
+            continue;
+        }
+
+        if (n > best && n < cap)
+        {
+            memcpy(out, run, n);
+            best = n;
+        }
+        n = 0;
+
+        if (!*p)
+            break;
+        if (literal)
+            continue;
+        if (c == '\\')
+            p++;   // \w, \b 같은 글자 묶음
+        else if (c == '|' && depth == 0)
+            return 0;
+        else if (c == '(')
+            depth++;
+        else if (c == ')' && depth > 0)
+            depth--;
+        else if (c == '[')
+        {
+            // [] 안은 한 글자: ']' 가 처음에 오면 글자로 본다
+            if (p[1] == '^')
+                p++;
+            if (p[1] == ']')
+                p++;
+            while (p[1] && p[1] != ']')
+                p++;
+            if (p[1])
+                p++;
+        }
+        else if (c == '{')
+        {
+            while (p[1] && p[1] != '}')
+                p++;
+            if (p[1])
+                p++;
+        }
+    }
+    return best;
+}
+
+static size_t count_newlines(const char *p, const char *end)
+{
+    size_t n = 0;
+    // 8 바이트씩: 개행인 바이트의 최상위 비트만 남긴다
+    while ((uintptr_t)p % 8 && p < end)
+        n += *p++ == '\n';
+    for (; end - p >= 8; p += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= 0x0a0a0a0a0a0a0a0aULL;
+        v = ~(((v & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | v | 0x7f7f7f7f7f7f7f7fULL);
+        n += (size_t)__builtin_popcountll(v);
+    }
+    while (p < end)
+        n += *p++ == '\n';
+    return n;
+}
+
+// ------------------------------------------------------------
+// 작업
+// ------------------------------------------------------------
+typedef struct
+{
+    int fd;
+    char *path;
+    size_t size;
+    int refs;                // 남은 조각 수 (호출한 스레드만 만진다)
+} SharedFile;
+
+struct Search;
+
+typedef struct Task
+{
+    struct Search *s;
+    SharedFile *file;
+    size_t off, end;         // 이 구간에서 시작하는 줄을 맡는다
+    bool first, last;
+    // 결과: [줄 번호(조각 안, 8)][길이(4)][내용] 의 반복
+    char *out;
+    size_t out_len, out_cap;
+    size_t lines;            // 맡은 줄 수 (다음 조각의 줄 번호 기준, 마지막 조각은 세지 않음)
+    bool binary, failed, done;
+    struct Task *next;
+} Task;
+
+typedef struct Search
+{
+    const SearchQuery *q;
+    Literal lit;
+    unsigned long gen;       // 작업 스레드가 정규식을 다시 컴파일할지 판단하는 번호
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    bool stop;               // 작업 스레드도 읽는다 (__atomic)
+
+    // 아래는 호출한 스레드만
+    WorkerPool *pool;
+    size_t window;
+    Task *head, *tail;
+    size_t inflight;
+    const char *dir;
+    SearchMatchFn match;
+    SearchPollFn poll;
+    void *ctx;
+    SearchStats *stats;
+    size_t line_base;
+    const SharedFile *last_matched;
+    struct timespec last_poll;
+} Search;
+
+static bool stopping(const Search *s)
+{
+    return __atomic_load_n(&s->stop, __ATOMIC_RELAXED);
+}
+
+// 정규식은 작업 스레드마다 따로 컴파일해 둔다 (같은 regex_t 를 여러 스레드가 쓰면 서로 기다린다)
+static pthread_mutex_t gen_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long next_gen;
+static __thread struct
+{
+    unsigned long gen;
+    bool ok;
+    regex_t re;
+} thread_re;
+
+static const regex_t *thread_regex(const Search *s)
+{
+    if (thread_re.gen != s->gen)
+    {
+        if (thread_re.ok)
+            regfree(&thread_re.re);
+        int flags = REG_EXTENDED | REG_NEWLINE | REG_NOSUB | (s->q->icase ? REG_ICASE : 0);
+        thread_re.ok = regcomp(&thread_re.re, s->q->pattern, flags) == 0;
+        thread_re.gen = s->gen;
+    }
+    return thread_re.ok ? &thread_re.re : NULL;
+}
+
+// regexec 에는 매핑이 아니라 복사본을 넘긴다: 매핑을 읽다 SIGBUS 로 빠져나오면 regexec 가 잡은
+// 잠금과 malloc 상태가 남기 때문이다 (복사는 잠금 없는 memcpy 라 중간에 빠져나와도 괜찮다).
+static __thread char *line_copy;
+static __thread size_t line_copy_cap;
+
+static bool line_matches(const Search *s, const char *ls, const char *le)
+{
+    if (!s->q->regex)
+        return true;   // 문자열 찾기는 literal_find 가 이미 확인했다
+    const regex_t *re = thread_regex(s);
+    size_t len = (size_t)(le - ls);
+    if (!re)
+        return false;
+    if (len + 1 > line_copy_cap)
+    {
+        size_t cap = line_copy_cap ? line_copy_cap : 4096;
+        while (cap < len + 1)
+            cap *= 2;
+        char *p = realloc(line_copy, cap);
+        if (!p)
+            return false;
+        line_copy = p;
+        line_copy_cap = cap;
+    }
+    memcpy(line_copy, ls, len);
+    line_copy[len] = '\0';
+    regmatch_t m = { 0, (regoff_t)len };
+    return regexec(re, line_copy, 1, &m, REG_STARTEND) == 0;
+}
+
+static void task_add_result(Task *t, size_t line, const char *text, size_t len)
+{
+    if (len > SEARCH_LINE_MAX)
+        len = SEARCH_LINE_MAX;
+    uint64_t line64 = line;
+    uint32_t len32 = (uint32_t)len;
+    size_t need = sizeof(line64) + sizeof(len32) + len;
+    if (t->out_len + need > t->out_cap)
+    {
+        size_t cap = t->out_cap ? t->out_cap * 2 : 4096;
+        while (cap < t->out_len + need)
+            cap *= 2;
+        char *p = realloc(t->out, cap);
+        if (!p)
+            return;
+        t->out = p;
+        t->out_cap = cap;
+    }
+    memcpy(t->out + t->out_len, &line64, sizeof(line64));
+    memcpy(t->out + t->out_len + sizeof(line64), &len32, sizeof(len32));
+    memcpy(t->out + t->out_len + sizeof(line64) + sizeof(len32), text, len);
+    t->out_len += need;
+}
+
+// 매핑 앞에 fstat 으로 크기를 확인하지만, 찾는 도중 파일이 줄어들면 매핑을 읽다 SIGBUS 가 난다:
+// 그 조각만 실패로 처리한다. 매핑을 읽는 곳은 memchr, memcpy 같은 잠금 없는 함수뿐이라 빠져나와도 된다.
+static __thread sigjmp_buf *bus_jump;
+static pthread_once_t bus_once = PTHREAD_ONCE_INIT;
+
+static void on_sigbus(int sig, siginfo_t *si, void *uc)
+{
+    (void)si;
+    (void)uc;
+    if (bus_jump)
+        siglongjmp(*bus_jump, 1);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void install_sigbus(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = on_sigbus;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+// 조각의 매핑: 파일의 [from, limit) 가 base 에 있다
+typedef struct
+{
+    char *base;
+    size_t from, limit;
+} ChunkMap;
+
+// siglongjmp 로 돌아온 뒤에도 풀 수 있도록 스레드마다 둔다 (자동 변수는 값을 믿을 수 없다)
+static __thread ChunkMap task_map;
+
+// 조각 [off, end) 와 앞 조각에서 넘어온 줄의 끝, 마지막 줄의 나머지만 매핑한다.
+// 마지막 줄이 SEARCH_TAIL 보다 길면 개행이 나올 때까지 두 배씩 늘린다.
+static bool map_chunk(const Task *t, size_t size, ChunkMap *m)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t tail = SEARCH_TAIL;
+    m->from = (t->off > 0 ? t->off - 1 : 0) & ~(page - 1);
+    for (;;)
+    {
+        m->limit = size - t->end > tail ? t->end + tail : size;
+        m->base = mmap(NULL, m->limit - m->from, PROT_READ, MAP_PRIVATE, t->file->fd, (off_t)m->from);
+        if (m->base == MAP_FAILED)
+        {
+            m->base = NULL;
+            return false;
+        }
+        const char *end = m->base + (t->end - m->from);
+        if (m->limit == size || memchr(end - 1, '\n', m->limit - t->end + 1))
+            return true;
+        munmap(m->base, m->limit - m->from);
+        m->base = NULL;
+        tail *= 2;
+    }
+}
+
+static void scan_chunk(Task *t, const ChunkMap *m)
+{
+    const Search *s = t->s;
+    const char *fend = m->base + (m->limit - m->from);
+    const char *start = m->base + (t->off - m->from);
+    const char *end = m->base + (t->end - m->from);
+    size_t max = s->q->max_matches;
+
+    // 앞 조각에서 시작한 줄은 건너뛴다
+    if (t->off > 0)
+    {
+        const char *nl = memchr(start - 1, '\n', (size_t)(fend - start + 1));
+        start = nl ? nl + 1 : fend;
+    }
+    // 맡은 마지막 줄의 끝: 이 뒤는 찾을 필요가 없다
+    const char *nl = start < end ? memchr(end - 1, '\n', (size_t)(fend - end + 1)) : NULL;
+    const char *owned_end = start >= end ? start : nl ? nl + 1 : fend;
+
+    const char *p = start, *counted = start;
+    size_t line = 0, found = 0;
+    while (p < end && found < max && !stopping(s))
+    {
+        const char *ls = p, *le;
+        if (s->lit.text)
+        {
+            const char *hit = literal_find(&s->lit, p, owned_end);
+            if (!hit)
+                break;
+            const char *lnl = memrchr(p, '\n', (size_t)(hit - p));
+            ls = lnl ? lnl + 1 : p;
+            if (ls >= end)
+                break;
+            le = memchr(hit, '\n', (size_t)(owned_end - hit));
+        }
+        else
+        {
+            le = memchr(p, '\n', (size_t)(owned_end - p));
+        }
+        if (!le)
+            le = owned_end;
+        p = le < owned_end ? le + 1 : owned_end;
+
+        if (!line_matches(s, ls, le))
+            continue;
+        line += count_newlines(counted, ls);
+        counted = ls;
+        task_add_result(t, line, ls, (size_t)(le - ls));
+        found++;
+    }
+
+    if (!t->last && !stopping(s))
+        t->lines = line + count_newlines(counted, owned_end > counted ? owned_end : counted);
+}
+
+// 파일 앞부분에 NUL 이 있으면 바이너리 (조각마다 같은 답을 내도록 늘 파일 처음을 본다)
+static bool sniff_binary(int fd, size_t size)
+{
+    char buf[SEARCH_SNIFF];
+    ssize_t n = pread(fd, buf, size < sizeof(buf) ? size : sizeof(buf), 0);
+    return n > 0 && memchr(buf, '\0', (size_t)n) != NULL;
+}
+
+static void task_run(void *arg)
+{
+    Task *t = arg;
+    Search *s = t->s;
+    struct stat sb;
+
+    if (!stopping(s))
+    {
+        // 걸을 때보다 줄었으면 매핑하지 않는다 (바뀐 파일이다)
+        if (fstat(t->file->fd, &sb) != 0 || (size_t)sb.st_size < t->file->size)
+        {
+            t->failed = true;
+        }
+        else if (sniff_binary(t->file->fd, t->file->size))
+        {
+            t->binary = true;
+        }
+        else
+        {
+            fair_share_disk(t->end - t->off);
+            ChunkMap *m = &task_map;
+            m->base = NULL;
+            sigjmp_buf jb;
+            if (sigsetjmp(jb, 0) == 0)
+            {
+                bus_jump = &jb;
+                if (map_chunk(t, t->file->size, m))
+                {
+                    madvise(m->base, m->limit - m->from, MADV_SEQUENTIAL);
+                    scan_chunk(t, m);
+                }
+                else
+                {
+                    t->failed = true;
+                }
+            }
+            else
+            {
+                t->failed = true;
+            }
+            bus_jump = NULL;
+            m = &task_map;
+            if (m->base)
+                munmap(m->base, m->limit - m->from);
+        }
+    }
+
+    pthread_mutex_lock(&s->mu);
+    t->done = true;
+    pthread_cond_broadcast(&s->cv);
+    pthread_mutex_unlock(&s->mu);
+}
+
+// ------------------------------------------------------------
+// 결과를 순서대로 내보내기 (호출한 스레드)
+// ------------------------------------------------------------
+static void request_stop(Search *s)
+{
+    __atomic_store_n(&s->stop, true, __ATOMIC_RELAXED);
+}
+
+static void maybe_poll(Search *s)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - s->last_poll.tv_sec) * 1000 + (now.tv_nsec - s->last_poll.tv_nsec) / 1000000;
+    if (ms < SEARCH_POLL_MS)
+        return;
+    s->last_poll = now;
+    if (s->poll && !s->poll(s->ctx, s->stats))
+        request_stop(s);
+}
+
+static void release_file(SharedFile *f)
+{
+    if (--f->refs > 0)
+        return;
+    close(f->fd);
+    free(f->path);
+    free(f);
+}
+
+static void emit_task(Search *s, Task *t)
+{
+    SearchStats *st = s->stats;
+    if (t->first)
+    {
+        s->line_base = 0;
+        st->files++;
+        st->binary += t->binary;
+        st->errors += t->failed;
+    }
+    if (!t->binary && !t->failed)
+        st->bytes += t->end - t->off;
+
+    for (size_t pos = 0; pos < t->out_len && !stopping(s);)
+    {
+        uint64_t line;
+        uint32_t len;
+        memcpy(&line, t->out + pos, sizeof(line));
+        memcpy(&len, t->out + pos + sizeof(line), sizeof(len));
+        const char *text = t->out + pos + sizeof(line) + sizeof(len);
+        pos += sizeof(line) + sizeof(len) + len;
+
+        if (s->last_matched != t->file)
+        {
+            s->last_matched = t->file;
+            st->matched_files++;
+        }
+        st->matches++;
+        if (!s->match(s->ctx, t->file->path, s->line_base + line + 1, text, len) || st->matches >= s->q->max_matches)
+            request_stop(s);
+    }
+    s->line_base += t->lines;
+}
+
+// 맨 앞 작업이 끝날 때까지 기다려 내보낸다. wait 가 false 면 끝난 것만.
+static void drain(Search *s, bool wait)
+{
+    while (s->head)
+    {
+        Task *t = s->head;
+        pthread_mutex_lock(&s->mu);
+        while (!t->done && wait)
+        {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += SEARCH_POLL_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&s->cv, &s->mu, &until);
+            pthread_mutex_unlock(&s->mu);
+            maybe_poll(s);
+            pthread_mutex_lock(&s->mu);
+        }
+        bool done = t->done;
+        pthread_mutex_unlock(&s->mu);
+        if (!done)
+            return;
+
+        s->head = t->next;
+        if (!s->head)
+            s->tail = NULL;
+        s->inflight--;
+        emit_task(s, t);
+        release_file(t->file);
+        free(t->out);
+        free(t);
+        if (!wait)
+            continue;
+        return;
+    }
+}
+
+static void submit(Search *s, Task *t)
+{
+    while (s->inflight >= s->window)
+        drain(s, true);
+
+    if (s->tail)
+        s->tail->next = t;
+    else
+        s->head = t;
+    s->tail = t;
+    s->inflight++;
+
+    if (!s->pool || worker_pool_submit(s->pool, task_run, t) != 0)
+        task_run(t);
+    drain(s, false);
+}
+
+// ------------------------------------------------------------
+// 걷기
+// ------------------------------------------------------------
+static int visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    Search *s = ctx;
+    maybe_poll(s);
+    if (stopping(s))
+        return -1;
+    fair_share_ops(1);
+    if (!sb)
+    {
+        s->stats->errors++;
+        return 0;
+    }
+    if (S_ISDIR(sb->st_mode))
+        return !strchr(rel, '/') &&
+               strncmp(name, TREE_WATCH_PRIVATE_PREFIX, sizeof(TREE_WATCH_PRIVATE_PREFIX) - 1) == 0;
+    if (!S_ISREG(sb->st_mode) || (s->q->name_glob && fnmatch(s->q->name_glob, name, 0) != 0))
+        return 0;
+    if (sb->st_size == 0)
+    {
+        s->stats->files++;
+        return 0;
+    }
+
+    SharedFile *f = calloc(1, sizeof(*f));
+    if (!f || asprintf(&f->path, "%s/%s", s->dir, rel) < 0)
+    {
+        free(f);
+        s->stats->errors++;
+        return 0;
+    }
+    if (s->q->may_match && !s->q->may_match(s->q->may_match_ctx, f->path, sb))
+    {
+        s->stats->skipped++;
+        free(f->path);
+        free(f);
+        return 0;
+    }
+    f->fd = openat(parentfd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    f->size = (size_t)sb->st_size;
+    if (f->fd < 0)
+    {
+        s->stats->files++;
+        s->stats->errors++;
+        free(f->path);
+        free(f);
+        return 0;
+    }
+
+    size_t chunks = (f->size + SEARCH_CHUNK - 1) / SEARCH_CHUNK;
+    f->refs = (int)chunks;
+    for (size_t i = 0; i < chunks; i++)
+    {
+        Task *t = calloc(1, sizeof(*t));
+        if (!t)
+        {
+            // 남은 조각은 포기한다
+            f->refs -= (int)(chunks - i - 1);
+            release_file(f);
+            s->stats->errors++;
+            break;
+        }
+        t->s = s;
+        t->file = f;
+        t->off = i * SEARCH_CHUNK;
+        t->end = i + 1 == chunks ? f->size : t->off + SEARCH_CHUNK;
+        t->first = i == 0;
+        t->last = i + 1 == chunks;
+        submit(s, t);
+    }
+    return stopping(s) ? -1 : 0;
+}
+
+int text_search_check(const SearchQuery *q, char *err, size_t err_len)
+{
+    if (!q->pattern || !q->pattern[0])
+    {
+        snprintf(err, err_len, "empty pattern");
+        return -1;
+    }
+    if (!q->regex)
+        return 0;
+
+    regex_t re;
+    int rc = regcomp(&re, q->pattern, REG_EXTENDED | REG_NEWLINE | REG_NOSUB | (q->icase ? REG_ICASE : 0));
+    if (rc != 0)
+    {
+        char msg[128];
+        regerror(rc, &re, msg, sizeof(msg));
+        snprintf(err, err_len, "bad regex: %s", msg);
+        return -1;
+    }
+    regfree(&re);
+    return 0;
+}
+
+size_t text_search_literal(const SearchQuery *q, char *out, size_t cap)
+{
+    if (q->regex)
+        return regex_literal(q->pattern, out, cap);
+    size_t n = strlen(q->pattern);
+    if (n >= cap)
+        n = cap - 1;
+    memcpy(out, q->pattern, n);
+    out[n] = '\0';
+    return n;
+}
+
+int text_search(WorkerPool *pool, const char *dir, const SearchQuery *q, SearchMatchFn match, SearchPollFn poll,
+                void *ctx, SearchStats *stats, char *err, size_t err_len)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (text_search_check(q, err, err_len) != 0)
+        return -1;
+
+    Search s;
+    memset(&s, 0, sizeof(s));
+    char required[256];
+    if (q->regex)
+    {
+        literal_init(&s.lit, required, regex_literal(q->pattern, required, sizeof(required)), q->icase);
+    }
+    else
+    {
+        literal_init(&s.lit, q->pattern, strlen(q->pattern), q->icase);
+    }
+
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+    {
+        snprintf(err, err_len, "%s", strerror(errno));
+        return -1;
+    }
+
+    pthread_once(&bus_once, install_sigbus);
+    pthread_mutex_lock(&gen_lock);
+    s.gen = ++next_gen;
+    pthread_mutex_unlock(&gen_lock);
+
+    s.q = q;
+    pthread_mutex_init(&s.mu, NULL);
+    pthread_cond_init(&s.cv, NULL);
+    s.pool = pool;
+    s.window = pool ? (size_t)worker_pool_size(pool) * SEARCH_WINDOW_PER_THREAD : 1;
+    s.dir = strcmp(dir, "/") == 0 ? "" : dir;
+    s.match = match;
+    s.poll = poll;
+    s.ctx = ctx;
+    s.stats = stats;
+    clock_gettime(CLOCK_MONOTONIC, &s.last_poll);
+
+    tree_walk(dfd, visit, &s);
+    close(dfd);
+    while (s.head)
+        drain(&s, true);
+
+    pthread_mutex_destroy(&s.mu);
+    pthread_cond_destroy(&s.cv);
+    return stopping(&s) ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+#ifndef TEXT_SEARCH_H
+#define TEXT_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "worker_pool.h"
+
+// 디렉토리 아래 파일 내용 찾기 (GREP)
+//
+// 호출한 스레드가 트리를 걸으며 파일을 열고, 큰 파일은 SEARCH_CHUNK 단위로 나눠 작업 풀에 넘긴다.
+// 작업은 파일을 mmap 해서 찾는다: 문자열(또는 정규식에 반드시 들어 있는 문자열)의 드문 글자를
+// memchr 로 훑어 후보 위치를 찾고, 그 줄만 확인한다. 앞 8KB 에 NUL 이 있는 파일은 바이너리로 보고
+// 건너뛴다. 결과는 걷는 순서(파일 순서, 줄 순서)대로 호출한 스레드에서 넘긴다.
+// 심볼릭 링크와 일반 파일이 아닌 항목은 보지 않는다.
+
+#define SEARCH_CHUNK (16 * 1024 * 1024)
+#define SEARCH_LINE_MAX 512          // 넘기는 줄의 최대 길이 (넘으면 자름)
+
+typedef struct
+{
+    const char *pattern;
+    bool icase;              // 대소문자 무시 (ASCII)
+    bool regex;              // POSIX 확장 정규식
+    const char *name_glob;   // 파일 이름 조건 (NULL = 전부)
+    size_t max_matches;      // 넘기는 최대 줄 수
+    // 열기 전에 후보를 거른다 (NULL = 전부). false = 이 파일에는 없음. sb 는 lstat.
+    bool (*may_match)(void *ctx, const char *path, const struct stat *sb);
+    void *may_match_ctx;
+} SearchQuery;
+
+typedef struct
+{
+    unsigned long long files;         // 찾아본 파일
+    unsigned long long binary;        // 바이너리라 건너뛴 파일
+    unsigned long long errors;        // 열거나 읽지 못한 파일
+    unsigned long long matched_files;
+    unsigned long long matches;       // 넘긴 줄 수
+    unsigned long long bytes;         // 찾아본 바이트
+    unsigned long long skipped;       // may_match 로 열지 않은 파일
+} SearchStats;
+
+// 일치한 줄 하나 (line 은 개행 없음, NUL 로 끝나지 않을 수 있음). false = 중단.
+typedef bool (*SearchMatchFn)(void *ctx, const char *path, unsigned long long line_no, const char *line, size_t len);
+// 결과가 없어도 호출한 스레드에서 주기적으로 불린다 (취소 확인, 진행 상황). false = 중단.
+typedef bool (*SearchPollFn)(void *ctx, const SearchStats *st);
+
+// 패턴/정규식을 확인한다 (찾기 전에 오류를 알려 줄 때). 0 = 정상, -1 = 실패 (err 에 이유)
+int text_search_check(const SearchQuery *q, char *err, size_t err_len);
+
+// 모든 일치 줄에 반드시 들어 있는 문자열 (문자열 찾기는 패턴 그대로, 정규식은 뽑을 수 있을 때만).
+// 길이를 돌려준다 (없으면 0).
+size_t text_search_literal(const SearchQuery *q, char *out, size_t cap);
+
+// 반환: 0 = 끝까지 찾음, 1 = 중단됨 (콜백 또는 max_matches), -1 = 실패 (err 에 이유)
+int text_search(WorkerPool *pool, const char *dir, const SearchQuery *q, SearchMatchFn match, SearchPollFn poll,
+                void *ctx, SearchStats *stats, char *err, size_t err_len);
+
+#endif
@@ -0,0 +1,23 @@
+// traffic_class.c
+#define _GNU_SOURCE
+#include "traffic_class.h"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define BULK_NOTSENT_LOWAT (128 * 1024)
+
+void traffic_class_mark(int fd, bool bulk)
+{
+    int prio = bulk ? 1 : 6;
+    int tos = bulk ? IPTOS_THROUGHPUT : IPTOS_LOWDELAY;
+    int one = 1, lowat = BULK_NOTSENT_LOWAT;
+    setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &prio, sizeof(prio));
+    setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    if (bulk)
+        setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+    else
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
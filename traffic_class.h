@@ -0,0 +1,15 @@
+#ifndef TRAFFIC_CLASS_H
+#define TRAFFIC_CLASS_H
+
+#include <stdbool.h>
+
+// 연결의 트래픽 종류 표시 (서버와 클라이언트가 함께 쓴다)
+//
+// 제어 연결은 지연이 작게, 데이터 연결은 처리량 우선으로 표시한다. 같은 링크를 나눠 쓸 때 커널 큐
+// (pfifo_fast 의 우선순위 밴드 등)가 제어 패킷을 먼저 내보내고, 데이터 연결은 아직 못 보낸 양을
+// 소켓에 조금만 쌓아 두어 그 우선순위가 바로 먹힌다.
+
+// Unix 소켓에는 해당하지 않는 옵션이므로 실패는 무시한다
+void traffic_class_mark(int fd, bool bulk);
+
+#endif
@@ -0,0 +1,573 @@
+// tree_stream.c
+#define _GNU_SOURCE
+#include "tree_stream.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 작은 파일 여러 개를 한 번의 send 로 묶기 위한 송신 버퍼 크기
+#define TREE_SEND_BUFFER (256 * 1024)
+#define TREE_IO_BUFFER (256 * 1024)
+
+// ------------------------------------------------------------
+// 보내는 쪽: 디렉토리를 걸으며 헤더와 본문을 하나의 스트림으로 이어 붙인다
+// ------------------------------------------------------------
+typedef struct
+{
+    const TreeSink *sink;
+    TreeStats *st;
+    char *buf;
+    size_t len;
+    bool failed;
+} TreeWriter;
+
+static void writer_flush(TreeWriter *w)
+{
+    if (w->failed || w->len == 0)
+        return;
+
+    if (w->sink->write(w->sink->ctx, w->buf, w->len) != 0)
+        w->failed = true;
+    w->len = 0;
+
+    if (!w->failed && w->sink->progress)
+        w->sink->progress(w->sink->ctx, w->st);
+}
+
+static void writer_put(TreeWriter *w, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0 && !w->failed)
+    {
+        size_t room = TREE_SEND_BUFFER - w->len;
+        size_t n = len < room ? len : room;
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+        p += n;
+        len -= n;
+
+        if (w->len == TREE_SEND_BUFFER)
+            writer_flush(w);
+    }
+}
+
+static void send_file_body(TreeWriter *w, int fd, long long size)
+{
+    char *io = malloc(TREE_IO_BUFFER);
+    long long sent = 0;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (io && sent < size && !w->failed)
+    {
+        size_t want = (size - sent) < TREE_IO_BUFFER ? (size_t)(size - sent) : TREE_IO_BUFFER;
+        ssize_t n = read(fd, io, want);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        writer_put(w, io, (size_t)n);
+        sent += n;
+    }
+
+    // 보내는 도중 파일이 줄어들었으면 헤더에 적은 크기만큼 0 으로 채워 동기를 유지
+    if (sent < size)
+    {
+        char zero[4096] = {0};
+        w->st->skipped++;
+        while (sent < size && !w->failed)
+        {
+            size_t n = (size - sent) < (long long)sizeof(zero) ? (size_t)(size - sent) : sizeof(zero);
+            writer_put(w, zero, n);
+            sent += (long long)n;
+        }
+    }
+
+    free(io);
+}
+
+static int walk_dir(int dfd, char *rel, size_t rel_len, TreeVisit visit, void *ctx)
+{
+    DIR *d = fdopendir(dfd);
+    if (!d)
+    {
+        close(dfd);
+        return visit(ctx, -1, "", rel, NULL) < 0 ? -1 : 0;
+    }
+
+    int rc = 0;
+    struct dirent *ent;
+    while (rc == 0)
+    {
+        errno = 0;
+        if ((ent = readdir(d)) == NULL)
+        {
+            // 중간에 읽기가 실패하면 나머지 항목이 빠지므로 디렉토리 자체를 실패로 알린다
+            if (errno != 0)
+            {
+                rel[rel_len] = '\0';
+                if (visit(ctx, -1, "", rel, NULL) < 0)
+                    rc = -1;
+            }
+            break;
+        }
+
+        const char *name = ent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+
+        size_t name_len = strlen(name);
+        if (strchr(name, '\n') || rel_len + name_len + 2 >= PATH_MAX)
+        {
+            if (visit(ctx, dirfd(d), name, rel, NULL) < 0)
+                rc = -1;
+            continue;
+        }
+
+        size_t child_len = rel_len;
+        if (rel_len > 0)
+            rel[child_len++] = '/';
+        memcpy(rel + child_len, name, name_len + 1);
+        child_len += name_len;
+
+        struct stat sb;
+        bool ok = fstatat(dirfd(d), name, &sb, AT_SYMLINK_NOFOLLOW) == 0;
+        int v = visit(ctx, dirfd(d), name, rel, ok ? &sb : NULL);
+
+        if (v < 0)
+        {
+            rc = -1;
+        }
+        else if (v == 0 && ok && S_ISDIR(sb.st_mode))
+        {
+            int child = openat(dirfd(d), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child >= 0)
+                rc = walk_dir(child, rel, child_len, visit, ctx);
+            else if (visit(ctx, dirfd(d), name, rel, NULL) < 0)
+                rc = -1;
+        }
+
+        rel[rel_len] = '\0';
+    }
+
+    closedir(d);
+    return rc;
+}
+
+int tree_walk(int dirfd, TreeVisit visit, void *ctx)
+{
+    // walk_dir 가 fd 를 닫으므로 복제해서 넘긴다
+    int dfd = dup(dirfd);
+    char rel[PATH_MAX] = "";
+    if (dfd < 0)
+        return visit(ctx, -1, "", rel, NULL) < 0 ? -1 : 0;
+    return walk_dir(dfd, rel, 0, visit, ctx);
+}
+
+// 항목 하나를 레코드로 보낸다 (링크/특수 파일/열 수 없는 항목은 skipped)
+static void send_entry(TreeWriter *w, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    char header[TREE_HEADER_MAX];
+    int hl;
+
+    if (!sb)
+    {
+        w->st->skipped++;
+    }
+    else if (S_ISDIR(sb->st_mode))
+    {
+        hl = snprintf(header, sizeof(header), "D %o %lld %s\n",
+                      (unsigned)(sb->st_mode & 07777), (long long)sb->st_mtime, rel);
+        writer_put(w, header, (size_t)hl);
+        w->st->dirs++;
+    }
+    else if (S_ISREG(sb->st_mode))
+    {
+        struct stat fsb;
+        int fd = openat(parentfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0 || fstat(fd, &fsb) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            w->st->skipped++;
+            return;
+        }
+
+        hl = snprintf(header, sizeof(header), "F %lld %o %lld %s\n", (long long)fsb.st_size,
+                      (unsigned)(fsb.st_mode & 07777), (long long)fsb.st_mtime, rel);
+        writer_put(w, header, (size_t)hl);
+        send_file_body(w, fd, (long long)fsb.st_size);
+        close(fd);
+        w->st->files++;
+        w->st->bytes += (unsigned long long)fsb.st_size;
+    }
+    else
+    {
+        w->st->skipped++;
+    }
+}
+
+static int send_visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    TreeWriter *w = ctx;
+    send_entry(w, parentfd, name, rel, sb);
+    return w->failed ? -1 : 0;
+}
+
+static int writer_open(TreeWriter *w, const TreeSink *sink, TreeStats *st)
+{
+    memset(w, 0, sizeof(*w));
+    memset(st, 0, sizeof(*st));
+    w->sink = sink;
+    w->st = st;
+    w->buf = malloc(TREE_SEND_BUFFER);
+    return w->buf ? 0 : -1;
+}
+
+static int writer_close(TreeWriter *w)
+{
+    writer_put(w, "E\n", 2);
+    writer_flush(w);
+    free(w->buf);
+    return w->failed ? -1 : 0;
+}
+
+int tree_send(int dirfd, const TreeSink *sink, TreeStats *st)
+{
+    TreeWriter w;
+    if (writer_open(&w, sink, st) != 0)
+        return -1;
+
+    tree_walk(dirfd, send_visit, &w);
+    return writer_close(&w);
+}
+
+int tree_send_paths(int dirfd, const char *const *paths, size_t count, const TreeSink *sink, TreeStats *st)
+{
+    TreeWriter w;
+    if (writer_open(&w, sink, st) != 0)
+        return -1;
+
+    for (size_t i = 0; i < count && !w.failed; i++)
+    {
+        const char *rel = paths[i];
+        const char *slash = strrchr(rel, '/');
+        int parentfd = dirfd;
+
+        // 부모는 받는 쪽에서 만들어지므로 여기서는 파일/디렉토리 자체만 보낸다
+        if (slash)
+        {
+            char parent[PATH_MAX];
+            snprintf(parent, sizeof(parent), "%.*s", (int)(slash - rel), rel);
+            parentfd = openat(dirfd, parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+
+        struct stat sb;
+        const char *name = slash ? slash + 1 : rel;
+        bool ok = parentfd >= 0 && tree_path_is_safe(rel) &&
+                  fstatat(parentfd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0;
+        send_entry(&w, parentfd, name, rel, ok ? &sb : NULL);
+
+        if (parentfd >= 0 && parentfd != dirfd)
+            close(parentfd);
+    }
+
+    return writer_close(&w);
+}
+
+// ------------------------------------------------------------
+// 받는 쪽: 레코드가 도착하는 대로 openat/mkdirat 로 트리를 만든다
+// ------------------------------------------------------------
+bool tree_path_is_safe(const char *path)
+{
+    if (!path || !*path || path[0] == '/' || strchr(path, '\n'))
+        return false;
+
+    const char *p = path;
+    while (*p)
+    {
+        const char *slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+
+        if (len == 0 || len > NAME_MAX ||
+            (len == 1 && p[0] == '.') ||
+            (len == 2 && p[0] == '.' && p[1] == '.'))
+            return false;
+
+        if (!slash)
+            break;
+        p = slash + 1;
+        if (!*p)
+            return false;
+    }
+    return true;
+}
+
+// 수신 중인 파일의 숨김 이름 번호 (같은 프로세스의 여러 세션이 같은 디렉토리에 받을 수 있다)
+static unsigned int receive_seq = 0;
+
+// 같은 디렉토리의 파일이 연달아 오므로 마지막 부모 디렉토리 fd 를 재사용한다
+typedef struct
+{
+    int rootfd;
+    char path[PATH_MAX];
+    int fd;
+} ParentCache;
+
+static void parent_cache_close(ParentCache *pc)
+{
+    if (pc->fd >= 0 && pc->fd != pc->rootfd)
+        close(pc->fd);
+    pc->fd = -1;
+    pc->path[0] = '\0';
+}
+
+// rel 의 부모 디렉토리를 연다 (없는 중간 디렉토리는 만든다). leaf 에는 마지막 구성요소.
+static int parent_open(ParentCache *pc, const char *rel, const char **leaf)
+{
+    const char *slash = strrchr(rel, '/');
+    size_t plen = slash ? (size_t)(slash - rel) : 0;
+    *leaf = slash ? slash + 1 : rel;
+
+    if (pc->fd >= 0 && strlen(pc->path) == plen && strncmp(pc->path, rel, plen) == 0)
+        return pc->fd;
+
+    parent_cache_close(pc);
+
+    int fd = pc->rootfd;
+    const char *p = rel;
+    while (p < rel + plen)
+    {
+        const char *end = memchr(p, '/', (size_t)(rel + plen - p));
+        if (!end)
+            end = rel + plen;
+
+        char comp[NAME_MAX + 1];
+        size_t len = (size_t)(end - p);
+        memcpy(comp, p, len);
+        comp[len] = '\0';
+
+        int next = openat(fd, comp, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (next < 0 && errno == ENOENT && mkdirat(fd, comp, 0755) == 0)
+            next = openat(fd, comp, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+        if (fd != pc->rootfd)
+            close(fd);
+        if (next < 0)
+            return -1;
+
+        fd = next;
+        p = end + 1;
+    }
+
+    memcpy(pc->path, rel, plen);
+    pc->path[plen] = '\0';
+    pc->fd = fd;
+    return fd;
+}
+
+static void set_mtime(int fd, long long mtime)
+{
+    struct timespec ts[2] = {
+        { .tv_sec = 0, .tv_nsec = UTIME_OMIT },
+        { .tv_sec = (time_t)mtime, .tv_nsec = 0 },
+    };
+    futimens(fd, ts);
+}
+
+static void note_error(TreeStats *st, char *err, size_t err_len, const char *what, const char *path)
+{
+    if (st->errors++ == 0 && err && err_len > 0)
+        snprintf(err, err_len, "%s %s: %s", what, path, strerror(errno));
+}
+
+static int receive_dir(ParentCache *pc, const char *rel, unsigned mode, long long mtime,
+                       TreeStats *st, char *err, size_t err_len)
+{
+    if (pc->rootfd < 0)
+        return 0;
+
+    const char *leaf;
+    int pfd;
+    if (!tree_path_is_safe(rel))
+    {
+        errno = EINVAL;
+        note_error(st, err, err_len, "invalid path", rel);
+        return 0;
+    }
+
+    if ((pfd = parent_open(pc, rel, &leaf)) < 0)
+    {
+        note_error(st, err, err_len, "cannot open parent of", rel);
+        return 0;
+    }
+
+    struct stat sb;
+    if (mkdirat(pfd, leaf, (mode & 0777) | 0700) != 0 &&
+        !(errno == EEXIST && fstatat(pfd, leaf, &sb, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sb.st_mode)))
+    {
+        note_error(st, err, err_len, "cannot create directory", rel);
+        return 0;
+    }
+
+    // 디렉토리 mtime 은 뒤따르는 파일이 만들어지며 바뀌므로 복원하지 않는다
+    (void)mtime;
+    st->dirs++;
+    return 0;
+}
+
+static int receive_file(ParentCache *pc, const TreeSource *src, const char *rel, long long size,
+                        unsigned mode, long long mtime, TreeStats *st, char *err, size_t err_len)
+{
+    const char *leaf = NULL;
+    int pfd = -1;
+    int fd = -1;
+    char tmp[NAME_MAX + 1] = "";
+
+    if (pc->rootfd >= 0)
+    {
+        if (!tree_path_is_safe(rel))
+        {
+            errno = EINVAL;
+            note_error(st, err, err_len, "invalid path", rel);
+        }
+        else if ((pfd = parent_open(pc, rel, &leaf)) < 0)
+        {
+            note_error(st, err, err_len, "cannot open parent of", rel);
+        }
+        else
+        {
+            // 본문이 모두 도착한 파일만 실제 이름으로 보이도록 숨김 이름에 먼저 기록
+            for (int attempt = 0; attempt < 16 && fd < 0; attempt++)
+            {
+                snprintf(tmp, sizeof(tmp), ".%.200s.tree-%d-%u", leaf, (int)getpid(),
+                         __atomic_add_fetch(&receive_seq, 1, __ATOMIC_RELAXED));
+                fd = openat(pfd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, mode & 0777);
+                if (fd < 0 && errno != EEXIST)
+                    break;
+            }
+            if (fd < 0)
+                note_error(st, err, err_len, "cannot create", rel);
+        }
+    }
+
+    char *io = malloc(TREE_IO_BUFFER);
+    long long got = 0;
+    bool write_failed = false;
+
+    while (io && got < size)
+    {
+        size_t want = (size - got) < TREE_IO_BUFFER ? (size_t)(size - got) : TREE_IO_BUFFER;
+        ssize_t n = src->read(src->ctx, io, want);
+        if (n <= 0)
+            break;
+
+        const char *p = io;
+        size_t left = (size_t)n;
+        while (fd >= 0 && !write_failed && left > 0)
+        {
+            ssize_t w = write(fd, p, left);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+            {
+                note_error(st, err, err_len, "write failed for", rel);
+                write_failed = true;
+                break;
+            }
+            p += w;
+            left -= (size_t)w;
+        }
+        got += n;
+    }
+    free(io);
+
+    if (got < size)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlinkat(pfd, tmp, 0);
+        }
+        return -1;
+    }
+
+    if (fd < 0)
+        return 0;
+
+    if (!write_failed)
+    {
+        fchmod(fd, mode & 0777);
+        set_mtime(fd, mtime);
+    }
+
+    if (close(fd) != 0 && !write_failed)
+    {
+        note_error(st, err, err_len, "write failed for", rel);
+        write_failed = true;
+    }
+
+    if (write_failed)
+    {
+        unlinkat(pfd, tmp, 0);
+    }
+    else if (renameat(pfd, tmp, pfd, leaf) != 0)
+    {
+        note_error(st, err, err_len, "cannot commit", rel);
+        unlinkat(pfd, tmp, 0);
+    }
+    else
+    {
+        st->files++;
+        st->bytes += (unsigned long long)size;
+    }
+    return 0;
+}
+
+int tree_receive(int rootfd, const TreeSource *src, TreeStats *st, char *err, size_t err_len)
+{
+    ParentCache pc = { .rootfd = rootfd, .fd = -1 };
+    char line[TREE_HEADER_MAX];
+    int rc = -1;
+
+    memset(st, 0, sizeof(*st));
+    if (err && err_len > 0)
+        err[0] = '\0';
+
+    while (src->read_line(src->ctx, line, sizeof(line)) >= 0)
+    {
+        long long size = 0, mtime = 0;
+        unsigned mode = 0;
+        int off = 0;
+
+        if (strcmp(line, "E") == 0)
+        {
+            rc = st->errors ? 1 : 0;
+            break;
+        }
+        else if (sscanf(line, "D %o %lld %n", &mode, &mtime, &off) == 2 && off > 0)
+        {
+            receive_dir(&pc, line + off, mode, mtime, st, err, err_len);
+        }
+        else if (sscanf(line, "F %lld %o %lld %n", &size, &mode, &mtime, &off) == 3 && off > 0 && size >= 0)
+        {
+            if (receive_file(&pc, src, line + off, size, mode, mtime, st, err, err_len) != 0)
+                break;
+        }
+        else
+        {
+            if (err && err_len > 0)
+                snprintf(err, err_len, "malformed record");
+            break;
+        }
+    }
+
+    parent_cache_close(&pc);
+    return rc;
+}
@@ -0,0 +1,68 @@
+#ifndef TREE_STREAM_H
+#define TREE_STREAM_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// 디렉토리 트리를 임시 아카이브 없이 주고받기 위한 레코드 스트림 (tar 와 비슷한 구조)
+//
+//   D <mode> <mtime> <path>\n                 디렉토리
+//   F <size> <mode> <mtime> <path>\n + 본문   일반 파일 (본문은 정확히 size 바이트)
+//   E\n                                       스트림 끝
+//
+// path 는 트리 루트 기준 상대경로이며 '/' 로 구분한다. 절대경로, 빈 구성요소,
+// ".", ".." 는 받는 쪽에서 거부한다. 심볼릭 링크/특수 파일은 보내지 않는다.
+
+#define TREE_HEADER_MAX (PATH_MAX + 96)
+
+typedef struct
+{
+    unsigned long long dirs;
+    unsigned long long files;
+    unsigned long long bytes;
+    unsigned long long skipped;   // 보내지 않은 항목 (링크, 특수 파일, 읽기 실패)
+    unsigned long long errors;    // 받는 쪽에서 만들지 못한 항목
+} TreeStats;
+
+// 스트림을 내보낼 곳. write 는 len 바이트를 모두 쓰거나 -1 을 돌려준다.
+typedef struct
+{
+    int (*write)(void *ctx, const void *buf, size_t len);
+    void (*progress)(void *ctx, const TreeStats *st);   // 선택 (버퍼를 비울 때마다 호출)
+    void *ctx;
+} TreeSink;
+
+// 스트림을 읽어올 곳. read 는 일부만 읽을 수 있고, 0 이하이면 연결 종료.
+// read_line 은 개행을 제외한 한 줄을 읽는다 (종료 시 -1).
+typedef struct
+{
+    ssize_t (*read)(void *ctx, void *buf, size_t len);
+    ssize_t (*read_line)(void *ctx, char *out, size_t size);
+    void *ctx;
+} TreeSource;
+
+// 트리 순회 콜백. 디렉토리는 자식보다 먼저 온다. rel 은 루트 기준 상대경로.
+// sb 가 NULL 이면 stat/열기에 실패한 항목. 반환: 음수 = 중단, 1 = 이 디렉토리 건너뜀, 0 = 계속
+typedef int (*TreeVisit)(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb);
+
+// dirfd 아래를 openat 기반으로 걷는다 (심볼릭 링크는 따라가지 않음). 중단 시 -1.
+int tree_walk(int dirfd, TreeVisit visit, void *ctx);
+
+// dirfd 아래 전체를 레코드로 보내고 마지막에 E 를 붙인다. sink 쓰기 실패 시 -1.
+int tree_send(int dirfd, const TreeSink *sink, TreeStats *st);
+// 지정한 상대경로 항목만 보낸다 (디렉토리는 D 레코드만, 하위 항목은 포함하지 않음)
+int tree_send_paths(int dirfd, const char *const *paths, size_t count, const TreeSink *sink, TreeStats *st);
+
+// 레코드를 읽어 rootfd 아래에 트리를 만든다 (openat/mkdirat 기반).
+// rootfd < 0 이면 본문을 버리면서 스트림만 끝까지 소비한다.
+// 반환: 0 = 전부 성공, 1 = 끝까지 받았으나 일부 실패(err 에 첫 오류),
+//       -1 = 연결 종료 또는 형식 오류 (스트림 동기가 깨짐)
+int tree_receive(int rootfd, const TreeSource *src, TreeStats *st, char *err, size_t err_len);
+
+// 상대경로 검증 ('/' 시작, 빈 구성요소, ".", "..", 개행 거부)
+bool tree_path_is_safe(const char *path);
+
+#endif
@@ -0,0 +1,473 @@
+// tree_watch.c
+#define _GNU_SOURCE
+#include "tree_watch.h"
+#include "tree_stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define TREE_WATCH_BUCKETS 4096
+// 짝이 될 IN_MOVED_TO 를 기다리는 시간 (넘으면 트리 밖으로 옮겨진 것으로 본다)
+#define TREE_WATCH_MOVE_WAIT_MS 10
+
+#define TREE_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+                         IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+// 감시 중인 디렉토리. 경로는 부모를 따라 올라가며 만든다 (디렉토리 이름이 바뀌어도 하위 노드는 그대로).
+typedef struct Node
+{
+    int wd;
+    struct Node *parent;     // 루트는 NULL
+    char *name;              // 루트는 루트 경로 전체
+    bool doomed;             // 정리할 때 표시용
+    struct Node *next;       // 같은 버킷
+} Node;
+
+typedef struct
+{
+    TreeWatchFn fn;
+    void *ctx;
+} Subscriber;
+
+static Subscriber subscribers[TREE_WATCH_MAX_SUBSCRIBERS];
+static int subscriber_count;
+
+// 아래는 모두 감시 스레드만 만진다
+static int ino_fd = -1;
+static char root_path[PATH_MAX];
+static Node *root_node;
+static Node *buckets[TREE_WATCH_BUCKETS];
+static bool warned_limit;
+
+// 짝을 기다리는 IN_MOVED_FROM
+static struct
+{
+    bool active;
+    uint32_t cookie;
+    bool is_dir;
+    Node *dir;
+    char name[NAME_MAX + 1];
+    char path[PATH_MAX];
+} moving;
+
+static void emit(TreeChangeKind kind, bool is_dir, const char *path, const char *newpath, const struct stat *st)
+{
+    TreeChange c = { kind, is_dir, path, newpath, st };
+    for (int i = 0; i < subscriber_count; i++)
+        subscribers[i].fn(subscribers[i].ctx, &c);
+}
+
+static Node *node_lookup(int wd)
+{
+    for (Node *n = buckets[(unsigned)wd % TREE_WATCH_BUCKETS]; n; n = n->next)
+        if (n->wd == wd)
+            return n;
+    return NULL;
+}
+
+static void node_unhash(Node *node)
+{
+    Node **p = &buckets[(unsigned)node->wd % TREE_WATCH_BUCKETS];
+    while (*p && *p != node)
+        p = &(*p)->next;
+    if (*p)
+        *p = node->next;
+}
+
+static void node_free(Node *node)
+{
+    if (node == root_node)
+        root_node = NULL;
+    free(node->name);
+    free(node);
+}
+
+static int node_path(const Node *node, char out[PATH_MAX])
+{
+    if (!node->parent)
+        return snprintf(out, PATH_MAX, "%s", node->name);
+
+    int len = node_path(node->parent, out);
+    if (len < 0 || len >= PATH_MAX)
+        return -1;
+    int n = snprintf(out + len, PATH_MAX - (size_t)len, "/%s", node->name);
+    return n < 0 || len + n >= PATH_MAX ? -1 : len + n;
+}
+
+static int child_path(const Node *dir, const char *name, char out[PATH_MAX])
+{
+    int len = node_path(dir, out);
+    if (len < 0)
+        return -1;
+    int n = snprintf(out + len, PATH_MAX - (size_t)len, "/%s", name);
+    return n < 0 || len + n >= PATH_MAX ? -1 : 0;
+}
+
+static bool is_private(const Node *dir, const char *name)
+{
+    return dir == root_node &&
+           strncmp(name, TREE_WATCH_PRIVATE_PREFIX, sizeof(TREE_WATCH_PRIVATE_PREFIX) - 1) == 0;
+}
+
+static Node *node_add(const char *path, Node *parent, const char *name)
+{
+    int wd = inotify_add_watch(ino_fd, path, TREE_WATCH_MASK);
+    if (wd < 0)
+    {
+        if (errno == ENOSPC && !warned_limit)
+        {
+            warned_limit = true;
+            fprintf(stderr, "[WARN] inotify watch limit reached: changes under some directories will be missed "
+                            "(raise fs.inotify.max_user_watches)\n");
+        }
+        return NULL;
+    }
+
+    // 같은 디렉토리를 다시 걸면 같은 wd 가 온다
+    Node *node = node_lookup(wd);
+    char *copy = strdup(name);
+    if (!copy)
+        return node;
+    if (node)
+    {
+        free(node->name);
+        node->name = copy;
+        node->parent = parent;
+        return node;
+    }
+
+    node = calloc(1, sizeof(*node));
+    if (!node)
+    {
+        free(copy);
+        inotify_rm_watch(ino_fd, wd);
+        return NULL;
+    }
+    node->wd = wd;
+    node->parent = parent;
+    node->name = copy;
+    node->next = buckets[(unsigned)wd % TREE_WATCH_BUCKETS];
+    buckets[(unsigned)wd % TREE_WATCH_BUCKETS] = node;
+    return node;
+}
+
+static Node *node_child(const Node *dir, const char *name)
+{
+    for (int b = 0; b < TREE_WATCH_BUCKETS; b++)
+        for (Node *n = buckets[b]; n; n = n->next)
+            if (n->parent == dir && strcmp(n->name, name) == 0)
+                return n;
+    return NULL;
+}
+
+// top 과 그 하위 노드의 watch 를 모두 걷는다 (top 이 NULL 이면 전부)
+static void node_drop_tree(Node *top)
+{
+    for (int b = 0; b < TREE_WATCH_BUCKETS; b++)
+    {
+        for (Node *n = buckets[b]; n; n = n->next)
+        {
+            const Node *p = n;
+            while (top && p && p != top)
+                p = p->parent;
+            n->doomed = p != NULL;
+        }
+    }
+
+    for (int b = 0; b < TREE_WATCH_BUCKETS; b++)
+    {
+        Node **p = &buckets[b];
+        while (*p)
+        {
+            Node *n = *p;
+            if (!n->doomed)
+            {
+                p = &n->next;
+                continue;
+            }
+            *p = n->next;
+            inotify_rm_watch(ino_fd, n->wd);
+            node_free(n);
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// 걷기: base 아래 디렉토리마다 watch 를 걸고 항목마다 kind 로 알린다
+// ------------------------------------------------------------
+typedef struct
+{
+    TreeChangeKind kind;
+    const char *base_path;
+    Node *base;
+    // 현재 위치까지의 디렉토리 노드 (rel 길이와 함께)
+    struct
+    {
+        size_t len;
+        Node *node;
+    } stack[PATH_MAX / 2];
+    int depth;
+} Walk;
+
+static int walk_visit(void *ctx, int parentfd, const char *name, const char *rel, const struct stat *sb)
+{
+    (void)parentfd;
+    Walk *w = ctx;
+    if (!sb || !rel[0])
+        return 0;
+
+    // 부모 디렉토리 노드 찾기: 깊이 우선이므로 부모보다 깊은 항목만 걷어 내면 맨 위가 부모다
+    const char *slash = strrchr(rel, '/');
+    size_t parent_len = slash ? (size_t)(slash - rel) : 0;
+    while (w->depth > 0 && w->stack[w->depth - 1].len > parent_len)
+        w->depth--;
+    Node *parent = w->base;
+    if (parent_len > 0)
+        parent = w->depth > 0 && w->stack[w->depth - 1].len == parent_len ? w->stack[w->depth - 1].node : NULL;
+
+    if (is_private(parent, name))
+        return 1;
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", w->base_path, rel) >= (int)sizeof(path))
+        return S_ISDIR(sb->st_mode) ? 1 : 0;
+
+    bool is_dir = S_ISDIR(sb->st_mode);
+    emit(w->kind, is_dir, path, NULL, sb);
+    if (!is_dir)
+        return 0;
+
+    // watch 를 걸지 못해도 (한도 초과 등) 안의 항목은 계속 알린다
+    Node *node = parent ? node_add(path, parent, name) : NULL;
+    if (!node)
+        return 0;
+    if (w->depth < (int)(sizeof(w->stack) / sizeof(w->stack[0])))
+    {
+        w->stack[w->depth].len = strlen(rel);
+        w->stack[w->depth].node = node;
+        w->depth++;
+    }
+    return 0;
+}
+
+static void walk_tree(Node *base, const char *base_path, TreeChangeKind kind)
+{
+    int dfd = open(base_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dfd < 0)
+        return;
+
+    Walk *w = calloc(1, sizeof(*w));
+    if (w)
+    {
+        w->kind = kind;
+        w->base_path = base_path;
+        w->base = base;
+        tree_walk(dfd, walk_visit, w);
+        free(w);
+    }
+    close(dfd);
+}
+
+static void walk_root(void)
+{
+    node_drop_tree(NULL);
+    root_node = node_add(root_path, NULL, root_path);
+    if (root_node)
+        walk_tree(root_node, root_path, TREE_SEEN);
+    emit(TREE_SYNCED, true, root_path, NULL, NULL);
+}
+
+// ------------------------------------------------------------
+// 이벤트 처리
+// ------------------------------------------------------------
+static void settle_move(void)
+{
+    if (!moving.active)
+        return;
+    moving.active = false;
+
+    // 트리 밖으로 옮겨졌다: 하위 디렉토리의 watch 는 옮겨 간 곳을 계속 보고 있으므로 걷는다
+    if (moving.is_dir)
+    {
+        Node *gone = node_child(moving.dir, moving.name);
+        if (gone)
+            node_drop_tree(gone);
+    }
+    emit(TREE_DEL, moving.is_dir, moving.path, NULL, NULL);
+}
+
+static void appeared(Node *dir, const char *name, const char *path, TreeChangeKind kind, const char *oldpath)
+{
+    struct stat st;
+    bool ok = lstat(path, &st) == 0;
+    bool is_dir = ok && S_ISDIR(st.st_mode);
+
+    emit(kind, is_dir, kind == TREE_REN ? oldpath : path, kind == TREE_REN ? path : NULL, ok ? &st : NULL);
+
+    // 새 디렉토리: watch 를 건 뒤 그 사이에 생긴 항목까지 알린다
+    if (is_dir && kind == TREE_ADD)
+    {
+        Node *node = node_add(path, dir, name);
+        if (node)
+            walk_tree(node, path, TREE_ADD);
+    }
+}
+
+static void handle_event(const struct inotify_event *ie)
+{
+    bool paired = (ie->mask & IN_MOVED_TO) && moving.active && moving.cookie == ie->cookie;
+    if (!paired)
+        settle_move();
+
+    if (ie->mask & IN_Q_OVERFLOW)
+    {
+        emit(TREE_LOST, true, root_path, NULL, NULL);
+        walk_root();
+        return;
+    }
+
+    Node *dir = node_lookup(ie->wd);
+    if (!dir)
+        return;
+
+    if (ie->mask & IN_IGNORED)
+    {
+        // 디렉토리가 지워졌다 (하위 디렉토리는 먼저 지워지며 각자 IN_IGNORED 를 받는다)
+        bool was_root = dir == root_node;
+        node_unhash(dir);
+        node_free(dir);
+        if (was_root)
+            emit(TREE_LOST, true, root_path, NULL, NULL);
+        return;
+    }
+    if (!ie->len || is_private(dir, ie->name))
+        return;
+
+    char path[PATH_MAX];
+    if (child_path(dir, ie->name, path) != 0)
+        return;
+    bool is_dir = (ie->mask & IN_ISDIR) != 0;
+
+    if (paired)
+    {
+        moving.active = false;
+        if (moving.is_dir)
+        {
+            Node *node = node_child(moving.dir, moving.name);
+            if (node)
+            {
+                char *copy = strdup(ie->name);
+                if (copy)
+                {
+                    free(node->name);
+                    node->name = copy;
+                    node->parent = dir;
+                }
+            }
+        }
+        appeared(dir, ie->name, path, TREE_REN, moving.path);
+    }
+    else if (ie->mask & IN_MOVED_FROM)
+    {
+        moving.active = true;
+        moving.cookie = ie->cookie;
+        moving.is_dir = is_dir;
+        moving.dir = dir;
+        snprintf(moving.name, sizeof(moving.name), "%s", ie->name);
+        memcpy(moving.path, path, sizeof(path));
+    }
+    else if (ie->mask & (IN_CREATE | IN_MOVED_TO))
+    {
+        appeared(dir, ie->name, path, TREE_ADD, NULL);
+    }
+    else if (ie->mask & IN_DELETE)
+    {
+        emit(TREE_DEL, is_dir, path, NULL, NULL);
+    }
+    else if (ie->mask & IN_CLOSE_WRITE)
+    {
+        struct stat st;
+        bool ok = lstat(path, &st) == 0;
+        if (ok)
+            emit(TREE_MOD, false, path, NULL, &st);
+    }
+}
+
+static void *tree_watch_main(void *arg)
+{
+    (void)arg;
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    walk_root();
+
+    while (1)
+    {
+        struct pollfd pfd = { .fd = ino_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, moving.active ? TREE_WATCH_MOVE_WAIT_MS : -1);
+        if (ready == 0)
+        {
+            settle_move();
+            continue;
+        }
+        if (ready < 0)
+            continue;
+
+        ssize_t len = read(ino_fd, buf, sizeof(buf));
+        for (char *p = buf; len > 0 && p < buf + len;)
+        {
+            const struct inotify_event *ie = (const struct inotify_event *)p;
+            p += sizeof(*ie) + ie->len;
+            handle_event(ie);
+        }
+    }
+    return NULL;
+}
+
+int tree_watch_subscribe(TreeWatchFn fn, void *ctx)
+{
+    if (subscriber_count == TREE_WATCH_MAX_SUBSCRIBERS || ino_fd >= 0)
+        return -1;
+    subscribers[subscriber_count++] = (Subscriber){ fn, ctx };
+    return 0;
+}
+
+int tree_watch_start(const char *root)
+{
+    // 서버가 뜰 때 말고도 (GREP-INDEX ON 처럼) 클라이언트 스레드에서 처음 필요해질 때 불릴 수 있다
+    static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&start_lock);
+    int rc = 0;
+    if (subscriber_count == 0 || ino_fd >= 0)
+        goto out;
+
+    snprintf(root_path, sizeof(root_path), "%s", root);
+    ino_fd = inotify_init1(IN_CLOEXEC);
+    if (ino_fd < 0)
+    {
+        rc = -1;
+        goto out;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, tree_watch_main, NULL) != 0)
+    {
+        close(ino_fd);
+        ino_fd = -1;
+        errno = EAGAIN;
+        rc = -1;
+        goto out;
+    }
+    pthread_detach(tid);
+out:
+    pthread_mutex_unlock(&start_lock);
+    return rc;
+}
@@ -0,0 +1,48 @@
+#ifndef TREE_WATCH_H
+#define TREE_WATCH_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+// 서버 루트 전체를 재귀적으로 감시하는 inotify 스레드 (변경 저널, 파일 이름 색인용)
+//
+// 시작하면 트리를 한 번 걸으며 모든 디렉토리에 watch 를 걸고 항목마다 TREE_SEEN 을 알린 뒤
+// TREE_SYNCED 를 보낸다. 이후의 변경은 아래 종류로 알린다. 새 디렉토리는 watch 를 건 뒤
+// 안을 걸어 그 사이에 생긴 항목도 TREE_ADD 로 알린다 (같은 항목이 두 번 올 수 있음).
+// 디렉토리 이름 변경은 하위 경로까지 새 이름으로 따라간다.
+// 이벤트가 넘치면 TREE_LOST(루트) 를 보내고 처음처럼 다시 걷는다 (SEEN ... SYNCED).
+//
+// 루트 바로 아래 TREE_WATCH_PRIVATE_PREFIX 로 시작하는 항목(중복 제거 저장소, 저널 등)은 보지 않는다.
+
+#define TREE_WATCH_PRIVATE_PREFIX ".talkshell-"
+#define TREE_WATCH_MAX_SUBSCRIBERS 4
+
+typedef enum
+{
+    TREE_SEEN,      // 처음(또는 LOST 뒤) 걸을 때 있던 항목
+    TREE_SYNCED,    // 걷기 끝
+    TREE_ADD,       // 생김 (만들기, 트리 밖에서 옮겨 옴)
+    TREE_DEL,       // 없어짐 (지우기, 트리 밖으로 옮김). 디렉토리는 하위 항목을 따로 알리지 않는다.
+    TREE_MOD,       // 파일 내용이 바뀜 (쓰기 뒤 닫힘)
+    TREE_REN,       // path → newpath (디렉토리면 하위 항목도 함께 옮겨진 것)
+    TREE_LOST,      // 이벤트를 놓침: path 아래를 다시 읽어야 함
+} TreeChangeKind;
+
+typedef struct
+{
+    TreeChangeKind kind;
+    bool is_dir;
+    const char *path;        // 절대 경로 (SYNCED 는 루트)
+    const char *newpath;     // REN 만
+    const struct stat *st;   // SEEN/ADD/MOD/REN 의 lstat 결과 (읽지 못했으면 NULL)
+} TreeChange;
+
+// 감시 스레드에서 순서대로 불린다
+typedef void (*TreeWatchFn)(void *ctx, const TreeChange *c);
+
+// tree_watch_start 전에 등록한다. 실패 시 -1.
+int tree_watch_subscribe(TreeWatchFn fn, void *ctx);
+// root 감시 스레드를 시작한다 (구독자가 없거나 이미 돌고 있으면 아무것도 하지 않음). 실패 시 -1 (errno).
+int tree_watch_start(const char *root);
+
+#endif
@@ -8,7 +8,10 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
 
 #include "socket_client.h"
 #include "dir_manager.h"
@@ -16,6 +19,12 @@
 #include "input_manager.h"
 #include "utils.h"
 #include "auth.h"
+#include "checksum.h"
+#include "file_hash.h"
+#include "tree_stream.h"
+#include "compress.h"
+#include "delta.h"
+#include "sync_manifest.h"
 
 #ifdef USE_INOTIFY
 #include <sys/inotify.h>
@@ -25,8 +34,39 @@
 #define KEY_CTRL_Z 26
 #define KEY_CTRL_C 3
 
+// 이 크기를 넘는 파일은 이어받기 가능한 청크 업로드를 사용
+#define CHUNKED_UPLOAD_THRESHOLD (8L * 1024 * 1024)
+#define UPLOAD_CHUNK_SIZE (4u * 1024 * 1024)
+#define UPLOAD_RETRY_MAX 3
+// 빠진 청크가 이 이상이면 추가 연결을 열어 병렬로 보낸다
+#define UPLOAD_STREAMS 4
+#define PARALLEL_UPLOAD_MIN_CHUNKS 4
+// 서버에 같은 이름의 파일이 있으면 달라진 부분만 보낸다 (리터럴이 이 비율을 넘으면 포기)
+#define DELTA_UPLOAD_MIN_SIZE (16L * 1024)
+#define DELTA_MAX_LITERAL_RATIO 0.5
+// 이 크기 이상이면 보내기 전에 서버 저장소에 같은 내용이 있는지 먼저 묻는다
+#define DEDUP_UPLOAD_MIN_SIZE (64L * 1024)
+// 동시에 돌 수 있는 백그라운드 업로드 수와 UI 루프가 넘겨받기 전까지 쌓아 두는 로그 줄 수
+#define BG_UPLOAD_MAX 4
+#define BG_LOG_MAX 64
+
+// 다운로드: 첫 구간으로 크기를 알아낸 뒤, 남은 양이 크면 구간을 나눠 병렬로 받는다
+#define DOWNLOAD_FIRST_SPAN (4LL * 1024 * 1024)
+#define PARALLEL_DOWNLOAD_THRESHOLD (32LL * 1024 * 1024)
+#define DOWNLOAD_STREAMS 4
+
 static WINDOW *win_dir, *win_file, *win_chat, *win_input;
 
+// /tail: 서버와 같은 한도 (file_tail.h 의 FILE_TAIL_MAX_FILES)
+#define TAIL_MAX_FILES 4
+
+typedef struct
+{
+    unsigned id;
+    char path[PATH_MAX];      // 서버의 절대 경로
+    long long offset;         // 마지막으로 받은 줄 다음 위치 (다시 접속하면 여기서부터)
+} TailView;
+
 typedef struct
 {
     DirList dl;
@@ -37,11 +77,20 @@ typedef struct
     FocusArea prev_focus;
     FocusArea last_list_focus;
     char username[64];
+    char pw_hash[65];         // 재접속 시 다시 로그인하기 위한 해시
     bool logged_in;
     bool upload_mode;
+    bool compress;            // 세션에서 압축을 협상했는지
+    bool no_dedup;            // 서버에 중복 제거 저장소가 없음 (UPLOAD HAVE 생략)
+    bool watching;            // 서버가 두 패널의 디렉토리 변경을 알려 주는 중 (WATCH)
+    char watched_dir[PATH_MAX];
+    char watched_base[PATH_MAX];
+    TailView tails[TAIL_MAX_FILES];   // 따라 읽고 있는 서버 파일 (/tail, id 가 0 이면 빈 칸)
 } App;
 
 static void redraw_all(App *a);
+static void tail_show_event(App *a, const char *evt);
+static void resume_tails(App *a);
 static void change_focus(App *a, FocusArea next);
 static void delete_selected_entry(App *a);
 static int delete_local_path(const char *target_path);
@@ -76,6 +125,41 @@ static int capture_masked_input(WINDOW *win, int y, int x, char *out, int maxlen
     return pos;
 }
 
+// 클라이언트 쪽 압축 작업용 스레드 풀 (처음 쓸 때 만든다)
+static WorkerPool *client_workers(void)
+{
+    static pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+    static WorkerPool *pool;
+    pthread_mutex_lock(&mu);
+    if (!pool)
+        pool = worker_pool_create(0);
+    pthread_mutex_unlock(&mu);
+    return pool;
+}
+
+// 업로드 경로(HAVE → DELTA → 일반)와 업로드 뒤 확인에서 같은 파일을 다시 읽지 않도록
+// (inode, 크기, 수정 시각) 이 같으면 기억해 둔 해시를 쓴다
+static bool local_file_hash(const char *path, char out[CHECKSUM_HEX_LEN])
+{
+    long long size;
+    bool cached;
+    return file_hash(path, out, &size, &cached) == 0;
+}
+
+// 로그인 직후 압축 사용을 협상한다 (TALKSHELL_COMPRESS=0 이면 끔)
+static void negotiate_compression(App *app)
+{
+    const char *env = getenv("TALKSHELL_COMPRESS");
+    app->compress = false;
+    if (env && strcmp(env, "0") == 0)
+        return;
+
+    char line[128];
+    socket_send_cmd("COMPRESS " COMPRESS_ALGO);
+    if (socket_recv_line(line, sizeof(line)) >= 0 && strcmp(line, "OK COMPRESS " COMPRESS_ALGO) == 0)
+        app->compress = true;
+}
+
 static bool login_prompt(App *app)
 {
     int h, w; getmaxyx(stdscr, h, w);
@@ -119,8 +203,10 @@ static bool login_prompt(App *app)
         if (rn > 0 && strncmp(resp, "OK:", 3) == 0)
         {
             snprintf(app->username, sizeof(app->username), "%s", user);
+            snprintf(app->pw_hash, sizeof(app->pw_hash), "%s", hash);
             app->logged_in = true; 
             delwin(login);
+            negotiate_compression(app);
             return true;
         }
 
@@ -188,7 +274,7 @@ static void redraw_all(App *a)
     const char *help =
         a->upload_mode
             ? "Upload: ↑↓ 이동 Enter 선택 Space 업로드, Ctrl+Z 상위, q 취소"
-            : "F1:위치 F2:선택 F3:입력 Tab 이동 Enter 실행 Ctrl+Z 상위 q 종료";
+            : "F1:위치 F2:선택 F3:입력 Tab 이동 Enter 실행 d 다운로드 Ctrl+Z 상위 q 종료";
 
     status_bar(win_chat, help);
 }
@@ -220,6 +306,182 @@ static void open_selected_dir(App *a)
     redraw_all(a);
 }
 
+// ------------------------------------------------------------
+// 패널 변경 알림 (WATCH)
+// ------------------------------------------------------------
+// 위치 패널(dl.cwd)과 선택 패널(fl.base)이 바뀌면 서버에 감시할 디렉토리를 다시 알린다.
+// 이후 서버가 보내는 EVT 줄을 목록에 바로 반영하므로 작업 뒤에 목록을 다시 읽을 필요가 없다.
+static void watch_panels(App *a)
+{
+    if (!a->logged_in || !socket_is_connected() || a->upload_mode)
+        return;
+    if (strcmp(a->watched_dir, a->dl.cwd) == 0 && strcmp(a->watched_base, a->fl.base) == 0)
+        return;
+
+    char cmd[PATH_MAX * 2 + 16], line[PATH_MAX + 64];
+    if (strcmp(a->dl.cwd, a->fl.base) == 0 || !a->fl.base[0])
+        snprintf(cmd, sizeof(cmd), "WATCH %s", a->dl.cwd);
+    else
+        snprintf(cmd, sizeof(cmd), "WATCH %s\t%s", a->dl.cwd, a->fl.base);
+    socket_send_cmd(cmd);
+
+    // 예전 서버는 WATCH 를 채팅으로 받아 ACK 를 돌려준다: 감시 없이 기존처럼 목록을 다시 읽는다
+    a->watching = socket_recv_line(line, sizeof(line)) >= 0 && strncmp(line, "OK WATCH", 8) == 0;
+    snprintf(a->watched_dir, sizeof(a->watched_dir), "%s", a->dl.cwd);
+    snprintf(a->watched_base, sizeof(a->watched_base), "%s", a->fl.base);
+}
+
+static void rescan_dir_panel(App *a)
+{
+    char cwd[PATH_MAX], selected[PATH_MAX] = "";
+    snprintf(cwd, sizeof(cwd), "%s", a->dl.cwd);
+    if (a->dl.selected >= 0 && a->dl.selected < a->dl.count)
+        snprintf(selected, sizeof(selected), "%s", a->dl.items[a->dl.selected]);
+
+    dirlist_scan(&a->dl, cwd);
+    for (int i = 0; selected[0] && i < a->dl.count; i++)
+        if (strcmp(a->dl.items[i], selected) == 0)
+            a->dl.selected = i;
+}
+
+static void rescan_file_panel(App *a)
+{
+    char base[PATH_MAX], selected[256] = "";
+    snprintf(base, sizeof(base), "%s", a->fl.base);
+    if (a->fl.selected >= 0 && a->fl.selected < a->fl.count)
+        snprintf(selected, sizeof(selected), "%s", a->fl.items[a->fl.selected].name);
+
+    filelist_scan(&a->fl, base);
+    for (int i = 0; selected[0] && i < a->fl.count; i++)
+        if (strcmp(a->fl.items[i].name, selected) == 0)
+            a->fl.selected = i;
+}
+
+// 이름이 바뀐 항목을 선택하고 있었으면 새 이름을 계속 선택한다
+static void filelist_rename(FileList *fl, const char *from, const char *to, bool is_dir, long long size)
+{
+    bool was_selected = fl->selected >= 0 && fl->selected < fl->count && strcmp(fl->items[fl->selected].name, from) == 0;
+    filelist_remove(fl, from);
+    filelist_insert(fl, to, is_dir, size);
+    for (int i = 0; was_selected && i < fl->count; i++)
+        if (strcmp(fl->items[i].name, to) == 0)
+            fl->selected = i;
+}
+
+// 한 번에 처리할 최대 알림 수 (나머지는 다음 루프에서)
+#define EVENTS_PER_POLL 512
+
+static void poll_server_events(App *a)
+{
+    if (!a->logged_in || !socket_is_connected())
+        return;
+
+    bool dir_changed = false, file_changed = false;
+    bool dir_rescan = socket_pushed_dropped(), file_rescan = dir_rescan;
+    char line[PATH_MAX * 2 + 64];
+
+    for (int n = 0; n < EVENTS_PER_POLL; n++)
+    {
+        int rc = socket_poll_pushed(line, sizeof(line));
+        if (rc <= 0)
+            break;
+
+        char op[8], kind;
+        long long size;
+        int off = 0;
+        if (strncmp(line, "EVT RESCAN ", 11) == 0)
+        {
+            dir_rescan |= strcmp(line + 11, a->dl.cwd) == 0;
+            file_rescan |= strcmp(line + 11, a->fl.base) == 0;
+            continue;
+        }
+        if (strncmp(line, "EVT ", 4) != 0)
+        {
+            chat_append(&a->chat, "server", line);
+            a->chat.dirty = 1;
+            continue;
+        }
+        if (strncmp(line, "EVT TAIL ", 9) == 0)
+        {
+            tail_show_event(a, line + 9);
+            continue;
+        }
+        if (sscanf(line, "EVT %7s %c %lld %n", op, &kind, &size, &off) != 3 || off == 0)
+            continue;
+
+        // <dir>\t<name>[\t<new name>]
+        char *dir = line + off;
+        char *name = strchr(dir, '\t');
+        if (!name)
+            continue;
+        *name++ = '\0';
+        char *newname = strchr(name, '\t');
+        if (newname)
+            *newname++ = '\0';
+        bool is_dir = kind == 'd';
+        bool ren = strcmp(op, "REN") == 0 && newname;
+
+        if (strcmp(dir, a->dl.cwd) == 0 && is_dir)
+        {
+            char from[PATH_MAX], to[PATH_MAX];
+            path_join(from, dir, name);
+            const char *sel = a->dl.selected >= 0 && a->dl.selected < a->dl.count ? a->dl.items[a->dl.selected] : NULL;
+            bool selected = sel && strcmp(sel, from) == 0;
+
+            if (strcmp(op, "ADD") == 0)
+                dirlist_insert(&a->dl, from);
+            else if (strcmp(op, "DEL") == 0 || ren)
+                dirlist_remove(&a->dl, from);
+            if (ren)
+            {
+                path_join(to, dir, newname);
+                dirlist_insert(&a->dl, to);
+            }
+            // 선택한 디렉토리가 사라지거나 이름이 바뀌면 선택 패널이 가리키는 곳이 없어진다
+            if (selected && a->dl.selected < 0)
+                file_rescan = true;
+            dir_changed = true;
+        }
+
+        if (strcmp(dir, a->fl.base) == 0)
+        {
+            if (strcmp(op, "ADD") == 0 || strcmp(op, "SIZE") == 0)
+                filelist_insert(&a->fl, name, is_dir, size);
+            else if (strcmp(op, "DEL") == 0)
+                filelist_remove(&a->fl, name);
+            else if (ren)
+                filelist_rename(&a->fl, name, newname, is_dir, size);
+            file_changed = true;
+        }
+    }
+
+    if (dir_rescan)
+        rescan_dir_panel(a);
+    if (file_rescan && a->dl.selected < 0 && strcmp(a->fl.base, a->dl.cwd) != 0)
+    {
+        // 선택한 디렉토리가 없어졌으면 현재 위치를 보여 준다
+        open_selected_dir(a);
+        return;
+    }
+    if (file_rescan)
+        rescan_file_panel(a);
+
+    if (dir_rescan || file_rescan || dir_changed || file_changed)
+        redraw_all(a);
+}
+
+// 업로드/동기화/일괄 작업 뒤 목록 갱신. 감시 중이면 변경 알림으로 반영되므로 다시 읽지 않는다.
+static void refresh_panels(App *a)
+{
+    if (a->watching)
+        return;
+
+    char current_cwd[PATH_MAX];
+    snprintf(current_cwd, sizeof(current_cwd), "%s", a->dl.cwd);
+    dirlist_scan(&a->dl, current_cwd);
+    open_selected_dir(a);
+}
+
 static void go_parent_dir(App *a)
 {
     char parent[PATH_MAX];
@@ -467,8 +729,9 @@ static void delete_selected_entry(App *a)
         
         // 2. 저장해둔 경로로 복구 (새로고침)
         if (from_file_panel) {
-            // 파일 패널에서 삭제했으면 현재 디렉토리 파일 목록 갱신
-            filelist_scan(&a->fl, a->fl.base);
+            // 파일 패널에서 삭제했으면 현재 디렉토리 파일 목록 갱신 (감시 중이면 알림으로 반영됨)
+            if (!a->watching)
+                filelist_scan(&a->fl, a->fl.base);
         } else {
             // 디렉토리 패널에서 삭제했으면 저장된 경로로 이동
             dirlist_scan(&a->dl, saved_path);
@@ -488,13 +751,95 @@ static void delete_selected_entry(App *a)
     a->chat.dirty = 1;
 }
 
+// ------------------------------------------------------------
+// 백그라운드 업로드: 본문은 STREAMS 토큰으로 따로 연 데이터 연결에서 보내고, 메인(제어) 연결과
+// 화면은 채팅과 다른 명령에 그대로 쓴다. 업로드 스레드는 화면을 직접 그리지 않고 로그와 진행 상황을
+// 남겨 두며, UI 루프(poll_background_uploads)가 채팅 창과 상태 줄에 옮긴다.
+// ------------------------------------------------------------
+typedef struct
+{
+    App *app;
+    pthread_t tid;
+    bool used;
+    bool done;                // bg_mu 로 보호
+    bool is_dir;
+    bool compress;            // 데이터 연결에서 협상한 압축
+    char path[PATH_MAX];
+    char dir[PATH_MAX];       // 서버 대상 디렉토리 (시작할 때 보고 있던 곳)
+    char token[33];
+} BgUpload;
+
+static pthread_mutex_t bg_mu = PTHREAD_MUTEX_INITIALIZER;
+static BgUpload bg_uploads[BG_UPLOAD_MAX];
+static char *bg_log[BG_LOG_MAX];
+static size_t bg_log_count;
+static char bg_progress[512];
+
+// 이 스레드가 맡은 백그라운드 업로드 (UI 스레드에서는 NULL)
+static __thread BgUpload *bg_current;
+
 static void upload_log(App *a, const char *msg)
 {
+    if (bg_current)
+    {
+        pthread_mutex_lock(&bg_mu);
+        char *copy = bg_log_count < BG_LOG_MAX ? strdup(msg) : NULL;
+        if (copy)
+            bg_log[bg_log_count++] = copy;
+        pthread_mutex_unlock(&bg_mu);
+        return;
+    }
     chat_append(&a->chat, "system/upload", msg);
     a->chat.dirty = 1;
     chat_draw(win_chat, &a->chat, a->focus == FOCUS_CHAT);
 }
 
+// 업로드 진행률 (백그라운드면 UI 루프가 상태 줄에 보여 준다)
+static void upload_status(const char *msg)
+{
+    if (!bg_current)
+    {
+        status_bar(win_chat, msg);
+        return;
+    }
+    pthread_mutex_lock(&bg_mu);
+    snprintf(bg_progress, sizeof(bg_progress), "%s", msg);
+    pthread_mutex_unlock(&bg_mu);
+}
+
+// 업로드를 만들 서버 디렉토리
+static const char *upload_target_dir(const App *a)
+{
+    return bg_current ? bg_current->dir : a->fl.base;
+}
+
+static bool upload_compress(const App *a)
+{
+    return bg_current ? bg_current->compress : a->compress;
+}
+
+// UPLOAD PLAN FILE|DIR <name>\t<dir>: 서버의 작업 디렉토리가 그 사이 바뀌어도 보고 있던 곳에 만든다
+static int upload_plan_format(const App *a, const char *kind, const char *base, char *cmd, size_t size)
+{
+    const char *dir = upload_target_dir(a);
+    return snprintf(cmd, size, "UPLOAD PLAN %s %s%s%s", kind, base, dir[0] ? "\t" : "", dir);
+}
+
+// PLAN 뒤의 명령은 응답을 기다리지 않고 이어 보내므로, 서버가 받아 줄 길이인지 먼저 확인한다
+static bool upload_plan_fits(const App *a, const char *base)
+{
+    char cmd[PATH_MAX + 300];
+    int n = upload_plan_format(a, "FILE", base, cmd, sizeof(cmd));
+    return n >= 0 && n <= SOCKET_COMMAND_MAX;
+}
+
+static void upload_send_plan(const App *a, const char *kind, const char *base)
+{
+    char cmd[PATH_MAX + 300];
+    upload_plan_format(a, kind, base, cmd, sizeof(cmd));
+    socket_send_cmd(cmd);
+}
+
 static void exit_upload_mode(App *a)
 {
     a->upload_mode = false;
@@ -504,29 +849,62 @@ static void exit_upload_mode(App *a)
     change_focus(a, a->prev_focus);
 }
 
-static void upload_file_data(App *a, const char *filepath)
+static int tree_socket_write(void *ctx, const void *buf, size_t len);
+
+// 압축할 가치가 있는 청크면 zbuf 에 압축하고 헤더 꼬리(" Z <len>")를 채운다.
+// 반환: 실제로 보낼 데이터와 길이
+static const char *chunk_payload(bool compress, const char *buf, size_t len, char *zbuf,
+                                 size_t *wire_len, char *suffix, size_t suffix_size)
+{
+    size_t zlen = 0;
+    suffix[0] = '\0';
+    *wire_len = len;
+
+    if (compress && zbuf && compress_worthwhile(buf, len) &&
+        compress_buffer(buf, len, zbuf, &zlen, COMPRESS_LEVEL_FAST) == 0)
+    {
+        snprintf(suffix, suffix_size, " Z %zu", zlen);
+        *wire_len = zlen;
+        return zbuf;
+    }
+    return buf;
+}
+
+// 반환: 서버가 업로드를 완료했으면 true
+static bool upload_file_data(App *a, const char *filepath)
 {
     FILE *fp = fopen(filepath, "rb");
     if (!fp) {
         upload_log(a, "[system/upload] Error: Cannot open local file");
-        return;
+        return false;
     }
 
     fseek(fp, 0, SEEK_END);
     long filesize = ftell(fp);
     rewind(fp);
 
+    // 서버가 커밋 전에 검증할 수 있도록 SHA-256 을 함께 전달
+    char hash[CHECKSUM_HEX_LEN];
+    if (!local_file_hash(filepath, hash)) {
+        upload_log(a, "[system/upload] Error: Cannot hash local file");
+        fclose(fp);
+        return false;
+    }
+
+    // 표본상 압축 이득이 있는 파일만 압축 프레임으로 보낸다
+    bool framed = upload_compress(a) && filesize >= 4096 && compress_file_worthwhile(fileno(fp), filesize);
+
     char cmd[256];
-    snprintf(cmd, sizeof(cmd), "UPLOAD START %ld", filesize);
+    snprintf(cmd, sizeof(cmd), "UPLOAD START %ld %s%s", filesize, hash, framed ? " " COMPRESS_ALGO : "");
     socket_send_cmd(cmd);
 
-    char ack[64];
-    socket_recv_response(ack, sizeof(ack));
+    char ack[64] = {0};
+    socket_recv_line(ack, sizeof(ack));
 
     if (strncmp(ack, "ACK: READY", 10) != 0) {
         upload_log(a, "[system/upload] Error: Server not ready");
         fclose(fp);
-        return;
+        return false;
     }
 
     char buf[4096];
@@ -534,137 +912,2702 @@ static void upload_file_data(App *a, const char *filepath)
 
     char log_buf[100];
     snprintf(log_buf, sizeof(log_buf),
-             "[system/upload] Sending %ld bytes...", filesize);
+             "[system/upload] Sending %ld bytes%s...", filesize, framed ? " (compressed)" : "");
 
     upload_log(a, log_buf);
 
-    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
-        send(sockfd, buf, n, 0);
+    if (framed)
+    {
+        // 블록 압축은 작업 스레드에서, 전송은 순서대로
+        FrameWriter *fw = frame_writer_new(client_workers(), COMPRESS_LEVEL_FAST, tree_socket_write, NULL);
+        char *block = malloc(COMPRESS_BLOCK);
+        while (fw && block && (n = fread(block, 1, COMPRESS_BLOCK, fp)) > 0)
+        {
+            if (frame_writer_put(fw, block, n) != 0)
+                break;
+        }
+
+        unsigned long long raw_bytes = 0, wire_bytes = 0;
+        if (fw && frame_writer_finish(fw, &raw_bytes, &wire_bytes) == 0)
+        {
+            socket_send_all("END\n", 4);
+            snprintf(log_buf, sizeof(log_buf), "[system/upload] %llu bytes on the wire", wire_bytes);
+            upload_log(a, log_buf);
+        }
+        frame_writer_free(fw);
+        free(block);
+    }
+    else
+    {
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        {
+            if (socket_send_all(buf, n) != 0)
+                break;
+        }
+    }
 
     fclose(fp);
 
     char resp[256];
     int rn = socket_recv_response(resp, sizeof(resp));
 
-    if (rn > 0)
+    if (rn > 0 && strncmp(resp, "OK", 2) == 0)
+    {
         upload_log(a, "[system/upload] Server: Upload Complete");
+        return true;
+    }
+    if (rn > 0)
+    {
+        resp[strcspn(resp, "\n")] = '\0';
+        char msg[320];
+        snprintf(msg, sizeof(msg), "[system/upload] Server: %s", resp);
+        upload_log(a, msg);
+    }
+    return false;
 }
 
-static void send_upload_plan(App *a, const char *path, bool is_dir)
+// 서버에 저장된 업로드 결과를 다시 읽어 로컬 파일과 비교한다 (TALKSHELL_VERIFY=0 이면 끔).
+// 서버는 바뀌지 않은 파일의 해시를 기억하므로 같은 파일을 다시 확인해도 읽지 않는다.
+static void verify_upload(App *a, const char *local_path, const char *base)
 {
-    if (is_dir) {
-        upload_log(a, "[system/upload] Directory upload is not supported yet.");
+    const char *env = getenv("TALKSHELL_VERIFY");
+    if (env && strcmp(env, "0") == 0)
+        return;
+
+    char local[CHECKSUM_HEX_LEN], remote[PATH_MAX], cmd[64], line[PATH_MAX + 160], msg[PATH_MAX + 200];
+    if (!local_file_hash(local_path, local))
+        return;
+    path_join(remote, upload_target_dir(a), base);
+
+    size_t len = strlen(remote);
+    remote[len] = '\n';
+    snprintf(cmd, sizeof(cmd), "HASH 1 %zu", len + 1);
+    socket_send_cmd(cmd);
+    int rc = socket_send_all(remote, len + 1);
+    remote[len] = '\0';
+    if (rc != 0 || socket_recv_line(line, sizeof(line)) < 0 || strcmp(line, "OK HASH 1") != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/upload] Verify failed: %s", rc != 0 ? "connection lost" : line);
+        upload_log(a, msg);
         return;
     }
 
-    const char *base = strrchr(path, '/');
-    base = base ? base + 1 : path;
+    char hex[CHECKSUM_HEX_LEN] = "", how[16] = "";
+    long long size = -1;
+    while (socket_recv_line(line, sizeof(line)) >= 0 && strncmp(line, "END HASH", 8) != 0)
+    {
+        if (sscanf(line, "ITEM 0 OK %64s %lld %15s", hex, &size, how) == 3)
+            continue;
+        snprintf(msg, sizeof(msg), "[system/upload] Verify failed: %s", line);
+        upload_log(a, msg);
+        hex[0] = '\0';
+    }
+    if (!hex[0])
+        return;
 
-    char base_copy[256];
-    snprintf(base_copy, sizeof(base_copy), "%.255s", base);
+    if (strcmp(hex, local) == 0)
+        snprintf(msg, sizeof(msg), "[system/upload] Verified %s (sha256 %.16s..., %lld bytes)", base, hex, size);
+    else
+        snprintf(msg, sizeof(msg), "[system/upload] MISMATCH %s: server sha256 %.16s... != local %.16s...", base,
+                 hex, local);
+    upload_log(a, msg);
+}
 
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "UPLOAD PLAN FILE %s", base_copy);
-    socket_send_cmd(cmd);
+// 연결이 끊긴 경우 다시 접속해 로그인하고 서버 작업 디렉토리를 복구한다.
+static bool session_reconnect(App *a, const char *server_dir)
+{
+    // 데이터 연결은 UI 스레드가 받아 준 토큰으로만 열 수 있다 (청크 업로드는 다음에 이어받는다)
+    if (bg_current)
+        return false;
 
-    char response[256];
-    int rn = socket_recv_response(response, sizeof(response));
+    // 새 연결에는 감시가 없으므로 다음 루프에서 다시 요청한다
+    a->watching = false;
+    a->watched_dir[0] = a->watched_base[0] = '\0';
 
-    if (rn > 0)
-    {
-        response[rn] = '\0';
+    if (socket_reconnect() != 0)
+        return false;
 
-        if (strncmp(response, "OK:", 3) == 0)
-        {
-            upload_log(a, "[system/upload] Plan accepted. Starting transfer...");
-            upload_file_data(a, path);
+    char line[512];
+    if (socket_recv_line(line, sizeof(line)) < 0) // INFO: login required
+        return false;
 
-            char current_cwd[PATH_MAX];
-            snprintf(current_cwd, sizeof(current_cwd), "%s", a->dl.cwd);
-            dirlist_scan(&a->dl, current_cwd);
+    char cmd[PATH_MAX + 8];
+    snprintf(cmd, sizeof(cmd), "LOGIN %s %s", a->username, a->pw_hash);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0 || strncmp(line, "OK:", 3) != 0)
+        return false;
 
-            open_selected_dir(a);
-        }
-        else
-        {
-            char msg[512];
-            snprintf(msg, sizeof(msg),
-                     "[system/upload] Server rejected plan: %s",
-                     response);
-            upload_log(a, msg);
-        }
-    }
-    else
+    negotiate_compression(a);
+
+    snprintf(cmd, sizeof(cmd), "cd %s", server_dir);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0 || strncmp(line, "OK", 2) != 0)
+        return false;
+
+    resume_tails(a);
+    return true;
+}
+
+// ------------------------------------------------------------
+// 병렬 청크 업로드: STREAMS 로 받은 토큰으로 추가 연결을 ATTACH 하고
+// 각 연결이 서로 다른 청크를 보낸다 (서버는 pwrite 로 같은 파일에 기록)
+// ------------------------------------------------------------
+typedef struct
+{
+    int fd;                 // 로컬 파일
+    const char *id;
+    long filesize;
+    unsigned chunk_size;
+    unsigned count;
+    unsigned char *todo;    // 1 = 아직 서버가 받지 못한 청크
+    unsigned next;          // 다음에 가져갈 청크 인덱스
+    unsigned sent;
+    int active;             // 아직 동작 중인 워커 수
+    bool compress;
+    char token[33];
+    pthread_mutex_t mu;
+} ParallelUpload;
+
+static bool parallel_take(ParallelUpload *pu, unsigned *out)
+{
+    bool ok = false;
+    pthread_mutex_lock(&pu->mu);
+    while (pu->next < pu->count && !pu->todo[pu->next])
+        pu->next++;
+    if (pu->next < pu->count)
     {
-        upload_log(a,
-                   "[system/upload] No response from server for upload plan");
+        *out = pu->next++;
+        ok = true;
     }
+    pthread_mutex_unlock(&pu->mu);
+    return ok;
 }
 
-static void start_upload_mode(App *a)
+static void *parallel_upload_worker(void *arg)
 {
-    a->prev_focus = a->focus;
-    a->upload_mode = true;
-    change_focus(a, FOCUS_FILE);
+    ParallelUpload *pu = arg;
+    SocketStream st = { .fd = -1 };
+    char cmd[512];
+    char line[512];
+    char *buf = malloc(pu->chunk_size);
+    char *zbuf = pu->compress ? malloc(compress_bound(pu->chunk_size)) : NULL;
 
-    char cwd[PATH_MAX];
-    if (!getcwd(cwd, sizeof(cwd)))
-        snprintf(cwd, sizeof(cwd), ".");
+    if (!buf || stream_open(&st) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0)
+        goto done;
 
-    if (localbrowser_scan(&a->lbrowser, cwd) >= 0)
-        localbrowser_draw(win_file, &a->lbrowser, true);
-    else
-        upload_log(a, "[system/upload] Failed to read local directory");
+    snprintf(cmd, sizeof(cmd), "ATTACH %s", pu->token);
+    if (stream_send_line(&st, cmd) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0 ||
+        strncmp(line, "OK", 2) != 0)
+        goto done;
 
-    upload_log(a, "[system/upload] Upload mode started");
-    upload_log(a,
-               "[system/upload] Bottom-left window shows LOCAL filesystem.");
+    unsigned i;
+    while (parallel_take(pu, &i))
+    {
+        off_t off = (off_t)i * pu->chunk_size;
+        size_t len = (size_t)((pu->filesize - off) < (off_t)pu->chunk_size ? (pu->filesize - off) : (off_t)pu->chunk_size);
+        if (pread(pu->fd, buf, len, off) != (ssize_t)len)
+            break;
 
-    redraw_all(a);
+        // 각 워커가 자기 청크를 압축하므로 압축도 스트림 수만큼 병렬로 돈다
+        char suffix[32];
+        size_t wire_len;
+        const char *payload = chunk_payload(pu->compress, buf, len, zbuf, &wire_len, suffix, sizeof(suffix));
+
+        snprintf(cmd, sizeof(cmd), "UPLOAD CHUNK %s %u %zu %016llx%s", pu->id, i, len,
+                 (unsigned long long)checksum_fast64(buf, len, 0), suffix);
+        if (stream_send_line(&st, cmd) != 0 || stream_send_all(&st, payload, wire_len) != 0 ||
+            stream_recv_line(&st, line, sizeof(line)) < 0)
+            break;
+
+        // 실패한 청크는 todo 에 남겨 두고 메인 연결이 이어서 보낸다
+        if (strncmp(line, "OK CHUNK", 8) != 0)
+            break;
+
+        pthread_mutex_lock(&pu->mu);
+        pu->todo[i] = 0;
+        pu->sent++;
+        pthread_mutex_unlock(&pu->mu);
+    }
+
+done:
+    stream_close(&st);
+    free(buf);
+    free(zbuf);
+    pthread_mutex_lock(&pu->mu);
+    pu->active--;
+    pthread_mutex_unlock(&pu->mu);
+    return NULL;
 }
 
-static void handle_upload_mode_key(App *a, int ch)
+// 병렬로 보낼 수 있는 만큼 보내고, 남은 청크는 todo 에 그대로 둔다.
+static void upload_parallel(App *a, int fd, const char *id, long filesize, unsigned chunk_size,
+                            unsigned count, unsigned char *todo, unsigned *sent, unsigned missing)
 {
-    if (ch == 'q' || ch == 'Q') {
-        upload_log(a, "[system/upload] Upload mode cancelled");
-        exit_upload_mode(a);
+    unsigned wanted = missing < UPLOAD_STREAMS ? missing : UPLOAD_STREAMS;
+    char cmd[64];
+    char line[512];
+
+    snprintf(cmd, sizeof(cmd), "STREAMS %u", wanted);
+    socket_send_cmd(cmd);
+
+    ParallelUpload pu;
+    memset(&pu, 0, sizeof(pu));
+    int granted = 0;
+    if (socket_recv_line(line, sizeof(line)) < 0 ||
+        sscanf(line, "OK STREAMS %d %32s", &granted, pu.token) != 2 || granted < 2)
         return;
-    }
 
-    if (a->lbrowser.count == 0)
+    pu.fd = fd;
+    pu.id = id;
+    pu.filesize = filesize;
+    pu.chunk_size = chunk_size;
+    pu.count = count;
+    pu.todo = todo;
+    pu.sent = *sent;
+    pu.compress = upload_compress(a);
+    pthread_mutex_init(&pu.mu, NULL);
+
+    pthread_t tids[UPLOAD_STREAMS];
+    int started = 0;
+    pu.active = granted < UPLOAD_STREAMS ? granted : UPLOAD_STREAMS;
+    for (int i = 0; i < granted && i < UPLOAD_STREAMS; i++)
     {
-        if (ch == KEY_BACKSPACE || ch == KEY_CTRL_Z)
-        {
-            char parent[PATH_MAX];
-            dirname_of(parent, a->lbrowser.cwd);
-
-            if (strcmp(parent, a->lbrowser.cwd) != 0)
-            {
-                if (localbrowser_scan(&a->lbrowser, parent) >= 0)
-                    localbrowser_draw(win_file, &a->lbrowser, true);
-            }
-        }
-        else if (ch == ' ')
+        if (pthread_create(&tids[started], NULL, parallel_upload_worker, &pu) == 0)
+            started++;
+        else
         {
-            upload_log(a, "[system/upload] No items to select");
-            exit_upload_mode(a);
+            pthread_mutex_lock(&pu.mu);
+            pu.active--;
+            pthread_mutex_unlock(&pu.mu);
         }
-        return;
     }
 
-    if (ch == KEY_UP)
-    {
-        if (a->lbrowser.selected > 0)
-            a->lbrowser.selected--;
+    char msg[128];
+    snprintf(msg, sizeof(msg), "[system/upload] Sending over %d parallel streams", started);
+    upload_log(a, msg);
 
-        localbrowser_draw(win_file, &a->lbrowser, true);
-    }
-    else if (ch == KEY_DOWN)
+    // 워커가 끝날 때까지 진행률만 갱신
+    while (1)
     {
-        if (a->lbrowser.selected < a->lbrowser.count - 1)
-            a->lbrowser.selected++;
+        pthread_mutex_lock(&pu.mu);
+        unsigned done = pu.sent;
+        bool finished = pu.active == 0;
+        pthread_mutex_unlock(&pu.mu);
 
-        localbrowser_draw(win_file, &a->lbrowser, true);
+        snprintf(msg, sizeof(msg), "[system/upload] %d%% (%u/%u chunks)",
+                 (int)(done * 100ULL / count), done, count);
+        upload_status(msg);
+
+        if (finished)
+            break;
+        napms(200);
+    }
+
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    *sent = pu.sent;
+    pthread_mutex_destroy(&pu.mu);
+}
+
+// 청크 업로드 1회 시도.
+// 반환: 1 완료, 0 실패(재시도 무의미), -1 연결 끊김(재접속 후 이어받기)
+static int upload_chunked_once(App *a, int fd, const char *base, long filesize, const char *hash)
+{
+    char cmd[512];
+    char line[512];
+    char msg[640];
+
+    upload_send_plan(a, "FILE", base);
+    if (socket_recv_line(line, sizeof(line)) < 0)
+        return -1;
+    if (strncmp(line, "OK:", 3) != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/upload] Server rejected plan: %s", line);
+        upload_log(a, msg);
+        return 0;
+    }
+
+    snprintf(cmd, sizeof(cmd), "UPLOAD INIT %ld %u %s", filesize, UPLOAD_CHUNK_SIZE, hash);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0)
+        return -1;
+
+    char id[17] = {0};
+    unsigned chunk_size = 0, count = 0, missing = 0;
+    if (sscanf(line, "OK UPLOAD %16s %u %u %u", id, &chunk_size, &count, &missing) != 4 || chunk_size == 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/upload] Server: %s", line);
+        upload_log(a, msg);
+        return 0;
+    }
+
+    // 서버에 없는 청크 목록 조회
+    unsigned char *todo = calloc(count ? count : 1, 1);
+    if (!todo)
+        return 0;
+
+    snprintf(cmd, sizeof(cmd), "UPLOAD MISSING %s", id);
+    socket_send_cmd(cmd);
+    while (1)
+    {
+        if (socket_recv_line(line, sizeof(line)) < 0)
+        {
+            free(todo);
+            return -1;
+        }
+        if (strcmp(line, "EOF") == 0)
+            break;
+
+        unsigned first, last;
+        if (sscanf(line, "MISSING %u %u", &first, &last) == 2)
+        {
+            for (unsigned i = first; i <= last && i < count; i++)
+                todo[i] = 1;
+        }
+    }
+
+    if (missing < count)
+    {
+        snprintf(cmd, sizeof(cmd), "[system/upload] Resuming: %u of %u chunks left", missing, count);
+        upload_log(a, cmd);
+    }
+
+    char *buf = malloc(chunk_size);
+    char *zbuf = upload_compress(a) ? malloc(compress_bound(chunk_size)) : NULL;
+    if (!buf)
+    {
+        free(todo);
+        return 0;
+    }
+
+    unsigned sent = count - missing;
+    if (missing >= PARALLEL_UPLOAD_MIN_CHUNKS)
+        upload_parallel(a, fd, id, filesize, chunk_size, count, todo, &sent, missing);
+
+    int rc = 1;
+    int last_pct = -1;
+
+    for (unsigned i = 0; i < count && rc == 1; i++)
+    {
+        if (!todo[i])
+            continue;
+
+        off_t off = (off_t)i * chunk_size;
+        size_t len = (size_t)((filesize - off) < (off_t)chunk_size ? (filesize - off) : (off_t)chunk_size);
+        if (pread(fd, buf, len, off) != (ssize_t)len)
+        {
+            upload_log(a, "[system/upload] Error: Cannot read local file");
+            rc = 0;
+            break;
+        }
+
+        char suffix[32];
+        size_t wire_len;
+        const char *payload = chunk_payload(upload_compress(a), buf, len, zbuf, &wire_len, suffix, sizeof(suffix));
+
+        snprintf(cmd, sizeof(cmd), "UPLOAD CHUNK %s %u %zu %016llx%s", id, i, len,
+                 (unsigned long long)checksum_fast64(buf, len, 0), suffix);
+        socket_send_cmd(cmd);
+        if (socket_send_all(payload, wire_len) != 0 || socket_recv_line(line, sizeof(line)) < 0)
+        {
+            rc = -1;
+            break;
+        }
+
+        if (strncmp(line, "OK CHUNK", 8) != 0)
+        {
+            snprintf(msg, sizeof(msg), "[system/upload] Server: %s", line);
+            upload_log(a, msg);
+            rc = 0;
+            break;
+        }
+
+        int pct = (int)(++sent * 100ULL / count);
+        if (pct / 10 != last_pct / 10)
+        {
+            last_pct = pct;
+            snprintf(cmd, sizeof(cmd), "[system/upload] %d%% (%u/%u chunks)", pct, sent, count);
+            upload_status(cmd);
+        }
+    }
+
+    free(buf);
+    free(zbuf);
+    free(todo);
+    if (rc != 1)
+        return rc;
+
+    snprintf(cmd, sizeof(cmd), "UPLOAD FINISH %s", id);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0)
+        return -1;
+
+    snprintf(msg, sizeof(msg), "[system/upload] Server: %s", line);
+    upload_log(a, msg);
+    return strncmp(line, "OK", 2) == 0 ? 1 : 0;
+}
+
+// 큰 파일: 청크 단위로 보내고, 연결이 끊기면 재접속해 빠진 청크만 다시 보낸다.
+static void upload_file_resumable(App *a, const char *filepath, const char *base)
+{
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        upload_log(a, "[system/upload] Error: Cannot open local file");
+        return;
+    }
+
+    struct stat st;
+    char hash[CHECKSUM_HEX_LEN];
+    if (fstat(fd, &st) != 0 || !local_file_hash(filepath, hash)) {
+        upload_log(a, "[system/upload] Error: Cannot hash local file");
+        close(fd);
+        return;
+    }
+
+    char server_dir[PATH_MAX];
+    snprintf(server_dir, sizeof(server_dir), "%s", upload_target_dir(a));
+
+    char msg[PATH_MAX + 64];
+    snprintf(msg, sizeof(msg), "[system/upload] Sending %lld bytes in chunks...", (long long)st.st_size);
+    upload_log(a, msg);
+
+    for (int attempt = 0; attempt <= UPLOAD_RETRY_MAX; attempt++)
+    {
+        if (attempt > 0)
+        {
+            snprintf(msg, sizeof(msg), "[system/upload] Connection lost, reconnecting (%d/%d)...",
+                     attempt, UPLOAD_RETRY_MAX);
+            upload_log(a, msg);
+            napms(1000);
+            if (!session_reconnect(a, server_dir))
+                continue;
+        }
+
+        int rc = upload_chunked_once(a, fd, base, (long)st.st_size, hash);
+        if (rc == 1)
+            verify_upload(a, filepath, base);
+        if (rc >= 0)
+            break;
+    }
+
+    close(fd);
+}
+
+// 디렉토리 업로드: PLAN 과 트리 레코드 스트림을 응답을 기다리지 않고 이어서 보낸다
+static int tree_socket_write(void *ctx, const void *buf, size_t len)
+{
+    (void)ctx;
+    return socket_send_all(buf, len);
+}
+
+static void tree_upload_progress(void *ctx, const TreeStats *st)
+{
+    (void)ctx;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "[system/upload] %llu dirs, %llu files, %llu bytes sent...",
+             st->dirs, st->files, st->bytes);
+    upload_status(msg);
+}
+
+static void upload_directory(App *a, const char *path, const char *base)
+{
+    int dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+    {
+        upload_log(a, "[system/upload] Error: Cannot open directory");
+        return;
+    }
+
+    upload_send_plan(a, "DIR", base);
+    socket_send_cmd("UPLOAD TREE");
+
+    TreeSink sink = { tree_socket_write, tree_upload_progress, NULL };
+    TreeStats st;
+    int rc = tree_send(dfd, &sink, &st);
+    close(dfd);
+
+    char line[512];
+    char msg[640];
+    if (rc != 0 || socket_recv_line(line, sizeof(line)) < 0)
+    {
+        upload_log(a, "[system/upload] Connection lost during directory upload");
+        return;
+    }
+
+    if (strncmp(line, "OK", 2) != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/upload] Server rejected plan: %s", line);
+        upload_log(a, msg);
+    }
+
+    if (socket_recv_line(line, sizeof(line)) < 0)
+    {
+        upload_log(a, "[system/upload] No response from server for directory upload");
+        return;
+    }
+
+    snprintf(msg, sizeof(msg), "[system/upload] Server: %s", line);
+    upload_log(a, msg);
+
+    if (st.skipped > 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/upload] Skipped %llu entries (links, special or unreadable files)",
+                 st.skipped);
+        upload_log(a, msg);
+    }
+}
+
+// 같은 호스트의 서버(Unix 소켓)면 본문을 보내지 않고 열린 파일을 넘긴다 (서버가 커널 안에서 복사).
+// 반환: true = 처리함 (성공/실패 모두 로그 출력), false = 평소대로 업로드
+static bool upload_file_local(App *a, const char *path, const char *base)
+{
+    if (!socket_is_local())
+        return false;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    char cmd[512], line[256];
+    upload_send_plan(a, "FILE", base);
+    snprintf(cmd, sizeof(cmd), "UPLOAD FD %lld", (long long)st.st_size);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0 || strncmp(line, "OK", 2) != 0 ||
+        socket_recv_line(line, sizeof(line)) < 0 || strcmp(line, "ACK: SEND FD") != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    upload_log(a, "[system/upload] Handing the file to the local server...");
+    int rc = socket_send_fd(fd);
+    close(fd);
+    if (rc != 0 || socket_recv_line(line, sizeof(line)) < 0)
+    {
+        upload_log(a, "[system/upload] Connection lost - reconnecting");
+        session_reconnect(a, upload_target_dir(a));
+        return true;
+    }
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "[system/upload] Server: %s", line);
+    upload_log(a, msg);
+    if (strncmp(line, "OK", 2) == 0)
+        verify_upload(a, path, base);
+    return true;
+}
+
+// 내용 주소 업로드: 서버 저장소에 같은 내용이 있으면 본문을 보내지 않는다.
+// 반환: true = 서버가 파일을 만들었음, false = 평소대로 업로드
+static bool upload_file_known(App *a, const char *path, const char *base)
+{
+    struct stat st;
+    char hash[CHECKSUM_HEX_LEN];
+    if (a->no_dedup || stat(path, &st) != 0 || st.st_size < DEDUP_UPLOAD_MIN_SIZE ||
+        !local_file_hash(path, hash))
+        return false;
+
+    char cmd[512];
+    upload_send_plan(a, "FILE", base);
+    snprintf(cmd, sizeof(cmd), "UPLOAD HAVE %lld %s", (long long)st.st_size, hash);
+    socket_send_cmd(cmd);
+
+    char line[256];
+    if (socket_recv_line(line, sizeof(line)) < 0 || socket_recv_line(line, sizeof(line)) < 0)
+        return false;
+
+    if (strncmp(line, "OK", 2) != 0)
+    {
+        if (strstr(line, "dedup disabled"))
+            a->no_dedup = true;
+        return false;
+    }
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "[system/upload] Server already has this content - %s", line);
+    upload_log(a, msg);
+    verify_upload(a, path, base);
+    return true;
+}
+
+// 차등 업로드: 서버의 기존 파일 서명을 받아 달라진 바이트만 보낸다.
+// 반환: true = 처리함 (성공/실패 모두 로그 출력), false = 일반 업로드로 진행
+static bool upload_file_delta(App *a, const char *path, const char *base)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < DELTA_UPLOAD_MIN_SIZE)
+    {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    // PLAN 과 서명 요청은 응답을 기다리지 않고 이어서 보낸다
+    char cmd[512];
+    upload_send_plan(a, "FILE", base);
+    socket_send_cmd("UPLOAD DELTA SIGS");
+
+    char line[256];
+    long long base_size = 0, count = 0;
+    unsigned block = 0;
+    bool planned = socket_recv_line(line, sizeof(line)) >= 0 && strncmp(line, "OK", 2) == 0;
+    // PLAN 이 거절돼도 이어 보낸 SIGS 의 응답은 온다: 서명까지 읽어 버려야 다음 응답과 섞이지 않는다
+    if (socket_recv_line(line, sizeof(line)) < 0 ||
+        sscanf(line, "OK SIGS %lld %u %lld", &base_size, &block, &count) != 3 || count <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    if (!planned || block < DELTA_MIN_BLOCK || block > DELTA_MAX_BLOCK)
+    {
+        char skip[4096];
+        for (long long left = count * DELTA_SIG_SIZE; left > 0;)
+        {
+            size_t n = left < (long long)sizeof(skip) ? (size_t)left : sizeof(skip);
+            if (socket_recv_exact(skip, n) != 0)
+                break;
+            left -= (long long)n;
+        }
+        close(fd);
+        return false;
+    }
+
+    unsigned char *wire = malloc((size_t)count * DELTA_SIG_SIZE);
+    DeltaSig *sigs = malloc((size_t)count * sizeof(*sigs));
+    if (!wire || !sigs || socket_recv_exact(wire, (size_t)count * DELTA_SIG_SIZE) != 0)
+    {
+        // 서명을 다 받지 못하면 스트림 위치를 알 수 없으므로 연결 문제로 본다
+        free(wire);
+        free(sigs);
+        close(fd);
+        upload_log(a, "[system/upload] Error: Cannot receive block signatures");
+        return true;
+    }
+    for (long long i = 0; i < count; i++)
+        delta_sig_decode(wire + i * DELTA_SIG_SIZE, &sigs[i]);
+    free(wire);
+
+    unsigned char *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        free(sigs);
+        return false;
+    }
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    DeltaStats ds;
+    DeltaPlan *plan = delta_plan(data, (size_t)st.st_size, sigs, (size_t)count, block, &ds);
+    free(sigs);
+
+    char hash[CHECKSUM_HEX_LEN];
+    if (!plan || (double)ds.literal > (double)st.st_size * DELTA_MAX_LITERAL_RATIO ||
+        !local_file_hash(path, hash))
+    {
+        // 겹치는 부분이 적으면 일반 업로드가 낫다 (서버는 다음 PLAN 에서 기준 파일을 놓는다)
+        delta_plan_free(plan);
+        munmap(data, (size_t)st.st_size);
+        return false;
+    }
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "[system/upload] Sending delta: %llu changed bytes, %llu bytes reused...",
+             ds.literal, ds.copied);
+    upload_log(a, msg);
+
+    snprintf(cmd, sizeof(cmd), "UPLOAD DELTA %lld %s", (long long)st.st_size, hash);
+    socket_send_cmd(cmd);
+
+    TreeSink sink = { tree_socket_write, NULL, NULL };
+    int rc = delta_send(plan, data, upload_compress(a), &sink, &ds);
+    delta_plan_free(plan);
+    munmap(data, (size_t)st.st_size);
+
+    if (rc != 0 || socket_recv_line(line, sizeof(line)) < 0)
+    {
+        upload_log(a, "[system/upload] Connection lost during delta upload");
+        return true;
+    }
+
+    snprintf(msg, sizeof(msg), "[system/upload] Server: %s", line);
+    upload_log(a, msg);
+    if (strncmp(line, "OK", 2) == 0)
+        verify_upload(a, path, base);
+    return true;
+}
+
+// 업로드 뒤 목록 갱신 (백그라운드면 UI 루프가 스레드를 거둘 때 한다)
+static void upload_finished(App *a)
+{
+    if (!bg_current)
+        refresh_panels(a);
+}
+
+static void send_upload_plan(App *a, const char *path, bool is_dir)
+{
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    char base_copy[256];
+    snprintf(base_copy, sizeof(base_copy), "%.255s", base);
+
+    if (!upload_plan_fits(a, base_copy))
+    {
+        upload_log(a, "[system/upload] Error: Target path is too long for the server");
+        return;
+    }
+
+    if (is_dir)
+    {
+        upload_directory(a, path, base_copy);
+
+        upload_finished(a);
+        return;
+    }
+
+    if (upload_file_local(a, path, base_copy) || upload_file_known(a, path, base_copy) ||
+        upload_file_delta(a, path, base_copy))
+    {
+        upload_finished(a);
+        return;
+    }
+
+    if (get_file_size(path) > CHUNKED_UPLOAD_THRESHOLD)
+    {
+        upload_file_resumable(a, path, base_copy);
+
+        upload_finished(a);
+        return;
+    }
+
+    upload_send_plan(a, "FILE", base_copy);
+
+    char response[256];
+    int rn = socket_recv_response(response, sizeof(response));
+
+    if (rn > 0)
+    {
+        response[rn] = '\0';
+
+        if (strncmp(response, "OK:", 3) == 0)
+        {
+            upload_log(a, "[system/upload] Plan accepted. Starting transfer...");
+            if (upload_file_data(a, path))
+                verify_upload(a, path, base_copy);
+
+            upload_finished(a);
+        }
+        else
+        {
+            char msg[512];
+            snprintf(msg, sizeof(msg),
+                     "[system/upload] Server rejected plan: %s",
+                     response);
+            upload_log(a, msg);
+        }
+    }
+    else
+    {
+        upload_log(a,
+                   "[system/upload] No response from server for upload plan");
+    }
+}
+
+static void *bg_upload_thread(void *arg)
+{
+    BgUpload *job = arg;
+    App *a = job->app;
+    SocketStream st = { .fd = -1 };
+    char cmd[64], line[256];
+
+    bg_current = job;
+    snprintf(cmd, sizeof(cmd), "ATTACH %s", job->token);
+    if (stream_open(&st) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0 ||
+        stream_send_line(&st, cmd) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0 ||
+        strncmp(line, "OK", 2) != 0)
+    {
+        upload_log(a, "[system/upload] Error: Cannot open data connection");
+    }
+    else
+    {
+        socket_bind_thread(&st);
+        if (a->compress)
+        {
+            socket_send_cmd("COMPRESS " COMPRESS_ALGO);
+            job->compress = socket_recv_line(line, sizeof(line)) >= 0 &&
+                            strcmp(line, "OK COMPRESS " COMPRESS_ALGO) == 0;
+        }
+        send_upload_plan(a, job->path, job->is_dir);
+        socket_bind_thread(NULL);
+    }
+    stream_close(&st);
+
+    pthread_mutex_lock(&bg_mu);
+    job->done = true;
+    pthread_mutex_unlock(&bg_mu);
+    return NULL;
+}
+
+// 데이터 연결 하나를 받아 업로드를 백그라운드로 넘긴다 (TALKSHELL_BG_UPLOAD=0 이면 끔).
+// 반환: false = 넘기지 못함 (호출자가 지금 이 자리에서 올린다)
+static bool start_background_upload(App *a, const char *path, bool is_dir)
+{
+    const char *env = getenv("TALKSHELL_BG_UPLOAD");
+    if ((env && strcmp(env, "0") == 0) || !socket_is_connected())
+        return false;
+
+    BgUpload *job = NULL;
+    pthread_mutex_lock(&bg_mu);
+    for (int i = 0; i < BG_UPLOAD_MAX && !job; i++)
+        if (!bg_uploads[i].used)
+            job = &bg_uploads[i];
+    pthread_mutex_unlock(&bg_mu);
+    if (!job)
+        return false;
+
+    char line[128];
+    int granted = 0;
+    memset(job, 0, sizeof(*job));
+    socket_send_cmd("STREAMS 1");
+    if (socket_recv_line(line, sizeof(line)) < 0 ||
+        sscanf(line, "OK STREAMS %d %32s", &granted, job->token) != 2 || granted < 1)
+        return false;
+
+    job->app = a;
+    job->is_dir = is_dir;
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    snprintf(job->dir, sizeof(job->dir), "%s", a->fl.base);
+    job->used = true;
+    if (pthread_create(&job->tid, NULL, bg_upload_thread, job) != 0)
+    {
+        job->used = false;
+        return false;
+    }
+
+    upload_log(a, "[system/upload] Transferring in the background; chat and commands stay available");
+    return true;
+}
+
+// UI 루프에서 호출: 업로드 스레드가 남긴 로그와 진행률을 옮기고 끝난 스레드를 거둔다
+static void poll_background_uploads(App *a)
+{
+    char *logs[BG_LOG_MAX];
+    char progress[sizeof(bg_progress)];
+    BgUpload *finished[BG_UPLOAD_MAX];
+    size_t nlogs, nfinished = 0;
+
+    pthread_mutex_lock(&bg_mu);
+    nlogs = bg_log_count;
+    memcpy(logs, bg_log, nlogs * sizeof(*logs));
+    bg_log_count = 0;
+    snprintf(progress, sizeof(progress), "%s", bg_progress);
+    bg_progress[0] = '\0';
+    for (int i = 0; i < BG_UPLOAD_MAX; i++)
+        if (bg_uploads[i].used && bg_uploads[i].done)
+            finished[nfinished++] = &bg_uploads[i];
+    pthread_mutex_unlock(&bg_mu);
+
+    for (size_t i = 0; i < nlogs; i++)
+    {
+        chat_append(&a->chat, "system/upload", logs[i]);
+        free(logs[i]);
+        a->chat.dirty = 1;
+    }
+    if (progress[0])
+        status_bar(win_chat, progress);
+
+    for (size_t i = 0; i < nfinished; i++)
+    {
+        pthread_join(finished[i]->tid, NULL);
+        pthread_mutex_lock(&bg_mu);
+        finished[i]->used = false;
+        pthread_mutex_unlock(&bg_mu);
+    }
+    if (nfinished > 0)
+        refresh_panels(a);
+}
+
+// ------------------------------------------------------------
+// 다운로드 (파일 패널에서 선택한 서버 파일 → 로컬 현재 디렉토리)
+// ------------------------------------------------------------
+static void download_log(App *a, const char *msg)
+{
+    chat_append(&a->chat, "system/download", msg);
+    a->chat.dirty = 1;
+    chat_draw(win_chat, &a->chat, a->focus == FOCUS_CHAT);
+}
+
+static void download_progress(long long done, long long total)
+{
+    char msg[128];
+    int pct = total > 0 ? (int)(done * 100 / total) : 100;
+    snprintf(msg, sizeof(msg), "[system/download] %d%% (%lld/%lld bytes)", pct, done, total);
+    status_bar(win_chat, msg);
+}
+
+static int pwrite_all_local(int fd, const char *p, size_t len, off_t off)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+typedef struct
+{
+    const char *remote;
+    int fd;
+    long long off;
+    long long len;
+    const char *token;
+    long long *done;        // 전체 수신 바이트 (mu 로 보호)
+    int *active;
+    pthread_mutex_t *mu;
+    bool ok;
+} DownloadRange;
+
+static void *parallel_download_worker(void *arg)
+{
+    DownloadRange *r = arg;
+    SocketStream st = { .fd = -1 };
+    char cmd[PATH_MAX + 64];
+    char line[512];
+    char *buf = malloc(65536);
+
+    if (!buf || stream_open(&st) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0)
+        goto done;
+
+    snprintf(cmd, sizeof(cmd), "ATTACH %s", r->token);
+    if (stream_send_line(&st, cmd) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0 ||
+        strncmp(line, "OK", 2) != 0)
+        goto done;
+
+    snprintf(cmd, sizeof(cmd), "DOWNLOAD RANGE %lld %lld %s", r->off, r->len, r->remote);
+    long long size, off, len;
+    if (stream_send_line(&st, cmd) != 0 || stream_recv_line(&st, line, sizeof(line)) < 0 ||
+        sscanf(line, "OK DOWNLOAD %lld %lld %lld", &size, &off, &len) != 3 || len != r->len)
+        goto done;
+
+    long long got = 0;
+    while (got < len)
+    {
+        size_t want = (len - got) < 65536 ? (size_t)(len - got) : 65536;
+        int n = stream_recv_some(&st, buf, want);
+        if (n <= 0 || pwrite_all_local(r->fd, buf, (size_t)n, (off_t)(r->off + got)) != 0)
+            goto done;
+        got += n;
+
+        pthread_mutex_lock(r->mu);
+        *r->done += n;
+        pthread_mutex_unlock(r->mu);
+    }
+    r->ok = true;
+
+done:
+    stream_close(&st);
+    free(buf);
+    pthread_mutex_lock(r->mu);
+    (*r->active)--;
+    pthread_mutex_unlock(r->mu);
+    return NULL;
+}
+
+// [start, total) 구간을 병렬 스트림으로 받는다. 스트림을 얻지 못하면 false.
+static bool download_parallel(App *a, const char *remote, int fd, long long start, long long total)
+{
+    char cmd[64];
+    char line[512];
+    char token[33] = {0};
+    int granted = 0;
+
+    snprintf(cmd, sizeof(cmd), "STREAMS %d", DOWNLOAD_STREAMS);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0 ||
+        sscanf(line, "OK STREAMS %d %32s", &granted, token) != 2 || granted < 2)
+        return false;
+    if (granted > DOWNLOAD_STREAMS)
+        granted = DOWNLOAD_STREAMS;
+
+    pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+    long long done = start;
+    int active = 0;
+    DownloadRange ranges[DOWNLOAD_STREAMS];
+    pthread_t tids[DOWNLOAD_STREAMS];
+
+    long long span = (total - start + granted - 1) / granted;
+    for (int i = 0; i < granted; i++)
+    {
+        long long off = start + span * i;
+        long long len = (off + span > total) ? total - off : span;
+        ranges[i] = (DownloadRange){ .remote = remote, .fd = fd, .off = off, .len = len > 0 ? len : 0,
+                                     .token = token, .done = &done, .active = &active, .mu = &mu };
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "[system/download] Receiving over %d parallel streams", granted);
+    download_log(a, msg);
+
+    int started = 0;
+    for (int i = 0; i < granted; i++)
+    {
+        pthread_mutex_lock(&mu);
+        active++;
+        pthread_mutex_unlock(&mu);
+        if (pthread_create(&tids[i], NULL, parallel_download_worker, &ranges[i]) == 0)
+            started = i + 1;
+        else
+        {
+            pthread_mutex_lock(&mu);
+            active--;
+            pthread_mutex_unlock(&mu);
+            break;
+        }
+    }
+
+    while (1)
+    {
+        pthread_mutex_lock(&mu);
+        long long d = done;
+        int act = active;
+        pthread_mutex_unlock(&mu);
+
+        download_progress(d, total);
+        if (act == 0)
+            break;
+        napms(200);
+    }
+
+    bool ok = (started == granted);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+        ok = ok && ranges[i].ok;
+    }
+    return ok;
+}
+
+// 메인 연결로 한 구간을 받아 fd 의 해당 위치에 기록. 반환: 받은 응답 헤더 정보
+static ssize_t socket_source_read(void *ctx, void *buf, size_t len)
+{
+    (void)ctx;
+    return socket_recv_some(buf, len);
+}
+
+static ssize_t socket_source_read_line(void *ctx, char *out, size_t size)
+{
+    (void)ctx;
+    return socket_recv_line(out, size);
+}
+
+// compress 이면 압축 전송을 요청한다. 서버가 압축해 보냈는지는 *compressed 로 알려준다.
+// mtime: 서버가 알려 준 수정 시각 ("<sec>.<nsec>", 없으면 빈 문자열)
+static int download_range(const char *remote, int fd, long long offset, long long length, bool compress,
+                          long long *out_size, long long *out_len, bool *compressed, char mtime[32],
+                          char *err, size_t err_len)
+{
+    char cmd[PATH_MAX + 64];
+    char line[512];
+
+    snprintf(cmd, sizeof(cmd), "DOWNLOAD %sRANGE %lld %lld %s",
+             compress ? COMPRESS_ALGO " " : "", offset, length, remote);
+    socket_send_cmd(cmd);
+    if (socket_recv_line(line, sizeof(line)) < 0)
+    {
+        snprintf(err, err_len, "connection lost");
+        return -1;
+    }
+
+    long long size, off, len;
+    char encoding[16] = "";
+    if (sscanf(line, "OK DOWNLOAD %lld %lld %lld %15s", &size, &off, &len, encoding) < 3)
+    {
+        snprintf(err, err_len, "%.*s", (int)err_len - 1, line);
+        return -1;
+    }
+
+    *compressed = (strcmp(encoding, COMPRESS_ALGO) == 0);
+    const char *m = strstr(line, " mtime=");
+    if (!m || sscanf(m + 7, "%31[0-9.]", mtime) != 1)
+        mtime[0] = '\0';
+
+    TreeSource raw = { socket_source_read, socket_source_read_line, NULL };
+    FrameReader fr;
+    TreeSource src = raw;
+    if (*compressed)
+    {
+        if (frame_reader_init(&fr, &raw) != 0)
+        {
+            snprintf(err, err_len, "out of memory");
+            return -1;
+        }
+        src = frame_reader_source(&fr);
+    }
+
+    char buf[65536];
+    long long got = 0;
+    while (got < len)
+    {
+        size_t want = (len - got) < (long long)sizeof(buf) ? (size_t)(len - got) : sizeof(buf);
+        ssize_t n = src.read(src.ctx, buf, want);
+        if (n <= 0)
+        {
+            if (*compressed)
+                frame_reader_free(&fr);
+            snprintf(err, err_len, "connection lost");
+            return -1;
+        }
+        want = (size_t)n;
+
+        if (pwrite_all_local(fd, buf, want, (off_t)(offset + got)) != 0)
+        {
+            // 스트림을 끝까지 읽지 못했으므로 호출자가 재접속해야 한다
+            if (*compressed)
+                frame_reader_free(&fr);
+            snprintf(err, err_len, "%s", strerror(errno));
+            return -1;
+        }
+        got += (long long)want;
+        if ((got & ((1 << 22) - 1)) < want || got == len)
+            download_progress(offset + got, size);
+    }
+
+    if (*compressed)
+    {
+        // 프레임 뒤의 END 줄까지 소비
+        char drain;
+        bool clean = src.read(src.ctx, &drain, 1) == 0 && fr.ended;
+        frame_reader_free(&fr);
+        if (!clean)
+        {
+            snprintf(err, err_len, "bad compressed stream");
+            return -1;
+        }
+    }
+
+    *out_size = size;
+    *out_len = len;
+    return 0;
+}
+
+// 받은 파일은 로컬 브라우저가 보고 있던 디렉토리 (없으면 현재 디렉토리) 에 저장
+static void local_target_dir(App *a, char *out, size_t size)
+{
+    if (a->lbrowser.cwd[0])
+        snprintf(out, size, "%s", a->lbrowser.cwd);
+    else if (!getcwd(out, size))
+        snprintf(out, size, ".");
+}
+
+typedef struct
+{
+    unsigned long long received;
+    unsigned long long next_report;
+} TreeRecvProgress;
+
+static ssize_t tree_socket_read(void *ctx, void *buf, size_t len)
+{
+    TreeRecvProgress *p = ctx;
+    int n = socket_recv_some(buf, len);
+    if (n > 0)
+    {
+        p->received += (unsigned long long)n;
+        if (p->received >= p->next_report)
+        {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "[system/download] %llu bytes received...", p->received);
+            status_bar(win_chat, msg);
+            p->next_report = p->received + 4 * 1024 * 1024;
+        }
+    }
+    return n;
+}
+
+static ssize_t tree_socket_read_line(void *ctx, char *out, size_t size)
+{
+    (void)ctx;
+    return socket_recv_line(out, size);
+}
+
+// 서버 디렉토리를 압축 스트림으로 받아 로컬에 바로 풀어 놓는다
+static void download_tree(App *a, const char *remote, const char *name)
+{
+    char local_dir[PATH_MAX];
+    char msg[PATH_MAX * 2 + 128];
+    local_target_dir(a, local_dir, sizeof(local_dir));
+
+    if (strchr(name, '/') || !tree_path_is_safe(name))
+    {
+        download_log(a, "[system/download] Error: Invalid directory name");
+        return;
+    }
+
+    int dfd = open(local_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int rootfd = -1;
+    if (dfd >= 0)
+    {
+        if (mkdirat(dfd, name, 0755) == 0 || errno == EEXIST)
+            rootfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        close(dfd);
+    }
+    if (rootfd < 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/download] Error: Cannot create %s/%s (%s)", local_dir, name, strerror(errno));
+        download_log(a, msg);
+        return;
+    }
+
+    char cmd[PATH_MAX + 32];
+    char line[512];
+    snprintf(cmd, sizeof(cmd), "DOWNLOAD TREE %s", remote);
+    socket_send_cmd(cmd);
+
+    if (socket_recv_line(line, sizeof(line)) < 0 || strncmp(line, "OK", 2) != 0)
+    {
+        close(rootfd);
+        snprintf(msg, sizeof(msg), "[system/download] Failed: %s", line);
+        download_log(a, msg);
+        return;
+    }
+
+    snprintf(msg, sizeof(msg), "[system/download] %s/ → %s/%s/", remote, local_dir, name);
+    download_log(a, msg);
+
+    TreeRecvProgress progress = {0};
+    TreeSource raw = { tree_socket_read, tree_socket_read_line, &progress };
+    FrameReader fr;
+    TreeStats st;
+    char err[PATH_MAX + 64] = "";
+    int rc = -1;
+
+    if (frame_reader_init(&fr, &raw) == 0)
+    {
+        TreeSource src = frame_reader_source(&fr);
+        rc = tree_receive(rootfd, &src, &st, err, sizeof(err));
+
+        // 트리 레코드 뒤의 END 줄까지 읽어 다음 명령과 어긋나지 않게 한다
+        char drain;
+        while (rc >= 0 && src.read(src.ctx, &drain, 1) > 0)
+            ;
+        if (!fr.ended)
+            rc = -1;
+    }
+    close(rootfd);
+
+    if (rc < 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/download] Failed: %s - reconnecting",
+                 fr.end_line[0] ? fr.end_line : "connection lost");
+        download_log(a, msg);
+        frame_reader_free(&fr);
+        session_reconnect(a, a->fl.base);
+        return;
+    }
+
+    unsigned long long dirs = 0, files = 0, bytes = 0, skipped = 0, raw_bytes = 0, wire_bytes = 0;
+    sscanf(fr.end_line, "END %llu %llu %llu %llu %llu %llu", &dirs, &files, &bytes, &skipped, &raw_bytes, &wire_bytes);
+    frame_reader_free(&fr);
+
+    snprintf(msg, sizeof(msg), "[system/download] Completed: %llu dirs, %llu files, %llu bytes (%llu bytes on the wire)",
+             st.dirs, st.files, st.bytes, wire_bytes);
+    download_log(a, msg);
+
+    if (rc > 0 || skipped > 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/download] %llu entries failed locally, %llu skipped by server%s%s",
+                 st.errors, skipped, err[0] ? ": " : "", err);
+        download_log(a, msg);
+    }
+
+    if (a->lbrowser.cwd[0])
+        localbrowser_scan(&a->lbrowser, a->lbrowser.cwd);
+    status_bar(win_chat, "다운로드 완료");
+}
+
+// 받다 만 ".<name>.part" 옆의 ".<name>.part.info" 에 서버 파일의 크기와 수정 시각을 적어 두고,
+// 이어받기 전에 지금 서버 파일과 같은지 확인한다 (길이만 보면 바뀐 파일에 이어 붙일 수 있다)
+static bool part_info_matches(const char *info_path, long long size, const char *mtime)
+{
+    FILE *f = fopen(info_path, "r");
+    if (!f)
+        return false;
+    long long saved_size = -1;
+    char saved_mtime[32] = "";
+    bool same = fscanf(f, "%lld %31s", &saved_size, saved_mtime) == 2 && saved_size == size && mtime[0] &&
+                strcmp(saved_mtime, mtime) == 0;
+    fclose(f);
+    return same;
+}
+
+static void part_info_write(const char *info_path, long long size, const char *mtime)
+{
+    FILE *f = mtime[0] ? fopen(info_path, "w") : NULL;
+    if (!f)
+        return;
+    fprintf(f, "%lld %s\n", size, mtime);
+    fclose(f);
+}
+
+static void download_selected_file(App *a)
+{
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+
+    if (a->fl.selected < 0 || a->fl.selected >= a->fl.count)
+    {
+        status_bar(win_chat, "다운로드할 파일을 선택하세요.");
+        return;
+    }
+
+    const char *name = a->fl.items[a->fl.selected].name;
+    char remote[PATH_MAX];
+    path_join(remote, a->fl.base, name);
+
+    if (a->fl.items[a->fl.selected].is_dir)
+    {
+        download_tree(a, remote, name);
+        return;
+    }
+
+    char local_dir[PATH_MAX];
+    local_target_dir(a, local_dir, sizeof(local_dir));
+
+    char local_path[PATH_MAX];
+    char part_path[PATH_MAX];
+    char info_path[PATH_MAX];
+    char part_name[300];
+    path_join(local_path, local_dir, name);
+    snprintf(part_name, sizeof(part_name), ".%.255s.part", name);
+    path_join(part_path, local_dir, part_name);
+    snprintf(part_name, sizeof(part_name), ".%.255s.part.info", name);
+    path_join(info_path, local_dir, part_name);
+
+    // 이전에 받다 만 파일이 있으면 그 뒤부터 이어받는다
+    int fd = open(part_path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        download_log(a, "[system/download] Error: Cannot create local file");
+        return;
+    }
+
+    struct stat st;
+    long long have = (fstat(fd, &st) == 0) ? (long long)st.st_size : 0;
+
+    char err[256] = {0};
+    char mtime[32] = "", now_mtime[32] = "";
+    long long size = 0, len = 0;
+    bool compressed = false;
+    if (have > 0)
+    {
+        // 길이 0 구간으로 서버 파일의 크기와 수정 시각만 받아, 받을 때와 다르면 처음부터 받는다
+        if (download_range(remote, fd, have, 0, false, &size, &len, &compressed, mtime, err, sizeof(err)) != 0 &&
+            strncmp(err, "ERR:", 4) != 0)
+        {
+            close(fd);
+            char msg[PATH_MAX + 320];
+            snprintf(msg, sizeof(msg), "[system/download] Failed: %s (%s) - 다시 시도하면 이어받습니다", remote, err);
+            download_log(a, msg);
+            return;
+        }
+        if (!part_info_matches(info_path, size, mtime))
+        {
+            have = 0;
+            if (ftruncate(fd, 0) != 0)
+            {
+                close(fd);
+                download_log(a, "[system/download] Error: Cannot truncate local file");
+                return;
+            }
+        }
+    }
+
+    char msg[PATH_MAX * 2 + 128];
+    snprintf(msg, sizeof(msg), "[system/download] %s → %s%s", remote, local_path,
+             have > 0 ? " (resuming)" : "");
+    download_log(a, msg);
+
+    int rc = download_range(remote, fd, have, DOWNLOAD_FIRST_SPAN, a->compress, &size, &len, &compressed,
+                            mtime, err, sizeof(err));
+    if (rc != 0 && have > 0 && strncmp(err, "ERR: invalid range", 18) == 0)
+    {
+        // 서버 파일이 더 작아졌음: 처음부터 다시
+        have = 0;
+        if (ftruncate(fd, 0) == 0)
+            rc = download_range(remote, fd, 0, DOWNLOAD_FIRST_SPAN, a->compress, &size, &len, &compressed,
+                                mtime, err, sizeof(err));
+    }
+    if (rc == 0 && have == 0)
+        part_info_write(info_path, size, mtime);
+
+    long long pos = have + len;
+    if (rc == 0 && pos < size)
+    {
+        bool done = false;
+        // 서버가 압축해 보낼 만한 파일이면 (느린 링크에서 더 유리한) 압축 순차 전송을 유지
+        if (have == 0 && !compressed && size - pos >= PARALLEL_DOWNLOAD_THRESHOLD)
+        {
+            done = download_parallel(a, remote, fd, pos, size);
+            if (!done)
+            {
+                // 병렬 구간 중 일부가 실패하면 구멍이 생기므로 앞부분만 남긴다
+                if (ftruncate(fd, pos) != 0)
+                    rc = -1;
+            }
+        }
+
+        if (!done && rc == 0)
+        {
+            rc = download_range(remote, fd, pos, -1, a->compress, &size, &len, &compressed, now_mtime,
+                                err, sizeof(err));
+            if (rc == 0 && strcmp(now_mtime, mtime) != 0)
+            {
+                // 받는 도중 서버 파일이 바뀌었다: 다음 시도는 처음부터
+                rc = -1;
+                unlink(info_path);
+                snprintf(err, sizeof(err), "file changed on server");
+            }
+        }
+    }
+
+    if (rc == 0 && ftruncate(fd, size) == 0 && fsync(fd) == 0 && close(fd) == 0)
+    {
+        fd = -1;
+        if (rename(part_path, local_path) == 0)
+        {
+            unlink(info_path);
+            snprintf(msg, sizeof(msg), "[system/download] Completed: %s (%lld bytes)", local_path, size);
+            download_log(a, msg);
+            status_bar(win_chat, "다운로드 완료");
+            return;
+        }
+        snprintf(err, sizeof(err), "%s", strerror(errno));
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    snprintf(msg, sizeof(msg), "[system/download] Failed: %s (%s) - 다시 시도하면 이어받습니다", remote, err);
+    download_log(a, msg);
+}
+
+// ------------------------------------------------------------
+// 디렉토리 동기화: /sync <로컬 디렉토리> [서버 디렉토리] [--delete] [--hash]
+// 서버 매니페스트를 받아 로컬과 비교한 뒤 바뀐 항목만 한 번의 스트림으로 보낸다.
+// ------------------------------------------------------------
+static void sync_log(App *a, const char *msg)
+{
+    chat_append(&a->chat, "system/sync", msg);
+    a->chat.dirty = 1;
+    chat_draw(win_chat, &a->chat, a->focus == FOCUS_CHAT);
+}
+
+static int frame_sink_write(void *ctx, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        size_t n = len < COMPRESS_BLOCK ? len : COMPRESS_BLOCK;
+        if (frame_writer_put(ctx, p, n) != 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 삭제 목록을 줄 단위로 묶어 보낸다
+static int send_path_lines(const char *const *paths, size_t count)
+{
+    char buf[64 * 1024];
+    size_t len = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t n = strlen(paths[i]);
+        if (len + n + 1 > sizeof(buf))
+        {
+            if (socket_send_all(buf, len) != 0)
+                return -1;
+            len = 0;
+        }
+        memcpy(buf + len, paths[i], n);
+        buf[len + n] = '\n';
+        len += n + 1;
+    }
+    return len > 0 ? socket_send_all(buf, len) : 0;
+}
+
+static double elapsed_since(const struct timespec *t0)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void sync_directory(App *a, const char *local, const char *remote, bool deletions, bool with_hash)
+{
+    char msg[PATH_MAX * 2 + 160];
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (strcmp(remote, ".") != 0 && !tree_path_is_safe(remote))
+    {
+        sync_log(a, "[system/sync] Error: Invalid server directory");
+        return;
+    }
+
+    int dfd = open(local, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/sync] Error: Cannot open %s (%s)", local, strerror(errno));
+        sync_log(a, msg);
+        return;
+    }
+
+    // 서버가 매니페스트를 만드는 동안 로컬 트리를 훑는다
+    char cmd[PATH_MAX + 32];
+    snprintf(cmd, sizeof(cmd), "SYNC MANIFEST %d %s", with_hash ? 1 : 0, remote);
+    socket_send_cmd(cmd);
+
+    Manifest mine, theirs;
+    manifest_init(&mine);
+    manifest_init(&theirs);
+    SyncDiff diff = {0};
+    char scan_bad[PATH_MAX];
+    int scan_rc = manifest_scan(&mine, dfd, scan_bad, sizeof(scan_bad));
+    int scan_errno = errno;
+
+    char line[512] = "";
+    if (socket_recv_line(line, sizeof(line)) < 0 || strncmp(line, "OK", 2) != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/sync] Failed: %s", line[0] ? line : "no response");
+        sync_log(a, msg);
+        goto out;
+    }
+
+    TreeRecvProgress progress = {0};
+    TreeSource raw = { tree_socket_read, tree_socket_read_line, &progress };
+    FrameReader fr;
+    int rc = -1;
+    if (frame_reader_init(&fr, &raw) == 0)
+    {
+        TreeSource src = frame_reader_source(&fr);
+        rc = manifest_receive(&theirs, &src);
+
+        char drain;
+        while (rc == 0 && src.read(src.ctx, &drain, 1) > 0)
+            ;
+        if (!fr.ended)
+            rc = -1;
+        frame_reader_free(&fr);
+    }
+
+    if (rc != 0)
+    {
+        sync_log(a, "[system/sync] Failed: broken manifest - reconnecting");
+        session_reconnect(a, a->fl.base);
+        goto out;
+    }
+
+    if (scan_rc != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/sync] Error: Cannot read %s: %s",
+                 scan_bad[0] ? scan_bad : "local directory", strerror(scan_errno));
+        sync_log(a, msg);
+        goto out;
+    }
+    if (manifest_diff(&mine, &theirs, dfd, deletions, &diff) != 0)
+    {
+        sync_log(a, "[system/sync] Error: Cannot scan local directory");
+        goto out;
+    }
+
+    if (diff.send_count == 0 && diff.remove_count == 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/sync] %s is up to date (%zu entries, %.2fs)",
+                 remote, mine.count, elapsed_since(&t0));
+        sync_log(a, msg);
+        goto out;
+    }
+
+    snprintf(msg, sizeof(msg), "[system/sync] %zu changed (%llu bytes), %zu to remove, %llu unchanged",
+             diff.send_count, diff.send_bytes, diff.remove_count, diff.unchanged);
+    sync_log(a, msg);
+
+    snprintf(cmd, sizeof(cmd), "SYNC PUSH %zu %s %s", diff.remove_count,
+             a->compress ? COMPRESS_ALGO : "raw", remote);
+    socket_send_cmd(cmd);
+
+    TreeStats st = {0};
+    int send_rc = send_path_lines(diff.remove, diff.remove_count);
+    if (send_rc == 0 && a->compress)
+    {
+        FrameWriter *fw = frame_writer_new(client_workers(), COMPRESS_LEVEL_FAST, tree_socket_write, NULL);
+        TreeSink sink = { frame_sink_write, tree_upload_progress, fw };
+        send_rc = fw ? tree_send_paths(dfd, diff.send, diff.send_count, &sink, &st) : -1;
+        if (send_rc == 0 && frame_writer_finish(fw, NULL, NULL) == 0)
+            send_rc = socket_send_all("END\n", 4);
+        else
+            send_rc = -1;
+        frame_writer_free(fw);
+    }
+    else if (send_rc == 0)
+    {
+        TreeSink sink = { tree_socket_write, tree_upload_progress, NULL };
+        send_rc = tree_send_paths(dfd, diff.send, diff.send_count, &sink, &st);
+    }
+
+    if (send_rc != 0 || socket_recv_line(line, sizeof(line)) < 0)
+    {
+        sync_log(a, "[system/sync] Connection lost during sync - reconnecting");
+        session_reconnect(a, a->fl.base);
+        goto out;
+    }
+
+    snprintf(msg, sizeof(msg), "[system/sync] Server: %s (%.2fs)", line, elapsed_since(&t0));
+    sync_log(a, msg);
+
+    if (st.skipped > 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/sync] Skipped %llu entries that changed during sync", st.skipped);
+        sync_log(a, msg);
+    }
+
+out:
+    sync_diff_free(&diff);
+    manifest_free(&mine);
+    manifest_free(&theirs);
+    close(dfd);
+
+    refresh_panels(a);
+}
+
+static void handle_sync_command(App *a, const char *linebuf)
+{
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%.1023s", linebuf);
+
+    const char *args[2] = { NULL, NULL };
+    int nargs = 0;
+    bool deletions = false, with_hash = false;
+    char *save = NULL;
+
+    for (char *tok = strtok_r(copy + 5, " ", &save); tok; tok = strtok_r(NULL, " ", &save))
+    {
+        if (strcmp(tok, "--delete") == 0)
+            deletions = true;
+        else if (strcmp(tok, "--hash") == 0)
+            with_hash = true;
+        else if (nargs < 2)
+            args[nargs++] = tok;
+    }
+
+    if (nargs == 0)
+    {
+        sync_log(a, "[system/sync] Usage: /sync <local dir> [server dir] [--delete] [--hash]");
+        return;
+    }
+
+    char local[PATH_MAX];
+    if (!realpath(args[0], local))
+    {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "[system/sync] Error: %s (%s)", args[0], strerror(errno));
+        sync_log(a, msg);
+        return;
+    }
+
+    // 서버 디렉토리를 생략하면 로컬 디렉토리 이름을 그대로 쓴다
+    const char *remote = args[1];
+    if (!remote)
+    {
+        const char *slash = strrchr(local, '/');
+        remote = (slash && slash[1]) ? slash + 1 : ".";
+    }
+
+    sync_directory(a, local, remote, deletions, with_hash);
+}
+
+// ------------------------------------------------------------
+// 일괄 작업: /delete a b c, /mkdir -p x/y z, /stat a b, /mv [-f] a b dir
+// 모든 항목을 BATCH 요청 하나로 보내고, 결과를 받는 대로 표시한 뒤 패널은 마지막에 한 번만 갱신한다.
+// ------------------------------------------------------------
+static void batch_log(App *a, const char *msg)
+{
+    chat_append(&a->chat, "system/batch", msg);
+    a->chat.dirty = 1;
+}
+
+static bool batch_append(char **buf, size_t *len, size_t *cap, const char *op, const char *flag,
+                         const char *path, const char *dst)
+{
+    char line[PATH_MAX * 2 + 32];
+    int n = snprintf(line, sizeof(line), "%s%s%s\t%s%s%s\n", op, flag ? "\t" : "", flag ? flag : "",
+                     path, dst ? "\t" : "", dst ? dst : "");
+    if (n < 0 || (size_t)n >= sizeof(line))
+        return false;
+
+    if (*len + (size_t)n > *cap)
+    {
+        size_t ncap = *cap ? *cap * 2 : 4096;
+        while (ncap < *len + (size_t)n)
+            ncap *= 2;
+        char *p = realloc(*buf, ncap);
+        if (!p)
+            return false;
+        *buf = p;
+        *cap = ncap;
+    }
+    memcpy(*buf + *len, line, (size_t)n);
+    *len += (size_t)n;
+    return true;
+}
+
+static void run_batch(App *a, const char *list, size_t len, size_t count, const char *const *labels)
+{
+    char line[PATH_MAX + 160], msg[PATH_MAX * 2 + 64];
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    snprintf(line, sizeof(line), "BATCH %zu %zu", count, len);
+    socket_send_cmd(line);
+    if (socket_send_all(list, len) != 0 || socket_recv_line(line, sizeof(line)) < 0)
+    {
+        batch_log(a, "[system/batch] Connection lost - reconnecting");
+        session_reconnect(a, a->fl.base);
+        return;
+    }
+    if (strncmp(line, "OK BATCH ", 9) != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/batch] Server: %s", line);
+        batch_log(a, msg);
+        return;
+    }
+
+    size_t done = 0;
+    while (socket_recv_line(line, sizeof(line)) >= 0)
+    {
+        unsigned long long ok, failed;
+        if (sscanf(line, "END BATCH %llu %llu", &ok, &failed) == 2)
+        {
+            snprintf(msg, sizeof(msg), "[system/batch] %llu done, %llu failed (%.2fs)", ok, failed, elapsed_since(&t0));
+            batch_log(a, msg);
+            status_bar(win_chat, msg + 15);
+            goto rescan;
+        }
+
+        size_t n;
+        int off = 0;
+        if (sscanf(line, "ITEM %zu %n", &n, &off) == 1 && off > 0 && n < count)
+        {
+            snprintf(msg, sizeof(msg), "%s: %s", labels[n], line + off);
+            batch_log(a, msg);
+            snprintf(msg, sizeof(msg), "일괄 작업 %zu/%zu", ++done, count);
+            status_bar(win_chat, msg);
+        }
+    }
+
+    batch_log(a, "[system/batch] Connection lost - reconnecting");
+    session_reconnect(a, a->fl.base);
+    return;
+
+rescan:;
+    refresh_panels(a);
+}
+
+static void handle_batch_command(App *a, const char *linebuf)
+{
+    char copy[4096];
+    snprintf(copy, sizeof(copy), "%.4095s", linebuf);
+
+    char *save = NULL;
+    char *cmd = strtok_r(copy, " ", &save);
+    const char *words[512];
+    size_t nwords = 0;
+    const char *flag = NULL;
+
+    for (char *tok = strtok_r(NULL, " ", &save); tok; tok = strtok_r(NULL, " ", &save))
+    {
+        if (nwords == 0 && !flag && (strcmp(tok, "-p") == 0 || strcmp(tok, "-f") == 0))
+            flag = tok;
+        else if (nwords < sizeof(words) / sizeof(words[0]))
+            words[nwords++] = tok;
+    }
+
+    const char *op;
+    bool is_move = strcmp(cmd, "/mv") == 0;
+    if (strcmp(cmd, "/delete") == 0)
+        op = "DELETE";
+    else if (strcmp(cmd, "/mkdir") == 0)
+        op = "MKDIR";
+    else if (strcmp(cmd, "/stat") == 0)
+        op = "STAT";
+    else
+        op = "MOVE";
+
+    if (nwords == 0 || (is_move && nwords < 2) ||
+        (flag && !((strcmp(op, "MKDIR") == 0 && strcmp(flag, "-p") == 0) || (is_move && strcmp(flag, "-f") == 0))))
+    {
+        batch_log(a, "[system/batch] Usage: /delete <path>... | /mkdir [-p] <path>... | /stat <path>... | /mv [-f] <src>... <dst>");
+        return;
+    }
+
+    // /mv 는 마지막 인자가 대상이다 (원본이 여러 개면 대상 디렉토리 안으로 옮긴다)
+    size_t count = is_move ? nwords - 1 : nwords;
+    const char *dst = is_move ? words[nwords - 1] : NULL;
+    char *list = NULL;
+    size_t len = 0, cap = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strchr(words[i], '\t') || (dst && strchr(dst, '\t')) ||
+            !batch_append(&list, &len, &cap, op, flag, words[i], dst))
+        {
+            batch_log(a, "[system/batch] Error: invalid path");
+            free(list);
+            return;
+        }
+    }
+
+    if (!socket_is_connected())
+    {
+        batch_log(a, "[system/batch] Error: not connected");
+        free(list);
+        return;
+    }
+
+    run_batch(a, list, len, count, words);
+    free(list);
+    redraw_all(a);
+}
+
+// 서버 파일 해시 (/hash <path>...): 서버가 파일마다 병렬로 계산하고, 끝나는 순서대로 보여 준다
+static void handle_hash_command(App *a, const char *linebuf)
+{
+    char copy[4096], line[PATH_MAX + 160], msg[PATH_MAX + 240];
+    snprintf(copy, sizeof(copy), "%.4095s", linebuf + 5);
+
+    const char *words[512];
+    size_t count = 0, len = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, " ", &save); tok && count < sizeof(words) / sizeof(words[0]);
+         tok = strtok_r(NULL, " ", &save))
+    {
+        words[count++] = tok;
+        len += strlen(tok) + 1;
+    }
+    if (count == 0)
+    {
+        batch_log(a, "[system/hash] Usage: /hash <path>...");
+        return;
+    }
+    if (!socket_is_connected())
+    {
+        batch_log(a, "[system/hash] Error: not connected");
+        return;
+    }
+
+    char *list = malloc(len + 1);
+    if (!list)
+        return;
+    size_t off = 0;
+    for (size_t i = 0; i < count; i++)
+        off += (size_t)sprintf(list + off, "%s\n", words[i]);
+
+    snprintf(line, sizeof(line), "HASH %zu %zu", count, len);
+    socket_send_cmd(line);
+    int rc = socket_send_all(list, len);
+    free(list);
+    if (rc != 0 || socket_recv_line(line, sizeof(line)) < 0)
+    {
+        batch_log(a, "[system/hash] Connection lost - reconnecting");
+        session_reconnect(a, a->fl.base);
+        return;
+    }
+    if (strncmp(line, "OK HASH ", 8) != 0)
+    {
+        snprintf(msg, sizeof(msg), "[system/hash] Server: %s", line);
+        batch_log(a, msg);
+        return;
+    }
+
+    while (socket_recv_line(line, sizeof(line)) >= 0)
+    {
+        unsigned long long ok, failed, read_bytes;
+        long ms;
+        if (sscanf(line, "END HASH %llu %llu %llu %ld", &ok, &failed, &read_bytes, &ms) == 4)
+        {
+            snprintf(msg, sizeof(msg), "[system/hash] %llu hashed, %llu failed, %llu bytes read (%ldms)", ok, failed,
+                     read_bytes, ms);
+            batch_log(a, msg);
+            status_bar(win_chat, msg + 14);
+            redraw_all(a);
+            return;
+        }
+
+        size_t n;
+        int at = 0;
+        char hex[CHECKSUM_HEX_LEN], how[16];
+        long long size;
+        if (sscanf(line, "ITEM %zu OK %64s %lld %15s", &n, hex, &size, how) == 4 && n < count)
+            snprintf(msg, sizeof(msg), "%s  %s  %lld bytes%s", hex, words[n], size,
+                     strcmp(how, "cached") == 0 ? " (cached)" : "");
+        else if (sscanf(line, "ITEM %zu %n", &n, &at) == 1 && at > 0 && n < count)
+            snprintf(msg, sizeof(msg), "%s: %s", words[n], line + at);
+        else
+            continue;
+        chat_append(&a->chat, "hash", msg);
+        a->chat.dirty = 1;
+    }
+
+    batch_log(a, "[system/hash] Connection lost - reconnecting");
+    session_reconnect(a, a->fl.base);
+}
+
+// 서버 작업 목록 (/jobs) 과 취소 (/cancel <id>): 다른 연결이나 이전 세션에서 시작한 작업도 보인다
+static void handle_jobs_command(App *a, const char *linebuf)
+{
+    char cmd[64], line[600];
+
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+
+    if (strncmp(linebuf, "/cancel", 7) == 0)
+    {
+        const char *id = linebuf + 7;
+        while (*id == ' ')
+            id++;
+        snprintf(cmd, sizeof(cmd), "CANCEL %.32s", id);
+        socket_send_cmd(cmd);
+        if (socket_recv_line(line, sizeof(line)) >= 0)
+        {
+            chat_append(&a->chat, "server", line);
+            status_bar(win_chat, line);
+        }
+        a->chat.dirty = 1;
+        return;
+    }
+
+    socket_send_cmd(strcmp(linebuf, "/jobs all") == 0 ? "JOBS ALL" : "JOBS");
+    int count = 0;
+    while (socket_recv_line(line, sizeof(line)) >= 0 && strcmp(line, "EOF") != 0)
+    {
+        // JOB <id> <state> <kind> <done> <total> <unit> <secs> <owner> <what>
+        unsigned id;
+        char state[32], kind[16], total[32], unit[16], owner[64];
+        unsigned long long done;
+        long secs;
+        int off = 0;
+        char msg[700];
+        if (sscanf(line, "JOB %u %31s %15s %llu %31s %15s %ld %63s %n", &id, state, kind, &done, total, unit,
+                   &secs, owner, &off) == 8 && off > 0)
+        {
+            unsigned long long t = strtoull(total, NULL, 10);
+            if (t > 0)
+                snprintf(msg, sizeof(msg), "#%u %-10s %-7s %3llu%% (%llu/%llu %s, %lds) %s", id, state, kind,
+                         done * 100 / t, done, t, unit, secs, line + off);
+            else
+                snprintf(msg, sizeof(msg), "#%u %-10s %-7s %llu %s (%lds) %s", id, state, kind, done, unit, secs,
+                         line + off);
+            chat_append(&a->chat, "jobs", msg);
+            count++;
+        }
+    }
+    if (count == 0)
+        chat_append(&a->chat, "jobs", "진행 중이거나 최근에 끝난 작업이 없습니다.");
+    a->chat.dirty = 1;
+}
+
+// 사용자별 자원 사용량 (/stats, 관리자는 /stats all): 전송 속도와 한도, 파일 시스템 작업 수, 작업 풀 대기
+static void handle_stats_command(App *a, const char *linebuf)
+{
+    char line[600];
+
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+
+    socket_send_cmd(strcmp(linebuf, "/stats all") == 0 ? "STATS ALL" : "STATS");
+    int count = 0;
+    while (socket_recv_line(line, sizeof(line)) >= 0 && strcmp(line, "EOF") != 0)
+    {
+        // SHARE <user> <level> <weight> <sessions> <bw limit> <rate> <bytes> <ops limit> <ops> <throttled ms> <queued>
+        char user[64], bw_limit[32], ops_limit[32];
+        int level, sessions;
+        unsigned weight;
+        unsigned long long rate, bytes, ops, throttled;
+        size_t queued;
+        if (sscanf(line, "SHARE %63s %d %u %d %31s %llu %llu %31s %llu %llu %zu", user, &level, &weight, &sessions,
+                   bw_limit, &rate, &bytes, ops_limit, &ops, &throttled, &queued) != 11)
+            continue;
+
+        char rate_s[16], bytes_s[16], limit_s[24] = "제한 없음", msg[400];
+        format_size((long long)rate, rate_s, sizeof(rate_s));
+        format_size((long long)bytes, bytes_s, sizeof(bytes_s));
+        if (strcmp(bw_limit, "-") != 0)
+        {
+            format_size(strtoll(bw_limit, NULL, 10), limit_s, sizeof(limit_s) - 2);
+            strcat(limit_s, "/s");
+        }
+        snprintf(msg, sizeof(msg), "%s (level %d, 비중 %u, 연결 %d): %s/s (한도 %s), 누적 %s, 파일 작업 %llu (한도 %s/s), 대기 %.1fs, 작업 풀 %zu",
+                 user, level, weight, sessions, rate_s, limit_s, bytes_s, ops,
+                 strcmp(ops_limit, "-") != 0 ? ops_limit : "∞", throttled / 1000.0, queued);
+        chat_append(&a->chat, "stats", msg);
+        count++;
+    }
+    if (count == 0)
+        chat_append(&a->chat, "stats", "기록된 사용량이 없습니다 (서버가 사용자별 한도를 쓰지 않음).");
+    a->chat.dirty = 1;
+}
+
+// 서버 색인에서 이름 찾기 (/find <조건> ...): 디렉토리 패널의 현재 위치 아래를 찾는다
+// 조건은 서버의 FIND 와 같다 (예: /find *.log size>10m newer=1d)
+#define FIND_SHOW_LIMIT 50
+
+// 입력 줄의 Tab: 경로를 받는 명령이면 서버에 COMPLETE 를 물어 마지막 단어를 완성한다.
+// 후보가 하나면 끝까지 (디렉토리는 '/', 파일은 ' ' 까지), 여럿이면 공통 부분까지 채우고,
+// 더 채울 것이 없으면 후보를 상태 줄에 보여 준다. cd/mkdir 은 서버 작업 디렉토리 기준,
+// /dls 와 일괄 명령은 디렉토리 패널의 현재 위치 기준.
+#define COMPLETE_SHOW_LIMIT 200
+
+typedef struct
+{
+    const char *cmd;
+    bool dirs_only;
+    bool panel_base;
+} CompleteRule;
+
+static const CompleteRule complete_rules[] = {
+    { "cd ", true, false },     { "mkdir ", true, false },   { "/dls ", true, true },
+    { "/mkdir ", true, true },  { "/delete ", false, true }, { "/stat ", false, true },
+    { "/mv ", false, true },    { "/sync ", true, true },    { "/hash ", false, true },
+    { "/tail ", false, true },
+};
+
+static int complete_remote_path(void *ctx, char *buf, int *len, int cap)
+{
+    App *a = ctx;
+    const CompleteRule *rule = NULL;
+    for (size_t i = 0; i < sizeof(complete_rules) / sizeof(complete_rules[0]) && !rule; i++)
+        if (strncmp(buf, complete_rules[i].cmd, strlen(complete_rules[i].cmd)) == 0)
+            rule = &complete_rules[i];
+    if (!rule)
+        return -1;
+    if (!a->logged_in || !socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return 0;
+    }
+
+    // 마지막 단어 (경로), 그 안의 마지막 구성요소
+    char *word = strrchr(buf, ' ') + 1;
+    char *last = strrchr(word, '/');
+    last = last ? last + 1 : word;
+    size_t have = strlen(last);
+
+    char cmd[PATH_MAX * 2 + 64], line[PATH_MAX + 64];
+    int n = snprintf(cmd, sizeof(cmd), "COMPLETE %s\tlimit=%d%s", word, COMPLETE_SHOW_LIMIT,
+                     rule->dirs_only ? "\td" : "");
+    if (rule->panel_base && n < (int)sizeof(cmd))
+        snprintf(cmd + n, sizeof(cmd) - (size_t)n, "\tbase=%s", a->dl.cwd);
+    socket_send_cmd(cmd);
+
+    // 후보의 공통 부분과 (하나뿐일 때) 종류, 상태 줄에 보일 목록
+    char common[NAME_MAX + 1] = "", shown[512] = "", msg[640];
+    size_t count = 0, common_len = 0;
+    bool is_dir = false, more = false;
+    while (socket_recv_line(line, sizeof(line)) >= 0 && strcmp(line, "EOF") != 0)
+    {
+        char shown_state[8];
+        long ms, num;
+        if (strncmp(line, "C ", 2) == 0 && line[2] && line[3] == ' ')
+        {
+            const char *name = line + 4;
+            if (count++ == 0)
+            {
+                common_len = strnlen(name, sizeof(common) - 1);
+                memcpy(common, name, common_len);
+                is_dir = line[2] == 'd';
+            }
+            else
+            {
+                size_t k = 0;
+                while (k < common_len && common[k] == name[k])
+                    k++;
+                common_len = k;
+            }
+            size_t used = strlen(shown);
+            if (used + strlen(name) + 3 < sizeof(shown))
+                snprintf(shown + used, sizeof(shown) - used, "%s%s%s", used ? "  " : "", name, line[2] == 'd' ? "/" : "");
+        }
+        else if (sscanf(line, "END COMPLETE %ld %7s %ld", &num, shown_state, &ms) == 3)
+        {
+            more = strcmp(shown_state, "more") == 0;
+        }
+        else if (strncmp(line, "ERR", 3) == 0)
+        {
+            status_bar(win_chat, line);
+        }
+    }
+
+    if (count == 0)
+        return 0;
+    if (count > 1 && common_len == have)
+    {
+        snprintf(msg, sizeof(msg), "후보 %zu%s개: %s", count, more ? "+" : "", shown);
+        status_bar(win_chat, msg);
+        return 0;
+    }
+
+    // 완성한 부분을 붙인다 (들어가지 않으면 그대로 둔다)
+    size_t add = common_len - have;
+    bool tail = count == 1 && !more;
+    if (*len + (int)add + (tail ? 1 : 0) >= cap)
+        return 0;
+    memcpy(buf + *len, common + have, add);
+    *len += (int)add;
+    if (tail)
+        buf[(*len)++] = is_dir ? '/' : ' ';
+    buf[*len] = '\0';
+    return 0;
+}
+
+static void handle_find_command(App *a, const char *linebuf)
+{
+    char cmd[PATH_MAX + 1024], line[PATH_MAX + 128];
+
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+
+    // 공백으로 나뉜 조건을 탭으로 잇는다
+    int n = snprintf(cmd, sizeof(cmd), "FIND %s", a->dl.cwd);
+    bool has_limit = false;
+    char terms[PATH_MAX];
+    snprintf(terms, sizeof(terms), "%s", linebuf + 5);
+    for (char *save = NULL, *t = strtok_r(terms, " ", &save); t && n < (int)sizeof(cmd); t = strtok_r(NULL, " ", &save))
+    {
+        has_limit |= strncmp(t, "limit=", 6) == 0;
+        n += snprintf(cmd + n, sizeof(cmd) - (size_t)n, "\t%s", t);
+    }
+    if (!has_limit && n < (int)sizeof(cmd))
+        snprintf(cmd + n, sizeof(cmd) - (size_t)n, "\tlimit=%d", FIND_SHOW_LIMIT);
+    socket_send_cmd(cmd);
+
+    while (socket_recv_line(line, sizeof(line)) >= 0 && strcmp(line, "EOF") != 0)
+    {
+        char type;
+        long long size, mtime;
+        int off = 0;
+        size_t shown, matched;
+        long ms;
+        char state[16];
+        char msg[PATH_MAX + 64];
+
+        if (sscanf(line, "F %c %lld %lld %n", &type, &size, &mtime, &off) == 3 && off > 0)
+        {
+            if (type == 'd')
+                snprintf(msg, sizeof(msg), "%s/", line + off);
+            else
+                snprintf(msg, sizeof(msg), "%s (%lld bytes)", line + off, size);
+            chat_append(&a->chat, "find", msg);
+        }
+        else if (sscanf(line, "END FIND %zu %zu %ld %15s", &shown, &matched, &ms, state) == 4)
+        {
+            snprintf(msg, sizeof(msg), "%zu개 중 %zu개 표시 (%ldms)%s", matched, shown, ms,
+                     strcmp(state, "ready") == 0 ? "" : ", 색인을 만드는 중이라 일부만 찾았을 수 있습니다");
+            chat_append(&a->chat, "find", msg);
+            status_bar(win_chat, msg);
+        }
+        else
+        {
+            chat_append(&a->chat, "server", line);
+            status_bar(win_chat, line);
+        }
+    }
+    a->chat.dirty = 1;
+}
+
+// 서버에서 내용 찾기 (/grep [-i] [-E] [--name=<glob>] <pattern>): 디렉토리 패널의 현재 위치 아래.
+// 결과는 오는 대로 채팅 창에 붙이고, 찾는 도중 ESC 나 Ctrl+C 를 누르면 서버에 멈추라고 보낸다.
+#define GREP_SHOW_LIMIT 200
+
+static void handle_grep_command(App *a, const char *linebuf)
+{
+    char cmd[PATH_MAX * 3], line[PATH_MAX + 1024], msg[PATH_MAX + 1040];
+
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+
+    const char *p = linebuf + 5;
+    char opts[512] = "";
+    while (1)
+    {
+        while (*p == ' ')
+            p++;
+        if (strncmp(p, "-i ", 3) == 0)
+            strncat(opts, "\ti", sizeof(opts) - strlen(opts) - 1);
+        else if (strncmp(p, "-E ", 3) == 0)
+            strncat(opts, "\tre", sizeof(opts) - strlen(opts) - 1);
+        else if (strncmp(p, "--name=", 7) == 0 && strchr(p, ' '))
+        {
+            size_t len = strlen(opts);
+            snprintf(opts + len, sizeof(opts) - len, "\tname=%.*s", (int)(strchr(p, ' ') - p - 7), p + 7);
+        }
+        else
+            break;
+        p = strchr(p, ' ');
+    }
+    if (!*p)
+    {
+        status_bar(win_chat, "사용법: /grep [-i] [-E] [--name=<glob>] <pattern>");
+        return;
+    }
+
+    // 앞서 와 있던 변경 알림을 먼저 반영해 두면 찾는 동안 오는 줄은 모두 GREP 응답이다
+    poll_server_events(a);
+    snprintf(cmd, sizeof(cmd), "GREP %s\t%s%s\tmax=%d", a->dl.cwd, p, opts, GREP_SHOW_LIMIT);
+    socket_send_cmd(cmd);
+    status_bar(win_chat, "찾는 중... (ESC: 멈춤)");
+
+    size_t base_len = strlen(a->dl.cwd);
+    bool cancel_sent = false;
+    timeout(50);
+    while (1)
+    {
+        int rc = socket_poll_pushed(line, sizeof(line));
+        if (rc < 0)
+            break;
+        if (rc == 0)
+        {
+            if (a->chat.dirty)
+            {
+                a->chat.dirty = 0;
+                chat_draw(win_chat, &a->chat, a->focus == FOCUS_CHAT);
+            }
+            int ch = getch();
+            if ((ch == 27 || ch == KEY_CTRL_C) && !cancel_sent)
+            {
+                socket_send_cmd("CANCEL");
+                cancel_sent = true;
+                status_bar(win_chat, "멈추는 중...");
+            }
+            continue;
+        }
+
+        char *path = line + 2, *num, *text;
+        unsigned long long matches, matched_files, files, binary, bytes, skipped = 0;
+        long ms;
+        char state[16];
+        if (strncmp(line, "M ", 2) == 0 && (num = strchr(path, '\t')) && (text = strchr(num + 1, '\t')))
+        {
+            *num++ = '\0';
+            *text++ = '\0';
+            // 현재 위치 아래는 상대 경로로 줄여 보여 준다
+            if (strncmp(path, a->dl.cwd, base_len) == 0 && path[base_len] == '/')
+                path += base_len + 1;
+            snprintf(msg, sizeof(msg), "%s:%s: %s", path, num, text);
+            chat_append(&a->chat, "grep", msg);
+            a->chat.dirty = 1;
+        }
+        else if (sscanf(line, "END GREP %llu %llu %llu %llu %llu %ld %15s %llu", &matches, &matched_files, &files,
+                        &binary, &bytes, &ms, state, &skipped) >= 7)
+        {
+            snprintf(msg, sizeof(msg),
+                     "%llu줄 (%llu개 파일) / 파일 %llu개, %llu bytes, 바이너리 %llu개 건너뜀, 색인으로 %llu개 제외, %ldms%s",
+                     matches, matched_files, files, bytes, binary, skipped, ms,
+                     strcmp(state, "cancelled") == 0 ? " - 멈춤" : strcmp(state, "limit") == 0 ? " - 결과가 더 있음" : "");
+            chat_append(&a->chat, "grep", msg);
+            status_bar(win_chat, msg);
+            break;
+        }
+        else if (strncmp(line, "OK GREP", 7) != 0)
+        {
+            chat_append(&a->chat, "server", line);
+            status_bar(win_chat, line);
+            if (strncmp(line, "ERR", 3) == 0)
+                break;
+        }
+    }
+    timeout(200);
+    a->chat.dirty = 1;
+}
+
+// ------------------------------------------------------------
+// 서버 파일 따라 읽기 (TAIL)
+// ------------------------------------------------------------
+static TailView *tail_find(App *a, unsigned id)
+{
+    for (int i = 0; i < TAIL_MAX_FILES; i++)
+        if (a->tails[i].id != 0 && a->tails[i].id == id)
+            return &a->tails[i];
+    return NULL;
+}
+
+// "<id> <offset> <kind>[ <text>]" 를 채팅 창에 붙인다. 탭은 공백으로 풀고 나머지 이스케이프는 그대로 보인다.
+static void tail_show_event(App *a, const char *evt)
+{
+    unsigned id;
+    long long offset;
+    char kind[8];
+    int off = 0;
+    if (sscanf(evt, "%u %lld %7s %n", &id, &offset, kind, &off) != 3)
+        return;
+    TailView *t = tail_find(a, id);
+    if (!t)
+        return;
+
+    const char *name = strrchr(t->path, '/') ? strrchr(t->path, '/') + 1 : t->path;
+    const char *text = off > 0 ? evt + off : "";
+    char tag[64], msg[2200];
+    snprintf(tag, sizeof(tag), "tail %.50s", name);
+
+    if (strcmp(kind, "L") == 0 || strcmp(kind, "P") == 0)
+    {
+        size_t n = 0;
+        for (const char *p = text; *p && n + 1 < sizeof(msg); p++)
+        {
+            if (p[0] == '\\' && p[1] == 't')
+            {
+                msg[n++] = ' ';
+                p++;
+            }
+            else if (p[0] == '\\' && p[1] == '\\')
+            {
+                msg[n++] = '\\';
+                p++;
+            }
+            else
+                msg[n++] = *p;
+        }
+        msg[n] = '\0';
+    }
+    else if (strcmp(kind, "SKIP") == 0)
+        snprintf(msg, sizeof(msg), "... %s bytes 건너뜀 (너무 빨리 늘어남)", text);
+    else if (strcmp(kind, "TRUNC") == 0)
+        snprintf(msg, sizeof(msg), "--- 파일이 줄어들어 처음부터 ---");
+    else if (strcmp(kind, "ROTATE") == 0)
+        snprintf(msg, sizeof(msg), "--- 새 파일로 바뀜 ---");
+    else if (strcmp(kind, "GONE") == 0)
+        snprintf(msg, sizeof(msg), "--- 파일이 사라짐 (다시 생기면 이어서) ---");
+    else if (strcmp(kind, "END") == 0)
+        snprintf(msg, sizeof(msg), "--- 디렉토리가 사라져 멈춤 ---");
+    else
+        return;
+
+    if (strcmp(kind, "END") == 0)
+        t->id = 0;
+    else
+        t->offset = offset;
+    chat_append(&a->chat, tag, msg);
+    a->chat.dirty = 1;
+}
+
+// 연결을 새로 맺은 뒤 따라 읽던 파일을 마지막으로 받은 위치부터 다시 요청한다
+static void resume_tails(App *a)
+{
+    char cmd[PATH_MAX + 64], line[PATH_MAX + 64];
+    for (int i = 0; i < TAIL_MAX_FILES; i++)
+    {
+        TailView *t = &a->tails[i];
+        if (t->id == 0)
+            continue;
+        snprintf(cmd, sizeof(cmd), "TAIL %s\tfrom=%lld", t->path, t->offset);
+        socket_send_cmd(cmd);
+        unsigned id;
+        if (socket_recv_line(line, sizeof(line)) < 0 || sscanf(line, "OK TAIL %u", &id) != 1)
+        {
+            t->id = 0;
+            continue;
+        }
+        t->id = id;
+    }
+}
+
+// /tail <path> [<lines>] : 따라 읽기 시작, /tail off [<path>] : 멈춤, /tail : 목록
+static void handle_tail_command(App *a, const char *linebuf)
+{
+    char cmd[PATH_MAX + 64], line[PATH_MAX + 64], msg[PATH_MAX + 128];
+    char arg[PATH_MAX] = "";
+    long lines = 10;
+
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+    snprintf(arg, sizeof(arg), "%s", linebuf[5] ? linebuf + 6 : "");
+
+    if (!arg[0])
+    {
+        size_t n = (size_t)snprintf(msg, sizeof(msg), "따라 읽는 중:");
+        int count = 0;
+        for (int i = 0; i < TAIL_MAX_FILES; i++)
+            if (a->tails[i].id != 0 && n < sizeof(msg))
+            {
+                n += (size_t)snprintf(msg + n, sizeof(msg) - n, " %s", a->tails[i].path);
+                count++;
+            }
+        status_bar(win_chat, count ? msg : "사용법: /tail <경로> [<줄 수>], /tail off [<경로>]");
+        return;
+    }
+
+    poll_server_events(a);
+    if (strcmp(arg, "off") == 0 || strncmp(arg, "off ", 4) == 0)
+    {
+        const char *which = arg[3] ? arg + 4 : "";
+        int stopped = 0;
+        for (int i = 0; i < TAIL_MAX_FILES; i++)
+        {
+            TailView *t = &a->tails[i];
+            const char *name = strrchr(t->path, '/') ? strrchr(t->path, '/') + 1 : t->path;
+            if (t->id == 0 || (which[0] && strcmp(which, t->path) != 0 && strcmp(which, name) != 0))
+                continue;
+            snprintf(cmd, sizeof(cmd), "TAIL-STOP %u", t->id);
+            socket_send_cmd(cmd);
+            socket_recv_line(line, sizeof(line));
+            t->id = 0;
+            stopped++;
+        }
+        snprintf(msg, sizeof(msg), "파일 %d개 따라 읽기를 멈췄습니다.", stopped);
+        status_bar(win_chat, msg);
+        return;
+    }
+
+    // 마지막 단어가 숫자면 처음에 보여 줄 줄 수
+    char *sp = strrchr(arg, ' ');
+    char *end = NULL;
+    if (sp && (lines = strtol(sp + 1, &end, 10)) >= 0 && end != sp + 1 && *end == '\0')
+        *sp = '\0';
+    else
+        lines = 10;
+
+    TailView *t = NULL;
+    for (int i = 0; i < TAIL_MAX_FILES && !t; i++)
+        if (a->tails[i].id == 0)
+            t = &a->tails[i];
+
+    snprintf(cmd, sizeof(cmd), "TAIL %s\tlines=%ld", arg, lines);
+    socket_send_cmd(cmd);
+    unsigned id;
+    long long offset;
+    int off = 0;
+    if (socket_recv_line(line, sizeof(line)) < 0)
+    {
+        status_bar(win_chat, "연결이 끊겼습니다.");
+        return;
+    }
+    if (sscanf(line, "OK TAIL %u %lld %n", &id, &offset, &off) != 2 || off == 0)
+    {
+        status_bar(win_chat, line);
+        return;
+    }
+    if (!t)
+    {
+        // 서버 한도와 같으므로 보통은 오지 않는다
+        snprintf(cmd, sizeof(cmd), "TAIL-STOP %u", id);
+        socket_send_cmd(cmd);
+        socket_recv_line(line, sizeof(line));
+        status_bar(win_chat, "더 따라 읽을 수 없습니다 (/tail off).");
+        return;
+    }
+    t->id = id;
+    t->offset = offset;
+    snprintf(t->path, sizeof(t->path), "%s", line + off);
+    snprintf(msg, sizeof(msg), "%s 따라 읽는 중 (/tail off 로 멈춤)", t->path);
+    status_bar(win_chat, msg);
+}
+
+// 서버에서 중복 파일 찾기 (/dupes [<최소 크기>]): 디렉토리 패널의 현재 위치 아래.
+// 절약량이 큰 묶음부터 오는 대로 채팅 창에 붙이고, ESC 나 Ctrl+C 를 누르면 서버에 멈추라고 보낸다.
+#define DUPES_SHOW_LIMIT 50
+
+static void handle_dupes_command(App *a, const char *linebuf)
+{
+    char cmd[PATH_MAX + 64], line[PATH_MAX + 160], msg[PATH_MAX + 200];
+
+    if (!socket_is_connected())
+    {
+        status_bar(win_chat, "서버에 연결되어 있지 않습니다.");
+        return;
+    }
+
+    const char *arg = linebuf + 6;
+    while (*arg == ' ')
+        arg++;
+    char *end = NULL;
+    long long min_size = *arg ? strtoll(arg, &end, 10) : 1;
+    if (*arg && (min_size < 0 || *end != '\0'))
+    {
+        status_bar(win_chat, "사용법: /dupes [<최소 크기(bytes)>]");
+        return;
+    }
+
+    poll_server_events(a);
+    snprintf(cmd, sizeof(cmd), "DUPES %s\tmin=%lld\tlimit=%d", a->dl.cwd, min_size, DUPES_SHOW_LIMIT);
+    socket_send_cmd(cmd);
+    status_bar(win_chat, "중복 파일 찾는 중... (ESC: 멈춤)");
+
+    size_t base_len = strlen(a->dl.cwd);
+    bool cancel_sent = false;
+    timeout(50);
+    while (1)
+    {
+        int rc = socket_poll_pushed(line, sizeof(line));
+        if (rc < 0)
+            break;
+        if (rc == 0)
+        {
+            if (a->chat.dirty)
+            {
+                a->chat.dirty = 0;
+                chat_draw(win_chat, &a->chat, a->focus == FOCUS_CHAT);
+            }
+            int ch = getch();
+            if ((ch == 27 || ch == KEY_CTRL_C) && !cancel_sent)
+            {
+                socket_send_cmd("CANCEL");
+                cancel_sent = true;
+                status_bar(win_chat, "멈추는 중...");
+            }
+            continue;
+        }
+
+        long long size;
+        size_t count;
+        unsigned long long groups, dup_files, reclaimable, files, candidates, bytes, saved;
+        long ms;
+        char state[16];
+        if (sscanf(line, "DUP %lld %zu %llu", &size, &count, &saved) == 3)
+        {
+            snprintf(msg, sizeof(msg), "%zu개 x %lld bytes (%llu bytes 절약 가능)", count, size, saved);
+            chat_append(&a->chat, "dupes", msg);
+            a->chat.dirty = 1;
+        }
+        else if (strncmp(line, "P ", 2) == 0)
+        {
+            const char *path = line + 2;
+            if (strncmp(path, a->dl.cwd, base_len) == 0 && path[base_len] == '/')
+                path += base_len + 1;
+            snprintf(msg, sizeof(msg), "  %s", path);
+            chat_append(&a->chat, "dupes", msg);
+            a->chat.dirty = 1;
+        }
+        else if (sscanf(line, "END DUPES %llu %llu %llu %llu %llu %llu %ld %15s", &groups, &dup_files, &reclaimable,
+                        &files, &candidates, &bytes, &ms, state) == 8)
+        {
+            snprintf(msg, sizeof(msg), "중복 %llu묶음, 파일 %llu개, %llu bytes 절약 가능 / 파일 %llu개 중 %llu개 확인, "
+                     "%llu bytes 읽음, %ldms%s",
+                     groups, dup_files, reclaimable, files, candidates, bytes, ms,
+                     strcmp(state, "cancelled") == 0 ? " - 멈춤" : strcmp(state, "limit") == 0 ? " - 결과가 더 있음" : "");
+            chat_append(&a->chat, "dupes", msg);
+            status_bar(win_chat, msg);
+            break;
+        }
+        else if (strncmp(line, "OK DUPES", 8) != 0)
+        {
+            chat_append(&a->chat, "server", line);
+            status_bar(win_chat, line);
+            if (strncmp(line, "ERR", 3) == 0)
+                break;
+        }
+    }
+    timeout(200);
+    a->chat.dirty = 1;
+}
+
+static void start_upload_mode(App *a)
+{
+    a->prev_focus = a->focus;
+    a->upload_mode = true;
+    change_focus(a, FOCUS_FILE);
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        snprintf(cwd, sizeof(cwd), ".");
+
+    if (localbrowser_scan(&a->lbrowser, cwd) >= 0)
+        localbrowser_draw(win_file, &a->lbrowser, true);
+    else
+        upload_log(a, "[system/upload] Failed to read local directory");
+
+    upload_log(a, "[system/upload] Upload mode started");
+    upload_log(a,
+               "[system/upload] Bottom-left window shows LOCAL filesystem.");
+
+    redraw_all(a);
+}
+
+static void handle_upload_mode_key(App *a, int ch)
+{
+    if (ch == 'q' || ch == 'Q') {
+        upload_log(a, "[system/upload] Upload mode cancelled");
+        exit_upload_mode(a);
+        return;
+    }
+
+    if (a->lbrowser.count == 0)
+    {
+        if (ch == KEY_BACKSPACE || ch == KEY_CTRL_Z)
+        {
+            char parent[PATH_MAX];
+            dirname_of(parent, a->lbrowser.cwd);
+
+            if (strcmp(parent, a->lbrowser.cwd) != 0)
+            {
+                if (localbrowser_scan(&a->lbrowser, parent) >= 0)
+                    localbrowser_draw(win_file, &a->lbrowser, true);
+            }
+        }
+        else if (ch == ' ')
+        {
+            upload_log(a, "[system/upload] No items to select");
+            exit_upload_mode(a);
+        }
+        return;
+    }
+
+    if (ch == KEY_UP)
+    {
+        if (a->lbrowser.selected > 0)
+            a->lbrowser.selected--;
+
+        localbrowser_draw(win_file, &a->lbrowser, true);
+    }
+    else if (ch == KEY_DOWN)
+    {
+        if (a->lbrowser.selected < a->lbrowser.count - 1)
+            a->lbrowser.selected++;
+
+        localbrowser_draw(win_file, &a->lbrowser, true);
     }
     else if (ch == KEY_BACKSPACE || ch == KEY_CTRL_Z || ch == KEY_LEFT)
     {
@@ -705,7 +3648,8 @@ static void handle_upload_mode_key(App *a, int ch)
 
                 upload_log(a, msg);
 
-                send_upload_plan(a, selected_path, false);
+                if (!start_background_upload(a, selected_path, false))
+                    send_upload_plan(a, selected_path, false);
                 exit_upload_mode(a);
             }
         }
@@ -732,7 +3676,8 @@ static void handle_upload_mode_key(App *a, int ch)
 
         upload_log(a, msg);
 
-        send_upload_plan(a, selected_path, ent->is_dir);
+        if (!start_background_upload(a, selected_path, ent->is_dir))
+            send_upload_plan(a, selected_path, ent->is_dir);
         exit_upload_mode(a);
     }
 }
@@ -830,6 +3775,7 @@ int main(int argc, char *argv[])
 
     layout_create();
     app_init(&app);
+    input_set_completer(complete_remote_path, &app);
 
     refresh();
 
@@ -857,6 +3803,10 @@ int main(int argc, char *argv[])
         }
 #endif
 
+        watch_panels(&app);
+        poll_server_events(&app);
+        poll_background_uploads(&app);
+
         int ch = getch();
         if (ch == ERR) continue;
 
@@ -965,6 +3915,10 @@ int main(int argc, char *argv[])
             {
                 go_parent_dir(&app);
             }
+            else if (ch == 'd' || ch == 'D')
+            {
+                download_selected_file(&app);
+            }
             break;
 
         case FOCUS_CHAT:
@@ -1021,6 +3975,78 @@ int main(int argc, char *argv[])
                 break;
             }
 
+            if (strcmp(linebuf, "/download") == 0)
+            {
+                download_selected_file(&app);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strcmp(linebuf, "/sync") == 0 || strncmp(linebuf, "/sync ", 6) == 0)
+            {
+                handle_sync_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strncmp(linebuf, "/delete ", 8) == 0 || strncmp(linebuf, "/mkdir ", 7) == 0 ||
+                strncmp(linebuf, "/stat ", 6) == 0 || strncmp(linebuf, "/mv ", 4) == 0)
+            {
+                handle_batch_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strcmp(linebuf, "/jobs") == 0 || strcmp(linebuf, "/jobs all") == 0 ||
+                strncmp(linebuf, "/cancel ", 8) == 0)
+            {
+                handle_jobs_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strcmp(linebuf, "/stats") == 0 || strcmp(linebuf, "/stats all") == 0)
+            {
+                handle_stats_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strcmp(linebuf, "/hash") == 0 || strncmp(linebuf, "/hash ", 6) == 0)
+            {
+                handle_hash_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strncmp(linebuf, "/grep ", 6) == 0)
+            {
+                handle_grep_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strcmp(linebuf, "/tail") == 0 || strncmp(linebuf, "/tail ", 6) == 0)
+            {
+                handle_tail_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strcmp(linebuf, "/dupes") == 0 || strncmp(linebuf, "/dupes ", 7) == 0)
+            {
+                handle_dupes_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
+            if (strncmp(linebuf, "/find ", 6) == 0)
+            {
+                handle_find_command(&app, linebuf);
+                change_focus(&app, FOCUS_INPUT);
+                break;
+            }
+
             if (strcmp(linebuf, "/delete") == 0)
             {
                 delete_selected_entry(&app);
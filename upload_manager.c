@@ -0,0 +1,1201 @@
+// upload_manager.c
+#define _GNU_SOURCE
+#include "upload_manager.h"
+#include "checksum.h"
+#include "file_hash.h"
+
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+// 그룹 커밋 대기 창: 이 시간 안에 도착한 업로드는 한 번의 syncfs 로 묶인다.
+#define GROUP_COMMIT_WINDOW_US 2000
+
+static pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long gc_open_batch = 1;   // 현재 참가자를 모으는 배치 번호
+static unsigned long gc_synced_batch = 0; // 마지막으로 동기화가 끝난 배치 번호
+static unsigned long gc_failed_batch = 0; // 마지막으로 실패한 배치 번호
+static int gc_members = 0;
+static dev_t gc_dev;
+static bool gc_leader = false;
+
+static unsigned int tmp_seq = 0;
+
+bool upload_name_is_safe(const char *name)
+{
+    if (!name || !*name)
+        return false;
+    if (strchr(name, '/'))
+        return false;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        return false;
+    return strlen(name) < 256;
+}
+
+int upload_group_sync(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return -1;
+
+    pthread_mutex_lock(&gc_lock);
+
+    // 다른 파일시스템의 배치가 모이는 중이면 묶을 수 없으므로 개별 fsync
+    if (gc_members > 0 && gc_dev != st.st_dev)
+    {
+        pthread_mutex_unlock(&gc_lock);
+        return fsync(fd);
+    }
+
+    gc_dev = st.st_dev;
+    gc_members++;
+    unsigned long my_batch = gc_open_batch;
+
+    while (gc_synced_batch < my_batch)
+    {
+        if (gc_leader)
+        {
+            pthread_cond_wait(&gc_cond, &gc_lock);
+            continue;
+        }
+
+        // 리더: 잠시 기다려 동시 업로드를 모은 뒤 한 번에 동기화
+        gc_leader = true;
+        pthread_mutex_unlock(&gc_lock);
+        usleep(GROUP_COMMIT_WINDOW_US);
+        pthread_mutex_lock(&gc_lock);
+
+        unsigned long batch = gc_open_batch++;
+        gc_members = 0;
+        pthread_mutex_unlock(&gc_lock);
+
+        int rc = syncfs(fd);
+
+        pthread_mutex_lock(&gc_lock);
+        gc_leader = false;
+        gc_synced_batch = batch;
+        if (rc != 0)
+            gc_failed_batch = batch;
+        pthread_cond_broadcast(&gc_cond);
+    }
+
+    bool failed = (gc_failed_batch == my_batch);
+    pthread_mutex_unlock(&gc_lock);
+
+    if (failed)
+    {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int make_hidden_name(char out[PATH_MAX], const char *dir, const char *name)
+{
+    unsigned int seq = __atomic_add_fetch(&tmp_seq, 1, __ATOMIC_RELAXED);
+    int n = snprintf(out, PATH_MAX, "%s/.%.200s.upload-%d-%u", dir, name, (int)getpid(), seq);
+    if (n < 0 || n >= PATH_MAX)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+int upload_target_open(UploadTarget *t, const char *dir, const char *name)
+{
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+
+    if (!upload_name_is_safe(name))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    snprintf(t->dir, sizeof(t->dir), "%s", dir);
+    snprintf(t->name, sizeof(t->name), "%s", name);
+
+    // 1순위: 이름 없는 임시 파일 (크래시 시 흔적이 남지 않음)
+    t->fd = open(dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+    if (t->fd >= 0)
+        return 0;
+
+    // O_TMPFILE 미지원 파일시스템: 숨김 임시 파일로 대체
+    for (int attempt = 0; attempt < 16; attempt++)
+    {
+        if (make_hidden_name(t->tmp_path, dir, name) != 0)
+            return -1;
+
+        t->fd = open(t->tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (t->fd >= 0)
+            return 0;
+        if (errno != EEXIST)
+            break;
+    }
+
+    t->tmp_path[0] = '\0';
+    return -1;
+}
+
+int upload_target_commit(UploadTarget *t, const char *sha256)
+{
+    if (t->fd < 0)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    if (sha256)
+        file_hash_remember(t->fd, sha256);
+
+    // 1. 데이터 영속화 (다른 업로드와 묶어서)
+    if (upload_group_sync(t->fd) != 0)
+        goto fail;
+
+    // 2. O_TMPFILE 은 linkat 이 기존 파일을 덮어쓰지 못하므로 숨김 이름으로 먼저 연결
+    if (!t->tmp_path[0])
+    {
+        char proc[64];
+        snprintf(proc, sizeof(proc), "/proc/self/fd/%d", t->fd);
+
+        int rc = -1;
+        for (int attempt = 0; attempt < 16 && rc != 0; attempt++)
+        {
+            if (make_hidden_name(t->tmp_path, t->dir, t->name) != 0)
+                goto fail;
+
+            rc = linkat(AT_FDCWD, proc, AT_FDCWD, t->tmp_path, AT_SYMLINK_FOLLOW);
+            if (rc != 0 && errno != EEXIST)
+                break;
+        }
+
+        if (rc != 0)
+        {
+            t->tmp_path[0] = '\0';
+            goto fail;
+        }
+    }
+
+    // 3. 실제 이름으로 원자적 교체
+    char final_path[PATH_MAX];
+    int n = snprintf(final_path, sizeof(final_path), "%s/%s", t->dir, t->name);
+    if (n < 0 || n >= (int)sizeof(final_path))
+    {
+        errno = ENAMETOOLONG;
+        goto fail;
+    }
+
+    if (rename(t->tmp_path, final_path) != 0)
+        goto fail;
+
+    close(t->fd);
+    t->fd = -1;
+    t->tmp_path[0] = '\0';
+
+    // 4. 디렉토리 엔트리 영속화
+    int dfd = open(t->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0)
+    {
+        upload_group_sync(dfd);
+        close(dfd);
+    }
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        upload_target_abort(t);
+        errno = saved;
+    }
+    return -1;
+}
+
+void upload_target_abort(UploadTarget *t)
+{
+    if (t->fd >= 0)
+    {
+        close(t->fd);
+        t->fd = -1;
+    }
+
+    if (t->tmp_path[0])
+    {
+        unlink(t->tmp_path);
+        t->tmp_path[0] = '\0';
+    }
+}
+
+// ------------------------------------------------------------
+// 이어받기 가능한 청크 업로드 세션
+// ------------------------------------------------------------
+
+#define MAX_UPLOAD_SESSIONS 64
+
+struct UploadSession
+{
+    char id[UPLOAD_ID_LEN];
+    char owner[64];
+    char dir[PATH_MAX];
+    char name[256];
+    char sha256[CHECKSUM_HEX_LEN];
+    long long size;
+    unsigned chunk_size;
+    unsigned chunk_count;
+    unsigned missing;
+    unsigned char *have;        // 청크별 수신 여부
+    int part_fd;
+    FILE *manifest;             // 수신 청크 기록 (append)
+    char part_path[PATH_MAX];
+    char manifest_path[PATH_MAX];
+    pthread_mutex_t mu;
+    int refs;
+    bool registered;
+    time_t last_used;
+    unsigned long long use_seq;  // 내보낼 세션을 고르는 순서 (초 단위 시각은 같을 때가 많다)
+};
+
+static UploadSession *sessions[MAX_UPLOAD_SESSIONS];
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static UploadSessionDropFn drop_hook;
+static unsigned long long use_counter;   // reg_lock
+
+void upload_session_on_drop(UploadSessionDropFn fn)
+{
+    drop_hook = fn;
+}
+
+static void session_free(UploadSession *s)
+{
+    if (!s)
+        return;
+    if (s->part_fd >= 0)
+        close(s->part_fd);
+    if (s->manifest)
+        fclose(s->manifest);
+    pthread_mutex_destroy(&s->mu);
+    free(s->have);
+    free(s);
+}
+
+static int pwrite_all(int fd, const void *data, size_t len, off_t off)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+static ssize_t pread_all(int fd, void *data, size_t len, off_t off)
+{
+    char *p = data;
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pread(fd, p + done, len - done, off + (off_t)done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static void session_make_id(char out[UPLOAD_ID_LEN], const char *owner, const char *dir, const char *name,
+                            long long size, unsigned chunk_size, const char *sha256)
+{
+    char key[PATH_MAX + 512];
+    int n = snprintf(key, sizeof(key), "%s|%s|%s|%lld|%u|%s", owner, dir, name, size, chunk_size, sha256);
+    if (n < 0)
+        n = 0;
+    if (n >= (int)sizeof(key))
+        n = sizeof(key) - 1;
+    snprintf(out, UPLOAD_ID_LEN, "%016llx", (unsigned long long)checksum_fast64(key, (size_t)n, 0));
+}
+
+// 기존 manifest 를 읽어 기록된 청크를 다시 해시로 검증한다.
+// (서버 재시작 후에는 페이지 캐시에만 있던 데이터가 유실됐을 수 있다)
+static void session_load_manifest(UploadSession *s)
+{
+    FILE *mf = fopen(s->manifest_path, "r");
+    if (!mf)
+        return;
+
+    char line[256];
+    long long size = -1;
+    unsigned chunk = 0;
+    char sha[CHECKSUM_HEX_LEN] = {0};
+
+    if (!fgets(line, sizeof(line), mf) ||
+        sscanf(line, "TSUPLOAD 1 %lld %u %64s", &size, &chunk, sha) != 3 ||
+        size != s->size || chunk != s->chunk_size || strcmp(sha, s->sha256) != 0)
+    {
+        fclose(mf);
+        return;
+    }
+
+    unsigned char *buf = malloc(s->chunk_size);
+    if (!buf)
+    {
+        fclose(mf);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), mf))
+    {
+        unsigned idx;
+        unsigned long long hash;
+        if (sscanf(line, "C %u %16llx", &idx, &hash) != 2 || idx >= s->chunk_count || s->have[idx])
+            continue;
+
+        size_t len = upload_session_chunk_len(s, idx);
+        ssize_t n = pread_all(s->part_fd, buf, len, (off_t)idx * s->chunk_size);
+        if (n == (ssize_t)len && checksum_fast64(buf, len, 0) == hash)
+        {
+            s->have[idx] = 1;
+            s->missing--;
+        }
+    }
+
+    free(buf);
+    fclose(mf);
+}
+
+static int session_rewrite_manifest(UploadSession *s)
+{
+    if (s->manifest)
+        fclose(s->manifest);
+
+    s->manifest = fopen(s->manifest_path, "w");
+    if (!s->manifest)
+        return -1;
+
+    fprintf(s->manifest, "TSUPLOAD 1 %lld %u %s\n", s->size, s->chunk_size, s->sha256);
+
+    // 검증된 청크만 다시 기록 (해시는 파일에서 재계산)
+    if (s->missing < s->chunk_count)
+    {
+        unsigned char *buf = malloc(s->chunk_size);
+        for (unsigned i = 0; buf && i < s->chunk_count; i++)
+        {
+            if (!s->have[i])
+                continue;
+            size_t len = upload_session_chunk_len(s, i);
+            if (pread_all(s->part_fd, buf, len, (off_t)i * s->chunk_size) == (ssize_t)len)
+                fprintf(s->manifest, "C %u %016llx\n", i, (unsigned long long)checksum_fast64(buf, len, 0));
+        }
+        free(buf);
+    }
+
+    fflush(s->manifest);
+    return 0;
+}
+
+static UploadSession *session_create(const char *id, const char *owner, const char *dir, const char *name,
+                                     long long size, unsigned chunk_size, const char *sha256)
+{
+    UploadSession *s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+
+    s->part_fd = -1;
+    pthread_mutex_init(&s->mu, NULL);
+    snprintf(s->id, sizeof(s->id), "%s", id);
+    snprintf(s->owner, sizeof(s->owner), "%s", owner);
+    snprintf(s->dir, sizeof(s->dir), "%s", dir);
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    snprintf(s->sha256, sizeof(s->sha256), "%s", sha256);
+    s->size = size;
+    s->chunk_size = chunk_size;
+    s->chunk_count = (unsigned)((size + chunk_size - 1) / chunk_size);
+    s->missing = s->chunk_count;
+    s->have = calloc(s->chunk_count ? s->chunk_count : 1, 1);
+
+    int n1 = snprintf(s->part_path, sizeof(s->part_path), "%s/.%.200s.part-%s", dir, name, id);
+    int n2 = snprintf(s->manifest_path, sizeof(s->manifest_path), "%s/.%.200s.manifest-%s", dir, name, id);
+    if (!s->have || n1 >= (int)sizeof(s->part_path) || n2 >= (int)sizeof(s->manifest_path))
+    {
+        session_free(s);
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    s->part_fd = open(s->part_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (s->part_fd < 0)
+    {
+        session_free(s);
+        return NULL;
+    }
+
+    // 병렬 스트림이 서로 다른 구간을 pwrite 할 수 있도록 미리 할당
+    struct stat st;
+    if (fstat(s->part_fd, &st) == 0 && st.st_size != size)
+    {
+        if (posix_fallocate(s->part_fd, 0, size) != 0 && ftruncate(s->part_fd, size) != 0)
+        {
+            int saved = errno;
+            unlink(s->part_path);
+            session_free(s);
+            errno = saved;
+            return NULL;
+        }
+    }
+
+    session_load_manifest(s);
+    if (session_rewrite_manifest(s) != 0)
+    {
+        session_free(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+// 밀려나거나 기한이 지난 세션: 이어받을 수 없으므로 디스크의 .part / .manifest 도 지운다
+static void registry_drop_locked(int i)
+{
+    UploadSession *s = sessions[i];
+    if (drop_hook)
+        drop_hook(s->owner, s->id);
+    unlink(s->part_path);
+    unlink(s->manifest_path);
+    session_free(s);
+    sessions[i] = NULL;
+}
+
+static void registry_expire_locked(time_t now)
+{
+    for (int i = 0; i < MAX_UPLOAD_SESSIONS; i++)
+        if (sessions[i] && sessions[i]->refs == 0 && now - sessions[i]->last_used >= UPLOAD_SESSION_TTL)
+            registry_drop_locked(i);
+}
+
+static bool registry_has_id(const char *id)
+{
+    bool found = false;
+    pthread_mutex_lock(&reg_lock);
+    for (int i = 0; i < MAX_UPLOAD_SESSIONS && !found; i++)
+        found = sessions[i] && strcmp(sessions[i]->id, id) == 0;
+    pthread_mutex_unlock(&reg_lock);
+    return found;
+}
+
+// ".<name>.part-<id>" / ".<name>.manifest-<id>" 이면 id 위치, 아니면 NULL
+static const char *session_file_id(const char *fname)
+{
+    if (fname[0] != '.')
+        return NULL;
+    size_t len = strlen(fname);
+    if (len < UPLOAD_ID_LEN)
+        return NULL;
+    const char *id = fname + len - (UPLOAD_ID_LEN - 1);
+    for (const char *p = id; *p; p++)
+        if (!isxdigit((unsigned char)*p) || isupper((unsigned char)*p))
+            return NULL;
+    size_t head = (size_t)(id - fname);
+    if ((head > 6 && memcmp(id - 6, ".part-", 6) == 0) || (head > 10 && memcmp(id - 10, ".manifest-", 10) == 0))
+        return id;
+    return NULL;
+}
+
+// 서버가 재시작되며 목록에서 사라진 세션 파일 중 기한이 지난 것을 지운다
+static void sweep_stale_files(const char *dir, time_t now)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        const char *id = session_file_id(e->d_name);
+        struct stat st;
+        if (!id || fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode) ||
+            now - st.st_mtime < UPLOAD_SESSION_TTL || registry_has_id(id))
+            continue;
+        if (unlinkat(dirfd(d), e->d_name, 0) == 0)
+            printf("[server/upload] Removed stale %s/%s\n", dir, e->d_name);
+    }
+    closedir(d);
+}
+
+static void registry_remove_locked(UploadSession *s)
+{
+    for (int i = 0; i < MAX_UPLOAD_SESSIONS; i++)
+    {
+        if (sessions[i] == s)
+        {
+            sessions[i] = NULL;
+            break;
+        }
+    }
+    s->registered = false;
+}
+
+// 빈 자리를 찾고, 없으면 사용 중이 아닌 가장 오래된 세션을 내보낸다
+static int registry_free_slot_locked(void)
+{
+    int victim = -1;
+    for (int i = 0; i < MAX_UPLOAD_SESSIONS; i++)
+    {
+        if (!sessions[i])
+            return i;
+        if (sessions[i]->refs == 0 &&
+            (victim < 0 || sessions[i]->use_seq < sessions[victim]->use_seq))
+            victim = i;
+    }
+
+    if (victim >= 0)
+        registry_drop_locked(victim);
+    return victim;
+}
+
+UploadSession *upload_session_open(const char *owner, const char *dir, const char *name,
+                                   long long size, unsigned chunk_size, const char *sha256)
+{
+    if (!upload_name_is_safe(name) || size < 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (chunk_size < UPLOAD_MIN_CHUNK)
+        chunk_size = UPLOAD_MIN_CHUNK;
+    if (chunk_size > UPLOAD_MAX_CHUNK)
+        chunk_size = UPLOAD_MAX_CHUNK;
+
+    char id[UPLOAD_ID_LEN];
+    session_make_id(id, owner, dir, name, size, chunk_size, sha256 ? sha256 : "");
+
+    UploadSession *found = upload_session_get(id, owner);
+    if (found)
+        return found;
+
+    // 디스크 I/O(기존 청크 재검증, 오래된 파일 정리)는 레지스트리 잠금 밖에서 수행
+    sweep_stale_files(dir, time(NULL));
+    UploadSession *s = session_create(id, owner, dir, name, size, chunk_size, sha256 ? sha256 : "");
+    if (!s)
+        return NULL;
+
+    pthread_mutex_lock(&reg_lock);
+    for (int i = 0; i < MAX_UPLOAD_SESSIONS; i++)
+    {
+        if (sessions[i] && strcmp(sessions[i]->id, id) == 0)
+        {
+            // 동시에 같은 세션을 연 다른 스레드가 먼저 등록함
+            found = sessions[i];
+            found->refs++;
+            found->last_used = time(NULL);
+            found->use_seq = ++use_counter;
+            pthread_mutex_unlock(&reg_lock);
+            session_free(s);
+            return found;
+        }
+    }
+
+    registry_expire_locked(time(NULL));
+    int slot = registry_free_slot_locked();
+    if (slot < 0)
+    {
+        pthread_mutex_unlock(&reg_lock);
+        session_free(s);
+        errno = EBUSY;
+        return NULL;
+    }
+
+    sessions[slot] = s;
+    s->registered = true;
+    s->refs = 1;
+    s->last_used = time(NULL);
+    s->use_seq = ++use_counter;
+    pthread_mutex_unlock(&reg_lock);
+    return s;
+}
+
+UploadSession *upload_session_get(const char *id, const char *owner)
+{
+    UploadSession *found = NULL;
+
+    pthread_mutex_lock(&reg_lock);
+    for (int i = 0; i < MAX_UPLOAD_SESSIONS; i++)
+    {
+        UploadSession *s = sessions[i];
+        if (s && strcmp(s->id, id) == 0 && strcmp(s->owner, owner) == 0)
+        {
+            s->refs++;
+            s->last_used = time(NULL);
+            s->use_seq = ++use_counter;
+            found = s;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reg_lock);
+    return found;
+}
+
+void upload_session_put(UploadSession *s)
+{
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&reg_lock);
+    bool release = (--s->refs == 0 && !s->registered);
+    pthread_mutex_unlock(&reg_lock);
+
+    if (release)
+        session_free(s);
+}
+
+const char *upload_session_id(const UploadSession *s) { return s->id; }
+unsigned upload_session_chunk_size(const UploadSession *s) { return s->chunk_size; }
+unsigned upload_session_chunk_count(const UploadSession *s) { return s->chunk_count; }
+
+size_t upload_session_chunk_len(const UploadSession *s, unsigned index)
+{
+    if (index >= s->chunk_count)
+        return 0;
+    long long off = (long long)index * s->chunk_size;
+    long long left = s->size - off;
+    return (size_t)(left < (long long)s->chunk_size ? left : (long long)s->chunk_size);
+}
+
+bool upload_session_has_chunk(UploadSession *s, unsigned index)
+{
+    pthread_mutex_lock(&s->mu);
+    bool have = index < s->chunk_count && s->have[index];
+    pthread_mutex_unlock(&s->mu);
+    return have;
+}
+
+unsigned upload_session_missing_count(UploadSession *s)
+{
+    pthread_mutex_lock(&s->mu);
+    unsigned missing = s->missing;
+    pthread_mutex_unlock(&s->mu);
+    return missing;
+}
+
+int upload_session_write_chunk(UploadSession *s, unsigned index, const void *data, size_t len, uint64_t hash)
+{
+    if (index >= s->chunk_count || len != upload_session_chunk_len(s, index))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (checksum_fast64(data, len, 0) != hash)
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    if (pwrite_all(s->part_fd, data, len, (off_t)index * s->chunk_size) != 0)
+        return -1;
+
+    pthread_mutex_lock(&s->mu);
+    if (!s->have[index])
+    {
+        s->have[index] = 1;
+        s->missing--;
+        if (s->manifest)
+        {
+            fprintf(s->manifest, "C %u %016llx\n", index, (unsigned long long)hash);
+            fflush(s->manifest);
+        }
+    }
+    pthread_mutex_unlock(&s->mu);
+    return 0;
+}
+
+int upload_session_finish(UploadSession *s)
+{
+    pthread_mutex_lock(&s->mu);
+    if (!s->registered || s->missing > 0)
+    {
+        pthread_mutex_unlock(&s->mu);
+        errno = s->registered ? EAGAIN : ENOENT;
+        return -1;
+    }
+    pthread_mutex_unlock(&s->mu);
+
+    if (s->sha256[0])
+    {
+        ChecksumCtx *ctx = checksum_begin();
+        char *buf = malloc(1024 * 1024);
+        off_t off = 0;
+        while (ctx && buf && off < s->size)
+        {
+            ssize_t n = pread_all(s->part_fd, buf, 1024 * 1024, off);
+            if (n <= 0)
+                break;
+            checksum_update(ctx, buf, (size_t)n);
+            off += n;
+        }
+        free(buf);
+
+        char actual[CHECKSUM_HEX_LEN];
+        checksum_end(ctx, actual);
+        if (strcasecmp(actual, s->sha256) != 0)
+        {
+            // 전체 해시 불일치: 모든 청크를 다시 받도록 초기화
+            pthread_mutex_lock(&s->mu);
+            memset(s->have, 0, s->chunk_count);
+            s->missing = s->chunk_count;
+            session_rewrite_manifest(s);
+            pthread_mutex_unlock(&s->mu);
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+
+    if (upload_group_sync(s->part_fd) != 0)
+        return -1;
+
+    char final_path[PATH_MAX];
+    int n = snprintf(final_path, sizeof(final_path), "%s/%s", s->dir, s->name);
+    if (n < 0 || n >= (int)sizeof(final_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if (rename(s->part_path, final_path) != 0)
+        return -1;
+
+    int dfd = open(s->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0)
+    {
+        upload_group_sync(dfd);
+        close(dfd);
+    }
+
+    unlink(s->manifest_path);
+
+    pthread_mutex_lock(&reg_lock);
+    registry_remove_locked(s);
+    pthread_mutex_unlock(&reg_lock);
+
+    if (s->sha256[0])
+    {
+        file_hash_remember(s->part_fd, s->sha256);
+        upload_dedup_register(s->dir, s->name, s->sha256, s->owner);
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------
+// 내용 주소 저장소
+// ------------------------------------------------------------
+
+static char cas_root[PATH_MAX];   // 비어 있으면 비활성
+
+static void *dedup_gc_thread(void *arg);
+
+int upload_dedup_init(const char *root)
+{
+    const char *env = getenv("TALKSHELL_DEDUP");
+    if (!env || strcmp(env, "1") != 0)
+        return 0;
+
+    int n = snprintf(cas_root, sizeof(cas_root), "%s/%s", root, UPLOAD_DEDUP_DIR);
+    if (n < 0 || n >= (int)sizeof(cas_root) || (mkdir(cas_root, 0711) != 0 && errno != EEXIST))
+    {
+        cas_root[0] = '\0';
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, dedup_gc_thread, NULL) == 0)
+        pthread_detach(tid);
+    return 0;
+}
+
+bool upload_dedup_enabled(void)
+{
+    return cas_root[0] != '\0';
+}
+
+static int object_path(char out[PATH_MAX], const char *sha256, bool create_dir)
+{
+    char sha[CHECKSUM_HEX_LEN];
+    for (int i = 0; i < CHECKSUM_HEX_LEN; i++)
+        sha[i] = (char)tolower((unsigned char)sha256[i]);
+
+    char sub[PATH_MAX + 4];
+    snprintf(sub, sizeof(sub), "%s/%.2s", cas_root, sha);
+    if (create_dir && mkdir(sub, 0711) != 0 && errno != EEXIST)
+        return -1;
+
+    // 뒤에 ".owners" 를 붙일 자리를 남긴다
+    int n = snprintf(out, PATH_MAX, "%s/%s", sub, sha);
+    if (n < 0 || n >= PATH_MAX - 8)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+// 객체를 연다. 크기가 다르거나 누군가 쓰기 권한을 되살린 객체(내용이 바뀌었을 수 있음)는 버린다.
+static int object_open(const char *path, long long size)
+{
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (size >= 0 && st.st_size != size) || (st.st_mode & 0222))
+    {
+        close(fd);
+        unlink(path);
+        errno = ENOENT;
+        return -1;
+    }
+    return fd;
+}
+
+// ------------------------------------------------------------
+// 객체를 올린 사용자 (<objpath>.owners)
+// ------------------------------------------------------------
+static bool owners_has(const char *objpath, const char *owner)
+{
+    char path[PATH_MAX], line[128];
+    snprintf(path, sizeof(path), "%s.owners", objpath);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        found = strcmp(line, owner) == 0;
+    }
+    fclose(f);
+    return found;
+}
+
+static void owners_add(const char *objpath, const char *owner)
+{
+    if (!owner || !*owner || owners_has(objpath, owner))
+        return;
+
+    char path[PATH_MAX], line[128];
+    snprintf(path, sizeof(path), "%s.owners", objpath);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    // 한 번의 O_APPEND 쓰기라 동시에 더해도 줄이 섞이지 않는다
+    int n = snprintf(line, sizeof(line), "%s\n", owner);
+    if (n > 0 && n < (int)sizeof(line) && write(fd, line, (size_t)n) < 0)
+        fprintf(stderr, "[WARN] Cannot record dedup owner in %s: %s\n", path, strerror(errno));
+    close(fd);
+}
+
+// 정리 기한을 다시 센다. 하드링크된 객체는 사용자 파일과 inode 가 같아 건드리지 않는다
+// (어차피 링크가 남아 있는 동안은 지우지 않는다).
+static void object_touch(const char *objpath)
+{
+    struct stat st;
+    if (lstat(objpath, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink == 1)
+        utimensat(AT_FDCWD, objpath, NULL, AT_SYMLINK_NOFOLLOW);
+}
+
+// 객체를 dir/name 으로 하드링크한다 (기존 파일은 원자적으로 교체)
+static int link_replace(const char *objpath, const char *dir, const char *name)
+{
+    char tmp[PATH_MAX], final_path[PATH_MAX];
+    int n = snprintf(final_path, sizeof(final_path), "%s/%s", dir, name);
+    if (n < 0 || n >= (int)sizeof(final_path) || make_hidden_name(tmp, dir, name) != 0)
+        return -1;
+
+    if (link(objpath, tmp) != 0)
+        return -1;
+    if (rename(tmp, final_path) != 0)
+    {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        return -1;
+    }
+
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0)
+    {
+        upload_group_sync(dfd);
+        close(dfd);
+    }
+    return 0;
+}
+
+// 커널 안에서 in 의 처음 size 바이트를 out 에 복사한다
+static int copy_contents(int in, int out, long long size)
+{
+    loff_t in_off = 0;
+    while (in_off < size)
+    {
+        ssize_t n = copy_file_range(in, &in_off, out, NULL, (size_t)(size - in_off), 0);
+        if (n <= 0)
+            return -1;
+    }
+    return 0;
+}
+
+int upload_dedup_register(const char *dir, const char *name, const char *sha256, const char *owner)
+{
+    if (!upload_dedup_enabled() || !checksum_is_hex(sha256))
+        return 0;
+
+    char path[PATH_MAX], objpath[PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (n < 0 || n >= (int)sizeof(path) || object_path(objpath, sha256, true) != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st, ost;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    // 하드링크는 inode 와 권한을 함께 나누므로 이미 읽기 전용인 파일만 묶는다
+    bool read_only = (st.st_mode & 0222) == 0;
+    int rc = 0;
+    int obj = object_open(objpath, st.st_size);
+    if (obj < 0)
+    {
+        // 처음 보는 내용: reflink, 안 되면 복사로 독립된 객체를 만든다 (읽기 전용 파일은 하드링크)
+        char tmp[PATH_MAX + 48];
+        snprintf(tmp, sizeof(tmp), "%s.tmp-%d-%u", objpath, (int)getpid(),
+                 __atomic_add_fetch(&tmp_seq, 1, __ATOMIC_RELAXED));
+        int ofd = -1;
+        if (read_only)
+        {
+            rc = link(path, objpath);
+            if (rc != 0 && errno == EEXIST)
+                rc = 0;
+        }
+        else if ((ofd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0444)) >= 0 &&
+                 (ioctl(ofd, FICLONE, fd) == 0 || copy_contents(fd, ofd, st.st_size) == 0))
+        {
+            close(ofd);
+            rc = rename(tmp, objpath);
+            if (rc != 0)
+                unlink(tmp);
+        }
+        else
+        {
+            if (ofd >= 0)
+            {
+                close(ofd);
+                unlink(tmp);
+            }
+            rc = -1;
+        }
+    }
+    else if (fstat(obj, &ost) == 0 && ost.st_ino == st.st_ino && ost.st_dev == st.st_dev)
+    {
+        rc = 0;   // 이미 같은 inode
+    }
+    else
+    {
+        // 같은 내용이 이미 있음: 방금 올라온 파일의 블록을 객체와 공유하도록 바꾼다.
+        // reflink 가 안 되면 권한이 같을 때(읽기 전용)만 하드링크로 바꾸고, 아니면 그대로 둔다.
+        int wfd = open(path, O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (wfd >= 0 && ioctl(wfd, FICLONE, obj) == 0)
+            rc = 0;
+        else if (read_only && (st.st_mode & 07777) == (ost.st_mode & 07777))
+            rc = link_replace(objpath, dir, name);
+        if (wfd >= 0)
+            close(wfd);
+    }
+
+    if (rc == 0)
+    {
+        owners_add(objpath, owner);
+        object_touch(objpath);
+    }
+    if (obj >= 0)
+        close(obj);
+    close(fd);
+    return rc;
+}
+
+int upload_dedup_materialize(const char *dir, const char *name, long long size, const char *sha256,
+                             const char *owner, const char **how)
+{
+    char objpath[PATH_MAX];
+    int obj = -1;
+    struct stat ost;
+    if (!upload_dedup_enabled() || !checksum_is_hex(sha256) || object_path(objpath, sha256, false) != 0 ||
+        (obj = object_open(objpath, size)) < 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // 올린 적이 없고 트리에 하드링크로 남아 있지도 않으면, 객체가 있다는 것조차 알리지 않는다
+    if (!owners_has(objpath, owner) && (fstat(obj, &ost) != 0 || ost.st_nlink < 2))
+    {
+        close(obj);
+        errno = ENOENT;
+        return -1;
+    }
+
+    UploadTarget t;
+    int rc = -1;
+
+    // 1순위 reflink, 아니면 서버 안에서 복사 (네트워크 전송은 어느 경우든 없음).
+    // 하드링크는 객체의 읽기 전용 권한을 새 파일과 나누게 되므로 쓰지 않는다.
+    if (upload_target_open(&t, dir, name) == 0)
+    {
+        if (ioctl(t.fd, FICLONE, obj) == 0)
+        {
+            rc = upload_target_commit(&t, sha256);
+            *how = "reflink";
+        }
+        else if (copy_contents(obj, t.fd, size) == 0)
+        {
+            rc = upload_target_commit(&t, sha256);
+            *how = "copy";
+        }
+        else
+        {
+            upload_target_abort(&t);
+        }
+    }
+
+    if (rc == 0)
+    {
+        owners_add(objpath, owner);
+        object_touch(objpath);
+    }
+    close(obj);
+    return rc;
+}
+
+// ------------------------------------------------------------
+// 저장소 정리
+// ------------------------------------------------------------
+static bool is_object_name(const char *name)
+{
+    size_t i = 0;
+    for (; name[i]; i++)
+        if (!isxdigit((unsigned char)name[i]) || isupper((unsigned char)name[i]))
+            return false;
+    return i == CHECKSUM_HEX_LEN - 1;
+}
+
+static void dedup_gc_dir(int dfd, time_t now, unsigned *removed, unsigned long long *bytes)
+{
+    DIR *d = fdopendir(dfd);
+    if (!d)
+    {
+        close(dfd);
+        return;
+    }
+
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        struct stat st;
+        const char *dot = strchr(e->d_name, '.');
+        if (e->d_name[0] == '.' || fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(st.st_mode))
+            continue;
+
+        if (is_object_name(e->d_name))
+        {
+            // 트리에 하드링크가 남아 있으면 그 파일이 곧 객체이므로 지우지 않는다
+            if (st.st_nlink > 1 || now - st.st_mtime < UPLOAD_DEDUP_TTL)
+                continue;
+            char owners[CHECKSUM_HEX_LEN + 8];
+            snprintf(owners, sizeof(owners), "%.*s.owners", CHECKSUM_HEX_LEN - 1, e->d_name);
+            if (unlinkat(dirfd(d), e->d_name, 0) == 0)
+            {
+                unlinkat(dirfd(d), owners, 0);
+                (*removed)++;
+                *bytes += (unsigned long long)st.st_size;
+            }
+        }
+        else if (dot && strncmp(dot, ".tmp-", 5) == 0 && now - st.st_mtime >= 60 * 60)
+        {
+            unlinkat(dirfd(d), e->d_name, 0);   // 만들다 만 객체
+        }
+        else if (dot && strcmp(dot, ".owners") == 0)
+        {
+            // 객체가 사라진 (버려졌거나 정리된) 목록
+            char obj[CHECKSUM_HEX_LEN];
+            snprintf(obj, sizeof(obj), "%.*s", (int)(dot - e->d_name), e->d_name);
+            struct stat ost;
+            if (fstatat(dirfd(d), obj, &ost, AT_SYMLINK_NOFOLLOW) != 0 && errno == ENOENT)
+                unlinkat(dirfd(d), e->d_name, 0);
+        }
+    }
+    closedir(d);
+}
+
+static void dedup_gc(time_t now)
+{
+    DIR *root = opendir(cas_root);
+    if (!root)
+        return;
+
+    unsigned removed = 0;
+    unsigned long long bytes = 0;
+    struct dirent *e;
+    while ((e = readdir(root)))
+    {
+        if (strlen(e->d_name) != 2 || !isxdigit((unsigned char)e->d_name[0]) ||
+            !isxdigit((unsigned char)e->d_name[1]))
+            continue;
+        int dfd = openat(dirfd(root), e->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dfd >= 0)
+            dedup_gc_dir(dfd, now, &removed, &bytes);
+    }
+    closedir(root);
+
+    if (removed > 0)
+        printf("[server/dedup] Removed %u unused objects (%llu bytes)\n", removed, bytes);
+}
+
+static void *dedup_gc_thread(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        dedup_gc(time(NULL));
+        sleep(UPLOAD_DEDUP_GC_INTERVAL);
+    }
+    return NULL;
+}
@@ -0,0 +1,102 @@
+#ifndef UPLOAD_MANAGER_H
+#define UPLOAD_MANAGER_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 업로드 대상 파일은 같은 디렉토리의 임시 파일(O_TMPFILE 또는 숨김 파일)에
+// 먼저 기록하고, 전체 크기/체크섬 검증이 끝난 뒤에만 실제 이름으로 커밋한다.
+// 연결이 끊겨도 실제 이름 아래에 잘린 파일이 남지 않는다.
+
+typedef struct
+{
+    int fd;
+    char dir[PATH_MAX];        // 대상 디렉토리 (절대경로)
+    char name[256];            // 최종 파일 이름
+    char tmp_path[PATH_MAX];   // 숨김 임시 파일 경로 (O_TMPFILE 사용 시 빈 문자열)
+} UploadTarget;
+
+// 업로드 파일 이름 검증 ('/', "..", 빈 이름 거부)
+bool upload_name_is_safe(const char *name);
+
+int upload_target_open(UploadTarget *t, const char *dir, const char *name);
+// 데이터 fsync(그룹 커밋) → 실제 이름으로 원자적 교체 → 디렉토리 fsync.
+// sha256 은 받으면서 검증한 내용의 해시 (모르면 NULL): file_hash 에 기억시켜 뒤따르는 HASH 가 다시 읽지 않게 한다.
+int upload_target_commit(UploadTarget *t, const char *sha256);
+void upload_target_abort(UploadTarget *t);
+
+// ------------------------------------------------------------
+// 이어받기 가능한 청크 업로드 세션
+// ------------------------------------------------------------
+// 데이터는 대상 디렉토리의 ".<name>.part-<id>" 에, 수신한 청크 목록은
+// ".<name>.manifest-<id>" 에 기록한다. 같은 (사용자, 디렉토리, 이름, 크기,
+// 청크 크기, SHA-256) 으로 다시 INIT 하면 같은 ID 가 나오므로 재접속한
+// 클라이언트는 빠진 청크만 보내면 된다.
+// UPLOAD_SESSION_TTL 동안 쓰이지 않은 세션과, 자리가 모자라 밀려난 세션은 두 파일을
+// 지운다. 서버가 재시작되어 목록에 없는 파일은 같은 디렉토리에 새 세션을 만들 때 수정 시각을
+// 보고 지운다.
+
+#define UPLOAD_ID_LEN 17
+#define UPLOAD_DEFAULT_CHUNK (4u * 1024 * 1024)
+#define UPLOAD_MIN_CHUNK (64u * 1024)
+#define UPLOAD_MAX_CHUNK (64u * 1024 * 1024)
+#define UPLOAD_SESSION_TTL (24 * 60 * 60)
+
+typedef struct UploadSession UploadSession;
+
+UploadSession *upload_session_open(const char *owner, const char *dir, const char *name,
+                                   long long size, unsigned chunk_size, const char *sha256);
+// ID 로 세션을 찾아 참조를 얻는다 (소유자가 다르면 NULL)
+UploadSession *upload_session_get(const char *id, const char *owner);
+void upload_session_put(UploadSession *s);
+
+const char *upload_session_id(const UploadSession *s);
+unsigned upload_session_chunk_size(const UploadSession *s);
+unsigned upload_session_chunk_count(const UploadSession *s);
+size_t upload_session_chunk_len(const UploadSession *s, unsigned index);
+bool upload_session_has_chunk(UploadSession *s, unsigned index);
+unsigned upload_session_missing_count(UploadSession *s);
+
+// 청크 해시가 맞지 않으면 -1 (errno = EBADMSG)
+int upload_session_write_chunk(UploadSession *s, unsigned index, const void *data, size_t len, uint64_t hash);
+// 모든 청크 수신 확인 → SHA-256 검증 → 실제 이름으로 커밋. 성공 시 세션은 등록 해제된다.
+int upload_session_finish(UploadSession *s);
+
+// 끝나지 않은 세션이 자리가 모자라 밀려나거나 기한이 지나 지워질 때 불린다 (세션에 붙여 둔 작업을 끝낼 때 쓴다).
+// 세션 목록 잠금 안에서 부르므로 upload_session_* 를 다시 부르면 안 된다.
+typedef void (*UploadSessionDropFn)(const char *owner, const char *id);
+void upload_session_on_drop(UploadSessionDropFn fn);
+
+// 여러 업로드의 fsync 를 한 번의 syncfs 로 묶는다 (group commit)
+int upload_group_sync(int fd);
+
+// ------------------------------------------------------------
+// 내용 주소 저장소 (중복 제거, TALKSHELL_DEDUP=1 일 때만)
+// ------------------------------------------------------------
+// <root>/.talkshell-cas/<sha 앞 2자>/<sha256> 에 내용마다 객체 하나를 두고, 같은 내용의
+// 업로드는 reflink(FICLONE) 로 블록을 공유한다. reflink 를 지원하지 않는 파일시스템에서는
+// 이미 읽기 전용인 파일만 하드링크로 공유하고, 나머지는 객체를 따로 복사해 둔다
+// (하드링크는 inode 와 권한을 함께 나누므로 쓰기 가능한 파일을 묶으면 객체가 바뀔 수 있다).
+//
+// 객체마다 올린 사용자를 <sha256>.owners 에 적어 두고, 해시만 알고 내용을 본 적 없는 사용자가
+// 객체를 꺼내 가지 못하게 한다. 하드링크로 트리 안에 남아 있는 객체는 누구나 이미 읽을 수
+// 있으므로 예외다.
+// 정리 스레드가 UPLOAD_DEDUP_GC_INTERVAL 마다, 하드링크가 남지 않았고 UPLOAD_DEDUP_TTL 동안
+// 등록/재사용되지 않은 객체를 지운다 (reflink 로 나눈 파일의 블록은 그대로 남는다).
+
+#define UPLOAD_DEDUP_DIR ".talkshell-cas"
+#define UPLOAD_DEDUP_TTL (30 * 24 * 60 * 60)
+#define UPLOAD_DEDUP_GC_INTERVAL (6 * 60 * 60)
+
+int upload_dedup_init(const char *root);
+bool upload_dedup_enabled(void);
+// owner 가 커밋한 dir/name 을 저장소에 등록한다 (같은 내용이 이미 있으면 그 객체와 공유하도록 바꿈)
+int upload_dedup_register(const char *dir, const char *name, const char *sha256, const char *owner);
+// 저장소에 있는 내용으로 dir/name 을 만든다. 객체가 없거나 owner 가 꺼낼 수 없으면 -1 (errno = ENOENT).
+// how 에는 "reflink" / "copy" 중 하나가 기록된다.
+int upload_dedup_materialize(const char *dir, const char *name, long long size, const char *sha256,
+                             const char *owner, const char **how);
+
+#endif
@@ -0,0 +1,237 @@
+// watch.c
+#define _GNU_SOURCE
+#include "watch.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_BUCKETS 1024
+// 주기 호출이 필요 없을 때 inotify 를 기다리는 최대 시간
+#define WATCH_IDLE_MS 1000
+
+typedef struct WatchDir
+{
+    int wd;                    // -1 이면 커널 쪽 감시가 사라짐 (IN_IGNORED)
+    char *path;
+    int refs;
+    int first;                 // 이 디렉토리의 첫 핸들 (handles 번호, 없으면 -1)
+    struct WatchDir *next;     // 같은 버킷
+} WatchDir;
+
+typedef struct
+{
+    bool used;
+    bool tick;
+    uint32_t mask;
+    WatchDir *dir;
+    int next;                  // 같은 디렉토리의 다음 핸들
+    WatchFn fn;
+    void *ctx;
+} WatchHandle;
+
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ino_fd = -1;
+static WatchDir *buckets[WATCH_BUCKETS];
+static WatchHandle *handles;
+static int handle_cap;
+static int tick_handles;
+
+static WatchDir *dir_lookup(int wd)
+{
+    for (WatchDir *d = buckets[(unsigned)wd % WATCH_BUCKETS]; d; d = d->next)
+        if (d->wd == wd)
+            return d;
+    return NULL;
+}
+
+static void dir_unhash(WatchDir *d)
+{
+    WatchDir **p = &buckets[(unsigned)d->wd % WATCH_BUCKETS];
+    while (*p && *p != d)
+        p = &(*p)->next;
+    if (*p)
+        *p = d->next;
+    d->next = NULL;
+}
+
+static void deliver(WatchDir *d, const char *name, uint32_t mask, uint32_t cookie)
+{
+    WatchEvent ev = { d->path, name, mask, cookie };
+    for (int h = d->first; h >= 0; h = handles[h].next)
+    {
+        // 감시가 사라졌거나 큐가 넘친 사실은 등록한 마스크와 관계없이 알린다
+        if (handles[h].mask & mask || mask & (IN_IGNORED | IN_Q_OVERFLOW))
+            handles[h].fn(handles[h].ctx, &ev);
+    }
+}
+
+static void *watch_main(void *arg)
+{
+    (void)arg;
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (1)
+    {
+        struct pollfd pfd = { .fd = ino_fd, .events = POLLIN };
+        int ticking = __atomic_load_n(&tick_handles, __ATOMIC_RELAXED);
+        int ready = poll(&pfd, 1, ticking > 0 ? WATCH_TICK_MS : WATCH_IDLE_MS);
+        ssize_t len = ready > 0 ? read(ino_fd, buf, sizeof(buf)) : 0;
+
+        pthread_mutex_lock(&watch_lock);
+        for (char *p = buf; len > 0 && p < buf + len;)
+        {
+            const struct inotify_event *ie = (const struct inotify_event *)p;
+            p += sizeof(*ie) + ie->len;
+
+            if (ie->mask & IN_Q_OVERFLOW)
+            {
+                // 어떤 디렉토리의 이벤트가 빠졌는지 모르므로 모두에게 알린다
+                for (int b = 0; b < WATCH_BUCKETS; b++)
+                    for (WatchDir *d = buckets[b]; d; d = d->next)
+                        deliver(d, "", IN_Q_OVERFLOW, 0);
+                continue;
+            }
+
+            WatchDir *d = dir_lookup(ie->wd);
+            if (!d)
+                continue;
+            deliver(d, ie->len ? ie->name : "", ie->mask, ie->cookie);
+
+            if (ie->mask & IN_IGNORED)
+            {
+                dir_unhash(d);
+                d->wd = -1;
+            }
+        }
+
+        for (int h = 0; tick_handles > 0 && h < handle_cap; h++)
+            if (handles[h].used && handles[h].tick)
+                handles[h].fn(handles[h].ctx, NULL);
+        pthread_mutex_unlock(&watch_lock);
+    }
+    return NULL;
+}
+
+static int watch_start_locked(void)
+{
+    if (ino_fd >= 0)
+        return 0;
+
+    ino_fd = inotify_init1(IN_CLOEXEC);
+    if (ino_fd < 0)
+        return -1;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, watch_main, NULL) != 0)
+    {
+        close(ino_fd);
+        ino_fd = -1;
+        errno = EAGAIN;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+int watch_add(const char *dir, uint32_t mask, bool tick, WatchFn fn, void *ctx)
+{
+    int h = -1;
+
+    pthread_mutex_lock(&watch_lock);
+    if (watch_start_locked() != 0)
+        goto out;
+
+    for (int i = 0; i < handle_cap; i++)
+    {
+        if (!handles[i].used)
+        {
+            h = i;
+            break;
+        }
+    }
+    if (h < 0)
+    {
+        int cap = handle_cap ? handle_cap * 2 : 64;
+        WatchHandle *n = realloc(handles, (size_t)cap * sizeof(*n));
+        if (!n)
+            goto out;
+        memset(n + handle_cap, 0, (size_t)(cap - handle_cap) * sizeof(*n));
+        handles = n;
+        h = handle_cap;
+        handle_cap = cap;
+    }
+
+    // 다른 핸들이 같은 디렉토리를 감시 중이면 커널은 같은 wd 를 돌려준다 (마스크는 더해짐)
+    int wd = inotify_add_watch(ino_fd, dir, mask | IN_MASK_ADD | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        h = -1;
+        goto out;
+    }
+
+    WatchDir *d = dir_lookup(wd);
+    if (!d)
+    {
+        d = calloc(1, sizeof(*d));
+        if (!d || !(d->path = strdup(dir)))
+        {
+            free(d);
+            inotify_rm_watch(ino_fd, wd);
+            h = -1;
+            goto out;
+        }
+        d->wd = wd;
+        d->first = -1;
+        d->next = buckets[(unsigned)wd % WATCH_BUCKETS];
+        buckets[(unsigned)wd % WATCH_BUCKETS] = d;
+    }
+
+    d->refs++;
+    handles[h] = (WatchHandle){ .used = true, .tick = tick, .mask = mask, .dir = d, .next = d->first,
+                                .fn = fn, .ctx = ctx };
+    d->first = h;
+    if (tick)
+        tick_handles++;
+
+out:
+    pthread_mutex_unlock(&watch_lock);
+    return h;
+}
+
+void watch_remove(int handle)
+{
+    pthread_mutex_lock(&watch_lock);
+    if (handle >= 0 && handle < handle_cap && handles[handle].used)
+    {
+        WatchHandle *wh = &handles[handle];
+        WatchDir *d = wh->dir;
+
+        int *p = &d->first;
+        while (*p >= 0 && *p != handle)
+            p = &handles[*p].next;
+        if (*p == handle)
+            *p = wh->next;
+
+        if (wh->tick)
+            tick_handles--;
+        memset(wh, 0, sizeof(*wh));
+
+        if (--d->refs == 0)
+        {
+            if (d->wd >= 0)
+            {
+                dir_unhash(d);
+                inotify_rm_watch(ino_fd, d->wd);
+            }
+            free(d->path);
+            free(d);
+        }
+    }
+    pthread_mutex_unlock(&watch_lock);
+}
@@ -0,0 +1,32 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 서버 전체가 공유하는 inotify 감시 스레드.
+// 같은 디렉토리를 여러 곳에서 감시해도 inotify watch 는 하나만 두고, 이벤트를 등록한 곳마다 나눠 준다.
+// 콜백은 감시 스레드에서 내부 잠금을 잡은 채 불리므로 짧게 끝내야 하고, 안에서 watch_add/remove 를 부르면 안 된다.
+
+typedef struct
+{
+    const char *dir;      // 감시 중인 디렉토리 (등록할 때의 경로)
+    const char *name;     // 디렉토리 안의 항목 이름 (디렉토리 자체의 이벤트면 "")
+    uint32_t mask;        // IN_* 비트
+    uint32_t cookie;      // IN_MOVED_FROM/IN_MOVED_TO 짝 맞추기용
+} WatchEvent;
+
+// ev 가 NULL 이면 주기 호출(tick): 모아 둔 이벤트를 내보낼 시점을 정하는 데 쓴다
+typedef void (*WatchFn)(void *ctx, const WatchEvent *ev);
+
+// 주기 호출 간격
+#define WATCH_TICK_MS 50
+
+// dir 을 감시한다. 반환: 핸들 (>= 0), 실패 시 -1 (errno).
+// tick 이 true 면 이벤트가 없어도 WATCH_TICK_MS 마다 fn(ctx, NULL) 을 부른다.
+// 디렉토리가 지워지면 IN_IGNORED 이벤트를 한 번 받고 더는 이벤트가 오지 않는다 (핸들은 그대로 해제해야 함).
+int watch_add(const char *dir, uint32_t mask, bool tick, WatchFn fn, void *ctx);
+// 돌아온 뒤에는 fn 이 다시 불리지 않는다
+void watch_remove(int handle);
+
+#endif
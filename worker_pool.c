@@ -0,0 +1,242 @@
+// worker_pool.c
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 비중 1 인 큐가 작업 하나를 꺼낼 때 늘어나는 가상 시간
+#define WORK_STRIDE 1000000ULL
+
+typedef struct WorkItem
+{
+    void (*fn)(void *arg);
+    void *arg;
+    void *context;               // 맡긴 스레드에서 capture 한 값
+    struct WorkItem *next;
+} WorkItem;
+
+// 주인 하나의 대기 작업. 비어 있으면 없앤다.
+typedef struct WorkQueue
+{
+    char owner[64];
+    unsigned weight;
+    unsigned long long pass;     // 다음에 꺼낼 차례 (작을수록 먼저)
+    size_t count;
+    WorkItem *head;
+    WorkItem *tail;
+    struct WorkQueue *next;
+} WorkQueue;
+
+struct WorkerPool
+{
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    WorkQueue *queues;
+    unsigned long long vtime;    // 마지막으로 꺼낸 작업의 차례 (새 큐는 여기서 시작)
+    bool stopping;
+    int nthreads;
+    pthread_t *threads;
+};
+
+static void *(*context_capture)(void);
+static void (*context_install)(void *);
+
+void worker_pool_set_context(void *(*capture)(void), void (*install)(void *))
+{
+    context_capture = capture;
+    context_install = install;
+}
+
+static __thread char owner_name[64];
+static __thread unsigned owner_weight = 1;
+
+void worker_pool_set_owner(const char *owner, unsigned weight)
+{
+    snprintf(owner_name, sizeof(owner_name), "%s", owner ? owner : "");
+    owner_weight = weight ? weight : 1;
+}
+
+// 차례가 가장 이른 큐의 맨 앞 작업을 꺼낸다 (mu 를 잡고)
+static WorkItem *take_next(WorkerPool *pool)
+{
+    WorkQueue **best = NULL;
+    for (WorkQueue **q = &pool->queues; *q; q = &(*q)->next)
+        if (!best || (*q)->pass < (*best)->pass)
+            best = q;
+    if (!best)
+        return NULL;
+
+    WorkQueue *q = *best;
+    WorkItem *item = q->head;
+    q->head = item->next;
+    if (!q->head)
+        q->tail = NULL;
+    q->count--;
+
+    pool->vtime = q->pass;
+    q->pass += WORK_STRIDE / q->weight;
+    if (!q->head)
+    {
+        *best = q->next;
+        free(q);
+    }
+    return item;
+}
+
+static void *worker_main(void *arg)
+{
+    WorkerPool *pool = arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->mu);
+        while (!pool->queues && !pool->stopping)
+            pthread_cond_wait(&pool->cv, &pool->mu);
+
+        WorkItem *item = take_next(pool);
+        if (!item)
+        {
+            // stopping 이고 남은 작업 없음
+            pthread_mutex_unlock(&pool->mu);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool->mu);
+
+        if (context_install)
+            context_install(item->context);
+        item->fn(item->arg);
+        if (context_install)
+            context_install(NULL);
+        free(item);
+    }
+}
+
+WorkerPool *worker_pool_create(int threads)
+{
+    if (threads <= 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (n > 0) ? (int)n : 2;
+    }
+
+    WorkerPool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->threads = calloc((size_t)threads, sizeof(pthread_t));
+    if (!pool->threads)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->mu, NULL);
+    pthread_cond_init(&pool->cv, NULL);
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0)
+            break;
+        pool->nthreads++;
+    }
+
+    if (pool->nthreads == 0)
+    {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void worker_pool_destroy(WorkerPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->mu);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cv);
+    pthread_mutex_unlock(&pool->mu);
+
+    for (int i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->mu);
+    pthread_cond_destroy(&pool->cv);
+    free(pool->threads);
+    free(pool);
+}
+
+int worker_pool_size(const WorkerPool *pool)
+{
+    return pool ? pool->nthreads : 0;
+}
+
+int worker_pool_submit(WorkerPool *pool, void (*fn)(void *arg), void *arg)
+{
+    if (!pool || !fn)
+        return -1;
+
+    WorkItem *item = malloc(sizeof(*item));
+    if (!item)
+        return -1;
+    item->fn = fn;
+    item->arg = arg;
+    item->context = context_capture ? context_capture() : NULL;
+    item->next = NULL;
+
+    pthread_mutex_lock(&pool->mu);
+    if (pool->stopping)
+    {
+        pthread_mutex_unlock(&pool->mu);
+        free(item);
+        return -1;
+    }
+
+    WorkQueue *q = pool->queues;
+    while (q && strcmp(q->owner, owner_name) != 0)
+        q = q->next;
+    if (!q)
+    {
+        q = calloc(1, sizeof(*q));
+        if (!q)
+        {
+            pthread_mutex_unlock(&pool->mu);
+            free(item);
+            return -1;
+        }
+        // 쉬던 주인이 밀린 차례를 한꺼번에 쓰지 않도록 지금 차례에서 시작한다
+        snprintf(q->owner, sizeof(q->owner), "%s", owner_name);
+        q->pass = pool->vtime;
+        q->next = pool->queues;
+        pool->queues = q;
+    }
+    q->weight = owner_weight;
+    if (q->tail)
+        q->tail->next = item;
+    else
+        q->head = item;
+    q->tail = item;
+    q->count++;
+
+    pthread_cond_signal(&pool->cv);
+    pthread_mutex_unlock(&pool->mu);
+    return 0;
+}
+
+size_t worker_pool_pending(WorkerPool *pool, const char *owner)
+{
+    size_t n = 0;
+    if (!pool)
+        return 0;
+    pthread_mutex_lock(&pool->mu);
+    for (WorkQueue *q = pool->queues; q; q = q->next)
+        if (strcmp(q->owner, owner ? owner : "") == 0)
+            n = q->count;
+    pthread_mutex_unlock(&pool->mu);
+    return n;
+}
@@ -0,0 +1,33 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+
+// 서버 전체가 공유하는 고정 크기 작업 스레드 풀.
+// 압축, 해시 계산처럼 CPU 를 쓰는 작업을 클라이언트 스레드 대신 코어 수만큼 나눠 돌린다.
+// 작업 함수 안에서 다른 작업의 완료를 기다리면 안 된다 (풀이 고갈될 수 있음).
+
+typedef struct WorkerPool WorkerPool;
+
+// threads <= 0 이면 온라인 CPU 수
+WorkerPool *worker_pool_create(int threads);
+void worker_pool_destroy(WorkerPool *pool);
+
+int worker_pool_size(const WorkerPool *pool);
+
+// 실패 시 -1 (호출자가 직접 실행하면 된다)
+int worker_pool_submit(WorkerPool *pool, void (*fn)(void *arg), void *arg);
+
+// 이 스레드가 맡기는 작업의 주인과 비중 (owner 가 NULL 이면 이름 없는 공용 큐, 비중 1).
+// 풀은 주인마다 큐를 두고 비중에 비례해 번갈아 꺼낸다 (stride 스케줄링). 한 사용자가 수천 개를 맡겨도
+// 다른 사용자의 작업은 그 뒤에 줄 서지 않고 자기 몫만큼 바로 돈다.
+void worker_pool_set_owner(const char *owner, unsigned weight);
+
+// 작업을 맡긴 스레드의 값 하나(capture) 를 작업과 함께 넘겨, 풀 스레드가 그 작업을 도는 동안
+// install 로 걸어 둔다 (끝나면 install(NULL)). 서버는 사용자 자원 몫 계정을 넘긴다.
+void worker_pool_set_context(void *(*capture)(void), void (*install)(void *));
+
+// owner 의 큐에서 기다리는 작업 수
+size_t worker_pool_pending(WorkerPool *pool, const char *owner);
+
+#endif